@@ -0,0 +1,68 @@
+#include "crashhandlersetup.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QSemaphore>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+
+#include <stdlib.h>
+
+namespace {
+const qint64 eventsPerThread = 20000000;
+}
+
+// 每个线程记录 eventsPerThread 个事件，返回平均每个事件的纳秒数
+static double recordEvents(int threadCount)
+{
+    // 线程创建和领取环不计入：每个线程领取环以后报到，全部到齐后才开始计时并放行
+    QSemaphore ready;
+    QSemaphore go;
+    QVector<QThread *> threads;
+    for (int i = 0; i < threadCount; ++i) {
+        threads.append(QThread::create([&ready, &go]() {
+            CrashHandlerSetup::breadcrumb("warm up");
+            ready.release();
+            go.acquire();
+            for (qint64 n = 0; n < eventsPerThread; ++n)
+                CrashHandlerSetup::breadcrumb("benchmark event", quint64(n));
+        }));
+    }
+    foreach (QThread *thread, threads)
+        thread->start();
+    ready.acquire(threadCount);
+
+    QElapsedTimer timer;
+    timer.start();
+    go.release(threadCount);
+    foreach (QThread *thread, threads)
+        thread->wait();
+    const qint64 elapsed = timer.nsecsElapsed();
+    qDeleteAll(threads);
+
+    // 线程并行运行，按每个线程的事件数折算
+    return double(elapsed) / double(eventsPerThread);
+}
+
+// 测量 CrashHandlerSetup::breadcrumb() 的开销，单线程和多线程（每个线程写自己的环）
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    // 每一轮的线程退出时归还它们的环，下一轮重新领取
+    if (!CrashHandlerSetup::enableBreadcrumbs(QThread::idealThreadCount())) {
+        QTextStream(stderr) << "Could not enable breadcrumbs.\n";
+        return EXIT_FAILURE;
+    }
+
+    QList<int> threadCounts({ 1 });
+    if (QThread::idealThreadCount() > 1)
+        threadCounts.append(QThread::idealThreadCount());
+    foreach (int threadCount, threadCounts) {
+        out << QString("%1 thread(s): %2 ns per event\n")
+               .arg(threadCount).arg(recordEvents(threadCount), 0, 'f', 2);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,227 @@
+#include "crashbenchmark.h"
+#include "crashtimeline.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QProcess>
+#include <QThread>
+
+#include <algorithm>
+
+namespace {
+const int daemonStartTimeout = 10 * 1000; // ms
+const char *const metrics[] = { "firstFrameMs", "fullReportMs", "targetHeldMs", "helperPeakRssKb" };
+}
+
+static QString crashHandlerPath(const QString &directory)
+{
+    return directory + QLatin1String("/crashhandler");
+}
+
+static QList<QByteArray> readLines(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QList<QByteArray>();
+    QList<QByteArray> lines = file.readAll().split('\n');
+    if (!lines.isEmpty() && lines.last().isEmpty())
+        lines.removeLast();
+    return lines;
+}
+
+// 每个指标的最小值、中位数和最大值
+static QJsonObject summarize(const QJsonArray &runs)
+{
+    QJsonObject summary;
+    for (const char *metric : metrics) {
+        QVector<double> values;
+        foreach (const QJsonValue &run, runs) {
+            const QJsonValue value = run.toObject().value(QLatin1String(metric));
+            if (value.isDouble())
+                values.append(value.toDouble());
+        }
+        if (values.isEmpty())
+            continue;
+        std::sort(values.begin(), values.end());
+        QJsonObject statistics;
+        statistics.insert(QLatin1String("min"), values.first());
+        statistics.insert(QLatin1String("median"), values.at(values.size() / 2));
+        statistics.insert(QLatin1String("max"), values.last());
+        summary.insert(QLatin1String(metric), statistics);
+    }
+    return summary;
+}
+
+CrashBenchmark::CrashBenchmark(const Settings &settings)
+    : m_settings(settings)
+{
+
+}
+
+CrashBenchmark::~CrashBenchmark()
+{
+
+}
+
+bool CrashBenchmark::prepare(QString *errorString)
+{
+    if (!m_directory.isValid()) {
+        *errorString = QString("Could not create a temporary directory: %1").arg(m_directory.errorString());
+        return false;
+    }
+    if (!QFileInfo(crashHandlerPath(m_settings.crashHandlerDir)).isExecutable()) {
+        *errorString = QString("%1 is not executable.").arg(crashHandlerPath(m_settings.crashHandlerDir));
+        return false;
+    }
+
+    if (m_settings.libraries > 0) {
+        m_libraryDir = m_directory.filePath(QLatin1String("libraries"));
+        if (!QDir().mkpath(m_libraryDir)) {
+            *errorString = QString("Could not create %1.").arg(m_libraryDir);
+            return false;
+        }
+        // 内容相同的副本也是不同的文件，动态链接器把它们当作不同的模块
+        for (int i = 0; i < m_settings.libraries; ++i) {
+            const QString copy = QString("%1/libcrashbenchvictim%2.so").arg(m_libraryDir).arg(i, 4, 10, QLatin1Char('0'));
+            if (!QFile::copy(m_settings.victimLibrary, copy)) {
+                *errorString = QString("Could not copy %1 to %2.").arg(m_settings.victimLibrary, copy);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+QJsonObject CrashBenchmark::settingsToJson() const
+{
+    QJsonObject victim;
+    victim.insert(QLatin1String("threads"), m_settings.victim.threads);
+    victim.insert(QLatin1String("depth"), m_settings.victim.depth);
+    victim.insert(QLatin1String("heavyLocals"), m_settings.victim.heavyLocals);
+    victim.insert(QLatin1String("rssMb"), m_settings.victim.rssMb);
+    victim.insert(QLatin1String("libraries"), m_settings.libraries);
+
+    QJsonObject settings;
+    settings.insert(QLatin1String("victim"), victim);
+    settings.insert(QLatin1String("runs"), m_settings.runs);
+    settings.insert(QLatin1String("maxTier"), m_settings.maxTier);
+    settings.insert(QLatin1String("cpus"), QThread::idealThreadCount());
+    return settings;
+}
+
+QJsonObject CrashBenchmark::run(const QString &mode, const QString &engine)
+{
+    QJsonObject result;
+    result.insert(QLatin1String("mode"), mode);
+    result.insert(QLatin1String("engine"), engine);
+
+    const QString name = mode + QLatin1Char('-') + engine;
+    const QString statsFile = m_directory.filePath(name + QLatin1String(".jsonl"));
+    const QString spoolDir = m_directory.filePath(name);
+    const QStringList options({ "--headless", "--engine", engine, "--max-tier", QString::number(m_settings.maxTier),
+                                "--stats-file", statsFile, "--spool-dir", spoolDir });
+
+    // 守护进程在所有崩溃之间保持运行，符号缓存等状态可以复用，这也是它要测量的
+    QProcess daemon;
+    QString socketPath;
+    if (mode == QLatin1String("daemon")) {
+        socketPath = m_directory.filePath(name + QLatin1String(".sock"));
+        daemon.setProcessChannelMode(QProcess::ForwardedChannels);
+        daemon.start(crashHandlerPath(m_settings.crashHandlerDir),
+                     QStringList({ "--daemon", "--socket", socketPath }) + options);
+        QElapsedTimer timer;
+        timer.start();
+        while (!QFileInfo::exists(socketPath) && timer.elapsed() < daemonStartTimeout
+               && daemon.state() != QProcess::NotRunning) {
+            QThread::msleep(10);
+        }
+        if (!QFileInfo::exists(socketPath)) {
+            result.insert(QLatin1String("error"), QLatin1String("The crash daemon did not start."));
+            daemon.kill();
+            daemon.waitForFinished();
+            return result;
+        }
+    }
+
+    QJsonArray runs;
+    for (int i = 0; i < m_settings.runs; ++i)
+        runs.append(runOnce(i, mode, options, statsFile, socketPath));
+    result.insert(QLatin1String("runs"), runs);
+    result.insert(QLatin1String("summary"), summarize(runs));
+
+    if (daemon.state() != QProcess::NotRunning) {
+        daemon.terminate();
+        if (!daemon.waitForFinished())
+            daemon.kill();
+    }
+    return result;
+}
+
+QJsonObject CrashBenchmark::runOnce(int run, const QString &mode, const QStringList &helperArguments,
+                                    const QString &statsFile, const QString &socketPath)
+{
+    QJsonObject result;
+    result.insert(QLatin1String("run"), run);
+
+    const VictimOptions &victim = m_settings.victim;
+    QStringList arguments({ "--victim", "--mode", mode,
+                            "--crashhandler-dir", m_settings.crashHandlerDir,
+                            "--threads", QString::number(victim.threads),
+                            "--depth", QString::number(victim.depth),
+                            "--rss-mb", QString::number(victim.rssMb) });
+    if (victim.heavyLocals)
+        arguments.append(QLatin1String("--heavy-locals"));
+    if (!m_libraryDir.isEmpty())
+        arguments += QStringList({ "--library-dir", m_libraryDir });
+    // 被测进程通过 CrashHandlerSetup::setHelperArguments() 把它们交给自己启动的 crashhandler
+    foreach (const QString &argument, helperArguments)
+        arguments += QStringList({ "--helper-arg", argument });
+
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    if (!socketPath.isEmpty())
+        environment.insert(QLatin1String("CRASHHANDLER_SOCKET"), socketPath);
+
+    const int statsBefore = readLines(statsFile).size();
+    QProcess process;
+    process.setProcessEnvironment(environment);
+    process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    process.start(QCoreApplication::applicationFilePath(), arguments);
+    const bool exited = process.waitForFinished(m_settings.timeout * 1000);
+    const quint64 exitTime = CrashTimeline::now();
+    if (!exited) {
+        process.kill();
+        process.waitForFinished();
+        result.insert(QLatin1String("error"), QLatin1String("The victim did not exit in time."));
+        return result;
+    }
+
+    // helper 在崩溃的进程退出之前写完统计，守护进程模式也一样
+    const QList<QByteArray> stats = readLines(statsFile);
+    if (stats.size() <= statsBefore) {
+        result.insert(QLatin1String("error"), QLatin1String("The crash handler did not write statistics."));
+        return result;
+    }
+    const QJsonObject crash = QJsonDocument::fromJson(stats.last()).object();
+    const QJsonObject phases = crash.value(QLatin1String("phases")).toObject();
+    const quint64 base = crash.value(QLatin1String("baseNanoseconds")).toString().toULongLong();
+    if (!crash.value(QLatin1String("relativeToSignal")).toBool()) {
+        result.insert(QLatin1String("error"), QLatin1String("The crash record did not carry the signal time."));
+        return result;
+    }
+
+    if (phases.contains(QLatin1String("firstOutput")))
+        result.insert(QLatin1String("firstFrameMs"), phases.value(QLatin1String("firstOutput")));
+    if (phases.contains(QLatin1String("finalState")))
+        result.insert(QLatin1String("fullReportMs"), phases.value(QLatin1String("finalState")));
+    if (exitTime > base)
+        result.insert(QLatin1String("targetHeldMs"), double(exitTime - base) / 1000000.0);
+    result.insert(QLatin1String("helperPeakRssKb"),
+                  crash.value(QLatin1String("helperPeakRssKb")).toString().toDouble());
+    result.insert(QLatin1String("phases"), phases);
+    return result;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "victim.h"
+
+#include <QJsonObject>
+#include <QStringList>
+#include <QTemporaryDir>
+
+// 反复启动被测进程让它崩溃，从 crashhandler 的统计文件（--stats-file）里取各阶段的时间：
+// 第一帧 - 信号处理程序入口到第一个回溯帧（CrashTimeline::FirstOutputPhase）：gdb 输出的第一帧，
+//          或者原生回溯完成。层的标题不算，旧版本的 crashhandler 在打印标题时就记录，测得的值偏小
+// 完整报告 - 信号处理程序入口到结果写完（CrashTimeline::FinalStatePhase）
+// 进程被占用 - 信号处理程序入口到崩溃的进程退出，由驱动程序测量
+// helper 峰值内存 - crashhandler 的 ru_maxrss，守护进程模式下是整个守护进程的
+class CrashBenchmark
+{
+public:
+    struct Settings
+    {
+        QString crashHandlerDir;
+        QString victimLibrary;  // 复制成 libraries 份供被测进程加载
+        int libraries = 0;
+        int runs = 5;
+        int maxTier = 3;
+        int timeout = 120;      // 秒，每次崩溃
+        VictimOptions victim;
+    };
+
+    explicit CrashBenchmark(const Settings &settings);
+    ~CrashBenchmark();
+
+    bool prepare(QString *errorString);
+    // mode 为 spawn、prespawn 或 daemon，engine 为 native 或 gdb
+    QJsonObject run(const QString &mode, const QString &engine);
+    QJsonObject settingsToJson() const;
+
+private:
+    QJsonObject runOnce(int run, const QString &mode, const QStringList &helperArguments,
+                        const QString &statsFile, const QString &socketPath);
+
+    Settings m_settings;
+    QTemporaryDir m_directory;
+    QString m_libraryDir;
+};
@@ -0,0 +1,30 @@
+QT += core gui widgets
+
+TARGET = crashbench
+TEMPLATE = app
+DESTDIR = $$OUT_PWD/../../bin/
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+# 被测进程的信号处理程序沿帧指针链回溯崩溃线程
+QMAKE_CXXFLAGS += -fno-omit-frame-pointer
+LIBS += -ldl
+
+INCLUDEPATH += $$PWD/../../crashhandler
+
+HEADERS += \
+    crashbenchmark.h \
+    victim.h \
+    $$PWD/../../crashhandler/breadcrumbs.h \
+    $$PWD/../../crashhandler/crashdaemonprotocol.h \
+    $$PWD/../../crashhandler/crashhandlersetup.h \
+    $$PWD/../../crashhandler/crashrecord.h \
+    $$PWD/../../crashhandler/crashtimeline.h
+
+SOURCES += \
+    main.cpp \
+    crashbenchmark.cpp \
+    victim.cpp \
+    $$PWD/../../crashhandler/crashhandlersetup.cpp \
+    $$PWD/../../crashhandler/crashtimeline.cpp
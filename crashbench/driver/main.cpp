@@ -0,0 +1,124 @@
+#include "crashbenchmark.h"
+#include "victim.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTextStream>
+
+#include <stdlib.h>
+
+// 端到端的崩溃处理基准测试。同一个程序既是驱动程序，也是被测进程（--victim）
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("crashbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Crashes synthetic victims repeatedly and reports crash handling latency as JSON.");
+    parser.addHelpOption();
+    const QCommandLineOption modeOption("mode", "Helper modes to compare: spawn, prespawn, daemon.",
+                                        "modes", "spawn");
+    parser.addOption(modeOption);
+    const QCommandLineOption engineOption("engine", "Collector backends to compare: native, gdb.",
+                                          "engines", "native");
+    parser.addOption(engineOption);
+    const QCommandLineOption maxTierOption("max-tier", "Highest backtrace tier to collect.", "1|2|3", "3");
+    parser.addOption(maxTierOption);
+    const QCommandLineOption runsOption("runs", "Crashes per mode and backend.", "n", "5");
+    parser.addOption(runsOption);
+    const QCommandLineOption timeoutOption("timeout", "Seconds to wait for each crash.", "seconds", "120");
+    parser.addOption(timeoutOption);
+    const QCommandLineOption threadsOption("threads", "Additional threads in the victim.", "n", "0");
+    parser.addOption(threadsOption);
+    const QCommandLineOption depthOption("depth", "Recursion depth of every thread.", "n", "16");
+    parser.addOption(depthOption);
+    const QCommandLineOption heavyLocalsOption("heavy-locals", "Give every frame large local arrays.");
+    parser.addOption(heavyLocalsOption);
+    const QCommandLineOption rssOption("rss-mb", "Heap memory the victim allocates and touches.", "size", "0");
+    parser.addOption(rssOption);
+    const QCommandLineOption librariesOption("libraries", "Shared libraries the victim loads.", "n", "0");
+    parser.addOption(librariesOption);
+    const QCommandLineOption crashHandlerDirOption("crashhandler-dir", "Directory containing crashhandler.", "dir");
+    parser.addOption(crashHandlerDirOption);
+    const QCommandLineOption outputOption(QStringList({"o", "output"}), "Write the JSON results to this file.", "file");
+    parser.addOption(outputOption);
+    QCommandLineOption victimOption("victim");
+    victimOption.setFlags(QCommandLineOption::HiddenFromHelp);
+    parser.addOption(victimOption);
+    QCommandLineOption libraryDirOption("library-dir", QString(), "dir");
+    libraryDirOption.setFlags(QCommandLineOption::HiddenFromHelp);
+    parser.addOption(libraryDirOption);
+    QCommandLineOption helperArgOption("helper-arg", QString(), "argument");
+    helperArgOption.setFlags(QCommandLineOption::HiddenFromHelp);
+    parser.addOption(helperArgOption);
+    parser.process(app);
+
+    const QString crashHandlerDir = parser.isSet(crashHandlerDirOption)
+            ? parser.value(crashHandlerDirOption) : QCoreApplication::applicationDirPath();
+
+    VictimOptions victim;
+    victim.crashHandlerDir = crashHandlerDir;
+    victim.threads = parser.value(threadsOption).toInt();
+    victim.depth = parser.value(depthOption).toInt();
+    victim.heavyLocals = parser.isSet(heavyLocalsOption);
+    victim.rssMb = parser.value(rssOption).toInt();
+    victim.libraryDir = parser.value(libraryDirOption);
+    victim.helperArguments = parser.values(helperArgOption);
+
+    if (parser.isSet(victimOption)) {
+        const QString mode = parser.value(modeOption);
+        if (mode == QLatin1String("prespawn"))
+            victim.helperMode = CrashHandlerSetup::PreSpawnHelper;
+        else if (mode == QLatin1String("daemon"))
+            victim.helperMode = CrashHandlerSetup::UseDaemon;
+        runVictim(victim);
+        return EXIT_FAILURE;
+    }
+
+    CrashBenchmark::Settings settings;
+    settings.crashHandlerDir = crashHandlerDir;
+    settings.victimLibrary = QCoreApplication::applicationDirPath() + QLatin1String("/libcrashbenchvictim.so");
+    settings.libraries = parser.value(librariesOption).toInt();
+    settings.runs = qMax(1, parser.value(runsOption).toInt());
+    settings.maxTier = parser.value(maxTierOption).toInt();
+    settings.timeout = qMax(1, parser.value(timeoutOption).toInt());
+    settings.victim = victim;
+
+    QTextStream err(stderr);
+    CrashBenchmark benchmark(settings);
+    QString errorString;
+    if (!benchmark.prepare(&errorString)) {
+        err << errorString << "\n";
+        return EXIT_FAILURE;
+    }
+
+    // 同一台机器上依次比较每种模式和后端
+    QJsonArray configurations;
+    foreach (const QString &mode, parser.value(modeOption).split(QLatin1Char(','), QString::SkipEmptyParts)) {
+        foreach (const QString &engine, parser.value(engineOption).split(QLatin1Char(','), QString::SkipEmptyParts)) {
+            err << "Running " << mode << " / " << engine << "\n";
+            err.flush();
+            configurations.append(benchmark.run(mode, engine));
+        }
+    }
+
+    QJsonObject results = benchmark.settingsToJson();
+    results.insert(QLatin1String("configurations"), configurations);
+    const QByteArray json = QJsonDocument(results).toJson(QJsonDocument::Indented);
+
+    QFile output;
+    if (parser.isSet(outputOption)) {
+        output.setFileName(parser.value(outputOption));
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            err << "Could not open " << output.fileName() << ": " << output.errorString() << "\n";
+            return EXIT_FAILURE;
+        }
+    } else {
+        output.open(stdout, QIODevice::WriteOnly | QIODevice::Text);
+    }
+    output.write(json);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+#include "victim.h"
+
+#include <QDir>
+#include <QSemaphore>
+#include <QTextStream>
+#include <QThread>
+
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace {
+const char appName[] = "crashbench";
+const int localValues = 256;
+}
+
+typedef int (*VictimFunction)(int);
+
+// 保持引用，分配的内存和加载的库都不释放
+static char *residentMemory = nullptr;
+static QSemaphore threadsReady;
+static volatile int librarySum = 0;
+
+static void crashHere()
+{
+    volatile int *address = nullptr;
+    *address = 1;
+}
+
+static void blockForever()
+{
+    threadsReady.release();
+    for (;;)
+        pause();
+}
+
+// 两种帧：轻的只有几个标量，重的有数组和结构体。递归调用之后还要用到局部变量，不会变成尾调用
+static Q_NOINLINE int lightFrame(int depth, void (*leaf)());
+static Q_NOINLINE int heavyFrame(int depth, void (*leaf)());
+
+static int recurse(int depth, bool heavyLocals, void (*leaf)())
+{
+    return heavyLocals ? heavyFrame(depth, leaf) : lightFrame(depth, leaf);
+}
+
+static int lightFrame(int depth, void (*leaf)())
+{
+    volatile int value = depth * 3;
+    if (depth <= 0)
+        leaf();
+    else
+        value += recurse(depth - 1, false, leaf);
+    return value;
+}
+
+static int heavyFrame(int depth, void (*leaf)())
+{
+    struct Record
+    {
+        char name[64];
+        double weights[16];
+        qint64 ids[16];
+    };
+    volatile int values[localValues];
+    Record records[8];
+    char text[1024];
+    for (int i = 0; i < localValues; ++i)
+        values[i] = depth + i;
+    memset(records, depth & 0x7f, sizeof(records));
+    memset(text, 'a' + depth % 26, sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+
+    int result = values[depth % localValues] + records[depth % 8].name[0] + text[depth % 1023];
+    if (depth <= 0)
+        leaf();
+    else
+        result += recurse(depth - 1, true, leaf);
+    return result;
+}
+
+static void touchMemory(int megabytes)
+{
+    if (megabytes <= 0)
+        return;
+    // 每页都写一次，内存才真正属于进程
+    const size_t size = size_t(megabytes) * 1024 * 1024;
+    residentMemory = static_cast<char *>(malloc(size));
+    if (!residentMemory)
+        return;
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    for (size_t offset = 0; offset < size; offset += size_t(pageSize))
+        residentMemory[offset] = char(offset / size_t(pageSize));
+}
+
+static void loadLibraries(const QString &directory)
+{
+    if (directory.isEmpty())
+        return;
+    int loaded = 0;
+    const QStringList files = QDir(directory).entryList(QStringList("*.so"), QDir::Files, QDir::Name);
+    foreach (const QString &file, files) {
+        void *library = dlopen(QFile::encodeName(directory + QLatin1Char('/') + file).constData(),
+                               RTLD_NOW | RTLD_LOCAL);
+        if (!library) {
+            QTextStream(stderr) << "Could not load " << file << ": " << dlerror() << "\n";
+            continue;
+        }
+        VictimFunction function = reinterpret_cast<VictimFunction>(dlsym(library, "crashbenchVictimFunction"));
+        if (function)
+            librarySum += function(loaded);
+        ++loaded;
+    }
+}
+
+void runVictim(const VictimOptions &options)
+{
+    touchMemory(options.rssMb);
+    loadLibraries(options.libraryDir);
+
+    // 进程只运行到崩溃为止，对象故意不析构
+    CrashHandlerSetup::setHelperArguments(options.helperArguments);
+    new CrashHandlerSetup(QLatin1String(appName), CrashHandlerSetup::DisableRestart,
+                          options.crashHandlerDir, options.helperMode);
+
+    for (int i = 0; i < options.threads; ++i) {
+        const int depth = options.depth;
+        const bool heavyLocals = options.heavyLocals;
+        QThread *thread = QThread::create([depth, heavyLocals]() { recurse(depth, heavyLocals, blockForever); });
+        thread->start();
+    }
+    threadsReady.acquire(options.threads);
+
+    recurse(options.depth, options.heavyLocals, crashHere);
+    abort(); // 不会到这里
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "crashhandlersetup.h"
+
+#include <QString>
+#include <QStringList>
+
+// 被测进程的形状，由驱动程序通过 --victim 的命令行参数传下来
+struct VictimOptions
+{
+    CrashHandlerSetup::HelperMode helperMode = CrashHandlerSetup::SpawnHelperOnCrash;
+    QString crashHandlerDir;
+    int threads = 0;             // 除了崩溃线程以外的线程数，每个线程都停在同样深的栈上
+    int depth = 16;              // 递归深度
+    bool heavyLocals = false;    // 每一层都有大的局部数组，backtrace full 要打印它们
+    int rssMb = 0;               // 分配并写入的堆内存
+    QString libraryDir;          // 加载这个目录下的所有共享库
+    QStringList helperArguments; // 传给 crashhandler 的额外选项
+};
+
+// 按 options 准备好进程，然后在主线程最深的一层崩溃，不会返回
+void runVictim(const VictimOptions &options);
@@ -0,0 +1,13 @@
+// 被测进程加载的共享库，只用来增加模块的数量。每个副本都有自己的代码、数据和符号表，
+// 回溯和核心转储时要像真实的库一样处理。
+
+namespace {
+int counter = 0;
+const char description[] = "crashbench victim library";
+}
+
+extern "C" int crashbenchVictimFunction(int value)
+{
+    counter += value;
+    return counter + int(sizeof(description));
+}
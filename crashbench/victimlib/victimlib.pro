@@ -0,0 +1,10 @@
+TARGET = crashbenchvictim
+TEMPLATE = lib
+DESTDIR = $$OUT_PWD/../../bin/
+
+# 没有 soname，基准测试把它复制成很多份，每一份都作为独立的模块加载
+CONFIG += plugin
+CONFIG -= qt
+
+SOURCES += \
+    victimlib.cpp
@@ -2,6 +2,12 @@ TEMPLATE = subdirs
 
 SUBDIRS = \
     crashhandler \
+    crashsymbolize \
+    crashquery \
+    breadcrumbbench \
+    crashbench \
+    crashstress \
+    reportreceiver \
     demo
 
 CONFIG += ordered
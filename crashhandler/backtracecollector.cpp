@@ -1,24 +1,178 @@
 #include "backtracecollector.h"
+#include "nativeunwinder.h"
+#include "processsnapshot.h"
 
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
 #include <QScopedPointer>
+#include <QSharedPointer>
 #include <QTemporaryFile>
+#include <QTimer>
+#include <QtConcurrent>
 
-const char GdbBatchCommands[] =
+const char GdbSetupCommands[] =
         "set height 0\n"
-        "set width 0\n"
-        "thread\n"
-        "thread apply all backtrace full\n";
+        "set width 0\n";
+
+namespace {
+const int defaultBudget = 30 * 1000; // ms
+const int defaultPhaseBudget = 20 * 1000; // ms
+// gdb 在每一层结束时输出这一行，后面跟着层号，据此把输出分层
+const char tierMarker[] = "@@crashhandler-tier-finished ";
+// 报告里最多保存这么多 gdb 输出（字符），完整的文本只在输出文件里
+const int maxReportedDebuggerOutput = 4 * 1024 * 1024;
+}
+
+struct NativeUnwinderResult
+{
+    bool success = false;
+    QString errorString;
+    QSharedPointer<NativeUnwinder> unwinder; // 分离之后继续用来符号化其余线程
+    RawCapture capture;
+    QString crashingThread; // 第一层的文本
+    QString messages;
+    bool symbolizeLocally = true;
+};
+
+struct CoreDumpResult
+{
+    bool success = false;
+    QString message;
+};
+
+struct NativeUnwinderOptions
+{
+    SymbolCache *symbolCache = nullptr;
+    QString rawCaptureFile;
+    QString reportFile;
+    RawProperties metadata;
+    RawProperties systemInfo;
+    quint64 crashAddress = 0;
+    pid_t crashingThread = 0;
+};
+
+// 各层对应的 gdb 命令
+static QByteArray gdbTierCommands(BacktraceCollector::Tier tier)
+{
+    switch (tier) {
+    case BacktraceCollector::CrashingThreadTier:
+        return "thread\n"
+               "backtrace\n";
+    case BacktraceCollector::AllThreadsTier:
+        return "thread apply all backtrace\n";
+    case BacktraceCollector::FullTier:
+        return "thread apply all backtrace full\n";
+    default:
+        return QByteArray();
+    }
+}
+
+// 信号处理程序记录了出错线程时直接用它。否则崩溃线程停在信号处理程序里，信号帧之后的那一帧正好是出错的指令。
+// 都找不到时与 gdb 一样取第一个线程。
+static int crashingThreadIndex(const RawCapture &capture, pid_t crashingThread, quint64 crashAddress)
+{
+    for (int i = 0; crashingThread != 0 && i < capture.threads.size(); ++i) {
+        if (capture.threads.at(i).tid == crashingThread)
+            return i;
+    }
+    if (crashAddress == 0)
+        return 0;
+    for (int i = 0; i < capture.threads.size(); ++i) {
+        foreach (const RawFrame &frame, capture.threads.at(i).frames) {
+            if (!frame.isReturnAddress && frame.pc == crashAddress)
+                return i;
+        }
+    }
+    return 0;
+}
+
+static void setProperty(RawProperties *properties, const QString &key, const QString &value)
+{
+    for (int i = 0; i < properties->size(); ++i) {
+        if (properties->at(i).first == key) {
+            (*properties)[i].second = value;
+            return;
+        }
+    }
+    properties->append(qMakePair(key, value));
+}
+
+// 在工作线程中运行，ptrace 的附加与分离都在这个线程里完成。
+// 一次附加就拿到了所有线程的原始帧，这里只符号化崩溃线程，其余线程留给第二层。
+static NativeUnwinderResult runNativeUnwinder(Q_PID pid, QSharedPointer<NativeUnwinder> unwinder,
+                                              const NativeUnwinderOptions &options)
+{
+    NativeUnwinderResult result;
+    result.unwinder = unwinder;
+    result.unwinder->setSymbolCache(options.symbolCache);
+
+    result.success = result.unwinder->collectRaw(&result.capture);
+    result.errorString = result.unwinder->errorString();
+    if (!result.success)
+        return result;
+    result.capture.metadata = options.metadata;
+    result.capture.systemInfo = options.systemInfo;
+
+    if (!options.rawCaptureFile.isEmpty()) {
+        if (result.capture.save(options.rawCaptureFile)) {
+            result.symbolizeLocally = false;
+            result.messages = QString::fromLatin1("Raw capture of process %1 (%2 threads) written to %3.\n"
+                                                  "Run crashsymbolize on a machine with debug symbols to symbolize it.\n")
+                    .arg(pid).arg(result.capture.threads.size()).arg(options.rawCaptureFile);
+        } else {
+            // 写不了文件时退回在本机符号化，线程已经回溯过了，不需要重新附加
+            result.messages = QString::fromLatin1("Could not write raw capture to %1.\n").arg(options.rawCaptureFile);
+        }
+    }
+
+    if (result.symbolizeLocally && !result.capture.threads.isEmpty()) {
+        const int index = crashingThreadIndex(result.capture, options.crashingThread, options.crashAddress);
+        result.crashingThread = result.unwinder->formatThread(result.capture, index);
+    }
+    return result;
+}
 
 class BacktraceCollectorPrivate
 {
 public:
     BacktraceCollectorPrivate() {}
 
+    BacktraceCollector::Engine engine = BacktraceCollector::NativeEngine;
+    BacktraceCollector::Tier maximumTier = BacktraceCollector::FullTier;
+    BacktraceCollector::Tier tier = BacktraceCollector::NoTier; // 已经完成的层
+    int timeBudget = defaultBudget;
+    int phaseTimeout = defaultPhaseBudget;
+    Q_PID pid = 0;
+    NativeUnwinderOptions nativeOptions;
+    QFutureWatcher<NativeUnwinderResult> nativeWatcher;
+    QFutureWatcher<QString> symbolizerWatcher;
+    QFutureWatcher<CoreDumpResult> coreDumpWatcher;
+    QFutureWatcher<ProcessSnapshot> snapshotWatcher;
+    ProcessSnapshot snapshot;
+    bool snapshotStarted = false;
+    bool snapshotReady = false;
+    bool snapshotShown = false;
+    bool snapshotInReport = false; // 最后写的报告里已经有快照
+    QSharedPointer<NativeUnwinder> attachingUnwinder; // 工作线程正在用它附加，用来从这里取消
+    QSharedPointer<NativeUnwinder> unwinder;
+    QSharedPointer<CoreDumper> coreDumper;
+    QString coreFile;
+    CoreDumpOptions coreDumpOptions;
+    bool coreDumpStarted = false;
+    RawCapture capture; // 写入报告的内容，gdb 回溯时没有线程
+    QTimer budgetTimer;
+    QTimer phaseTimer;
+    QElapsedTimer clock;
+    QString partialReason; // 期限到了时的原因，非空表示结果不完整
+    CrashTimeline *timeline = nullptr;
+    bool finished = false;
     bool errorOccurred = false;
     QScopedPointer<QTemporaryFile> commandFile;
     QProcess debugger;
-    QString output;
+    QByteArray debuggerLineBuffer;
+    QString debuggerOutput; // 只有 gdb 的输出，写入报告，有上限
+    bool debuggerOutputTruncated = false;
 };
 
 BacktraceCollector::BacktraceCollector(QObject *parent)
@@ -32,22 +186,193 @@ BacktraceCollector::BacktraceCollector(QObject *parent)
     connect(&d->debugger, &QProcess::errorOccurred, this, &BacktraceCollector::onDebuggerError);
     connect(&d->debugger, &QIODevice::readyRead, this, &BacktraceCollector::onDebuggerOutputAvailable);
     d->debugger.setProcessChannelMode(QProcess::MergedChannels);
+    connect(&d->nativeWatcher, &QFutureWatcherBase::finished,
+            this, &BacktraceCollector::onNativeUnwinderFinished);
+    connect(&d->symbolizerWatcher, &QFutureWatcherBase::finished,
+            this, &BacktraceCollector::onNativeSymbolizerFinished);
+    connect(&d->coreDumpWatcher, &QFutureWatcherBase::finished,
+            this, &BacktraceCollector::onCoreDumpFinished);
+    connect(&d->snapshotWatcher, &QFutureWatcherBase::finished,
+            this, &BacktraceCollector::onSnapshotFinished);
+    d->budgetTimer.setSingleShot(true);
+    connect(&d->budgetTimer, &QTimer::timeout, this, &BacktraceCollector::onTimeBudgetExpired);
+    d->phaseTimer.setSingleShot(true);
+    connect(&d->phaseTimer, &QTimer::timeout, this, &BacktraceCollector::onPhaseTimeout);
 }
 
 BacktraceCollector::~BacktraceCollector()
 {
+    Q_D(BacktraceCollector);
+
+    // 工作线程还附加在目标进程上，必须等它分离。先取消，卡在等待线程停下时不至于一直等
+    if (d->attachingUnwinder)
+        d->attachingUnwinder->cancel();
+    d->nativeWatcher.waitForFinished();
+    d->symbolizerWatcher.waitForFinished();
+    if (d->coreDumper)
+        d->coreDumper->cancel();
+    d->coreDumpWatcher.waitForFinished();
+    d->snapshotWatcher.waitForFinished();
+}
+
+int BacktraceCollector::defaultTimeBudget()
+{
+    return defaultBudget;
+}
+
+int BacktraceCollector::defaultPhaseTimeout()
+{
+    return defaultPhaseBudget;
+}
+
+QString BacktraceCollector::tierDescription(Tier tier)
+{
+    switch (tier) {
+    case CrashingThreadTier:
+        return QLatin1String("crashing thread");
+    case AllThreadsTier:
+        return QLatin1String("all threads");
+    case FullTier:
+        return QLatin1String("all threads with local variables");
+    default:
+        return QString();
+    }
+}
+
+void BacktraceCollector::setEngine(Engine engine)
+{
+    Q_D(BacktraceCollector);
+
+    d->engine = engine;
+}
+
+void BacktraceCollector::setSymbolCache(SymbolCache *cache)
+{
+    Q_D(BacktraceCollector);
+
+    d->nativeOptions.symbolCache = cache;
+}
+
+void BacktraceCollector::setRawCaptureFile(const QString &fileName)
+{
+    Q_D(BacktraceCollector);
+
+    d->nativeOptions.rawCaptureFile = fileName;
+}
+
+void BacktraceCollector::setReportFile(const QString &fileName)
+{
+    Q_D(BacktraceCollector);
+
+    d->nativeOptions.reportFile = fileName;
+}
+
+void BacktraceCollector::setReportInfo(const RawProperties &metadata, const RawProperties &systemInfo)
+{
+    Q_D(BacktraceCollector);
+
+    d->nativeOptions.metadata = metadata;
+    d->nativeOptions.systemInfo = systemInfo;
+}
+
+void BacktraceCollector::setCrashAddress(quint64 address)
+{
+    Q_D(BacktraceCollector);
+
+    d->nativeOptions.crashAddress = address;
+}
+
+void BacktraceCollector::setCrashingThread(pid_t thread)
+{
+    Q_D(BacktraceCollector);
+
+    d->nativeOptions.crashingThread = thread;
+}
+
+void BacktraceCollector::setMaximumTier(Tier tier)
+{
+    Q_D(BacktraceCollector);
+
+    d->maximumTier = qBound(CrashingThreadTier, tier, FullTier);
+}
+
+void BacktraceCollector::setTimeBudget(int msecs)
+{
+    Q_D(BacktraceCollector);
+
+    d->timeBudget = qMax(0, msecs);
+}
+
+void BacktraceCollector::setPhaseTimeout(int msecs)
+{
+    Q_D(BacktraceCollector);
+
+    d->phaseTimeout = qMax(0, msecs);
+}
+
+void BacktraceCollector::setCoreDump(const QString &fileName, const CoreDumpOptions &options)
+{
+    Q_D(BacktraceCollector);
+
+    d->coreFile = fileName;
+    d->coreDumpOptions = options;
+}
 
+void BacktraceCollector::setTimeline(CrashTimeline *timeline)
+{
+    Q_D(BacktraceCollector);
+
+    d->timeline = timeline;
 }
 
 void BacktraceCollector::run(Q_PID pid)
 {
     Q_D(BacktraceCollector);
 
+    if (d->timeline)
+        d->timeline->mark(CrashTimeline::CollectionStartPhase);
+
+    d->pid = pid;
+    d->capture = RawCapture();
+    d->capture.pid = pid;
+    d->capture.metadata = d->nativeOptions.metadata;
+    d->capture.systemInfo = d->nativeOptions.systemInfo;
+    d->clock.start();
+    if (d->timeBudget > 0)
+        d->budgetTimer.start(d->timeBudget);
+    startPhase();
+
+    // 进程状态的快照与回溯同时进行。线程状态必须在附加之前读，只是每个线程一个小文件
+    ProcessSnapshot snapshot;
+    snapshot.readThreads(pid);
+    d->snapshotStarted = true;
+    d->snapshotWatcher.setFuture(QtConcurrent::run([pid, snapshot]() mutable {
+        snapshot.readProcess(pid);
+        return snapshot;
+    }));
+
+    if (d->engine == NativeEngine) {
+        // 附加受阶段期限约束，没有阶段期限时用总期限
+        d->attachingUnwinder.reset(new NativeUnwinder(pid));
+        d->attachingUnwinder->setAttachTimeout(d->phaseTimeout > 0 ? d->phaseTimeout : d->timeBudget);
+        d->nativeWatcher.setFuture(QtConcurrent::run(runNativeUnwinder, pid, d->attachingUnwinder,
+                                                     d->nativeOptions));
+    } else {
+        runDebugger(CrashingThreadTier);
+    }
+}
+
+void BacktraceCollector::runDebugger(Tier firstTier)
+{
+    Q_D(BacktraceCollector);
+
+    d->debuggerLineBuffer.clear();
+    beginTier(firstTier);
     d->debugger.start(QLatin1String("gdb"), QStringList({
         "--nw",    // Do not use a window interface.
         "--nx",    // Do not read .gdbinit file.
         "--batch", // Exit after processing options.
-        "--command", createTemporaryCommandFile(), "--pid", QString::number(pid) })
+        "--command", createTemporaryCommandFile(firstTier), "--pid", QString::number(d->pid) })
     );
 }
 
@@ -55,22 +380,364 @@ bool BacktraceCollector::isRunning() const
 {
     Q_D(const BacktraceCollector);
 
-    return d->debugger.state() == QProcess::Running;
+    return d->nativeWatcher.isRunning() || d->symbolizerWatcher.isRunning()
+            || d->coreDumpWatcher.isRunning() || d->snapshotWatcher.isRunning()
+            || d->debugger.state() == QProcess::Running;
 }
 
 void BacktraceCollector::kill()
 {
     Q_D(BacktraceCollector);
 
+    // 原生回溯在等待线程停下时可以取消，之后等它从目标进程分离，调试器才能附加
+    d->budgetTimer.stop();
+    d->phaseTimer.stop();
+    if (d->nativeWatcher.isRunning()) {
+        d->nativeWatcher.disconnect(this);
+        d->attachingUnwinder->cancel();
+        d->nativeWatcher.waitForFinished();
+    }
+    if (d->symbolizerWatcher.isRunning()) {
+        d->symbolizerWatcher.disconnect(this);
+        d->symbolizerWatcher.waitForFinished();
+    }
+    if (d->coreDumpWatcher.isRunning()) {
+        d->coreDumpWatcher.disconnect(this);
+        d->coreDumper->cancel();
+        d->coreDumpWatcher.waitForFinished();
+    }
     d->debugger.kill();
 }
 
+void BacktraceCollector::startPhase()
+{
+    Q_D(BacktraceCollector);
+
+    if (d->phaseTimeout > 0)
+        d->phaseTimer.start(d->phaseTimeout);
+}
+
+// 期限到了：保留已有的输出，终止 gdb，不再等待原生回溯和符号化，结束后报告标记为不完整
+void BacktraceCollector::abortCollection(const QString &reason)
+{
+    Q_D(BacktraceCollector);
+
+    if (d->finished || !d->partialReason.isEmpty())
+        return;
+    d->partialReason = reason;
+    appendOutput(QString::fromLatin1("\n%1\n").arg(reason));
+
+    // gdb 被终止后由 onDebuggerFinished() 结束
+    if (d->debugger.state() != QProcess::NotRunning) {
+        d->debugger.kill();
+        return;
+    }
+    // 原生回溯取消附加，已经在回溯的工作线程丢弃结果，析构时仍然会等它们从目标进程分离。
+    // 核心转储在下一批块之前停下，删掉写了一半的文件
+    if (d->attachingUnwinder)
+        d->attachingUnwinder->cancel();
+    d->nativeWatcher.disconnect(this);
+    d->symbolizerWatcher.disconnect(this);
+    d->coreDumpWatcher.disconnect(this);
+    if (d->coreDumper)
+        d->coreDumper->cancel();
+    finish();
+}
+
+void BacktraceCollector::beginTier(Tier tier)
+{
+    startPhase();
+    appendOutput(QString::fromLatin1("\n--- Tier %1: %2 ---\n").arg(tier).arg(tierDescription(tier)));
+}
+
+void BacktraceCollector::finishTier(Tier tier)
+{
+    Q_D(BacktraceCollector);
+
+    // 先写报告再通知，显示出来的层一定已经落盘
+    d->tier = tier;
+    saveReport();
+    emit tierFinished(tier, d->maximumTier);
+}
+
+// 原生回溯之后的层：第二层在工作线程里符号化其余线程，第三层交给 gdb
+void BacktraceCollector::startNextTier()
+{
+    Q_D(BacktraceCollector);
+
+    const Tier next = Tier(d->tier + 1);
+    if (next > d->maximumTier || !d->partialReason.isEmpty()) {
+        finish();
+        return;
+    }
+
+    if (next == AllThreadsTier && d->unwinder) {
+        beginTier(next);
+        QSharedPointer<NativeUnwinder> unwinder = d->unwinder;
+        const RawCapture capture = d->capture;
+        d->symbolizerWatcher.setFuture(QtConcurrent::run([unwinder, capture]() {
+            return unwinder->formatBacktrace(capture);
+        }));
+        return;
+    }
+
+    runDebugger(next);
+}
+
+void BacktraceCollector::startCoreDump()
+{
+    Q_D(BacktraceCollector);
+
+    d->coreDumpStarted = true;
+    startPhase();
+    appendOutput(QString::fromLatin1("\n--- Core dump ---\n"));
+
+    // 崩溃线程放在第一个，gdb 打开核心转储时就停在这个线程上
+    CoreDumpOptions options = d->coreDumpOptions;
+    if (options.crashingThread == 0)
+        options.crashingThread = d->nativeOptions.crashingThread;
+    if (!d->capture.threads.isEmpty() && options.crashingThread == 0)
+        options.crashingThread = d->capture.threads.at(crashingThreadIndex(d->capture, 0, d->nativeOptions.crashAddress)).tid;
+
+    QSharedPointer<CoreDumper> dumper(new CoreDumper(d->pid));
+    dumper->setOptions(options);
+    d->coreDumper = dumper;
+    const QString fileName = d->coreFile;
+    QElapsedTimer clock;
+    clock.start();
+    d->coreDumpWatcher.setFuture(QtConcurrent::run([dumper, fileName, clock]() {
+        CoreDumpResult result;
+        result.success = dumper->dump(fileName);
+        if (result.success) {
+            result.message = QString::fromLatin1("Core dump written to %1: %2 mappings, %3 MiB of memory, "
+                                                 "%4 MiB on disk in %5 ms.\n")
+                    .arg(fileName).arg(dumper->dumpedMappings())
+                    .arg(dumper->dumpedBytes() / (1024 * 1024)).arg(dumper->fileSize() / (1024 * 1024))
+                    .arg(clock.elapsed());
+        } else {
+            result.message = QString::fromLatin1("Could not write core dump: %1\n").arg(dumper->errorString());
+        }
+        return result;
+    }));
+}
+
+void BacktraceCollector::onSnapshotFinished()
+{
+    Q_D(BacktraceCollector);
+
+    // finish() 里等待过时，排队的 finished 信号还会再来一次
+    if (d->snapshotReady)
+        return;
+    d->snapshot = d->snapshotWatcher.result();
+    d->snapshotReady = true;
+}
+
+void BacktraceCollector::onCoreDumpFinished()
+{
+    Q_D(BacktraceCollector);
+
+    const CoreDumpResult result = d->coreDumpWatcher.result();
+    d->coreDumper.clear();
+    appendOutput(result.message);
+    if (result.success) {
+        setProperty(&d->capture.metadata, QLatin1String("coreFile"), d->coreFile);
+        saveReport();
+    }
+    finish();
+}
+
+void BacktraceCollector::appendOutput(const QString &chunk)
+{
+    Q_D(BacktraceCollector);
+
+    if (chunk.isEmpty())
+        return;
+    emit backtraceChunk(chunk);
+}
+
+void BacktraceCollector::appendDebuggerOutput(const QString &chunk)
+{
+    Q_D(BacktraceCollector);
+
+    // 第一帧，而不是 beginTier() 的标题或者 gdb 附加时的提示，gdb 的帧以 "#0" 这样的行开始
+    if (d->timeline && (chunk.startsWith(QLatin1Char('#')) || chunk.contains(QLatin1String("\n#"))))
+        d->timeline->mark(CrashTimeline::FirstOutputPhase);
+    if (!d->debuggerOutputTruncated) {
+        if (d->debuggerOutput.size() + chunk.size() <= maxReportedDebuggerOutput) {
+            d->debuggerOutput.append(chunk);
+        } else {
+            d->debuggerOutputTruncated = true;
+            d->debuggerOutput.append(QString::fromLatin1("\n[gdb output truncated after %1 characters]\n")
+                                     .arg(d->debuggerOutput.size()));
+        }
+    }
+    appendOutput(chunk);
+}
+
+void BacktraceCollector::finish()
+{
+    Q_D(BacktraceCollector);
+
+    if (d->finished)
+        return;
+    // 快照通常早就读完了，放在回溯后面，不打断 gdb 的输出
+    if (d->snapshotStarted && !d->snapshotShown) {
+        if (!d->snapshotReady) {
+            d->snapshotWatcher.waitForFinished();
+            onSnapshotFinished();
+        }
+        d->snapshotShown = true;
+        appendOutput(d->snapshot.format());
+        if (!d->snapshotInReport && d->tier != NoTier)
+            saveReport();
+    }
+    if (d->timeline)
+        d->timeline->mark(CrashTimeline::BacktraceFinishedPhase);
+    // 回溯收集完了再写核心转储，期限到了就不写了。gdb 已经退出，不会同时附加
+    if (!d->coreFile.isEmpty() && !d->coreDumpStarted && d->partialReason.isEmpty()) {
+        startCoreDump();
+        return;
+    }
+    d->finished = true;
+    d->budgetTimer.stop();
+    d->phaseTimer.stop();
+    d->unwinder.clear();
+
+    if (d->tier < d->maximumTier) {
+        appendOutput(QString::fromLatin1("\nCollected up to tier %1 of %2 in %3 ms.\n")
+                     .arg(d->tier).arg(d->maximumTier).arg(d->clock.elapsed()));
+    }
+    // 被中断的层已经输出的内容也写进报告
+    if (!d->partialReason.isEmpty())
+        saveReport();
+    emit backtraceFinished();
+}
+
+void BacktraceCollector::saveReport()
+{
+    Q_D(BacktraceCollector);
+
+    if (d->nativeOptions.reportFile.isEmpty())
+        return;
+
+    setProperty(&d->capture.metadata, QLatin1String("tier"), QString::number(d->tier));
+    if (!d->partialReason.isEmpty()) {
+        setProperty(&d->capture.metadata, QLatin1String("partial"), QLatin1String("1"));
+        setProperty(&d->capture.metadata, QLatin1String("partialReason"), d->partialReason);
+    }
+    if (!d->debuggerOutput.isEmpty())
+        setProperty(&d->capture.metadata, QLatin1String("gdbBacktrace"), d->debuggerOutput);
+    if (d->snapshotReady) {
+        const RawProperties snapshot = d->snapshot.toMetadata();
+        for (int i = 0; i < snapshot.size(); ++i)
+            setProperty(&d->capture.metadata, snapshot.at(i).first, snapshot.at(i).second);
+        d->snapshotInReport = true;
+    }
+    if (d->timeline) {
+        const RawProperties phases = d->timeline->toMetadata();
+        for (int i = 0; i < phases.size(); ++i)
+            setProperty(&d->capture.metadata, phases.at(i).first, phases.at(i).second);
+    }
+    if (!d->capture.save(d->nativeOptions.reportFile)) {
+        appendOutput(QString::fromLatin1("Could not write crash report to %1.\n")
+                     .arg(d->nativeOptions.reportFile));
+    }
+}
+
+void BacktraceCollector::updateReport()
+{
+    Q_D(BacktraceCollector);
+
+    // 没有收集过或者还在收集时不写，避免覆盖正在更新的报告
+    if (d->pid == 0 || isRunning())
+        return;
+    saveReport();
+}
+
+void BacktraceCollector::onNativeUnwinderFinished()
+{
+    Q_D(BacktraceCollector);
+
+    const NativeUnwinderResult result = d->nativeWatcher.result();
+    d->attachingUnwinder.clear();
+    if (!result.success) {
+        // 退回 gdb
+        appendOutput(QString::fromLatin1("Native unwinding failed: %1\nFalling back to gdb.\n")
+                     .arg(result.errorString));
+        runDebugger(CrashingThreadTier);
+        return;
+    }
+
+    d->capture = result.capture;
+    d->capture.pid = d->pid;
+    // 原生回溯一次拿到所有线程的帧，有帧时就是第一帧的时间
+    if (d->timeline && !d->capture.threads.isEmpty())
+        d->timeline->mark(CrashTimeline::FirstOutputPhase);
+    appendOutput(result.messages);
+
+    if (!result.symbolizeLocally) {
+        // 原始捕获里已经有所有线程，符号化在别处进行
+        finishTier(AllThreadsTier);
+    } else {
+        d->unwinder = result.unwinder;
+        beginTier(CrashingThreadTier);
+        appendOutput(result.crashingThread);
+        finishTier(CrashingThreadTier);
+    }
+    startNextTier();
+}
+
+void BacktraceCollector::onNativeSymbolizerFinished()
+{
+    Q_D(BacktraceCollector);
+
+    appendOutput(d->symbolizerWatcher.result());
+    d->unwinder.clear();
+    finishTier(AllThreadsTier);
+    startNextTier();
+}
+
+void BacktraceCollector::onTimeBudgetExpired()
+{
+    Q_D(BacktraceCollector);
+
+    abortCollection(QString::fromLatin1("Time budget of %1 ms exhausted after tier %2.")
+                    .arg(d->timeBudget).arg(d->tier));
+}
+
+void BacktraceCollector::onPhaseTimeout()
+{
+    Q_D(BacktraceCollector);
+
+    QString phase = QString::fromLatin1("Tier %1").arg(d->tier + 1);
+    if (d->coreDumpStarted)
+        phase = QString::fromLatin1("Core dump");
+    else if (d->tier == NoTier && d->engine == NativeEngine && d->nativeWatcher.isRunning())
+        phase = QString::fromLatin1("Native unwinding");
+    abortCollection(QString::fromLatin1("%1 did not finish within %2 ms, stopped after tier %3.")
+                    .arg(phase).arg(d->phaseTimeout).arg(d->tier));
+}
+
 void BacktraceCollector::onDebuggerFinished(int exitCode, QProcess::ExitStatus exitStatus)
 {
     Q_D(BacktraceCollector);
 
     Q_UNUSED(exitStatus);
 
+    if (d->timeline)
+        d->timeline->mark(CrashTimeline::DebuggerFinishedPhase);
+    if (!d->debuggerLineBuffer.isEmpty()) {
+        const QString rest = QString::fromLocal8Bit(d->debuggerLineBuffer);
+        d->debuggerLineBuffer.clear();
+        appendDebuggerOutput(rest);
+    }
+
+    // 已经完成的层仍然有用，只有一层都没拿到时才算出错
+    if (!d->partialReason.isEmpty() || d->tier != NoTier) {
+        finish();
+        return;
+    }
+
     if (d->errorOccurred) {
         emit error(QLatin1String("QProcess: ") + d->debugger.errorString());
         return;
@@ -81,19 +748,27 @@ void BacktraceCollector::onDebuggerFinished(int exitCode, QProcess::ExitStatus e
         return;
     }
 
-    emit backtrace(d->output);
+    finish();
 }
 
 void BacktraceCollector::onDebuggerError(QProcess::ProcessError error)
 {
     Q_D(BacktraceCollector);
 
-    Q_UNUSED(error);
-
     d->errorOccurred = true;
+
+    // 启动失败时不会有 finished() 信号
+    if (error == QProcess::FailedToStart) {
+        if (d->tier != NoTier) {
+            appendOutput(QString::fromLatin1("Could not start gdb: %1\n").arg(d->debugger.errorString()));
+            finish();
+        } else {
+            emit this->error(QLatin1String("QProcess: ") + d->debugger.errorString());
+        }
+    }
 }
 
-QString BacktraceCollector::createTemporaryCommandFile()
+QString BacktraceCollector::createTemporaryCommandFile(Tier firstTier)
 {
     Q_D(BacktraceCollector);
 
@@ -104,7 +779,21 @@ QString BacktraceCollector::createTemporaryCommandFile()
         return QString();
     }
 
-    if (d->commandFile->write(GdbBatchCommands) == -1) {
+    QByteArray commands = GdbSetupCommands;
+    // gdb 附加以后停在主线程上，先切换到出错的线程，第一层的 "thread" 和 "backtrace" 才是它的
+    if (d->nativeOptions.crashingThread != 0) {
+        commands += "python\n"
+                    "for thread in gdb.selected_inferior().threads():\n"
+                    "    if thread.ptid[1] == " + QByteArray::number(d->nativeOptions.crashingThread) + ":\n"
+                    "        thread.switch()\n"
+                    "end\n";
+    }
+    for (int tier = firstTier; tier <= d->maximumTier; ++tier) {
+        commands += gdbTierCommands(Tier(tier));
+        commands += "echo \\n" + QByteArray(tierMarker) + QByteArray::number(tier) + "\\n\n";
+    }
+
+    if (d->commandFile->write(commands) == -1) {
         emit error(QLatin1String("Error: Could not write temporary command file."));
         return QString();
     }
@@ -117,8 +806,27 @@ void BacktraceCollector::onDebuggerOutputAvailable()
 {
     Q_D(BacktraceCollector);
 
-    const QString newChunk = QString::fromLocal8Bit(d->debugger.readAll());
-    d->output.append(newChunk);
+    // 按整行处理，分层标记可能被拆在两次读取里
+    d->debuggerLineBuffer.append(d->debugger.readAll());
+    const int end = d->debuggerLineBuffer.lastIndexOf('\n');
+    if (end == -1)
+        return;
+    const QList<QByteArray> lines = d->debuggerLineBuffer.left(end).split('\n');
+    d->debuggerLineBuffer.remove(0, end + 1);
+
+    QString chunk;
+    foreach (const QByteArray &line, lines) {
+        if (!line.startsWith(tierMarker)) {
+            chunk += QString::fromLocal8Bit(line) + QLatin1Char('\n');
+            continue;
+        }
+        appendDebuggerOutput(chunk);
+        chunk.clear();
 
-    emit backtraceChunk(newChunk);
+        const Tier tier = Tier(line.mid(int(sizeof(tierMarker)) - 1).toInt());
+        finishTier(tier);
+        if (tier < d->maximumTier)
+            beginTier(Tier(tier + 1));
+    }
+    appendDebuggerOutput(chunk);
 }
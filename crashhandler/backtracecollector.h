@@ -1,33 +1,95 @@
 #pragma once
 
+#include "coredumper.h"
+#include "crashtimeline.h"
+#include "rawcapture.h"
+
 #include <QProcess>
 
 class BacktraceCollectorPrivate;
+class SymbolCache;
 
 class BacktraceCollector : public QObject
 {
     Q_OBJECT
 
 public:
+    // NativeEngine - 用 ptrace 和 .eh_frame 直接回溯，失败时退回 gdb
+    // GdbEngine - 运行 gdb --batch
+    enum Engine { NativeEngine, GdbEngine };
+
+    // 分层收集，每一层完成后立即显示并写入报告，后面的层慢或者超时不会影响已经拿到的结果。
+    // CrashingThreadTier - 崩溃线程的回溯，不含局部变量
+    // AllThreadsTier - 所有线程的回溯，不含局部变量
+    // FullTier - 所有线程的 backtrace full，需要 gdb
+    enum Tier { NoTier = 0, CrashingThreadTier = 1, AllThreadsTier = 2, FullTier = 3 };
+
     explicit BacktraceCollector(QObject *parent = Q_NULLPTR);
     ~BacktraceCollector();
 
+    static int defaultTimeBudget();
+    static int defaultPhaseTimeout();
+    static QString tierDescription(Tier tier);
+
+    void setEngine(Engine engine);
+    // 原生回溯使用的符号缓存，不转移所有权
+    void setSymbolCache(SymbolCache *cache);
+    // 设置后原生回溯只把原始帧地址和模块表写到这个文件，不在本机符号化
+    void setRawCaptureFile(const QString &fileName);
+    // 设置后每完成一层就把二进制报告（见 crashreport.h）重写到这个文件，元数据 tier 为已完成的层
+    void setReportFile(const QString &fileName);
+    void setReportInfo(const RawProperties &metadata, const RawProperties &systemInfo);
+    // 信号处理程序记录的出错指令地址，用来在原生回溯中找出崩溃线程
+    void setCrashAddress(quint64 address);
+    // 信号处理程序记录的出错线程，原生回溯和 gdb 的第一层都直接回溯这个线程
+    void setCrashingThread(pid_t thread);
+    void setMaximumTier(Tier tier);
+    // 整体期限：从 run() 开始计时，毫秒，0 表示不限制
+    void setTimeBudget(int msecs);
+    // 每个阶段（原生回溯和每一层）的期限，毫秒，0 表示不限制
+    // 任何一个期限到了都保留已有的输出，终止 gdb，不再等待原生回溯，报告标记为不完整（元数据 partial）
+    void setPhaseTimeout(int msecs);
+    // 设置后在回溯收集完以后写一个核心转储（见 coredumper.h），作为单独的阶段，受同样的期限限制
+    void setCoreDump(const QString &fileName, const CoreDumpOptions &options);
+    // 在上面记录收集阶段的时间点，并写进报告，不转移所有权
+    void setTimeline(CrashTimeline *timeline);
     void run(Q_PID pid);
+    // 收集结束后重写报告，补上之后记录的阶段时间
+    void updateReport();
     bool isRunning() const;
     void kill();
 
 signals:
     void error(const QString &errorMessage);
-    void backtrace(const QString &backtrace);
+    // 输出只通过 backtraceChunk() 给出，不在内存中保留完整的回溯
     void backtraceChunk(const QString &chunk);
+    void backtraceFinished();
+    void tierFinished(int tier, int maximumTier);
 
 private slots:
     void onDebuggerOutputAvailable();
     void onDebuggerFinished(int exitCode, QProcess::ExitStatus exitStatus);
     void onDebuggerError(QProcess::ProcessError err);
+    void onNativeUnwinderFinished();
+    void onNativeSymbolizerFinished();
+    void onTimeBudgetExpired();
+    void onPhaseTimeout();
+    void onCoreDumpFinished();
+    void onSnapshotFinished();
 
 private:
-    QString createTemporaryCommandFile();
+    void runDebugger(Tier firstTier);
+    QString createTemporaryCommandFile(Tier firstTier);
+    void startPhase();
+    void abortCollection(const QString &reason);
+    void beginTier(Tier tier);
+    void finishTier(Tier tier);
+    void startNextTier();
+    void startCoreDump();
+    void appendOutput(const QString &chunk);
+    void appendDebuggerOutput(const QString &chunk);
+    void finish();
+    void saveReport();
 
     QScopedPointer<BacktraceCollectorPrivate> d_ptr;
     Q_DECLARE_PRIVATE_D(d_ptr, BacktraceCollector)
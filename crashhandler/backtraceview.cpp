@@ -0,0 +1,211 @@
+#include "backtraceview.h"
+#include "outputspool.h"
+
+#include <QApplication>
+#include <QClipboard>
+#include <QFontDatabase>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QScrollBar>
+
+namespace {
+const int updateInterval = 100; // ms
+const int textMargin = 4;
+const qint64 readBlockSize = 64 * 1024;
+}
+
+BacktraceView::BacktraceView(QWidget *parent)
+    : QAbstractScrollArea(parent)
+{
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    setFocusPolicy(Qt::StrongFocus);
+    viewport()->setBackgroundRole(QPalette::Base);
+    viewport()->setAutoFillBackground(true);
+
+    m_lineStarts.append(0);
+    m_updateTimer.setSingleShot(true);
+    m_updateTimer.setInterval(updateInterval);
+    connect(&m_updateTimer, &QTimer::timeout, this, &BacktraceView::updateLines);
+}
+
+void BacktraceView::setSpool(OutputSpool *spool)
+{
+    m_spool = spool;
+    m_file.close();
+    m_file.setFileName(spool ? spool->fileName() : QString());
+    if (spool)
+        m_file.open(QIODevice::ReadOnly);
+
+    m_lineStarts.clear();
+    m_lineStarts.append(0);
+    m_indexedSize = 0;
+    m_longestLine = 0;
+    m_selectedLine = -1;
+    updateLines();
+}
+
+void BacktraceView::scheduleUpdate()
+{
+    if (!m_updateTimer.isActive())
+        m_updateTimer.start();
+}
+
+void BacktraceView::updateLines()
+{
+    m_updateTimer.stop();
+    if (!m_spool || !m_file.isOpen())
+        return;
+    m_spool->flush();
+    const qint64 size = m_file.size();
+    if (size <= m_indexedSize)
+        return;
+
+    // 停在底部时跟随新的输出
+    QScrollBar *scrollBar = verticalScrollBar();
+    const bool followOutput = scrollBar->value() == scrollBar->maximum();
+
+    // 只扫描新追加的部分，一次读一块
+    m_file.seek(m_indexedSize);
+    while (m_indexedSize < size) {
+        const QByteArray block = m_file.read(qMin(readBlockSize, size - m_indexedSize));
+        if (block.isEmpty())
+            break;
+        for (int i = block.indexOf('\n'); i != -1; i = block.indexOf('\n', i + 1)) {
+            const qint64 next = m_indexedSize + i + 1;
+            m_longestLine = qMax(m_longestLine, int(next - 1 - m_lineStarts.last()));
+            m_lineStarts.append(next);
+        }
+        m_indexedSize += block.size();
+    }
+    m_longestLine = qMax(m_longestLine, int(m_indexedSize - m_lineStarts.last()));
+
+    updateScrollBars();
+    if (followOutput)
+        scrollBar->setValue(scrollBar->maximum());
+    viewport()->update();
+}
+
+int BacktraceView::lineCount() const
+{
+    return m_lineStarts.size();
+}
+
+QString BacktraceView::line(int index) const
+{
+    if (index < 0 || index >= m_lineStarts.size() || !m_file.isOpen())
+        return QString();
+
+    const qint64 start = m_lineStarts.at(index);
+    const qint64 end = index + 1 < m_lineStarts.size() ? m_lineStarts.at(index + 1) - 1 : m_indexedSize;
+    if (end <= start || !m_file.seek(start))
+        return QString();
+    return QString::fromUtf8(m_file.read(end - start));
+}
+
+QString BacktraceView::toPlainText() const
+{
+    if (!m_file.isOpen())
+        return QString();
+    if (m_spool)
+        m_spool->flush();
+    m_file.seek(0);
+    return QString::fromUtf8(m_file.readAll());
+}
+
+int BacktraceView::find(const QString &text, int from, bool backward)
+{
+    updateLines();
+    if (text.isEmpty())
+        return -1;
+
+    const int step = backward ? -1 : 1;
+    for (int i = qBound(0, from, m_lineStarts.size() - 1); i >= 0 && i < m_lineStarts.size(); i += step) {
+        if (line(i).contains(text)) {
+            selectLine(i);
+            return i;
+        }
+    }
+    return -1;
+}
+
+void BacktraceView::selectLine(int index)
+{
+    m_selectedLine = index;
+
+    // 把选中的行滚动到可见范围
+    QScrollBar *scrollBar = verticalScrollBar();
+    const int visibleLines = qMax(1, viewport()->height() / lineHeight());
+    if (index < scrollBar->value())
+        scrollBar->setValue(index);
+    else if (index >= scrollBar->value() + visibleLines)
+        scrollBar->setValue(index - visibleLines + 1);
+    viewport()->update();
+}
+
+int BacktraceView::lineHeight() const
+{
+    return fontMetrics().height();
+}
+
+void BacktraceView::updateScrollBars()
+{
+    const int visibleLines = qMax(1, viewport()->height() / lineHeight());
+    verticalScrollBar()->setRange(0, qMax(0, m_lineStarts.size() - visibleLines));
+    verticalScrollBar()->setPageStep(visibleLines);
+    verticalScrollBar()->setSingleStep(1);
+
+    // 等宽字体，最长一行的宽度按字节数估算，不必测量每一行
+    const int contentWidth = m_longestLine * fontMetrics().averageCharWidth() + 2 * textMargin;
+    horizontalScrollBar()->setRange(0, qMax(0, contentWidth - viewport()->width()));
+    horizontalScrollBar()->setPageStep(viewport()->width());
+    horizontalScrollBar()->setSingleStep(fontMetrics().averageCharWidth());
+}
+
+void BacktraceView::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+
+    QPainter painter(viewport());
+    const int height = lineHeight();
+    const int first = verticalScrollBar()->value();
+    const int last = qMin(m_lineStarts.size() - 1, first + viewport()->height() / height + 1);
+    const int x = textMargin - horizontalScrollBar()->value();
+
+    for (int i = first; i <= last; ++i) {
+        const QRect lineRect(0, (i - first) * height, viewport()->width(), height);
+        if (i == m_selectedLine) {
+            painter.fillRect(lineRect, palette().highlight());
+            painter.setPen(palette().highlightedText().color());
+        } else {
+            painter.setPen(palette().text().color());
+        }
+        painter.drawText(x, lineRect.top() + fontMetrics().ascent(), line(i));
+    }
+}
+
+void BacktraceView::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void BacktraceView::mousePressEvent(QMouseEvent *event)
+{
+    const int index = verticalScrollBar()->value() + event->pos().y() / lineHeight();
+    if (index < m_lineStarts.size()) {
+        m_selectedLine = index;
+        viewport()->update();
+    }
+    QAbstractScrollArea::mousePressEvent(event);
+}
+
+void BacktraceView::keyPressEvent(QKeyEvent *event)
+{
+    // 复制选中的行，整个内容通过对话框的按钮复制
+    if (event->matches(QKeySequence::Copy) && m_selectedLine >= 0) {
+        QApplication::clipboard()->setText(line(m_selectedLine));
+        return;
+    }
+    QAbstractScrollArea::keyPressEvent(event);
+}
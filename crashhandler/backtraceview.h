@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QAbstractScrollArea>
+#include <QFile>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+
+class OutputSpool;
+
+// 只读的按行索引的文本视图，只绘制可见的行，用来代替 QTextEdit 显示很大的回溯。
+// 文本在 OutputSpool 写的文件里，视图只保存每行在文件中的偏移，可见的行按需从文件读回。
+// 追加通知由定时器合并成一次更新，所以频繁的小块输出不会反复触发布局。
+// 不换行，每行高度相同，滚动、查找和选中一行的开销都与总行数无关或只是一次线性扫描。
+class BacktraceView : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    explicit BacktraceView(QWidget *parent = Q_NULLPTR);
+
+    // 不转移所有权，文件必须已经打开
+    void setSpool(OutputSpool *spool);
+    // spool 里追加了内容，稍后一起更新
+    void scheduleUpdate();
+
+    int lineCount() const;
+    QString line(int index) const;
+    QString toPlainText() const;
+
+    // 从 from 开始查找包含 text 的行，找到时选中并滚动到该行，返回行号，找不到返回 -1
+    int find(const QString &text, int from, bool backward = false);
+    void selectLine(int index);
+    int selectedLine() const { return m_selectedLine; }
+
+public slots:
+    void updateLines();
+
+protected:
+    void paintEvent(QPaintEvent *event) Q_DECL_OVERRIDE;
+    void resizeEvent(QResizeEvent *event) Q_DECL_OVERRIDE;
+    void mousePressEvent(QMouseEvent *event) Q_DECL_OVERRIDE;
+    void keyPressEvent(QKeyEvent *event) Q_DECL_OVERRIDE;
+
+private:
+    void updateScrollBars();
+    int lineHeight() const;
+
+    OutputSpool *m_spool = nullptr;
+    mutable QFile m_file;
+    QVector<qint64> m_lineStarts; // 每行开始的偏移，最后一行是还没有结束的行，可能为空
+    qint64 m_indexedSize = 0;
+    int m_longestLine = 0; // 字节数，用来估算宽度
+    QTimer m_updateTimer;
+    int m_selectedLine = -1;
+};
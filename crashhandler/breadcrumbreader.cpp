@@ -0,0 +1,125 @@
+#include "breadcrumbreader.h"
+#include "breadcrumbs.h"
+#include "processmemory.h"
+
+#include <QFile>
+#include <QHash>
+
+#include <algorithm>
+
+#include <unistd.h>
+
+namespace {
+const quint64 maxLabelSize = 64;
+}
+
+struct RawEvent
+{
+    pid_t tid;
+    uint64_t ticks;
+    uint64_t label;
+    uint64_t value;
+};
+
+// 标签是崩溃的进程里的字符串字面量，读不到时显示地址
+static QString readLabel(ProcessMemoryReader &memory, quint64 address)
+{
+    if (address == 0)
+        return QString();
+    // 不跨页读取，字符串后面的页可能没有映射
+    const quint64 pageSize = quint64(sysconf(_SC_PAGESIZE));
+    const quint64 size = qMin(maxLabelSize, pageSize - address % pageSize);
+    QByteArray text = memory.readRange(address, size);
+    if (text.isEmpty())
+        return QString("0x%1").arg(address, 0, 16);
+    const int end = text.indexOf('\0');
+    if (end != -1)
+        text.truncate(end);
+    return QString::fromUtf8(text);
+}
+
+bool BreadcrumbReader::load(pid_t pid, int fd)
+{
+    m_events.clear();
+
+    QFile file(QString("/proc/%1/fd/%2").arg(pid).arg(fd));
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_errorString = QString("Could not open breadcrumbs: %1").arg(file.errorString());
+        return false;
+    }
+    const QByteArray contents = file.readAll();
+    if (size_t(contents.size()) < sizeof(BreadcrumbHeader)) {
+        m_errorString = QLatin1String("Breadcrumb buffer is truncated.");
+        return false;
+    }
+    BreadcrumbHeader header;
+    memcpy(&header, contents.constData(), sizeof(header));
+    if (header.magic != BreadcrumbMagic || header.version != BreadcrumbVersion
+            || sizeof(header) + quint64(header.ringCount) * sizeof(BreadcrumbRing) > quint64(contents.size())) {
+        m_errorString = QLatin1String("Breadcrumb buffer has an unknown format.");
+        return false;
+    }
+
+    // 把 ticks 换算成纳秒。TSC 的频率用设置时和现在的两对值估计，TSC 在各个进程之间是同一个时钟
+    const uint64_t nowTicks = breadcrumbTicks();
+    const uint64_t nowNanoseconds = breadcrumbMonotonicNanoseconds();
+    double nanosecondsPerTick = 1.0;
+    if (header.clock == BreadcrumbClockTsc) {
+        if (header.clock != breadcrumbClock() || nowTicks <= header.setupTicks
+                || nowNanoseconds <= header.setupNanoseconds) {
+            m_errorString = QLatin1String("Breadcrumb timestamps cannot be converted on this machine.");
+            return false;
+        }
+        nanosecondsPerTick = double(nowNanoseconds - header.setupNanoseconds) / double(nowTicks - header.setupTicks);
+    }
+
+    QVector<RawEvent> rawEvents;
+    const char *rings = contents.constData() + sizeof(header);
+    const uint32_t ringCount = qMin(header.ringCount, header.claimedRings);
+    for (uint32_t i = 0; i < ringCount; ++i) {
+        BreadcrumbRing ring;
+        memcpy(&ring, rings + i * sizeof(BreadcrumbRing), sizeof(ring));
+        if (ring.tid == 0)
+            continue;
+        const uint64_t count = qMin(ring.head, uint64_t(BreadcrumbRingSize));
+        for (uint64_t n = ring.head - count; n < ring.head; ++n) {
+            const Breadcrumb &event = ring.events[n & (BreadcrumbRingSize - 1)];
+            rawEvents.append({ ring.tid, event.ticks, event.label, event.value });
+        }
+    }
+    std::sort(rawEvents.begin(), rawEvents.end(), [](const RawEvent &a, const RawEvent &b) {
+        return a.ticks < b.ticks;
+    });
+
+    ProcessMemoryReader memory(pid);
+    QHash<quint64, QString> labels;
+    const uint64_t lastTicks = rawEvents.isEmpty() ? 0 : rawEvents.last().ticks;
+    m_events.reserve(rawEvents.size());
+    foreach (const RawEvent &rawEvent, rawEvents) {
+        Event event;
+        event.tid = rawEvent.tid;
+        event.nanoseconds = -qint64(double(lastTicks - rawEvent.ticks) * nanosecondsPerTick);
+        auto label = labels.constFind(rawEvent.label);
+        if (label == labels.constEnd())
+            label = labels.insert(rawEvent.label, readLabel(memory, rawEvent.label));
+        event.label = label.value();
+        event.value = rawEvent.value;
+        m_events.append(event);
+    }
+    return true;
+}
+
+QString BreadcrumbReader::format(int maxEvents) const
+{
+    const int first = qMax(0, m_events.size() - maxEvents);
+    QString text = QString("Breadcrumbs (last %1 of %2 events, time relative to the last event):\n")
+            .arg(m_events.size() - first).arg(m_events.size());
+    for (int i = first; i < m_events.size(); ++i) {
+        const Event &event = m_events.at(i);
+        // 标签来自应用程序，可能含有 %1 这样的文本，一次替换所有参数，不会被再次替换
+        const QString time = QString("%1").arg(double(event.nanoseconds) / 1000000.0, 12, 'f', 3);
+        text += QString("%1 ms  thread %2  %3  %4\n")
+                .arg(time, QString::number(event.tid), event.label, QString::number(event.value));
+    }
+    return text;
+}
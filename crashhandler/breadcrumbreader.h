@@ -0,0 +1,32 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+
+#include <sys/types.h>
+
+// 读取崩溃的进程记录的面包屑（见 breadcrumbs.h）。memfd 通过 /proc/<pid>/fd/<fd> 打开，
+// 标签的文本从进程内存里读，所以要在进程退出之前调用。
+class BreadcrumbReader
+{
+public:
+    struct Event
+    {
+        pid_t tid = 0;
+        qint64 nanoseconds = 0; // 相对最后一个事件，不大于 0
+        QString label;
+        quint64 value = 0;
+    };
+
+    bool load(pid_t pid, int fd);
+
+    // 所有线程的事件按时间排序，最后一个是离崩溃最近的
+    const QVector<Event> &events() const { return m_events; }
+    // 最后 maxEvents 个事件的文本
+    QString format(int maxEvents) const;
+    QString errorString() const { return m_errorString; }
+
+private:
+    QVector<Event> m_events;
+    QString m_errorString;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// 面包屑：应用程序记录的最近的事件，崩溃后由 crashhandler 读出来写进报告。
+// 所有环形缓冲区放在一个 memfd 里，应用程序和 crashhandler 之间只共享这块内存，这里只使用 POD 类型。
+// 每个线程第一次记录时领取一个环，退出时归还，之后只有这个线程写它，所以记录时不需要锁，也没有原子的读-改-写：
+// 先写事件，再以 release 语义更新 head。读的一方先读 head，再读 head 之前的事件。
+// 事件里只保存标签的地址，标签必须是字符串字面量，crashhandler 从崩溃的进程里读出文本。
+
+enum {
+    BreadcrumbMagic = 0x43524243, // "CRBC"
+    BreadcrumbVersion = 1,
+    BreadcrumbRingSize = 256 // 2 的幂
+};
+
+// ticks 的单位，见 BreadcrumbHeader::clock
+enum BreadcrumbClock {
+    BreadcrumbClockTsc = 1,      // x86 的 TSC，用 setupTicks/setupNanoseconds 和读取时的一对值换算
+    BreadcrumbClockMonotonic = 2 // CLOCK_MONOTONIC 的纳秒
+};
+
+struct Breadcrumb
+{
+    uint64_t ticks;
+    uint64_t label; // const char *，在崩溃的进程里
+    uint64_t value;
+};
+
+// 按缓存行对齐，相邻线程的环不共享缓存行
+struct alignas(64) BreadcrumbRing
+{
+    int32_t tid; // 0 表示还没有被领取
+    uint32_t released; // 1 表示线程已经退出，可以被新线程领取，在那之前事件仍然有效
+    uint64_t head; // 已经写入的事件数，最近的事件在 events[(head - 1) % BreadcrumbRingSize]
+    Breadcrumb events[BreadcrumbRingSize];
+};
+
+struct alignas(64) BreadcrumbHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ringCount;
+    uint32_t claimedRings; // 领取时原子递增，可能超过 ringCount
+    uint32_t clock;
+    uint32_t reserved;
+    uint64_t setupTicks;
+    uint64_t setupNanoseconds; // CLOCK_MONOTONIC
+    // 后面紧接着 ringCount 个 BreadcrumbRing
+};
+
+inline BreadcrumbRing *breadcrumbRings(BreadcrumbHeader *header)
+{
+    return reinterpret_cast<BreadcrumbRing *>(header + 1);
+}
+
+inline uint64_t breadcrumbMonotonicNanoseconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return uint64_t(now.tv_sec) * 1000000000 + uint64_t(now.tv_nsec);
+}
+
+inline uint32_t breadcrumbClock()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return BreadcrumbClockTsc;
+#else
+    return BreadcrumbClockMonotonic;
+#endif
+}
+
+// 记录路径上的时间戳，TSC 只要几个时钟周期，其他平台走 vDSO 的 clock_gettime()
+inline uint64_t breadcrumbTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return breadcrumbMonotonicNanoseconds();
+#endif
+}
@@ -0,0 +1,396 @@
+#include "coredumper.h"
+#include "nativeunwinder.h"
+#include "processmaps.h"
+#include "utils.h"
+
+#include <QFile>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent>
+
+#include <elf.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/procfs.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define CORE_DUMPER_SUPPORTED
+#endif
+
+namespace {
+const quint64 chunkSize = 4 * 1024 * 1024;
+const char noteName[] = "CORE";
+}
+
+int CoreDumpOptions::parseFilter(const QString &text, bool *ok)
+{
+    int filter = 0;
+    bool valid = true;
+    foreach (const QString &name, text.split(QLatin1Char(','), QString::SkipEmptyParts)) {
+        const QString trimmed = name.trimmed();
+        if (trimmed == QLatin1String("stacks"))
+            filter |= Stacks;
+        else if (trimmed == QLatin1String("heap"))
+            filter |= Heap;
+        else if (trimmed == QLatin1String("data"))
+            filter |= FileData;
+        else if (trimmed == QLatin1String("files"))
+            filter |= ReadOnlyFiles;
+        else
+            valid = false;
+    }
+    if (ok)
+        *ok = valid;
+    return filter;
+}
+
+#ifdef CORE_DUMPER_SUPPORTED
+
+struct CoreThread
+{
+    elf_prstatus status;
+    elf_fpregset_t fpRegisters;
+};
+
+// 一个 PT_LOAD 段，fileSize 为从 start 开始写入文件的字节数，可以小于 size
+struct CoreSegment
+{
+    quint64 start = 0;
+    quint64 size = 0;
+    quint64 fileSize = 0;
+    quint64 offset = 0;
+    quint32 flags = 0;
+};
+
+// 输出文件中的一块：头部已经在 data 里，其余的从目标进程读取
+struct CoreChunk
+{
+    QByteArray data;
+    quint64 address = 0;
+    quint64 size = 0;
+};
+
+static quint64 alignUp(quint64 value, quint64 alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static void appendNote(QByteArray *notes, quint32 type, const void *desc, quint64 descSize)
+{
+    Elf64_Nhdr header;
+    header.n_namesz = sizeof(noteName);
+    header.n_descsz = Elf64_Word(descSize);
+    header.n_type = type;
+    notes->append(reinterpret_cast<const char *>(&header), sizeof(header));
+    notes->append(noteName, sizeof(noteName));
+    notes->append(QByteArray(int(alignUp(sizeof(noteName), 4) - sizeof(noteName)), '\0'));
+    notes->append(static_cast<const char *>(desc), int(descSize));
+    notes->append(QByteArray(int(alignUp(descSize, 4) - descSize), '\0'));
+}
+
+static QByteArray processInfoNote(pid_t pid)
+{
+    elf_prpsinfo info;
+    memset(&info, 0, sizeof(info));
+    info.pr_sname = 'R';
+    info.pr_pid = pid;
+
+    const QByteArray name = fileContents(QString("/proc/%1/comm").arg(pid)).trimmed();
+    strncpy(info.pr_fname, name.constData(), sizeof(info.pr_fname) - 1);
+    QByteArray arguments = fileContents(QString("/proc/%1/cmdline").arg(pid));
+    arguments.replace('\0', ' ');
+    arguments = arguments.trimmed();
+    strncpy(info.pr_psargs, arguments.constData(), sizeof(info.pr_psargs) - 1);
+
+    QByteArray note;
+    appendNote(&note, NT_PRPSINFO, &info, sizeof(info));
+    return note;
+}
+
+// NT_FILE：文件映射的列表，gdb 据此找到共享库，格式与内核写的相同
+static QByteArray fileMappingsNote(const ProcessMaps &maps, quint64 pageSize)
+{
+    QVector<quint64> ranges;
+    QByteArray names;
+    foreach (const MemoryMapping &mapping, maps.mappings()) {
+        if (!mapping.isFileBacked())
+            continue;
+        ranges << mapping.start << mapping.end << mapping.offset / pageSize;
+        names += mapping.path.toLocal8Bit();
+        names += '\0';
+    }
+
+    QByteArray desc;
+    const quint64 header[] = { quint64(ranges.size() / 3), pageSize };
+    desc.append(reinterpret_cast<const char *>(header), sizeof(header));
+    desc.append(reinterpret_cast<const char *>(ranges.constData()), int(ranges.size() * sizeof(quint64)));
+    desc += names;
+
+    QByteArray note;
+    appendNote(&note, NT_FILE, desc.constData(), quint64(desc.size()));
+    return note;
+}
+
+// 读一块内存，读不到的页（比如被截断的文件映射）填 0
+static QByteArray readChunk(pid_t pid, quint64 address, quint64 size, quint64 pageSize)
+{
+    QByteArray data(int(size), '\0');
+    struct iovec local = { data.data(), size };
+    struct iovec remote = { reinterpret_cast<void *>(address), size };
+    if (process_vm_readv(pid, &local, 1, &remote, 1, 0) == ssize_t(size))
+        return data;
+
+    for (quint64 offset = 0; offset < size; offset += pageSize) {
+        const quint64 length = qMin(pageSize, size - offset);
+        struct iovec localPage = { data.data() + offset, length };
+        struct iovec remotePage = { reinterpret_cast<void *>(address + offset), length };
+        if (process_vm_readv(pid, &localPage, 1, &remotePage, 1, 0) != ssize_t(length))
+            memset(data.data() + offset, 0, length);
+    }
+    return data;
+}
+
+// 压缩成一个完整的 gzip 成员，失败时返回空
+static QByteArray gzipChunk(const QByteArray &data, int level)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // windowBits 加 16 表示写 gzip 头和尾
+    if (deflateInit2(&stream, level, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return QByteArray();
+
+    QByteArray compressed;
+    compressed.resize(int(deflateBound(&stream, uLong(data.size()))));
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    stream.avail_in = uInt(data.size());
+    stream.next_out = reinterpret_cast<Bytef *>(compressed.data());
+    stream.avail_out = uInt(compressed.size());
+    const int result = deflate(&stream, Z_FINISH);
+    compressed.resize(int(stream.total_out));
+    deflateEnd(&stream);
+    return result == Z_STREAM_END ? compressed : QByteArray();
+}
+
+#endif // CORE_DUMPER_SUPPORTED
+
+CoreDumper::CoreDumper(pid_t pid)
+    : m_pid(pid)
+{
+}
+
+bool CoreDumper::dump(const QString &fileName)
+{
+#ifdef CORE_DUMPER_SUPPORTED
+    // 借用回溯的附加逻辑：反复扫描直到没有新线程，所有线程停下后读取内存映射。析构时分离
+    NativeUnwinder unwinder(m_pid);
+    if (!unwinder.attach()) {
+        m_errorString = unwinder.errorString();
+        return false;
+    }
+    const quint64 pageSize = quint64(sysconf(_SC_PAGESIZE));
+
+    // 寄存器只能由附加的线程读取
+    QVector<CoreThread> threads;
+    QVector<quint64> stackPointers;
+    foreach (const NativeThread &nativeThread, unwinder.threads()) {
+        CoreThread thread;
+        memset(&thread, 0, sizeof(thread));
+        thread.status.pr_pid = nativeThread.tid;
+        struct iovec registers = { &thread.status.pr_reg, sizeof(thread.status.pr_reg) };
+        if (ptrace(PTRACE_GETREGSET, nativeThread.tid, reinterpret_cast<void *>(NT_PRSTATUS), &registers) == -1)
+            continue;
+        struct iovec fpRegisters = { &thread.fpRegisters, sizeof(thread.fpRegisters) };
+        thread.status.pr_fpvalid = ptrace(PTRACE_GETREGSET, nativeThread.tid,
+                                          reinterpret_cast<void *>(NT_PRFPREG), &fpRegisters) != -1;
+        stackPointers.append(nativeThread.registers.sp());
+        if (nativeThread.tid == m_options.crashingThread) {
+            thread.status.pr_cursig = short(m_options.signalNumber);
+            thread.status.pr_info.si_signo = m_options.signalNumber;
+            threads.prepend(thread);
+        } else {
+            threads.append(thread);
+        }
+    }
+    if (threads.isEmpty()) {
+        m_errorString = QString("Could not read registers of process %1.").arg(m_pid);
+        return false;
+    }
+
+    // 选择写入内容的映射。只读的文件映射在磁盘上有，[vvar] 读不出来
+    QVector<CoreSegment> segments;
+    quint64 heapBytes = 0;
+    foreach (const MemoryMapping &mapping, unwinder.maps().mappings()) {
+        CoreSegment segment;
+        segment.start = mapping.start;
+        segment.size = mapping.end - mapping.start;
+        if (mapping.permissions.contains('r'))
+            segment.flags |= PF_R;
+        if (mapping.permissions.contains('w'))
+            segment.flags |= PF_W;
+        if (mapping.permissions.contains('x'))
+            segment.flags |= PF_X;
+
+        bool isStack = mapping.path == QLatin1String("[stack]");
+        foreach (quint64 sp, stackPointers)
+            isStack = isStack || mapping.contains(sp);
+        const bool writable = segment.flags & PF_W;
+
+        if (!(segment.flags & PF_R) || mapping.path.startsWith(QLatin1String("[vvar"))
+                || mapping.path == QLatin1String("[vsyscall]")) {
+            segment.fileSize = 0;
+        } else if (mapping.path == QLatin1String("[vdso]")) {
+            segment.fileSize = segment.size; // 很小，gdb 用它回溯信号帧
+        } else if (isStack) {
+            segment.fileSize = m_options.filter & CoreDumpOptions::Stacks ? segment.size : 0;
+        } else if (mapping.isFileBacked()) {
+            const int needed = writable ? CoreDumpOptions::FileData : CoreDumpOptions::ReadOnlyFiles;
+            segment.fileSize = m_options.filter & needed ? segment.size : 0;
+        } else if (m_options.filter & CoreDumpOptions::Heap) {
+            segment.fileSize = segment.size;
+            if (m_options.heapLimit > 0) {
+                const quint64 remaining = m_options.heapLimit - qMin(heapBytes, m_options.heapLimit);
+                segment.fileSize = qMin(segment.size, remaining & ~(pageSize - 1));
+            }
+            heapBytes += segment.fileSize;
+        }
+        segments.append(segment);
+    }
+    if (1 + segments.size() >= PN_XNUM) {
+        m_errorString = QString("Too many memory mappings (%1).").arg(segments.size());
+        return false;
+    }
+
+    // 头部：ELF 头、程序头、注释，按内核的顺序，崩溃线程的 NT_PRSTATUS 在最前面
+    QByteArray notes;
+    for (int i = 0; i < threads.size(); ++i) {
+        appendNote(&notes, NT_PRSTATUS, &threads.at(i).status, sizeof(threads.at(i).status));
+        if (i == 0) {
+            notes += processInfoNote(m_pid);
+            const QByteArray auxv = fileContents(QString("/proc/%1/auxv").arg(m_pid));
+            appendNote(&notes, NT_AUXV, auxv.constData(), quint64(auxv.size()));
+            notes += fileMappingsNote(unwinder.maps(), pageSize);
+        }
+        if (threads.at(i).status.pr_fpvalid)
+            appendNote(&notes, NT_PRFPREG, &threads.at(i).fpRegisters, sizeof(threads.at(i).fpRegisters));
+    }
+
+    const int segmentCount = 1 + segments.size();
+    const quint64 notesOffset = sizeof(Elf64_Ehdr) + segmentCount * sizeof(Elf64_Phdr);
+    quint64 offset = alignUp(notesOffset + quint64(notes.size()), pageSize);
+    for (int i = 0; i < segments.size(); ++i) {
+        segments[i].offset = offset;
+        offset += segments.at(i).fileSize;
+    }
+
+    Elf64_Ehdr elfHeader;
+    memset(&elfHeader, 0, sizeof(elfHeader));
+    memcpy(elfHeader.e_ident, ELFMAG, SELFMAG);
+    elfHeader.e_ident[EI_CLASS] = ELFCLASS64;
+    elfHeader.e_ident[EI_DATA] = ELFDATA2LSB;
+    elfHeader.e_ident[EI_VERSION] = EV_CURRENT;
+    elfHeader.e_ident[EI_OSABI] = ELFOSABI_NONE;
+    elfHeader.e_type = ET_CORE;
+#if defined(__x86_64__)
+    elfHeader.e_machine = EM_X86_64;
+#elif defined(__aarch64__)
+    elfHeader.e_machine = EM_AARCH64;
+#endif
+    elfHeader.e_version = EV_CURRENT;
+    elfHeader.e_phoff = sizeof(Elf64_Ehdr);
+    elfHeader.e_ehsize = sizeof(Elf64_Ehdr);
+    elfHeader.e_phentsize = sizeof(Elf64_Phdr);
+    elfHeader.e_phnum = Elf64_Half(segmentCount);
+
+    QByteArray head(reinterpret_cast<const char *>(&elfHeader), sizeof(elfHeader));
+    Elf64_Phdr noteHeader;
+    memset(&noteHeader, 0, sizeof(noteHeader));
+    noteHeader.p_type = PT_NOTE;
+    noteHeader.p_offset = notesOffset;
+    noteHeader.p_filesz = quint64(notes.size());
+    noteHeader.p_align = 4;
+    head.append(reinterpret_cast<const char *>(&noteHeader), sizeof(noteHeader));
+    foreach (const CoreSegment &segment, segments) {
+        Elf64_Phdr header;
+        memset(&header, 0, sizeof(header));
+        header.p_type = PT_LOAD;
+        header.p_offset = segment.offset;
+        header.p_vaddr = segment.start;
+        header.p_filesz = segment.fileSize;
+        header.p_memsz = segment.size;
+        header.p_flags = segment.flags;
+        header.p_align = pageSize;
+        head.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    }
+    head += notes;
+    head.append(QByteArray(int(alignUp(quint64(head.size()), pageSize) - quint64(head.size())), '\0'));
+
+    // 切成块，头部是第一块
+    QVector<CoreChunk> chunks;
+    CoreChunk headChunk;
+    headChunk.data = head;
+    headChunk.size = quint64(head.size());
+    chunks.append(headChunk);
+    foreach (const CoreSegment &segment, segments) {
+        if (segment.fileSize == 0)
+            continue;
+        ++m_dumpedMappings;
+        m_dumpedBytes += segment.fileSize;
+        for (quint64 start = 0; start < segment.fileSize; start += chunkSize) {
+            CoreChunk chunk;
+            chunk.address = segment.start + start;
+            chunk.size = qMin(chunkSize, segment.fileSize - start);
+            chunks.append(chunk);
+        }
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        m_errorString = QString("Could not open %1: %2").arg(fileName, file.errorString());
+        return false;
+    }
+
+    // 每批的块数是核数的两倍，读内存和压缩在工作线程里并行，写文件按顺序在这里完成
+    const int batchSize = qMax(1, QThread::idealThreadCount()) * 2;
+    const int level = qBound(0, m_options.compressionLevel, 9);
+    QVector<QByteArray> encoded(batchSize);
+    QVector<int> indexes;
+    for (int first = 0; first < chunks.size(); first += batchSize) {
+        if (m_canceled.loadAcquire()) {
+            m_errorString = QLatin1String("Core dump canceled.");
+            file.remove();
+            return false;
+        }
+
+        const int count = qMin(batchSize, chunks.size() - first);
+        indexes.resize(count);
+        for (int i = 0; i < count; ++i)
+            indexes[i] = i;
+        QtConcurrent::blockingMap(indexes, [&](int i) {
+            const CoreChunk &chunk = chunks.at(first + i);
+            const QByteArray data = chunk.data.isNull() ? readChunk(m_pid, chunk.address, chunk.size, pageSize)
+                                                        : chunk.data;
+            encoded[i] = level > 0 ? gzipChunk(data, level) : data;
+        });
+
+        for (int i = 0; i < count; ++i) {
+            if (encoded.at(i).isEmpty() || file.write(encoded.at(i)) != encoded.at(i).size()) {
+                m_errorString = QString("Could not write %1: %2").arg(fileName, file.errorString());
+                file.remove();
+                return false;
+            }
+            m_fileSize += quint64(encoded.at(i).size());
+            encoded[i].clear();
+        }
+    }
+    return true;
+#else
+    Q_UNUSED(fileName);
+    m_errorString = QLatin1String("Core dumps are not supported on this architecture.");
+    return false;
+#endif
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QAtomicInt>
+#include <QString>
+
+#include <sys/types.h>
+
+struct CoreDumpOptions
+{
+    // 写入内容的映射，其余映射只有程序头（p_filesz 为 0），gdb 从磁盘上的文件读取只读的部分
+    enum Filter {
+        Stacks = 0x1,       // 各线程的栈
+        Heap = 0x2,         // [heap] 和其他可写的匿名映射（glibc 的 arena、mmap 分配的大块内存），总量受 heapLimit 限制
+        FileData = 0x4,     // 可写的文件映射，比如模块的 .data 和 .got，动态链接器的 r_debug 也在这里
+        ReadOnlyFiles = 0x8 // 只读的文件映射，通常不需要
+    };
+
+    int filter = Stacks | Heap | FileData;
+    quint64 heapLimit = quint64(256) * 1024 * 1024; // 字节，0 表示不限制
+    int compressionLevel = 1; // 0 表示不压缩，否则为 gzip 压缩级别
+    int signalNumber = 0;
+    pid_t crashingThread = 0; // 放在第一个，gdb 把它当作当前线程
+
+    // 形如 "stacks,heap,data,files" 的列表
+    static int parseFilter(const QString &text, bool *ok = nullptr);
+};
+
+// 不依赖内核的 core_pattern 和 ulimit，直接从目标进程生成标准的 ELF 核心转储，可以用 gdb 打开。
+// 只写选中的映射，所以几十 GB 的进程也能在几秒内写完。内存按块通过 process_vm_readv() 读取，
+// 各块在全局线程池里并行压缩，每块是一个独立的 gzip 成员，连起来就是一个合法的 .gz 文件，
+// 用 gunzip 解压后交给 gdb。同时在内存中的只有一批块。
+class CoreDumper
+{
+public:
+    explicit CoreDumper(pid_t pid);
+
+    void setOptions(const CoreDumpOptions &options) { m_options = options; }
+
+    // 附加、写出并分离，附加和读取寄存器在调用线程里完成
+    bool dump(const QString &fileName);
+    // 可以在任何线程里调用，dump() 在处理下一批块之前检查
+    void cancel() { m_canceled.storeRelease(1); }
+
+    QString errorString() const { return m_errorString; }
+    int dumpedMappings() const { return m_dumpedMappings; }
+    quint64 dumpedBytes() const { return m_dumpedBytes; } // 未压缩的内存字节数
+    quint64 fileSize() const { return m_fileSize; }
+
+private:
+    const pid_t m_pid;
+    CoreDumpOptions m_options;
+    QAtomicInt m_canceled;
+    QString m_errorString;
+    int m_dumpedMappings = 0;
+    quint64 m_dumpedBytes = 0;
+    quint64 m_fileSize = 0;
+};
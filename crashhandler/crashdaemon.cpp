@@ -0,0 +1,242 @@
+#include "crashdaemon.h"
+#include "crashdaemonprotocol.h"
+#include "crashhandler.h"
+#include "crashtimeline.h"
+
+#include <QFile>
+#include <QSocketNotifier>
+#include <QThread>
+#include <QThreadPool>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+const int listenBacklog = 64;
+const int helloSize = int(sizeof(CrashDaemonHello));
+}
+
+CrashDaemon::CrashDaemon(QObject *parent)
+    : QObject(parent)
+    , m_workerCount(qMax(1, QThread::idealThreadCount()))
+    , m_restartPolicy(QString())
+{
+}
+
+CrashDaemon::~CrashDaemon()
+{
+    // 还没处理完的崩溃进程在连接关闭后会自行退出
+    foreach (Client *client, m_clients) {
+        delete client->handler;
+        close(client->fd);
+        delete client;
+    }
+    if (m_listenFd != -1) {
+        close(m_listenFd);
+        unlink(QFile::encodeName(m_socketPath).constData());
+    }
+}
+
+void CrashDaemon::setWorkerCount(int count)
+{
+    m_workerCount = qMax(1, count);
+    // 原生回溯在全局线程池里运行，每个崩溃占用一个线程
+    QThreadPool::globalInstance()->setMaxThreadCount(qMax(m_workerCount,
+                                                          QThreadPool::globalInstance()->maxThreadCount()));
+}
+
+bool CrashDaemon::listen(const QString &socketPath, QString *errorString)
+{
+    const QByteArray path = QFile::encodeName(socketPath);
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (size_t(path.size()) >= sizeof(address.sun_path)) {
+        *errorString = QString("Socket path %1 is too long.").arg(socketPath);
+        return false;
+    }
+    memcpy(address.sun_path, path.constData(), size_t(path.size()));
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd == -1) {
+        *errorString = QString("socket() failed: %1").arg(QString::fromLocal8Bit(strerror(errno)));
+        return false;
+    }
+
+    // 能连上说明已经有一个守护进程在运行，否则是上次留下的文件
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0) {
+        close(fd);
+        *errorString = QString("Another crash daemon is listening on %1.").arg(socketPath);
+        return false;
+    }
+    unlink(path.constData());
+
+    if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1
+            || ::listen(fd, listenBacklog) == -1) {
+        *errorString = QString("Could not listen on %1: %2").arg(socketPath,
+                       QString::fromLocal8Bit(strerror(errno)));
+        close(fd);
+        return false;
+    }
+    // 用户守护进程只接受自己的应用程序，系统守护进程接受所有用户，重启时切换到连接者的用户
+    chmod(path.constData(), geteuid() == 0 ? 0666 : 0600);
+
+    m_listenFd = fd;
+    m_socketPath = socketPath;
+    m_listenNotifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(m_listenNotifier, &QSocketNotifier::activated, this, [this]() { acceptConnection(); });
+    return true;
+}
+
+void CrashDaemon::acceptConnection()
+{
+    while (true) {
+        const int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (fd == -1) {
+            if (errno == EINTR)
+                continue;
+            return; // EAGAIN，或者出错时等下一次通知
+        }
+
+        // 以内核给出的凭据为准，而不是相信客户端自己发来的 pid
+        ucred credentials;
+        socklen_t length = sizeof(credentials);
+        if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == -1
+                || (geteuid() != 0 && credentials.uid != geteuid())) {
+            close(fd);
+            continue;
+        }
+
+        Client *client = new Client;
+        client->fd = fd;
+        client->pid = credentials.pid;
+        client->uid = credentials.uid;
+        client->gid = credentials.gid;
+        client->notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+        connect(client->notifier, &QSocketNotifier::activated, this, [this, client]() { readClient(client); });
+        m_clients.insert(fd, client);
+    }
+}
+
+void CrashDaemon::readClient(Client *client)
+{
+    char data[4096];
+    while (true) {
+        const ssize_t count = read(client->fd, data, sizeof(data));
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count == -1 && errno == EAGAIN)
+            break;
+        if (count <= 0) {
+            // 应用程序正常退出，或者在发完记录之前就没了
+            removeClient(client);
+            return;
+        }
+        client->buffer.append(data, int(count));
+        if (client->buffer.size() > helloSize + int(sizeof(CrashRecord))) {
+            removeClient(client);
+            return;
+        }
+    }
+
+    if (!client->registered && client->buffer.size() >= helloSize) {
+        CrashDaemonHello hello;
+        memcpy(&hello, client->buffer.constData(), sizeof(hello));
+        client->buffer.remove(0, helloSize);
+        if (hello.magic != CrashDaemonHelloMagic || hello.version != CrashDaemonHelloVersion) {
+            removeClient(client);
+            return;
+        }
+        hello.appName[CrashDaemonAppNameSize - 1] = '\0';
+        client->appName = QString::fromLocal8Bit(hello.appName);
+        client->disableRestart = hello.flags & CrashDaemonDisableRestart;
+        client->registered = true;
+    }
+
+    if (client->registered && client->buffer.size() >= int(sizeof(CrashRecord))) {
+        memcpy(&client->record, client->buffer.constData(), sizeof(CrashRecord));
+        client->recordTime = CrashTimeline::now();
+        client->buffer.clear();
+        // 崩溃之后连接上不会再有数据，只等我们关闭它
+        client->notifier->setEnabled(false);
+        if (client->record.magic != CrashRecordMagic
+                || client->record.version != CrashRecordVersion
+                || client->record.frameCount > CrashRecordMaxFrames) {
+            removeClient(client);
+            return;
+        }
+        m_pendingCrashes.enqueue(client);
+        startPendingCrashes();
+    }
+}
+
+void CrashDaemon::startPendingCrashes()
+{
+    while (m_runningCrashes < m_workerCount && !m_pendingCrashes.isEmpty()) {
+        ++m_runningCrashes;
+        handleCrash(m_pendingCrashes.dequeue());
+    }
+}
+
+void CrashDaemon::handleCrash(Client *client)
+{
+    const QString signalName = QString::fromLocal8Bit(strsignal(client->record.signalNumber));
+    const CrashHandler::RestartCapability restartCap = client->disableRestart
+            ? CrashHandler::DisableRestart : CrashHandler::EnableRestart;
+
+    client->handler = new CrashHandler(client->pid, signalName, client->appName, restartCap,
+                                       CrashHandler::Headless);
+    client->handler->setBacktraceEngine(m_engine);
+    client->handler->setMaximumTier(m_maximumTier);
+    client->handler->setTimeBudget(m_timeBudget);
+    client->handler->setPhaseTimeout(m_phaseTimeout);
+    if (m_coreDumpEnabled)
+        client->handler->setCoreDump(m_coreDumpOptions);
+    client->handler->setSymbolCache(m_symbolCache);
+    client->handler->setSignatureStore(m_signatureStore);
+    client->handler->setSpoolDirectory(m_spoolDirectory);
+    if (m_spoolLimitsSet)
+        client->handler->setSpoolLimits(m_spoolMaximumReports, m_spoolMaximumBytes);
+    client->handler->setCrashRecord(client->record);
+    client->handler->setRestartCredentials(client->uid, client->gid);
+    client->handler->setHelperStartTime(client->recordTime);
+    if (!m_statsFile.isEmpty())
+        client->handler->setStatsFile(m_statsFile);
+    client->handler->setUploadQueue(m_uploadQueue);
+    client->handler->setReportStore(m_reportStore);
+
+    // 重启状态保存在文件里，每次崩溃复制一个策略对象即可
+    RestartPolicy *restartPolicy = new RestartPolicy(m_restartPolicy);
+    restartPolicy->setAppName(client->appName);
+    if (restartCap == CrashHandler::EnableRestart)
+        client->handler->setRestartPolicy(restartPolicy);
+
+    connect(client->handler, &CrashHandler::finished, this, [this, client, restartPolicy]() {
+        delete restartPolicy;
+        crashHandled(client);
+    }, Qt::QueuedConnection);
+    client->handler->run();
+}
+
+void CrashDaemon::crashHandled(Client *client)
+{
+    --m_runningCrashes;
+    // 关闭连接后崩溃的进程从信号处理程序里退出
+    removeClient(client);
+    startPendingCrashes();
+}
+
+void CrashDaemon::removeClient(Client *client)
+{
+    m_clients.remove(client->fd);
+    m_pendingCrashes.removeAll(client);
+    delete client->notifier;
+    close(client->fd);
+    if (client->handler)
+        client->handler->deleteLater();
+    delete client;
+}
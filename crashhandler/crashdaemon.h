@@ -0,0 +1,112 @@
+#pragma once
+
+#include "backtracecollector.h"
+#include "crashrecord.h"
+#include "restartpolicy.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QQueue>
+#include <QString>
+
+#include <sys/types.h>
+
+QT_BEGIN_NAMESPACE
+class QSocketNotifier;
+QT_END_NAMESPACE
+
+class CrashHandler;
+class CrashSignatureStore;
+class ReportStore;
+class SymbolCache;
+class UploadQueue;
+
+// 常驻的崩溃收集守护进程：应用程序通过 CrashHandlerSetup::UseDaemon 注册，
+// 崩溃时只需要往已经建立的连接里写一个记录。符号缓存在各次崩溃之间保持打开，
+// 同时最多有 workerCount 个崩溃在处理，其余的排队。每个崩溃由一个 Headless 模式的 CrashHandler 处理。
+class CrashDaemon : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CrashDaemon(QObject *parent = Q_NULLPTR);
+    ~CrashDaemon();
+
+    void setWorkerCount(int count);
+    int workerCount() const { return m_workerCount; }
+
+    // 以下设置应用到每个崩溃的 CrashHandler 上，都不转移所有权
+    void setBacktraceEngine(BacktraceCollector::Engine engine) { m_engine = engine; }
+    void setMaximumTier(BacktraceCollector::Tier tier) { m_maximumTier = tier; }
+    void setTimeBudget(int msecs) { m_timeBudget = msecs; }
+    void setPhaseTimeout(int msecs) { m_phaseTimeout = msecs; }
+    // 核心转储写到结果目录里
+    void setCoreDump(const CoreDumpOptions &options) { m_coreDumpEnabled = true; m_coreDumpOptions = options; }
+    void setSymbolCache(SymbolCache *cache) { m_symbolCache = cache; }
+    void setSignatureStore(CrashSignatureStore *store) { m_signatureStore = store; }
+    void setSpoolDirectory(const QString &directory) { m_spoolDirectory = directory; }
+    // 不设置时使用 CrashHandler 的默认上限
+    void setSpoolLimits(int maximumReports, qint64 maximumBytes)
+    {
+        m_spoolLimitsSet = true;
+        m_spoolMaximumReports = maximumReports;
+        m_spoolMaximumBytes = maximumBytes;
+    }
+    void setStatsFile(const QString &fileName) { m_statsFile = fileName; }
+    void setUploadQueue(UploadQueue *queue) { m_uploadQueue = queue; }
+    void setReportStore(ReportStore *store) { m_reportStore = store; }
+    // 阈值和退避设置的模板，应用程序名由注册的客户端决定
+    void setRestartPolicy(const RestartPolicy &policy) { m_restartPolicy = policy; }
+
+    bool listen(const QString &socketPath, QString *errorString);
+
+private:
+    struct Client
+    {
+        int fd = -1;
+        pid_t pid = 0;
+        uid_t uid = 0;
+        gid_t gid = 0;
+        QSocketNotifier *notifier = nullptr;
+        QByteArray buffer;
+        bool registered = false;
+        QString appName;
+        bool disableRestart = false;
+        CrashRecord record;
+        quint64 recordTime = 0; // 收到崩溃记录的时间，CLOCK_MONOTONIC
+        CrashHandler *handler = nullptr;
+    };
+
+    void acceptConnection();
+    void readClient(Client *client);
+    void startPendingCrashes();
+    void handleCrash(Client *client);
+    void crashHandled(Client *client);
+    void removeClient(Client *client);
+
+    int m_listenFd = -1;
+    QString m_socketPath;
+    QSocketNotifier *m_listenNotifier = nullptr;
+    QHash<int, Client *> m_clients;
+    QQueue<Client *> m_pendingCrashes;
+    int m_runningCrashes = 0;
+    int m_workerCount;
+
+    BacktraceCollector::Engine m_engine = BacktraceCollector::NativeEngine;
+    BacktraceCollector::Tier m_maximumTier = BacktraceCollector::FullTier;
+    int m_timeBudget = BacktraceCollector::defaultTimeBudget();
+    int m_phaseTimeout = BacktraceCollector::defaultPhaseTimeout();
+    bool m_coreDumpEnabled = false;
+    CoreDumpOptions m_coreDumpOptions;
+    SymbolCache *m_symbolCache = nullptr;
+    CrashSignatureStore *m_signatureStore = nullptr;
+    QString m_spoolDirectory;
+    bool m_spoolLimitsSet = false;
+    int m_spoolMaximumReports = 0;
+    qint64 m_spoolMaximumBytes = 0;
+    QString m_statsFile;
+    UploadQueue *m_uploadQueue = nullptr;
+    ReportStore *m_reportStore = nullptr;
+    RestartPolicy m_restartPolicy;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+#include <stdint.h>
+#include <unistd.h>
+
+// 应用程序与 crashhandler --daemon 之间的协议。
+// 应用程序启动时连接守护进程的 Unix socket，发送一个 CrashDaemonHello 后保持连接。
+// 崩溃时信号处理程序在同一个连接上发送 CrashRecord（见 crashrecord.h），然后阻塞到守护进程关闭连接。
+// 应用程序正常退出时连接被关闭，守护进程直接丢弃这个客户端。
+
+enum {
+    CrashDaemonHelloMagic = 0x43524844, // "CRHD"
+    CrashDaemonHelloVersion = 1,
+    CrashDaemonAppNameSize = 64
+};
+
+enum CrashDaemonHelloFlag {
+    CrashDaemonDisableRestart = 0x1
+};
+
+struct CrashDaemonHello
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t reserved;
+    char appName[CrashDaemonAppNameSize]; // 以 '\0' 结尾
+};
+
+// CRASHHANDLER_SOCKET 优先，否则放在 $XDG_RUNTIME_DIR 下，没有时退回 /tmp
+inline QString defaultCrashDaemonSocketPath()
+{
+    const QByteArray socketPath = qgetenv("CRASHHANDLER_SOCKET");
+    if (!socketPath.isEmpty())
+        return QFile::decodeName(socketPath);
+    const QByteArray runtimeDir = qgetenv("XDG_RUNTIME_DIR");
+    if (!runtimeDir.isEmpty())
+        return QFile::decodeName(runtimeDir) + QLatin1String("/crashhandler.sock");
+    return QString("/tmp/crashhandler-%1.sock").arg(getuid());
+}
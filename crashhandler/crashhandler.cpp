@@ -1,30 +1,52 @@
 #include "crashhandler.h"
 #include "crashhandlerdialog.h"
 #include "backtracecollector.h"
+#include "breadcrumbreader.h"
+#include "crashrecord.h"
+#include "crashsignature.h"
+#include "crashtimeline.h"
+#include "descriptorhandoff.h"
+#include "faultinfo.h"
+#include "outputspool.h"
+#include "processmaps.h"
+#include "reportstore.h"
+#include "restartpolicy.h"
+#include "uploadqueue.h"
 #include "utils.h"
 
 #include <QApplication>
+#include <QDateTime>
 #include <QDebug>
 #include <QDesktopServices>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QRegExp>
+#include <QStandardPaths>
 #include <QTextStream>
 #include <QUrl>
 #include <QVector>
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <pwd.h>
 #include <unistd.h>
 
+#include <sys/resource.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
 namespace {
 const QString fileDistroInformation = "/etc/lsb-release";
 const QString fileKernelVersion = "/proc/version";
+const int maxReportedBreadcrumbs = 256; // 所有线程合计
+const int defaultSpoolMaximumReports = 1000;
+const qint64 defaultSpoolMaximumBytes = qint64(1024) * 1024 * 1024;
 }
 
 static QString collectLinuxDistributionInfo()
@@ -37,6 +59,22 @@ static QString collectKernelVersionInfo()
     return QString::fromLatin1(fileContents(fileKernelVersion));
 }
 
+// 把信号处理程序在进程内回溯到的原始 PC 格式化为与 gdb 相似的文本
+static QString formatInProcessBacktrace(const ProcessMaps &maps, const QVector<quint64> &frames)
+{
+    QString text = QString("Crashing thread (in-process unwind, %1 frames):\n").arg(frames.size());
+    for (int i = 0; i < frames.size(); ++i) {
+        const quint64 pc = frames.at(i);
+        // 除了第 0 帧以外都是返回地址，减一后才落在调用指令内
+        const QString location = maps.describeAddress(i == 0 ? pc : pc - 1);
+        text += QString("#%1 0x%2").arg(i, -2).arg(pc, 16, 16, QLatin1Char('0'));
+        if (!location.isEmpty())
+            text += QLatin1String(" in ") + location;
+        text += QLatin1Char('\n');
+    }
+    return text;
+}
+
 // 方便与 exec() 函数族交互的类
 class CExecList : public QVector<char *>
 {
@@ -61,44 +99,112 @@ public:
     CrashHandlerPrivate(pid_t pid,
                         const QString &signalName,
                         const QString &appName,
+                        CrashHandler::UiMode uiMode,
                         CrashHandler *crashHandler)
         : pid(pid)
-        , dialog(crashHandler, signalName, appName) {}
+        , signalName(signalName)
+        , appName(appName)
+    {
+        // 对话框显示临时文件里的内容，Headless 模式在 run() 中打开结果文件
+        if (uiMode == CrashHandler::DialogUi) {
+            debugInfo.open();
+            dialog.reset(new CrashHandlerDialog(crashHandler, signalName, appName, &debugInfo));
+        }
+    }
 
     const pid_t pid;
+    const QString signalName;
+    const QString appName;
     const QString creatorInPath; // 备份 debugger
 
     BacktraceCollector backtraceCollector;
-    CrashHandlerDialog dialog;
+    OutputSpool debugInfo; // 显示或写出的文本结果，只在内存中缓冲一小块
+    QScopedPointer<CrashHandlerDialog> dialog; // Headless 模式下为空
+
+    bool restartEnabled = true;
+    QString spoolDirectory;
+    QString baseName; // 应用程序名、进程号和时间，结果文件和上传队列里的文件都用它
+    QString spoolBaseName;
+    int spoolMaximumReports = defaultSpoolMaximumReports;
+    qint64 spoolMaximumBytes = defaultSpoolMaximumBytes;
+    QString reportFile;
 
     QStringList restartAppCommandLine;
     QStringList restartAppEnvironment;
+    QString restartAppWorkingDirectory; // 相对的 argv[0] 和文件参数都相对于它
+    QVector<quint64> crashFrames;
+    int crashSignal = 0;
+    int breadcrumbFd = -1;
+    CrashRecord crashRecord;
+    bool hasCrashRecord = false;
+    FaultInfo fault;
+    DescriptorHandoff descriptorHandoff;
+    bool restarted = false;
+    bool hasRestartCredentials = false;
+    uid_t restartUid = 0;
+    gid_t restartGid = 0;
+    bool coreDumpEnabled = false;
+    CoreDumpOptions coreDumpOptions;
+    QString coreFile;
+    CrashSignatureStore *signatureStore = nullptr;
+    RestartPolicy *restartPolicy = nullptr;
+    RestartPolicy::Decision restartDecision;
+    UploadQueue *uploadQueue = nullptr;
+    bool uploadQueued = false;
+    ReportStore *reportStore = nullptr;
+    bool reportIndexed = false;
+    RawProperties reportMetadata;
+    RawProperties reportSystemInfo;
+    CrashTimeline timeline;
+    QString statsFile;
+    bool timingsWritten = false;
 };
 
 CrashHandler::CrashHandler(pid_t pid,
                            const QString &signalName,
                            const QString &appName,
                            RestartCapability restartCap,
+                           UiMode uiMode,
                            QObject *parent)
     : QObject(parent)
-    , d_ptr(new CrashHandlerPrivate(pid, signalName, appName, this))
+    , d_ptr(new CrashHandlerPrivate(pid, signalName, appName, uiMode, this))
 {
     Q_D(CrashHandler);
 
     connect(&d->backtraceCollector, &BacktraceCollector::error, this, &CrashHandler::onError);
     connect(&d->backtraceCollector, &BacktraceCollector::backtraceChunk, this, &CrashHandler::onBacktraceChunk);
-    connect(&d->backtraceCollector, &BacktraceCollector::backtrace, this, &CrashHandler::onBacktraceFinished);
+    connect(&d->backtraceCollector, &BacktraceCollector::backtraceFinished, this, &CrashHandler::onBacktraceFinished);
+    connect(&d->backtraceCollector, &BacktraceCollector::tierFinished, this, &CrashHandler::onTierFinished);
+    d->backtraceCollector.setTimeline(&d->timeline);
+
+    if (!d->dialog) {
+        // 与对话框的标题和版本信息对应
+        appendDebugInfo(tr("%1 has closed unexpectedly (Signal \"%2\")\n").arg(appName, signalName));
+        appendDebugInfo(tr("%1, based on Qt %2 (%3 bit)\n")
+                        .arg(appName, QLatin1String(QT_VERSION_STR), QString::number(QSysInfo::WordSize)));
+    }
 
-    d->dialog.appendDebugInfo(collectKernelVersionInfo());
-    d->dialog.appendDebugInfo(collectLinuxDistributionInfo());
+    const QString kernelVersionInfo = collectKernelVersionInfo();
+    const QString linuxDistributionInfo = collectLinuxDistributionInfo();
+    appendDebugInfo(kernelVersionInfo);
+    appendDebugInfo(linuxDistributionInfo);
+
+    d->reportMetadata.append(qMakePair(QString("signal"), signalName));
+    d->reportMetadata.append(qMakePair(QString("application"), appName));
+    d->reportSystemInfo.append(qMakePair(QString("kernel"), kernelVersionInfo));
+    d->reportSystemInfo.append(qMakePair(QString("distribution"), linuxDistributionInfo));
 
     if (restartCap == DisableRestart || !collectRestartAppData()) {
-        d->dialog.disableRestartAppCheckBox();
-        if (d->creatorInPath.isEmpty())
-            d->dialog.disableDebugAppButton();
+        d->restartEnabled = false;
+        if (d->dialog) {
+            d->dialog->disableRestartAppCheckBox();
+            if (d->creatorInPath.isEmpty())
+                d->dialog->disableDebugAppButton();
+        }
     }
 
-    d->dialog.show();
+    if (d->dialog)
+        d->dialog->show();
 }
 
 CrashHandler::~CrashHandler()
@@ -106,48 +212,511 @@ CrashHandler::~CrashHandler()
 
 }
 
-void CrashHandler::run()
+void CrashHandler::setCrashRecord(const CrashRecord &record)
 {
     Q_D(CrashHandler);
 
-    d->backtraceCollector.run(d->pid);
+    d->crashRecord = record;
+    d->hasCrashRecord = true;
+    d->backtraceCollector.setCrashingThread(record.faultingThread);
+    // 崩溃的进程还在等 helper，这时它的描述符一定还在
+    if (!d->descriptorHandoff.take(d->pid, record))
+        qWarning("%s", qPrintable(d->descriptorHandoff.errorString()));
+    d->crashSignal = record.signalNumber;
+    // signal 是本地化的文本，查询和分组用与语言无关的缩写
+    d->reportMetadata.append(qMakePair(QString("signo"), ReportStore::signalAbbreviation(record.signalNumber)));
+    d->breadcrumbFd = record.breadcrumbFd;
+    d->crashFrames.clear();
+    for (uint i = 0; i < record.frameCount; ++i)
+        d->crashFrames.append(record.frames[i]);
+    if (record.signalNanoseconds != 0)
+        d->timeline.mark(CrashTimeline::SignalPhase, record.signalNanoseconds);
+    if (record.handoverNanoseconds != 0)
+        d->timeline.mark(CrashTimeline::HandoverPhase, record.handoverNanoseconds);
 }
 
-void CrashHandler::onError(const QString &errorMessage)
+void CrashHandler::setHelperStartTime(quint64 nanoseconds)
 {
     Q_D(CrashHandler);
 
-    d->dialog.setToFinalState();
+    d->timeline.mark(CrashTimeline::HelperStartPhase, nanoseconds);
+}
+
+void CrashHandler::setStatsFile(const QString &fileName)
+{
+    Q_D(CrashHandler);
+
+    d->statsFile = fileName;
+}
+
+void CrashHandler::setBacktraceEngine(BacktraceCollector::Engine engine)
+{
+    Q_D(CrashHandler);
+
+    d->backtraceCollector.setEngine(engine);
+}
+
+void CrashHandler::setMaximumTier(BacktraceCollector::Tier tier)
+{
+    Q_D(CrashHandler);
+
+    d->backtraceCollector.setMaximumTier(tier);
+}
+
+void CrashHandler::setTimeBudget(int msecs)
+{
+    Q_D(CrashHandler);
+
+    d->backtraceCollector.setTimeBudget(msecs);
+}
+
+void CrashHandler::setPhaseTimeout(int msecs)
+{
+    Q_D(CrashHandler);
+
+    d->backtraceCollector.setPhaseTimeout(msecs);
+}
+
+void CrashHandler::setCoreDump(const CoreDumpOptions &options, const QString &fileName)
+{
+    Q_D(CrashHandler);
+
+    d->coreDumpEnabled = true;
+    d->coreDumpOptions = options;
+    d->coreFile = fileName;
+}
+
+void CrashHandler::setSymbolCache(SymbolCache *cache)
+{
+    Q_D(CrashHandler);
+
+    d->backtraceCollector.setSymbolCache(cache);
+}
+
+void CrashHandler::setRawCaptureFile(const QString &fileName)
+{
+    Q_D(CrashHandler);
+
+    d->backtraceCollector.setRawCaptureFile(fileName);
+}
 
+void CrashHandler::setSignatureStore(CrashSignatureStore *store)
+{
+    Q_D(CrashHandler);
+
+    d->signatureStore = store;
+}
+
+void CrashHandler::setRestartPolicy(RestartPolicy *policy)
+{
+    Q_D(CrashHandler);
+
+    d->restartPolicy = policy;
+}
+
+void CrashHandler::setUploadQueue(UploadQueue *queue)
+{
+    Q_D(CrashHandler);
+
+    d->uploadQueue = queue;
+}
+
+void CrashHandler::setRestartCredentials(uid_t uid, gid_t gid)
+{
+    Q_D(CrashHandler);
+
+    d->hasRestartCredentials = true;
+    d->restartUid = uid;
+    d->restartGid = gid;
+}
+
+void CrashHandler::setReportStore(ReportStore *store)
+{
+    Q_D(CrashHandler);
+
+    d->reportStore = store;
+}
+
+void CrashHandler::setReportFile(const QString &fileName)
+{
+    Q_D(CrashHandler);
+
+    d->reportFile = fileName;
+    d->backtraceCollector.setReportFile(fileName);
+}
+
+void CrashHandler::setSpoolDirectory(const QString &directory)
+{
+    Q_D(CrashHandler);
+
+    d->spoolDirectory = directory;
+}
+
+void CrashHandler::setSpoolLimits(int maximumReports, qint64 maximumBytes)
+{
+    Q_D(CrashHandler);
+
+    d->spoolMaximumReports = qMax(0, maximumReports);
+    d->spoolMaximumBytes = qMax(qint64(0), maximumBytes);
+}
+
+QString CrashHandler::defaultSpoolDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
+            + QLatin1String("/crashhandler/spool");
+}
+
+void CrashHandler::run()
+{
+    Q_D(CrashHandler);
+
+    bool fullCollection = true;
+
+    // 文本结果、报告和上传队列里的文件使用相同的文件名前缀
+    QString name = d->appName;
+    name.replace(QRegExp("[^A-Za-z0-9._-]"), QString("_"));
+    const QDateTime now = QDateTime::currentDateTime();
+    d->baseName = QString("%1-%2-%3").arg(name, QString::number(d->pid), now.toString("yyyyMMdd-hhmmss"));
+    // 报告索引按这个时间查询，报告文件的修改时间会被 writeTimings() 改变
+    d->reportMetadata.append(qMakePair(QString("time"), QString::number(now.toMSecsSinceEpoch())));
+
+    if (!d->dialog) {
+        const QString directory = d->spoolDirectory.isEmpty() ? defaultSpoolDirectory() : d->spoolDirectory;
+        d->spoolBaseName = directory + QLatin1Char('/') + d->baseName;
+        if (QDir().mkpath(directory)) {
+            if (d->reportFile.isEmpty())
+                setReportFile(d->spoolBaseName + QLatin1String(".chreport"));
+            if (!d->debugInfo.open(d->spoolBaseName + QLatin1String(".txt"))) {
+                QTextStream(stderr) << "Could not write " << d->debugInfo.fileName() << ": "
+                                    << d->debugInfo.errorString() << "\n";
+            }
+        }
+    }
+
+    // 崩溃循环：先决定重启方式，循环中的重复崩溃不值得每次都完整收集
+    if (d->restartPolicy) {
+        d->restartDecision = d->restartPolicy->recordCrash();
+        d->reportMetadata.append(qMakePair(QString("recentCrashes"),
+                                           QString::number(d->restartDecision.recentCrashes)));
+        if (d->restartDecision.state != RestartPolicy::Normal) {
+            d->reportMetadata.append(qMakePair(QString("crashLoop"),
+                                               QString::number(d->restartDecision.loopLevel)));
+            appendDebugInfo(QString("\n%1\n").arg(d->restartDecision.toString()));
+        }
+        if (d->dialog) {
+            if (!d->restartDecision.restartAllowed())
+                d->dialog->disableRestartAppCheckBox();
+            else if (d->restartDecision.restartDelay > 0)
+                d->dialog->setRestartDelay(d->restartDecision.restartDelay);
+        }
+        fullCollection = d->restartDecision.fullCollection;
+    }
+
+    // 热重启：监听 socket 已经在手里，不必等收集完，新实例马上接手排队的连接。
+    // 有对话框时仍然由用户决定，这期间连接在监听队列里等待
+    if (!d->dialog && d->restartEnabled && !d->descriptorHandoff.isEmpty()) {
+        d->reportMetadata.append(qMakePair(QString("keptDescriptors"),
+                                           QString::number(d->descriptorHandoff.count())));
+        restartApplication();
+    }
+
+    // 面包屑是崩溃之前发生的事情，按时间顺序放在回溯前面。标签要从进程里读，必须在进程退出之前
+    if (d->breadcrumbFd != -1) {
+        BreadcrumbReader breadcrumbs;
+        if (breadcrumbs.load(d->pid, d->breadcrumbFd)) {
+            const QString text = breadcrumbs.format(maxReportedBreadcrumbs);
+            appendDebugInfo(text);
+            d->reportMetadata.append(qMakePair(QString("breadcrumbs"), text));
+        } else {
+            appendDebugInfo(breadcrumbs.errorString() + QLatin1Char('\n'));
+        }
+    }
+
+    // 出错的上下文和进程内回溯的结果马上就有，先显示出来，不必等 gdb
+    ProcessMaps maps;
+    if (d->hasCrashRecord || !d->crashFrames.isEmpty())
+        maps.load(d->pid);
+    if (d->hasCrashRecord) {
+        d->fault = FaultInfo::fromRecord(d->crashRecord, maps);
+        appendDebugInfo(d->fault.toString());
+        d->reportMetadata.append(qMakePair(QString("faultKind"), FaultInfo::kindName(d->fault.kind)));
+        d->reportMetadata.append(qMakePair(QString("faultingThread"), QString::number(d->fault.thread)));
+        d->reportMetadata.append(qMakePair(QString("signalCode"), d->fault.signalCodeName()));
+        d->reportMetadata.append(qMakePair(QString("faultAddress"),
+                                           QString("0x%1").arg(d->fault.faultAddress, 0, 16)));
+    }
+    if (!d->crashFrames.isEmpty()) {
+        appendDebugInfo(formatInProcessBacktrace(maps, d->crashFrames));
+
+        const QByteArray signature = CrashSignature::compute(d->crashSignal, d->crashFrames, maps);
+        d->reportMetadata.append(qMakePair(QString("signature"), QString::fromLatin1(signature)));
+
+        if (d->signatureStore) {
+            const CrashSignatureStore::Occurrence occurrence =
+                    d->signatureStore->record(signature, d->appName, d->pid);
+            if (!occurrence.fullCollection) {
+                // 已知的崩溃：只留下发生记录，跳过完整收集
+                appendDebugInfo(tr("\nKnown crash %1, seen %2 times on this machine.\n"
+                                             "Full backtrace collection is skipped; it runs again every %3 occurrences.\n")
+                                          .arg(QString::fromLatin1(signature))
+                                          .arg(occurrence.hitCount)
+                                          .arg(d->signatureStore->recollectInterval()));
+                finish();
+                return;
+            }
+            appendDebugInfo(tr("\nCrash signature %1, seen %2 times on this machine.\n")
+                                      .arg(QString::fromLatin1(signature))
+                                      .arg(occurrence.hitCount));
+        }
+    }
+
+    if (!fullCollection) {
+        appendDebugInfo(tr("\nFull backtrace collection is skipped while the application is crash looping.\n"));
+        finish();
+        return;
+    }
+
+    d->backtraceCollector.setReportInfo(d->reportMetadata, d->reportSystemInfo);
+    if (!d->crashFrames.isEmpty())
+        d->backtraceCollector.setCrashAddress(d->crashFrames.first());
+    if (d->coreDumpEnabled) {
+        QString coreFile = d->coreFile;
+        if (coreFile.isEmpty() && !d->spoolBaseName.isEmpty()) {
+            coreFile = d->spoolBaseName + (d->coreDumpOptions.compressionLevel > 0
+                                           ? QLatin1String(".core.gz") : QLatin1String(".core"));
+        }
+        CoreDumpOptions options = d->coreDumpOptions;
+        options.signalNumber = d->crashSignal;
+        if (!coreFile.isEmpty())
+            d->backtraceCollector.setCoreDump(coreFile, options);
+    }
+    d->backtraceCollector.run(d->pid);
+}
+
+void CrashHandler::onError(const QString &errorMessage)
+{
     QTextStream(stderr) << errorMessage;
     const QString text = QLatin1String("A problem occurred providing the backtrace. "
                                        "Please make sure to have the debugger \"gdb\" installed.\n");
-    d->dialog.appendDebugInfo(text);
-    d->dialog.appendDebugInfo(errorMessage);
+    appendDebugInfo(text);
+    appendDebugInfo(errorMessage);
+    finish();
 }
 
 void CrashHandler::onBacktraceChunk(const QString &chunk)
 {
     Q_D(CrashHandler);
 
-    d->dialog.appendDebugInfo(chunk);
+    // 回溯输出本身带换行，按原样拼接
+    d->debugInfo.append(chunk);
+    if (d->dialog)
+        d->dialog->debugInfoChanged();
+}
+
+void CrashHandler::onTierFinished(int tier, int maximumTier)
+{
+    Q_D(CrashHandler);
+
+    if (d->dialog) {
+        d->dialog->setTierAvailable(tier, maximumTier,
+                                    BacktraceCollector::tierDescription(BacktraceCollector::Tier(tier)));
+    }
 }
 
-void CrashHandler::onBacktraceFinished(const QString &backtrace)
+void CrashHandler::onBacktraceFinished()
 {
     Q_D(CrashHandler);
 
-    d->dialog.setToFinalState();
+    finish();
+    if (!d->dialog)
+        return;
 
-    // 选择相关线程的第一行
+    // 选择出错线程的第一行。gdb 和原生回溯的线程标题里都有 LWP，形式分别是 "(LWP 123)" 和 "(LWP 123 "
+    if (d->fault.isValid()) {
+        if (d->dialog->selectLineWithContents(QString("(LWP %1)").arg(d->fault.thread))
+                || d->dialog->selectLineWithContents(QString("(LWP %1 ").arg(d->fault.thread))) {
+            return;
+        }
+    }
+
+    // 没有崩溃记录时从 gdb 的输出里找当前线程，回溯可能很大，从文件中逐行查找
+    d->debugInfo.flush();
+    QFile file(d->debugInfo.fileName());
+    if (!file.open(QIODevice::ReadOnly))
+        return;
     QRegExp rx("\\[Current thread is (\\d+)");
-    const int pos = rx.indexIn(backtrace);
+    int pos = -1;
+    while (pos == -1 && !file.atEnd())
+        pos = rx.indexIn(QString::fromUtf8(file.readLine()));
     if (pos == -1)
         return;
 
     const QString threadNumber = rx.cap(1);
     const QString textToSelect = QString("Thread %1").arg(threadNumber);
-    d->dialog.selectLineWithContents(textToSelect);
+    d->dialog->selectLineWithContents(textToSelect);
+}
+
+void CrashHandler::appendDebugInfo(const QString &chunk)
+{
+    Q_D(CrashHandler);
+
+    // 与 QTextEdit::append 一样，每段另起一行
+    d->debugInfo.appendParagraph(chunk);
+    if (d->dialog)
+        d->dialog->debugInfoChanged();
+}
+
+void CrashHandler::finish()
+{
+    Q_D(CrashHandler);
+
+    if (d->dialog) {
+        d->dialog->setToFinalState();
+        d->timeline.mark(CrashTimeline::FinalStatePhase);
+        return;
+    }
+
+    // 没有用户可以询问：写出结果，按重启策略决定是否重启
+    writeSpoolFile();
+    d->timeline.mark(CrashTimeline::FinalStatePhase);
+    if (d->restartEnabled)
+        restartApplication();
+    writeTimings();
+    indexReport();
+    queueUpload();
+    // 报告索引在 crashquery 下一次增量更新时作废删掉的报告
+    trimSpool();
+    emit finished();
+}
+
+void CrashHandler::queueUpload()
+{
+    Q_D(CrashHandler);
+
+    if (!d->uploadQueue || d->uploadQueued || d->baseName.isEmpty())
+        return;
+    d->uploadQueued = true;
+
+    // 报告已经由 writeTimings() 补全，文本结果在对话框模式下是一个临时文件
+    QString errorString;
+    if (!d->reportFile.isEmpty() && QFile::exists(d->reportFile)
+            && !d->uploadQueue->enqueue(d->reportFile, d->baseName + QLatin1String(".chreport"), &errorString)) {
+        QTextStream(stderr) << errorString << "\n";
+    }
+    if (d->debugInfo.isOpen() && d->debugInfo.flush()
+            && !d->uploadQueue->enqueue(d->debugInfo.fileName(), d->baseName + QLatin1String(".txt"), &errorString)) {
+        QTextStream(stderr) << errorString << "\n";
+    }
+}
+
+void CrashHandler::trimSpool()
+{
+    Q_D(CrashHandler);
+
+    if (d->spoolBaseName.isEmpty() || (d->spoolMaximumReports == 0 && d->spoolMaximumBytes == 0))
+        return;
+
+    static const QStringList suffixes({ ".chreport", ".txt", ".core.gz", ".core" });
+    const QFileInfoList entries = QFileInfo(d->spoolBaseName).dir().entryInfoList(
+                QStringList({ "*.chreport", "*.txt", "*.core.gz", "*.core" }), QDir::Files, QDir::Time | QDir::Reversed);
+    qint64 totalBytes = 0;
+    int reports = 0;
+    foreach (const QFileInfo &entry, entries) {
+        totalBytes += entry.size();
+        if (entry.fileName().endsWith(QLatin1String(".chreport")))
+            ++reports;
+    }
+    // 这次崩溃的文件不删
+    const QString current = d->spoolBaseName + QLatin1Char('.');
+    auto overBytes = [&]() { return d->spoolMaximumBytes > 0 && totalBytes > d->spoolMaximumBytes; };
+    auto overReports = [&]() { return d->spoolMaximumReports > 0 && reports > d->spoolMaximumReports; };
+
+    for (int i = 0; i < entries.size() && overBytes(); ++i) {
+        const QFileInfo &entry = entries.at(i);
+        const bool isCore = entry.fileName().endsWith(QLatin1String(".core"))
+                || entry.fileName().endsWith(QLatin1String(".core.gz"));
+        if (isCore && !entry.filePath().startsWith(current) && QFile::remove(entry.filePath()))
+            totalBytes -= entry.size();
+    }
+    for (int i = 0; i < entries.size() && (overBytes() || overReports()); ++i) {
+        const QString path = entries.at(i).filePath();
+        if (path.startsWith(current) || !QFile::exists(path))
+            continue;
+        QString base = path;
+        foreach (const QString &suffix, suffixes) {
+            if (base.endsWith(suffix)) {
+                base.chop(suffix.size());
+                break;
+            }
+        }
+        foreach (const QString &suffix, suffixes) {
+            const QFileInfo file(base + suffix);
+            const qint64 size = file.size();
+            if (file.exists() && QFile::remove(file.filePath())) {
+                totalBytes -= size;
+                if (suffix == QLatin1String(".chreport"))
+                    --reports;
+            }
+        }
+    }
+}
+
+void CrashHandler::indexReport()
+{
+    Q_D(CrashHandler);
+
+    if (!d->reportStore || d->reportIndexed || d->reportFile.isEmpty() || !QFile::exists(d->reportFile))
+        return;
+    d->reportIndexed = true;
+
+    QString errorString;
+    if (!d->reportStore->add(d->reportFile, &errorString))
+        QTextStream(stderr) << errorString << "\n";
+}
+
+void CrashHandler::writeTimings()
+{
+    Q_D(CrashHandler);
+
+    if (d->timingsWritten)
+        return;
+    d->timingsWritten = true;
+
+    d->backtraceCollector.updateReport();
+    if (d->statsFile.isEmpty())
+        return;
+
+    RawProperties context;
+    context.append(qMakePair(QString("application"), d->appName));
+    context.append(qMakePair(QString("pid"), QString::number(d->pid)));
+    context.append(qMakePair(QString("signal"), d->signalName));
+    if (!d->reportFile.isEmpty())
+        context.append(qMakePair(QString("report"), d->reportFile));
+    // 守护进程中是整个守护进程的峰值
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        context.append(qMakePair(QString("helperPeakRssKb"), QString::number(usage.ru_maxrss)));
+
+    // 每次崩溃一行，守护进程中的多个崩溃可以共用一个文件
+    QFile file(d->statsFile);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)
+            || file.write(d->timeline.toJson(context) + '\n') == -1) {
+        QTextStream(stderr) << "Could not write " << d->statsFile << ": " << file.errorString() << "\n";
+    }
+}
+
+void CrashHandler::writeSpoolFile()
+{
+    Q_D(CrashHandler);
+
+    // 文本结果一直在往文件里写，这里只写出最后的缓冲区
+    if (!d->debugInfo.isOpen())
+        return;
+    QTextStream err(stderr);
+    if (d->debugInfo.flush())
+        err << "Crash information written to " << d->debugInfo.fileName() << "\n";
+    else
+        err << "Could not write " << d->debugInfo.fileName() << ": " << d->debugInfo.errorString() << "\n";
 }
 
 void CrashHandler::openBugTracker()
@@ -187,38 +756,80 @@ bool CrashHandler::collectRestartAppData()
     foreach (const QByteArray &item, environment)
         d->restartAppEnvironment.append(QString::fromLatin1(item));
 
+    // 守护进程的工作目录与崩溃的进程无关，重启时要回到崩溃的进程的工作目录
+    const QByteArray procCwdFileName = QFile::encodeName(procDir + "/cwd");
+    QByteArray workingDirectory(PATH_MAX, Qt::Uninitialized);
+    const ssize_t length = readlink(procCwdFileName.constData(), workingDirectory.data(), size_t(workingDirectory.size()));
+    if (length <= 0 || length >= workingDirectory.size()) {
+        qWarning("%s: Could not read '%s'.\n", Q_FUNC_INFO, procCwdFileName.constData());
+        return false;
+    }
+    workingDirectory.truncate(int(length));
+    d->restartAppWorkingDirectory = QFile::decodeName(workingDirectory);
+
     return true;
 }
 
-void CrashHandler::runCommand(QStringList commandLine, QStringList environment, WaitMode waitMode)
+void CrashHandler::runCommand(QStringList commandLine, QStringList environment, WaitMode waitMode,
+                              int delaySeconds, const QVector<int> &inheritedDescriptors, const RunAs &runAs,
+                              const QString &workingDirectory)
 {
     // TODO: QTBUG-2284 QProcess::startDetached 不支持为新进程设置环境。
     // 如果解决了这个 Bug，就可以正常使用它了。因此，这里先使用 fork-exec。
 
+    // 守护进程是多线程的，fork() 之后子进程里只能用异步信号安全的函数，不能分配内存，也不能用 stdio，
+    // 所以参数、环境和工作目录都在 fork() 之前准备好
+    CExecList argv(commandLine);
+    CExecList envp(environment);
+    const QByteArray workingDirectoryPath = QFile::encodeName(workingDirectory);
+    qDebug("Running\n");
+    for (int i = 0; argv[i]; ++i)
+        qDebug("   %s", argv[i]);
+    if (!environment.isEmpty()) {
+        qDebug("\nwith environment:\n");
+        for (int i = 0; envp[i]; ++i)
+            qDebug("   %s", envp[i]);
+    }
+
     pid_t pid = fork();
     switch (pid) {
     case -1: // error
         qFatal("%s: fork() failed.", Q_FUNC_INFO);
         break;
     case 0: { // child
-        CExecList argv(commandLine);
-        CExecList envp(environment);
-        qDebug("Running\n");
-        for (int i = 0; argv[i]; ++i)
-            qDebug("   %s", argv[i]);
-        if (!environment.isEmpty()) {
-            qDebug("\nwith environment:\n");
-            for (int i = 0; envp[i]; ++i)
-                qDebug("   %s", envp[i]);
+        // 不等待的命令再 fork 一次，中间进程马上退出并由下面的 waitpid() 回收，
+        // 命令本身交给 init，常驻的守护进程不会为每次重启留下一个僵尸进程
+        if (waitMode == DontWaitForExit) {
+            const pid_t grandchild = fork();
+            if (grandchild != 0)
+                _exit(grandchild == -1 ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+
+        // 先放弃 root，再以目标用户的身份进入工作目录，任何一步失败时宁可不启动
+        if (runAs.dropPrivileges
+                && (setgroups(size_t(runAs.groups.size()), runAs.groups.constData()) == -1
+                    || setgid(runAs.gid) == -1 || setuid(runAs.uid) == -1)) {
+            _exit(EXIT_FAILURE);
         }
+        if (!workingDirectoryPath.isEmpty() && chdir(workingDirectoryPath.constData()) == -1)
+            _exit(EXIT_FAILURE);
 
         // 标准管道必须是打开的，否则一旦使用了这些标准管道，应用程序就会收到一个 SIGPIPE。
-        if (freopen("/dev/null", "r", stdin) == 0)
-            qFatal("%s: freopen() failed for stdin: %s.\n", Q_FUNC_INFO, strerror(errno));
-        if (freopen("/dev/null", "w", stdout) == 0)
-            qFatal("%s: freopen() failed for stdout: %s.\n", Q_FUNC_INFO, strerror(errno));
-        if (freopen("/dev/null", "w", stderr) == 0)
-            qFatal("%s: freopen() failed for stderr: %s.\n.", Q_FUNC_INFO, strerror(errno));
+        const int nullFd = open("/dev/null", O_RDWR);
+        if (nullFd == -1 || dup2(nullFd, STDIN_FILENO) == -1 || dup2(nullFd, STDOUT_FILENO) == -1
+                || dup2(nullFd, STDERR_FILENO) == -1) {
+            _exit(EXIT_FAILURE);
+        }
+        if (nullFd > STDERR_FILENO)
+            close(nullFd);
+
+        // 交接的描述符以相同的编号传给新进程
+        foreach (int fd, inheritedDescriptors)
+            fcntl(fd, F_SETFD, 0);
+
+        // 退避延迟在子进程里等待，crashhandler 自己可以马上退出
+        if (delaySeconds > 0)
+            sleep(unsigned(delaySeconds));
 
         if (environment.isEmpty())
             execvp(argv[0], argv.data());
@@ -226,7 +837,9 @@ void CrashHandler::runCommand(QStringList commandLine, QStringList environment,
             execvpe(argv[0], argv.data(), envp.data());
         _exit(EXIT_FAILURE);
     } default: // parent
-        if (waitMode == WaitForExit) {
+        if (waitMode == DontWaitForExit) {
+            while (waitpid(pid, nullptr, 0) == -1 && errno == EINTR) {}
+        } else {
             while (true) {
                 int status;
                 if (waitpid(pid, &status, 0) == -1) {
@@ -251,22 +864,52 @@ void CrashHandler::restartApplication()
 {
     Q_D(CrashHandler);
 
-    runCommand(d->restartAppCommandLine, d->restartAppEnvironment, DontWaitForExit);
+    if (d->restarted || !d->restartDecision.restartAllowed())
+        return;
+    d->restarted = true;
+    d->timeline.mark(CrashTimeline::RestartPhase);
+
+    // 命令行和环境来自崩溃的进程，root 的守护进程不能用 root 执行它们
+    RunAs runAs;
+    if (geteuid() == 0 && d->hasRestartCredentials && d->restartUid != 0) {
+        runAs.dropPrivileges = true;
+        runAs.uid = d->restartUid;
+        runAs.gid = d->restartGid;
+        runAs.groups.append(d->restartGid);
+        passwd entry;
+        passwd *result = nullptr;
+        QByteArray buffer(16384, Qt::Uninitialized);
+        if (getpwuid_r(d->restartUid, &entry, buffer.data(), size_t(buffer.size()), &result) == 0 && result) {
+            int count = 64;
+            runAs.groups.resize(count);
+            if (getgrouplist(entry.pw_name, d->restartGid, runAs.groups.data(), &count) == -1) {
+                runAs.groups.resize(count);
+                getgrouplist(entry.pw_name, d->restartGid, runAs.groups.data(), &count);
+            }
+            runAs.groups.resize(count);
+        }
+    }
+    runCommand(d->restartAppCommandLine, d->descriptorHandoff.environment(d->restartAppEnvironment),
+               DontWaitForExit, d->restartDecision.restartDelay, d->descriptorHandoff.descriptors(), runAs,
+               d->restartAppWorkingDirectory);
 }
 
 void CrashHandler::debugApplication()
 {
     Q_D(CrashHandler);
 
+    if (!d->dialog)
+        return;
+
     // 当调试器正在运行时，用户请求调试应用程序。
     if (d->backtraceCollector.isRunning()) {
-        if (!d->dialog.runDebuggerWhileBacktraceNotFinished())
+        if (!d->dialog->runDebuggerWhileBacktraceNotFinished())
             return;
         if (d->backtraceCollector.isRunning()) {
             d->backtraceCollector.disconnect();
             d->backtraceCollector.kill();
-            d->dialog.setToFinalState();
-            d->dialog.appendDebugInfo(tr("\n\nCollecting backtrace aborted by user."));
+            d->dialog->setToFinalState();
+            appendDebugInfo(tr("\n\nCollecting backtrace aborted by user."));
             QCoreApplication::processEvents(); // 立即显示最后附加的输出
         }
     }
@@ -281,7 +924,7 @@ void CrashHandler::debugApplication()
         environment = d->restartAppEnvironment;
 
     // UI 无论如何都是阻塞/冻结的，所以在调试时隐藏对话框。
-    d->dialog.hide();
+    d->dialog->hide();
     runCommand(commandLine, environment, WaitForExit);
-    d->dialog.show();
+    d->dialog->show();
 }
@@ -1,9 +1,18 @@
 #pragma once
 
+#include "backtracecollector.h"
+
 #include <QObject>
+#include <QVector>
 
 class ApplicationInfo;
 class CrashHandlerPrivate;
+class CrashSignatureStore;
+class ReportStore;
+class RestartPolicy;
+class SymbolCache;
+class UploadQueue;
+struct CrashRecord;
 
 class CrashHandler : public QObject
 {
@@ -11,19 +20,64 @@ class CrashHandler : public QObject
 
 public:
     enum RestartCapability { EnableRestart, DisableRestart };
+    // Headless 不创建对话框，只需要 QCoreApplication：结果写入 spool 目录，按重启策略自动重启
+    enum UiMode { DialogUi, Headless };
 
     explicit CrashHandler(pid_t pid,
                           const QString &signalName,
                           const QString &appName,
                           RestartCapability restartCap = EnableRestart,
+                          UiMode uiMode = DialogUi,
                           QObject *parent = Q_NULLPTR);
     ~CrashHandler();
 
+    void setCrashRecord(const CrashRecord &record);
+    // crashhandler 开始运行的时间，见 CrashTimeline::HelperStartPhase
+    void setHelperStartTime(quint64 nanoseconds);
+    // 设置后把各阶段的时间作为一行 JSON 追加到这个文件
+    void setStatsFile(const QString &fileName);
+    void setBacktraceEngine(BacktraceCollector::Engine engine);
+    void setMaximumTier(BacktraceCollector::Tier tier);
+    void setTimeBudget(int msecs);
+    void setPhaseTimeout(int msecs);
+    // 回溯之后写核心转储。fileName 为空时只在 Headless 模式下写到结果目录里
+    void setCoreDump(const CoreDumpOptions &options, const QString &fileName = QString());
+    void setSymbolCache(SymbolCache *cache);
+    void setRawCaptureFile(const QString &fileName);
+    void setReportFile(const QString &fileName);
+    // 设置后已知的崩溃跳过完整收集，不转移所有权
+    void setSignatureStore(CrashSignatureStore *store);
+    // 设置后检测崩溃循环，重启按退避延迟，不转移所有权
+    void setRestartPolicy(RestartPolicy *policy);
+    // 设置后结果写完以后把报告和文本结果压缩放进上传队列，不转移所有权
+    void setUploadQueue(UploadQueue *queue);
+    // 以 root 运行的守护进程用崩溃的进程的用户重启它，而不是 root
+    void setRestartCredentials(uid_t uid, gid_t gid);
+    // 设置后报告写完以后加入报告索引，不转移所有权
+    void setReportStore(ReportStore *store);
+    // Headless 模式下文本结果和报告的存放目录
+    void setSpoolDirectory(const QString &directory);
+    // spool 目录的上限，与上传队列的上限无关，0 表示不限。超过字节数时先删最旧的核心转储，
+    // 报告要留给 crashquery 查询，仍然超过时才按崩溃删除最旧的报告和文本结果
+    void setSpoolLimits(int maximumReports, qint64 maximumBytes);
+    static QString defaultSpoolDirectory();
+    // 把阶段时间补写进报告和统计文件，无界面模式下由 finish() 调用，对话框在关闭时调用
+    void writeTimings();
+    // 把报告和文本结果放进上传队列，只做一次。无界面模式下由 finish() 调用，对话框在关闭时调用
+    void queueUpload();
+    // 把写完的报告加入报告索引，只做一次，调用时机与 queueUpload() 相同
+    void indexReport();
+
+Q_SIGNALS:
+    // Headless 模式下结果写完、重启也已经处理之后发出
+    void finished();
+
 public Q_SLOTS:
     void run();
     void onError(const QString &errorMessage);
     void onBacktraceChunk(const QString &chunk);
-    void onBacktraceFinished(const QString &backtrace);
+    void onTierFinished(int tier, int maximumTier);
+    void onBacktraceFinished();
     void openBugTracker();
     void restartApplication();
     void debugApplication();
@@ -31,8 +85,26 @@ public Q_SLOTS:
 private:
     enum WaitMode { WaitForExit, DontWaitForExit };
 
+    // 子进程在 exec 之前切换到的用户，组列表在 fork 之前查好，子进程里只做系统调用
+    struct RunAs
+    {
+        RunAs() : dropPrivileges(false), uid(0), gid(0) {}
+
+        bool dropPrivileges;
+        uid_t uid;
+        gid_t gid;
+        QVector<gid_t> groups;
+    };
+
     bool collectRestartAppData();
-    static void runCommand(QStringList commandLine, QStringList environment, WaitMode waitMode);
+    void appendDebugInfo(const QString &chunk);
+    void finish();
+    void writeSpoolFile();
+    void trimSpool();
+    static void runCommand(QStringList commandLine, QStringList environment, WaitMode waitMode,
+                           int delaySeconds = 0,
+                           const QVector<int> &inheritedDescriptors = QVector<int>(),
+                           const RunAs &runAs = RunAs(), const QString &workingDirectory = QString());
 
     QScopedPointer<CrashHandlerPrivate> d_ptr;
     Q_DECLARE_PRIVATE_D(d_ptr, CrashHandler)
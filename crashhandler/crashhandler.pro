@@ -1,4 +1,4 @@
-QT += core gui widgets
+QT += core gui widgets concurrent network
 
 TARGET = crashhandler
 TEMPLATE = app
@@ -6,16 +6,74 @@ DESTDIR = $$OUT_PWD/../bin/
 
 HEADERS += \
     backtracecollector.h \
+    backtraceview.h \
+    breadcrumbreader.h \
+    breadcrumbs.h \
+    coredumper.h \
+    dwarfcursor.h \
+    dwarflinetable.h \
+    ehframeunwinder.h \
+    elffile.h \
+    faultinfo.h \
+    nativeunwinder.h \
+    outputspool.h \
+    processmemory.h \
+    crashdaemon.h \
+    crashdaemonprotocol.h \
+    descriptorhandoff.h \
     crashhandlerdialog.h \
     crashhandler.h \
+    crashreport.h \
+    crashsignature.h \
+    crashtimeline.h \
+    crashrecord.h \
+    processmaps.h \
+    processsnapshot.h \
+    reportstore.h \
+    reportuploader.h \
+    rawcapture.h \
+    restartpolicy.h \
+    symbolcache.h \
+    symbolindex.h \
+    symbolizer.h \
+    uploadbatch.h \
+    uploadqueue.h \
     utils.h
 
 SOURCES += \
     main.cpp \
     backtracecollector.cpp \
+    backtraceview.cpp \
+    breadcrumbreader.cpp \
+    coredumper.cpp \
+    dwarflinetable.cpp \
+    ehframeunwinder.cpp \
+    elffile.cpp \
+    faultinfo.cpp \
+    nativeunwinder.cpp \
+    outputspool.cpp \
+    processmemory.cpp \
+    crashdaemon.cpp \
+    descriptorhandoff.cpp \
     crashhandlerdialog.cpp \
     crashhandler.cpp \
+    crashreport.cpp \
+    crashsignature.cpp \
+    crashtimeline.cpp \
+    processmaps.cpp \
+    processsnapshot.cpp \
+    reportstore.cpp \
+    reportuploader.cpp \
+    rawcapture.cpp \
+    restartpolicy.cpp \
+    symbolcache.cpp \
+    symbolindex.cpp \
+    symbolizer.cpp \
+    uploadbatch.cpp \
+    uploadqueue.cpp \
     utils.cpp
 
+LIBS += -lz
+
 FORMS += \
     crashhandlerdialog.ui
@@ -1,26 +1,31 @@
 #include "crashhandlerdialog.h"
 #include "crashhandler.h"
+#include "outputspool.h"
 #include "ui_crashhandlerdialog.h"
 #include "utils.h"
 
 #include <QMessageBox>
 #include <QClipboard>
 #include <QIcon>
+#include <QLineEdit>
 #include <QSettings>
 #include <QStyle>
 
 CrashHandlerDialog::CrashHandlerDialog(CrashHandler *handler,
                                        const QString &signalName,
                                        const QString &appName,
+                                       OutputSpool *debugInfo,
                                        QWidget *parent)
     : QDialog(parent)
     , m_crashHandler(handler)
+    , m_appName(appName)
+    , m_debugInfo(debugInfo)
     , m_ui(new Ui::CrashHandlerDialog)
 {
     m_ui->setupUi(this);
+    m_ui->debugInfoEdit->setSpool(m_debugInfo);
     m_ui->introLabel->setTextFormat(Qt::RichText);
     m_ui->introLabel->setOpenExternalLinks(true);
-    m_ui->debugInfoEdit->setReadOnly(true);
     m_ui->progressBar->setMinimum(0);
     m_ui->progressBar->setMaximum(0);
     m_ui->restartAppCheckBox->setText(tr("&Restart %1 on close").arg(appName));
@@ -39,6 +44,7 @@ CrashHandlerDialog::CrashHandlerDialog(CrashHandler *handler,
     connect(m_ui->debugAppButton, &QAbstractButton::clicked,
             m_crashHandler, &CrashHandler::debugApplication);
     connect(m_ui->closeButton, &QAbstractButton::clicked, this, &CrashHandlerDialog::close);
+    connect(m_ui->findEdit, &QLineEdit::returnPressed, this, &CrashHandlerDialog::findNext);
 
     setApplicationInfo(signalName, appName);
 }
@@ -68,6 +74,18 @@ bool CrashHandlerDialog::runDebuggerWhileBacktraceNotFinished()
     return result == QMessageBox::Yes;
 }
 
+void CrashHandlerDialog::setTierAvailable(int tier, int maximumTier, const QString &description)
+{
+    // 从不确定的进度变为按层显示
+    m_ui->progressBar->setMaximum(maximumTier);
+    m_ui->progressBar->setValue(tier);
+    m_ui->progressBar->setFormat(tr("Tier %1 of %2 available (%3)").arg(tier).arg(maximumTier).arg(description));
+    m_ui->progressBar->setTextVisible(true);
+    // 已经有可以报告的内容了
+    m_ui->copyToClipBoardButton->setEnabled(true);
+    m_ui->reportBugButton->setEnabled(true);
+}
+
 void CrashHandlerDialog::setToFinalState()
 {
     m_ui->progressBar->hide();
@@ -80,6 +98,11 @@ void CrashHandlerDialog::disableRestartAppCheckBox()
     m_ui->restartAppCheckBox->setDisabled(true);
 }
 
+void CrashHandlerDialog::setRestartDelay(int seconds)
+{
+    m_ui->restartAppCheckBox->setText(tr("&Restart %1 on close (in %2 seconds)").arg(m_appName).arg(seconds));
+}
+
 void CrashHandlerDialog::disableDebugAppButton()
 {
     m_ui->debugAppButton->setDisabled(true);
@@ -99,28 +122,27 @@ void CrashHandlerDialog::setApplicationInfo(const QString &signalName, const QSt
 
     setWindowTitle(title);
     m_ui->introLabel->setText(introLabelContents);
-    m_ui->debugInfoEdit->append(versionInformation);
+    m_debugInfo->appendParagraph(versionInformation);
+    debugInfoChanged();
+}
+
+void CrashHandlerDialog::debugInfoChanged()
+{
+    m_ui->debugInfoEdit->scheduleUpdate();
 }
 
-void CrashHandlerDialog::appendDebugInfo(const QString &chunk)
+bool CrashHandlerDialog::selectLineWithContents(const QString &text)
 {
-    m_ui->debugInfoEdit->append(chunk);
+    // 从最后一行开始反向搜索，选中并高亮整行
+    return m_ui->debugInfoEdit->find(text, m_ui->debugInfoEdit->lineCount() - 1, true) != -1;
 }
 
-void CrashHandlerDialog::selectLineWithContents(const QString &text)
+void CrashHandlerDialog::findNext()
 {
-    // 移到最后
-    QTextCursor cursor = m_ui->debugInfoEdit->textCursor();
-    cursor.movePosition(QTextCursor::End);
-    m_ui->debugInfoEdit->setTextCursor(cursor);
-
-    // 通过反向搜索找到文本
-    m_ui->debugInfoEdit->find(text, QTextDocument::FindCaseSensitively | QTextDocument::FindBackward);
-
-    // 高亮整行
-    cursor = m_ui->debugInfoEdit->textCursor();
-    cursor.select(QTextCursor::LineUnderCursor);
-    m_ui->debugInfoEdit->setTextCursor(cursor);
+    // 从选中的行之后继续查找，到末尾后从头开始
+    const QString text = m_ui->findEdit->text();
+    if (m_ui->debugInfoEdit->find(text, m_ui->debugInfoEdit->selectedLine() + 1) == -1)
+        m_ui->debugInfoEdit->find(text, 0);
 }
 
 void CrashHandlerDialog::copyToClipboardClicked()
@@ -132,6 +154,9 @@ void CrashHandlerDialog::close()
 {
     if (m_ui->restartAppCheckBox->isEnabled() && m_ui->restartAppCheckBox->isChecked())
         m_crashHandler->restartApplication();
+    m_crashHandler->writeTimings();
+    m_crashHandler->indexReport();
+    m_crashHandler->queueUpload();
 
     QCoreApplication::quit();
 }
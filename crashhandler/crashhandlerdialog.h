@@ -8,31 +8,41 @@ namespace Ui { class CrashHandlerDialog; }
 QT_END_NAMESPACE
 
 class CrashHandler;
+class OutputSpool;
 
 class CrashHandlerDialog : public QDialog
 {
     Q_OBJECT
 
 public:
+    // debugInfo 为显示的调试信息，必须已经打开，不转移所有权
     explicit CrashHandlerDialog(CrashHandler *handler,
                                 const QString &signalName,
                                 const QString &appName,
+                                OutputSpool *debugInfo,
                                 QWidget *parent = Q_NULLPTR);
     ~CrashHandlerDialog();
 
 public:
     void setApplicationInfo(const QString &signalName, const QString &appName);
-    void appendDebugInfo(const QString &chunk);
-    void selectLineWithContents(const QString &text);
+    // 调试信息文件里追加了内容
+    void debugInfoChanged();
+    // 找不到时返回 false
+    bool selectLineWithContents(const QString &text);
+    void setTierAvailable(int tier, int maximumTier, const QString &description);
     void setToFinalState();
     void disableRestartAppCheckBox();
+    void setRestartDelay(int seconds);
     void disableDebugAppButton();
     bool runDebuggerWhileBacktraceNotFinished();
 
 private:
     void copyToClipboardClicked();
+    void findNext();
     void close();
 
     CrashHandler *m_crashHandler;
+    QString m_appName;
+    OutputSpool *m_debugInfo;
     Ui::CrashHandlerDialog *m_ui;
 };
@@ -1,4 +1,6 @@
 #include "crashhandlersetup.h"
+#include "crashdaemonprotocol.h"
+#include "crashrecord.h"
 
 #include <QtGlobal>
 
@@ -9,17 +11,28 @@
 #ifdef BUILD_CRASH_HANDLER
 
 #include <QApplication>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QString>
 
 #include <stdlib.h>
 
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
+#include <time.h>
+#include <ucontext.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
 
 // 旧库中没有 PR_SET_PTRACER，所以需要定义一下，在下面会用到。
 #ifndef PR_SET_PTRACER
@@ -34,43 +47,516 @@
 static const char *appNameC = nullptr;
 static const char *disableRestartOptionC = nullptr;
 static const char *crashHandlerPathC = nullptr;
-static void *signalHandlerStack = nullptr;
+static const char *helperArgumentsC[16];
+static int helperArgumentCount = 0;
+static CrashRecord *crashRecord = nullptr;
+static pid_t helperPid = -1;
+static int helperSocket = -1;
+static int helperTimeoutSeconds = 120;
+static BreadcrumbHeader *breadcrumbHeader = nullptr;
+static int breadcrumbFd = -1;
+static char *signalStackPool = nullptr;
+static int signalStackInUse[64];
+static pid_t crashingThread = 0; // 第一个进入信号处理程序的线程
+static int keptDescriptors[CrashRecordMaxKeptDescriptors];
+static char keptDescriptorNames[CrashRecordMaxKeptDescriptors][CrashRecordKeptNameSize];
+static uint32_t keptDescriptorCount = 0; // 条目写好以后才以 release 语义递增
+static QMutex keptDescriptorMutex;
 
 namespace {
 const QString execName = "crashhandler";
+const char recordFdOptionC[] = "--record-fd";
+const char waitFdOptionC[] = "--wait-fd";
+// 信号处理程序要做进程内回溯，再加上 fork()，SIGSTKSZ 不够用
+const size_t signalStackSize = 64 * 1024;
+const int signalStackPoolSize = sizeof(signalStackInUse) / sizeof(signalStackInUse[0]);
+const int handledSignals[] = {SIGILL, SIGABRT, SIGFPE, SIGSEGV, SIGBUS, 0};
 }
 
-extern "C" void signalHandler(int signal)
+// 每个栈下面有一个不可访问的保护页，信号处理程序自己栈溢出时不会悄悄写坏相邻的栈
+static size_t signalStackGuardSize()
 {
+    return size_t(sysconf(_SC_PAGESIZE));
+}
+
+static char *mapSignalStacks(int count)
+{
+    const size_t slotSize = signalStackGuardSize() + signalStackSize;
+    void *memory = mmap(nullptr, slotSize * size_t(count), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (memory == MAP_FAILED)
+        return nullptr;
+    char *stacks = static_cast<char *>(memory);
+    for (int i = 0; i < count; ++i)
+        mprotect(stacks + size_t(i) * slotSize, signalStackGuardSize(), PROT_NONE);
+    return stacks;
+}
+
+// 池里的栈用一个标志数组管理，取和还都只是一次原子交换
+static char *acquireSignalStack(int *poolIndex)
+{
+    char *pool = __atomic_load_n(&signalStackPool, __ATOMIC_ACQUIRE);
+    for (int i = 0; pool && i < signalStackPoolSize; ++i) {
+        if (__atomic_load_n(&signalStackInUse[i], __ATOMIC_RELAXED) == 0
+                && __atomic_exchange_n(&signalStackInUse[i], 1, __ATOMIC_ACQUIRE) == 0) {
+            *poolIndex = i;
+            return pool + size_t(i) * (signalStackGuardSize() + signalStackSize) + signalStackGuardSize();
+        }
+    }
+    *poolIndex = -1;
+    char *stack = mapSignalStacks(1);
+    return stack ? stack + signalStackGuardSize() : nullptr;
+}
+
+static void releaseSignalStack(char *stack, int poolIndex)
+{
+    if (poolIndex >= 0)
+        __atomic_store_n(&signalStackInUse[poolIndex], 0, __ATOMIC_RELEASE);
+    else
+        munmap(stack - signalStackGuardSize(), signalStackGuardSize() + signalStackSize);
+}
+
+// 线程退出时析构，停用并归还这个线程的替代信号栈
+struct ThreadSignalStack
+{
+    char *stack = nullptr;
+    int poolIndex = -1;
+
+    ~ThreadSignalStack() { release(); }
+
+    void release()
+    {
+        if (!stack)
+            return;
+        stack_t ss;
+        memset(&ss, 0, sizeof(ss));
+        ss.ss_flags = SS_DISABLE;
+        sigaltstack(&ss, nullptr);
+        releaseSignalStack(stack, poolIndex);
+        stack = nullptr;
+        poolIndex = -1;
+    }
+};
+
+static thread_local ThreadSignalStack threadSignalStack;
+
+// 以下函数都在信号处理程序中调用，只能使用异步信号安全的操作，不能分配内存。
+
+// 通过 process_vm_readv() 读取一个字，地址无效时返回 false，而不是再次触发 SIGSEGV。
+static bool readStackWord(uintptr_t address, uintptr_t *value)
+{
+    struct iovec local = { value, sizeof(*value) };
+    struct iovec remote = { reinterpret_cast<void *>(address), sizeof(*value) };
+    return process_vm_readv(getpid(), &local, 1, &remote, 1, 0) == ssize_t(sizeof(*value));
+}
+
+// 沿着帧指针链回溯出错线程的栈。起点取自 ucontext 而不是当前（替代）栈，
+// 所以即使是栈溢出也能得到出错线程的调用链。
+static void unwindFaultingThread(const ucontext_t *context, CrashRecord *record)
+{
+    uintptr_t pc = 0;
+    uintptr_t fp = 0;
+#if defined(__x86_64__)
+    pc = context->uc_mcontext.gregs[REG_RIP];
+    fp = context->uc_mcontext.gregs[REG_RBP];
+#elif defined(__i386__)
+    pc = context->uc_mcontext.gregs[REG_EIP];
+    fp = context->uc_mcontext.gregs[REG_EBP];
+#elif defined(__aarch64__)
+    pc = context->uc_mcontext.pc;
+    fp = context->uc_mcontext.regs[29];
+#else
+    Q_UNUSED(context);
+#endif
+
+    record->frameCount = 0;
+    if (pc == 0)
+        return;
+    record->frames[record->frameCount++] = pc;
+
+    // 帧记录的布局是 [fp] = 上一帧的 fp，[fp + 一个字] = 返回地址。
+    while (fp != 0 && record->frameCount < CrashRecordMaxFrames) {
+        if (fp & (sizeof(uintptr_t) - 1))
+            break;
+        uintptr_t nextFp = 0;
+        uintptr_t returnAddress = 0;
+        if (!readStackWord(fp, &nextFp) || !readStackWord(fp + sizeof(uintptr_t), &returnAddress))
+            break;
+        if (returnAddress == 0)
+            break;
+        record->frames[record->frameCount++] = returnAddress;
+        // 栈向低地址增长，帧指针必须单调递增，否则说明栈已损坏。
+        if (nextFp <= fp)
+            break;
+        fp = nextFp;
+    }
+}
+
+// 记录 siginfo_t 和 ucontext 中的出错上下文，helper 据此直接找到出错的线程，判断出错的类型
+static void captureFaultContext(pid_t thread, const siginfo_t *info, const ucontext_t *context,
+                                CrashRecord *record)
+{
+    record->faultingThread = thread;
+    record->signalCode = info ? info->si_code : 0;
+    record->faultAddress = info ? uint64_t(uintptr_t(info->si_addr)) : 0;
+    record->registerCount = 0;
+    if (!context)
+        return;
+#if defined(__x86_64__) || defined(__i386__)
+    const int count = qMin(int(NGREG), int(CrashRecordMaxRegisters));
+    for (int i = 0; i < count; ++i)
+        record->registers[i] = uint64_t(context->uc_mcontext.gregs[i]);
+    record->registerCount = uint32_t(count);
+#if defined(__x86_64__)
+    record->stackPointer = uint64_t(context->uc_mcontext.gregs[REG_RSP]);
+    record->framePointer = uint64_t(context->uc_mcontext.gregs[REG_RBP]);
+#else
+    record->stackPointer = uint64_t(context->uc_mcontext.gregs[REG_ESP]);
+    record->framePointer = uint64_t(context->uc_mcontext.gregs[REG_EBP]);
+#endif
+#elif defined(__aarch64__)
+    // x0-x30、sp、pc、pstate
+    for (int i = 0; i < 31; ++i)
+        record->registers[i] = context->uc_mcontext.regs[i];
+    record->registers[31] = context->uc_mcontext.sp;
+    record->registers[32] = context->uc_mcontext.pc;
+    record->registers[33] = context->uc_mcontext.pstate;
+    record->registerCount = 34;
+    record->stackPointer = context->uc_mcontext.sp;
+    record->framePointer = context->uc_mcontext.regs[29];
+#endif
+}
+
+static void formatDecimal(char *buffer, int value)
+{
+    char digits[16];
+    int count = 0;
+    do {
+        digits[count++] = char('0' + value % 10);
+        value /= 10;
+    } while (value > 0 && count < int(sizeof(digits)));
+    while (count > 0)
+        *buffer++ = digits[--count];
+    *buffer = '\0';
+}
+
+static bool writeAll(int fd, const void *buffer, size_t size)
+{
+    const char *data = static_cast<const char *>(buffer);
+    while (size > 0) {
+        const ssize_t written = write(fd, data, size);
+        if (written == -1 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data += written;
+        size -= size_t(written);
+    }
+    return true;
+}
+
+// 距离期限还有多少毫秒，期限为 0 表示不限制，返回 -1
+static qint64 remainingMsecs(qint64 deadline)
+{
+    if (deadline == 0)
+        return -1;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return qMax(qint64(0), deadline - (qint64(now.tv_sec) * 1000 + now.tv_nsec / 1000000));
+}
+
+static qint64 helperDeadline()
+{
+    if (helperTimeoutSeconds <= 0)
+        return 0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return qint64(now.tv_sec) * 1000 + now.tv_nsec / 1000000 + qint64(helperTimeoutSeconds) * 1000;
+}
+
+// 等 fork() 出的 helper 退出，最多到期限为止
+static void waitForHelperExit(pid_t pid)
+{
+    const qint64 deadline = helperDeadline();
+    if (deadline == 0) {
+        while (waitpid(pid, nullptr, 0) == -1 && errno == EINTR) {}
+        return;
+    }
+    while (remainingMsecs(deadline) > 0) {
+        const pid_t result = waitpid(pid, nullptr, WNOHANG);
+        if (result == pid || (result == -1 && errno != EINTR))
+            return;
+        const struct timespec interval = { 0, 50 * 1000 * 1000 };
+        nanosleep(&interval, nullptr);
+    }
+}
+
+// 等 socket 的另一端关闭，最多到期限为止
+static void waitForHangUp(int fd)
+{
+    const qint64 deadline = helperDeadline();
+    for (;;) {
+        const qint64 remaining = remainingMsecs(deadline);
+        if (remaining == 0)
+            return;
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        const int ready = poll(&pfd, 1, int(remaining));
+        if (ready == -1 && errno == EINTR)
+            continue;
+        if (ready <= 0)
+            return;
+        char c;
+        const ssize_t count = read(fd, &c, sizeof(c));
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return;
+    }
+}
+
+// 把登记的描述符复制进崩溃记录，只有 memcpy()
+static void copyKeptDescriptors(CrashRecord *record)
+{
+    const uint32_t count = __atomic_load_n(&keptDescriptorCount, __ATOMIC_ACQUIRE);
+    memcpy(record->keptDescriptors, keptDescriptors, sizeof(keptDescriptors));
+    memcpy(record->keptDescriptorNames, keptDescriptorNames, sizeof(keptDescriptorNames));
+    record->keptDescriptorCount = count;
+    record->keptDescriptorsInherited = 0;
+}
+
+// clock_gettime() 是异步信号安全的
+static uint64_t monotonicNanoseconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return uint64_t(now.tv_sec) * 1000000000 + uint64_t(now.tv_nsec);
+}
+
+// 把崩溃记录写入一个管道，返回读端。管道缓冲区远大于记录，所以 write() 不会阻塞。
+static int writeCrashRecord(const CrashRecord *record)
+{
+    int fds[2];
+    if (pipe(fds) == -1)
+        return -1;
+
+    if (!writeAll(fds[1], record, sizeof(*record))) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    close(fds[1]);
+    return fds[0];
+}
+
+// 预先启动的 crashhandler 或守护进程模式：只把记录写给已经在等待的 helper，然后阻塞到 helper 退出
+// （守护进程模式下是阻塞到守护进程处理完并关闭连接）。
+// 不需要 fork()，所以崩溃时的延迟和内存开销与应用程序的大小无关。
+// 使用 socketpair 而不是管道，这样 helper 不在了时 MSG_NOSIGNAL 可以避免 SIGPIPE。
+static bool handOverToSpawnedHelper(const CrashRecord *record)
+{
+    if (helperSocket == -1)
+        return false;
+
+    const char *data = reinterpret_cast<const char *>(record);
+    size_t remaining = sizeof(*record);
+    while (remaining > 0) {
+        const ssize_t sent = send(helperSocket, data, remaining, MSG_NOSIGNAL);
+        if (sent == -1 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        data += sent;
+        remaining -= size_t(sent);
+    }
+
+    // helper 退出时它那一端被关闭，read() 返回 0
+    waitForHangUp(helperSocket);
+    return true;
+}
+
+extern "C" void signalHandler(int signal, siginfo_t *info, void *context)
+{
+    // 只有第一个出错的线程处理崩溃。其他同时出错的线程停在这里，由第一个线程最后退出进程，
+    // 不会在收集途中以默认动作杀死进程
+    const pid_t thread = pid_t(syscall(SYS_gettid));
+    pid_t expected = 0;
+    if (!__atomic_compare_exchange_n(&crashingThread, &expected, thread, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        if (expected == thread) {
+            // 信号处理程序自己出错了：恢复默认动作，返回后重新执行出错的指令
+            ::signal(signal, SIG_DFL);
+            return;
+        }
+        for (;;)
+            pause();
+    }
+
+    // 先在进程内完成崩溃线程的回溯，这样即使 gdb 不可用或者附加很慢，也总能拿到崩溃线程的调用栈。
+    if (crashRecord) {
+        crashRecord->signalNanoseconds = monotonicNanoseconds();
+        crashRecord->signalNumber = signal;
+        crashRecord->pid = getpid();
+        crashRecord->breadcrumbFd = breadcrumbFd;
+        captureFaultContext(thread, info, static_cast<const ucontext_t *>(context), crashRecord);
+        copyKeptDescriptors(crashRecord);
+        unwindFaultingThread(static_cast<const ucontext_t *>(context), crashRecord);
+    }
+
 #ifdef Q_WS_X11
     // Kill window since it's frozen anyway.
     if (QX11Info::display())
         close(ConnectionNumber(QX11Info::display()));
 #endif
+
+    if (crashRecord)
+        crashRecord->handoverNanoseconds = monotonicNanoseconds();
+    if (crashRecord && handOverToSpawnedHelper(crashRecord))
+        _exit(EXIT_FAILURE);
+
+    // helper 没有预先启动或者已经不在了，退回到 fork() 的方式
+    int recordFd = -1;
+    char recordFdString[16] = { 0 };
+    if (crashRecord) {
+        crashRecord->handoverNanoseconds = monotonicNanoseconds();
+        // 下面的子进程清除了 FD_CLOEXEC，helper 不需要 pidfd_getfd() 也能拿到登记的描述符
+        crashRecord->keptDescriptorsInherited = 1;
+        recordFd = writeCrashRecord(crashRecord);
+        if (recordFd != -1)
+            formatDecimal(recordFdString, recordFd);
+    }
+
     pid_t pid = fork();
     switch (pid) {
     case -1: // error
         break;
-    case 0: // child
-        if (disableRestartOptionC) {
-            execl(crashHandlerPathC, crashHandlerPathC, strsignal(signal), appNameC,
-                  disableRestartOptionC, nullptr);
-        } else {
-            execl(crashHandlerPathC, crashHandlerPathC, strsignal(signal), appNameC, nullptr);
+    case 0: { // child
+        // 在 execv() 之前出错时不要进入上面的闩锁，直接以默认动作结束
+        for (int i = 0; handledSignals[i]; ++i)
+            ::signal(handledSignals[i], SIG_DFL);
+        if (crashRecord) {
+            for (uint32_t i = 0; i < crashRecord->keptDescriptorCount; ++i)
+                fcntl(crashRecord->keptDescriptors[i], F_SETFD, 0);
         }
+        const char *args[8 + sizeof(helperArgumentsC) / sizeof(helperArgumentsC[0])];
+        int argc = 0;
+        args[argc++] = crashHandlerPathC;
+        args[argc++] = strsignal(signal);
+        args[argc++] = appNameC;
+        if (recordFd != -1) {
+            args[argc++] = recordFdOptionC;
+            args[argc++] = recordFdString;
+        }
+        if (disableRestartOptionC)
+            args[argc++] = disableRestartOptionC;
+        for (int i = 0; i < helperArgumentCount; ++i)
+            args[argc++] = helperArgumentsC[i];
+        args[argc] = nullptr;
+        execv(crashHandlerPathC, const_cast<char * const *>(args));
         _exit(EXIT_FAILURE);
+    }
     default: // parent
+        if (recordFd != -1)
+            close(recordFd);
         prctl(PR_SET_PTRACER, pid, 0, 0, 0);
-        waitpid(pid, nullptr, 0);
+        waitForHelperExit(pid);
         _exit(EXIT_FAILURE);
         break;
     }
 }
+
+// 启动 crashhandler 并让它阻塞在崩溃记录的 socket 上。它会被 exec()，所以只有明确清除了
+// FD_CLOEXEC 的那一端会被继承下去。
+static void spawnHelper()
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+        qWarning("Warning: Could not create crash record socket (%s).", Q_FUNC_INFO);
+        return;
+    }
+
+    char waitFdString[16];
+    formatDecimal(waitFdString, fds[1]);
+
+    const pid_t pid = fork();
+    switch (pid) {
+    case -1: // error
+        qWarning("Warning: Could not start crash handler in advance (%s).", Q_FUNC_INFO);
+        close(fds[0]);
+        close(fds[1]);
+        return;
+    case 0: { // child
+        fcntl(fds[1], F_SETFD, 0);
+        const char *args[7 + sizeof(helperArgumentsC) / sizeof(helperArgumentsC[0])];
+        int argc = 0;
+        args[argc++] = crashHandlerPathC;
+        args[argc++] = waitFdOptionC;
+        args[argc++] = waitFdString;
+        args[argc++] = appNameC;
+        if (disableRestartOptionC)
+            args[argc++] = disableRestartOptionC;
+        for (int i = 0; i < helperArgumentCount; ++i)
+            args[argc++] = helperArgumentsC[i];
+        args[argc] = nullptr;
+        execv(crashHandlerPathC, const_cast<char * const *>(args));
+        _exit(EXIT_FAILURE);
+    }
+    default: // parent
+        close(fds[1]);
+        helperPid = pid;
+        helperSocket = fds[0];
+        // helper 是子进程，Yama 默认不允许子进程 ptrace 父进程
+        prctl(PR_SET_PTRACER, pid, 0, 0, 0);
+        break;
+    }
+}
+
+// 连接 crashhandler --daemon 并注册，之后崩溃时使用与预先启动的 helper 相同的交接方式
+static bool connectToDaemon(const QString &socketPath)
+{
+    const QByteArray path = QFile::encodeName(socketPath);
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (size_t(path.size()) >= sizeof(address.sun_path))
+        return false;
+    memcpy(address.sun_path, path.constData(), size_t(path.size()));
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return false;
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1) {
+        close(fd);
+        return false;
+    }
+
+    CrashDaemonHello hello;
+    memset(&hello, 0, sizeof(hello));
+    hello.magic = CrashDaemonHelloMagic;
+    hello.version = CrashDaemonHelloVersion;
+    hello.flags = disableRestartOptionC ? CrashDaemonDisableRestart : 0;
+    strncpy(hello.appName, appNameC, sizeof(hello.appName) - 1);
+
+    // 守护进程不是父进程，Yama 默认不允许它 ptrace 我们，需要明确授权
+    ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if (!writeAll(fd, &hello, sizeof(hello))
+            || getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == -1) {
+        close(fd);
+        return false;
+    }
+    prctl(PR_SET_PTRACER, credentials.pid, 0, 0, 0);
+
+    helperSocket = fd;
+    return true;
+}
 #endif // BUILD_CRASH_HANDLER
 
+thread_local BreadcrumbRing *CrashHandlerSetup::currentBreadcrumbRing = nullptr;
+
 CrashHandlerSetup::CrashHandlerSetup(const QString &appName,
                                      RestartCapability restartCap,
-                                     const QString &executableDirPath)
+                                     const QString &executableDirPath,
+                                     HelperMode helperMode)
 {
 #ifdef BUILD_CRASH_HANDLER
     appNameC = qstrdup(qPrintable(appName));
@@ -84,16 +570,18 @@ CrashHandlerSetup::CrashHandlerSetup(const QString &appName,
     const QString crashHandlerPath = execDirPath + "/" + execName;
     crashHandlerPathC = qstrdup(qPrintable(crashHandlerPath));
 
+    // 崩溃记录必须预先分配，信号处理程序中不能分配内存。
+    crashRecord = new CrashRecord;
+    memset(crashRecord, 0, sizeof(*crashRecord));
+    crashRecord->magic = CrashRecordMagic;
+    crashRecord->version = CrashRecordVersion;
+    crashRecord->breadcrumbFd = -1;
+
     // 为信号处理程序设置一个替代堆栈，这样就可以处理 SIGSEGV 了，即使正常的进程堆栈已经耗尽。
-    stack_t ss;
-    ss.ss_sp = signalHandlerStack = malloc(SIGSTKSZ);
-    if (ss.ss_sp == nullptr) {
-        qWarning("Warning: Could not allocate space for alternative signal stack (%s).", Q_FUNC_INFO);
-        return;
-    }
-    ss.ss_size = SIGSTKSZ;
-    ss.ss_flags = 0;
-    if (sigaltstack(&ss, nullptr) == -1) {
+    // 其他线程的栈从同一个池里取，见 registerThread()
+    if (!signalStackPool)
+        __atomic_store_n(&signalStackPool, mapSignalStacks(signalStackPoolSize), __ATOMIC_RELEASE);
+    if (!registerThread()) {
         qWarning("Warning: Failed to set alternative signal stack (%s).", Q_FUNC_INFO);
         return;
     }
@@ -104,32 +592,280 @@ CrashHandlerSetup::CrashHandlerSetup(const QString &appName,
         qWarning("Warning: Failed to empty signal set (%s).", Q_FUNC_INFO);
         return;
     }
-    sa.sa_handler = &signalHandler;
-    // SA_RESETHAND - 在信号处理程序被调用后，将信号动作恢复为默认值
+    sa.sa_sigaction = &signalHandler;
+    // SA_SIGINFO - 信号处理程序可以拿到出错线程的 ucontext，用于进程内回溯
+    // 不使用 SA_RESETHAND：另一个线程同时出错时会以默认动作杀死正在收集的进程，由信号处理程序里的闩锁代替
     // SA_NODEFER - 在信号被触发后不要阻塞它（否则阻塞信号将通过 fork() 和 execve() 继承），没有信号将不能重启主程序。
     // SA_ONSTACK - 使用替代堆栈
-    sa.sa_flags = SA_RESETHAND | SA_NODEFER | SA_ONSTACK;
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER | SA_ONSTACK;
 
     // 不要在这里添加 SIGPIPE, QProcess 和 QTcpSocket 使用它。
-    const int signalsToHandle[] = {SIGILL, SIGABRT, SIGFPE, SIGSEGV, SIGBUS, 0};
-    for (int i = 0; signalsToHandle[i]; ++i) {
-        if (sigaction(signalsToHandle[i], &sa, nullptr) == -1 ) {
+    for (int i = 0; handledSignals[i]; ++i) {
+        if (sigaction(handledSignals[i], &sa, nullptr) == -1 ) {
             qWarning("Warning: Failed to install signal handler for signal \"%s\" (%s).",
-                strsignal(signalsToHandle[i]), Q_FUNC_INFO);
+                strsignal(handledSignals[i]), Q_FUNC_INFO);
         }
     }
+
+    if (helperMode == PreSpawnHelper) {
+        spawnHelper();
+    } else if (helperMode == UseDaemon && !connectToDaemon(defaultCrashDaemonSocketPath())) {
+        qWarning("Warning: Could not register with the crash daemon, "
+                 "falling back to starting the crash handler on crash (%s).", Q_FUNC_INFO);
+    }
 #else
     Q_UNUSED(appName);
     Q_UNUSED(restartCap);
     Q_UNUSED(executableDirPath);
+    Q_UNUSED(helperMode);
 #endif // BUILD_CRASH_HANDLER
 }
 
+void CrashHandlerSetup::setHelperTimeout(int seconds)
+{
+#ifdef BUILD_CRASH_HANDLER
+    helperTimeoutSeconds = qMax(0, seconds);
+#else
+    Q_UNUSED(seconds);
+#endif
+}
+
+void CrashHandlerSetup::setHelperArguments(const QStringList &arguments)
+{
+#ifdef BUILD_CRASH_HANDLER
+    const int maximumCount = int(sizeof(helperArgumentsC) / sizeof(helperArgumentsC[0]));
+    if (arguments.size() > maximumCount)
+        qWarning("Warning: Only the first %d crash handler arguments are used (%s).", maximumCount, Q_FUNC_INFO);
+    // 信号处理程序里不能分配内存，预先转换好
+    for (int i = 0; i < helperArgumentCount; ++i)
+        delete[] helperArgumentsC[i];
+    helperArgumentCount = qMin(arguments.size(), maximumCount);
+    for (int i = 0; i < helperArgumentCount; ++i)
+        helperArgumentsC[i] = qstrdup(arguments.at(i).toLocal8Bit().constData());
+#else
+    Q_UNUSED(arguments);
+#endif
+}
+
+bool CrashHandlerSetup::registerThread()
+{
+#ifdef BUILD_CRASH_HANDLER
+    if (threadSignalStack.stack)
+        return true;
+
+    int poolIndex = -1;
+    char *stack = acquireSignalStack(&poolIndex);
+    if (!stack)
+        return false;
+    stack_t ss;
+    ss.ss_sp = stack;
+    ss.ss_size = signalStackSize;
+    ss.ss_flags = 0;
+    if (sigaltstack(&ss, nullptr) == -1) {
+        releaseSignalStack(stack, poolIndex);
+        return false;
+    }
+    threadSignalStack.stack = stack;
+    threadSignalStack.poolIndex = poolIndex;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void CrashHandlerSetup::unregisterThread()
+{
+#ifdef BUILD_CRASH_HANDLER
+    threadSignalStack.release();
+#endif
+}
+
+bool CrashHandlerSetup::keepDescriptor(int fd, const char *name)
+{
+#ifdef BUILD_CRASH_HANDLER
+    const size_t nameLength = name ? strlen(name) : 0;
+    if (fd < 0 || nameLength == 0 || nameLength >= size_t(CrashRecordKeptNameSize)
+            || strpbrk(name, "=,") || fcntl(fd, F_GETFD) == -1) {
+        return false;
+    }
+
+    QMutexLocker locker(&keptDescriptorMutex);
+    const uint32_t count = keptDescriptorCount;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (strcmp(keptDescriptorNames[i], name) == 0) {
+            keptDescriptors[i] = fd;
+            return true;
+        }
+    }
+    if (count == uint32_t(CrashRecordMaxKeptDescriptors))
+        return false;
+    keptDescriptors[count] = fd;
+    memcpy(keptDescriptorNames[count], name, nameLength + 1);
+    __atomic_store_n(&keptDescriptorCount, count + 1, __ATOMIC_RELEASE);
+    return true;
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(name);
+    return false;
+#endif
+}
+
+int CrashHandlerSetup::inheritedDescriptor(const char *name)
+{
+#ifdef BUILD_CRASH_HANDLER
+    const QByteArray value = qgetenv(CrashRecordKeptDescriptorsVariable);
+    foreach (const QByteArray &entry, value.split(',')) {
+        const int separator = entry.indexOf('=');
+        if (separator <= 0 || entry.left(separator) != name)
+            continue;
+        bool ok = false;
+        const int fd = entry.mid(separator + 1).toInt(&ok);
+        if (!ok || fd < 0 || fcntl(fd, F_GETFD) == -1)
+            return -1;
+        // 不再传给这个实例自己启动的子进程，再次崩溃时由 crashhandler 重新交接
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        return fd;
+    }
+    return -1;
+#else
+    Q_UNUSED(name);
+    return -1;
+#endif
+}
+
+bool CrashHandlerSetup::enableBreadcrumbs(int maxThreads)
+{
+#ifdef BUILD_CRASH_HANDLER
+    if (breadcrumbHeader)
+        return true;
+    if (maxThreads <= 0)
+        return false;
+
+    // 放在 memfd 里，崩溃后 crashhandler 通过 /proc/<pid>/fd 一次读出，不必逐页读取进程内存
+    const int fd = int(syscall(SYS_memfd_create, "crashhandler-breadcrumbs", MFD_CLOEXEC));
+    if (fd == -1) {
+        qWarning("Warning: Could not create the breadcrumb buffer: %s (%s).", strerror(errno), Q_FUNC_INFO);
+        return false;
+    }
+    const size_t size = sizeof(BreadcrumbHeader) + size_t(maxThreads) * sizeof(BreadcrumbRing);
+    void *memory = MAP_FAILED;
+    if (ftruncate(fd, off_t(size)) == 0)
+        memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        qWarning("Warning: Could not map the breadcrumb buffer: %s (%s).", strerror(errno), Q_FUNC_INFO);
+        close(fd);
+        return false;
+    }
+
+    // ftruncate() 之后内容全是 0，所有的环都还没有被领取
+    BreadcrumbHeader *header = static_cast<BreadcrumbHeader *>(memory);
+    header->magic = BreadcrumbMagic;
+    header->version = BreadcrumbVersion;
+    header->ringCount = uint32_t(maxThreads);
+    header->clock = breadcrumbClock();
+    header->setupTicks = breadcrumbTicks();
+    header->setupNanoseconds = breadcrumbMonotonicNanoseconds();
+    breadcrumbFd = fd;
+    __atomic_store_n(&breadcrumbHeader, header, __ATOMIC_RELEASE);
+    return true;
+#else
+    Q_UNUSED(maxThreads);
+    return false;
+#endif
+}
+
+#ifdef BUILD_CRASH_HANDLER
+// 环用完以后，其余线程写进这个丢弃用的环，不再重复尝试领取
+static BreadcrumbRing discardedBreadcrumbs;
+
+// 线程退出时归还它的环。事件留在环里，直到别的线程重新领取它之前仍然会出现在报告里
+struct ThreadBreadcrumbRing
+{
+    BreadcrumbRing *ring = nullptr;
+
+    ~ThreadBreadcrumbRing()
+    {
+        if (!ring)
+            return;
+        // 之后的线程局部析构函数里记录的事件不能再写进可能已经被别人领取的环
+        CrashHandlerSetup::releaseBreadcrumbRing(ring);
+        ring = nullptr;
+    }
+};
+
+static thread_local ThreadBreadcrumbRing threadBreadcrumbRing;
+
+// 找一个线程已经退出的环，领取成功后清空
+static BreadcrumbRing *reclaimBreadcrumbRing(BreadcrumbHeader *header)
+{
+    BreadcrumbRing *rings = breadcrumbRings(header);
+    for (uint32_t i = 0; i < header->ringCount; ++i) {
+        uint32_t released = 1;
+        if (__atomic_compare_exchange_n(&rings[i].released, &released, 0, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&rings[i].head, 0, __ATOMIC_RELEASE);
+            return rings + i;
+        }
+    }
+    return nullptr;
+}
+#endif
+
+BreadcrumbRing *CrashHandlerSetup::claimBreadcrumbRing()
+{
+#ifdef BUILD_CRASH_HANDLER
+    BreadcrumbHeader *header = __atomic_load_n(&breadcrumbHeader, __ATOMIC_ACQUIRE);
+    if (!header)
+        return nullptr;
+    // 先按顺序领取从没用过的环，用完以后再回收退出的线程归还的环
+    BreadcrumbRing *ring = nullptr;
+    if (__atomic_load_n(&header->claimedRings, __ATOMIC_RELAXED) < header->ringCount) {
+        const uint32_t index = __atomic_fetch_add(&header->claimedRings, 1, __ATOMIC_RELAXED);
+        if (index < header->ringCount)
+            ring = breadcrumbRings(header) + index;
+    }
+    if (!ring)
+        ring = reclaimBreadcrumbRing(header);
+    if (ring) {
+        __atomic_store_n(&ring->tid, int32_t(syscall(SYS_gettid)), __ATOMIC_RELAXED);
+        threadBreadcrumbRing.ring = ring;
+    } else {
+        ring = &discardedBreadcrumbs;
+    }
+    currentBreadcrumbRing = ring;
+    return ring;
+#else
+    return nullptr;
+#endif
+}
+
+void CrashHandlerSetup::releaseBreadcrumbRing(BreadcrumbRing *ring)
+{
+#ifdef BUILD_CRASH_HANDLER
+    currentBreadcrumbRing = &discardedBreadcrumbs;
+    __atomic_store_n(&ring->released, 1, __ATOMIC_RELEASE);
+#else
+    Q_UNUSED(ring);
+#endif
+}
+
 CrashHandlerSetup::~CrashHandlerSetup()
 {
 #ifdef BUILD_CRASH_HANDLER
+    // 关闭 socket 后，空闲的 helper 读到 EOF 就会退出，守护进程则丢弃这个客户端
+    if (helperSocket != -1) {
+        close(helperSocket);
+        helperSocket = -1;
+    }
+    if (helperPid != -1) {
+        waitpid(helperPid, nullptr, 0);
+        helperPid = -1;
+    }
     delete[] crashHandlerPathC;
     delete[] appNameC;
-    free(signalHandlerStack);
+    delete crashRecord;
+    crashRecord = nullptr;
+    // 替代信号栈的池和面包屑的映射保留到进程退出，其他线程可能还在使用
+
 #endif
 }
@@ -1,14 +1,69 @@
 #pragma once
 
+#include "breadcrumbs.h"
+
 #include <QString>
+#include <QStringList>
 
 class CrashHandlerSetup
 {
 public:
     enum RestartCapability { EnableRestart, DisableRestart };
+    // SpawnHelperOnCrash - 崩溃时 fork() 并启动 crashhandler
+    // PreSpawnHelper - 预先启动 crashhandler，崩溃时只通过 socket 交给它一个记录
+    // UseDaemon - 向常驻的 crashhandler --daemon 注册，连不上时退回 SpawnHelperOnCrash
+    enum HelperMode { SpawnHelperOnCrash, PreSpawnHelper, UseDaemon };
 
     CrashHandlerSetup(const QString &appName,
                       RestartCapability restartCap = EnableRestart,
-                      const QString &executableDirPath = QString());
+                      const QString &executableDirPath = QString(),
+                      HelperMode helperMode = SpawnHelperOnCrash);
     ~CrashHandlerSetup();
+
+    // 崩溃的进程最多等 helper 这么多秒，之后直接退出，不再占着内存，helper 继续处理已经拿到的结果。
+    // 超时后就不能再附加调试器了，0 表示一直等。默认 120 秒，应该比 crashhandler 的收集期限长
+    static void setHelperTimeout(int seconds);
+    // 启动 crashhandler 时额外传给它的选项，比如 --headless、--stats-file，每个元素是一个参数。
+    // 必须在构造之前调用，最多 16 个。守护进程模式下由守护进程自己的命令行决定，不受影响
+    static void setHelperArguments(const QStringList &arguments);
+
+    // 替代信号栈是每个线程各自的，没有它的线程栈溢出时信号处理程序无法运行，进程直接被杀死。
+    // 构造函数为调用线程注册，其他线程在开始时调用 registerThread()，只是从预先映射的池里取一个栈，
+    // 线程退出时自动归还。池用完以后单独映射。可以在构造之前调用，这时也是单独映射
+    static bool registerThread();
+    static void unregisterThread();
+
+    // 热重启：崩溃后 crashhandler 从进程里取走登记的描述符（比如监听 socket、共享内存的 memfd），
+    // 交给重启的实例，重启期间新连接在监听队列里等待，而不是被拒绝。描述符必须一直打开。
+    // name 不能包含 '=' 和 ','，最长 31 个字符，最多 16 个，同名的再次登记时替换
+    static bool keepDescriptor(int fd, const char *name);
+    // 重启的实例用它取回描述符，没有时返回 -1。返回的描述符设置了 FD_CLOEXEC
+    static int inheritedDescriptor(const char *name);
+
+    // 为最多 maxThreads 个线程分配面包屑的环形缓冲区，之后 breadcrumb() 才会记录，崩溃报告里包含最近的事件
+    static bool enableBreadcrumbs(int maxThreads = 64);
+    // 记录一个事件，label 必须是字符串字面量（只保存地址）。不加锁，也不分配内存，可以在热路径上调用。
+    // 线程第一次调用时领取一个环，线程退出时归还。同时记录的线程超过 maxThreads 时，多出来的线程的事件被丢弃
+    static void breadcrumb(const char *label, quint64 value = 0)
+    {
+        BreadcrumbRing *ring = currentBreadcrumbRing;
+        if (Q_UNLIKELY(!ring)) {
+            ring = claimBreadcrumbRing();
+            if (!ring)
+                return;
+        }
+        const uint64_t head = ring->head;
+        Breadcrumb &event = ring->events[head & (BreadcrumbRingSize - 1)];
+        event.ticks = breadcrumbTicks();
+        event.label = uint64_t(uintptr_t(label));
+        event.value = value;
+        __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    }
+
+private:
+    // 没有启用时返回 nullptr
+    static BreadcrumbRing *claimBreadcrumbRing();
+    static void releaseBreadcrumbRing(BreadcrumbRing *ring);
+    friend struct ThreadBreadcrumbRing;
+    static thread_local BreadcrumbRing *currentBreadcrumbRing;
 };
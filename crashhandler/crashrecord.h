@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+// 崩溃进程的信号处理程序与 crashhandler 之间传递的数据块。
+// 信号处理程序中只能做异步信号安全的操作，所以这里只使用 POD 类型，
+// 并且整个结构体在 CrashHandlerSetup 中预先分配好。
+
+enum {
+    CrashRecordMagic = 0x43524852, // "CRHR"
+    CrashRecordVersion = 5,
+    CrashRecordMaxFrames = 128,
+    CrashRecordMaxRegisters = 36,
+    CrashRecordMaxKeptDescriptors = 16,
+    CrashRecordKeptNameSize = 32
+};
+
+// 重启的实例从这个环境变量里找到交给它的描述符，形如 "name=fd,name=fd"
+static const char CrashRecordKeptDescriptorsVariable[] = "CRASHHANDLER_KEPT_FDS";
+
+struct CrashRecord
+{
+    uint32_t magic;
+    uint32_t version;
+    int32_t signalNumber;
+    int32_t pid;
+    uint32_t frameCount;
+    int32_t breadcrumbFd; // 面包屑的 memfd，-1 表示没有
+    uint64_t signalNanoseconds;   // 进入信号处理程序，CLOCK_MONOTONIC
+    uint64_t handoverNanoseconds; // 把记录交给 helper 之前，CLOCK_MONOTONIC
+    // 出错的上下文，来自 siginfo_t 和 ucontext
+    int32_t faultingThread; // tid
+    int32_t signalCode;     // si_code
+    uint64_t faultAddress;  // si_addr，只对 SIGSEGV、SIGBUS、SIGILL 和 SIGFPE 有意义
+    uint64_t stackPointer;
+    uint64_t framePointer;
+    uint32_t registerCount;
+    uint32_t reserved;
+    uint64_t registers[CrashRecordMaxRegisters]; // 通用寄存器，按本机 mcontext 的顺序
+    // 热重启时交给新实例的描述符，编号是崩溃的进程里的，见 CrashHandlerSetup::keepDescriptor()
+    uint32_t keptDescriptorCount;
+    uint32_t keptDescriptorsInherited; // 1 表示 fork() 启动的 helper 以相同的编号继承了它们
+    int32_t keptDescriptors[CrashRecordMaxKeptDescriptors];
+    char keptDescriptorNames[CrashRecordMaxKeptDescriptors][CrashRecordKeptNameSize]; // 以 '\0' 结尾
+    uint64_t frames[CrashRecordMaxFrames]; // 崩溃线程的原始 PC，frames[0] 为出错的指令
+};
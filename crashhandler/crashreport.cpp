@@ -0,0 +1,465 @@
+#include "crashreport.h"
+
+#include <QHash>
+#include <QIODevice>
+
+#include <string.h>
+
+namespace {
+const char reportMagic[8] = { 'C', 'H', 'R', 'E', 'P', 'O', 'R', 'T' };
+const char padding[8] = {};
+}
+
+Q_STATIC_ASSERT(sizeof(CrashReportFileHeader) == 16);
+Q_STATIC_ASSERT(sizeof(CrashReportSectionHeader) == 16);
+Q_STATIC_ASSERT(sizeof(CrashReportThread) == 32);
+Q_STATIC_ASSERT(sizeof(CrashReportRegisterSet) == 24 + 8 * RawRegisters::MaxRegisters);
+Q_STATIC_ASSERT(sizeof(CrashReportFrame) == 24);
+Q_STATIC_ASSERT(sizeof(CrashReportStackSnippet) == 16);
+Q_STATIC_ASSERT(sizeof(CrashReportModule) == 32);
+
+static quint64 alignedSize(quint64 size)
+{
+    return (size + 7) & ~quint64(7);
+}
+
+CrashReportWriter::CrashReportWriter(QIODevice *device)
+    : m_device(device)
+{
+}
+
+bool CrashReportWriter::writeData(const void *data, qint64 size)
+{
+    return m_device->write(static_cast<const char *>(data), size) == size;
+}
+
+bool CrashReportWriter::writeSection(CrashReportSectionType type, quint32 count, const QByteArray &payload)
+{
+    CrashReportSectionHeader header;
+    header.type = type;
+    header.count = count;
+    header.size = quint64(payload.size());
+    return writeData(&header, sizeof(header))
+            && writeData(payload.constData(), payload.size())
+            && writeData(padding, qint64(alignedSize(header.size) - header.size));
+}
+
+bool CrashReportWriter::write(const RawCapture &capture)
+{
+    return writeHeader(capture.machine, capture.pid)
+            && writeProperties(CrashReportMetadata, capture.metadata)
+            && writeProperties(CrashReportSystemInfo, capture.systemInfo)
+            && writeModules(capture.modules)
+            && writeThreads(capture.threads)
+            && writeRegisters(capture.threads)
+            && writeFrames(capture.threads, capture.modules)
+            && writeStackMemory(capture.threads)
+            && writeEnd();
+}
+
+bool CrashReportWriter::writeHeader(quint16 machine, pid_t pid)
+{
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    // 报告格式是小端的，目前支持的架构都不需要转换
+    Q_UNUSED(machine);
+    Q_UNUSED(pid);
+    return false;
+#else
+    CrashReportFileHeader header;
+    memcpy(header.magic, reportMagic, sizeof(reportMagic));
+    header.version = CrashReportVersion;
+    header.machine = machine;
+    header.pid = pid;
+    return writeData(&header, sizeof(header));
+#endif
+}
+
+bool CrashReportWriter::writeProperties(CrashReportSectionType type, const RawProperties &properties)
+{
+    QByteArray payload;
+    for (int i = 0; i < properties.size(); ++i) {
+        payload.append(properties.at(i).first.toUtf8());
+        payload.append('\0');
+        payload.append(properties.at(i).second.toUtf8());
+        payload.append('\0');
+    }
+    return writeSection(type, quint32(properties.size()), payload);
+}
+
+bool CrashReportWriter::writeThreads(const QVector<RawThread> &threads)
+{
+    QByteArray payload(threads.size() * int(sizeof(CrashReportThread)), '\0');
+    CrashReportThread *records = reinterpret_cast<CrashReportThread *>(payload.data());
+    quint32 firstFrame = 0;
+    for (int i = 0; i < threads.size(); ++i) {
+        const RawThread &thread = threads.at(i);
+        const QByteArray name = thread.name.toUtf8().left(int(sizeof(records[i].name)) - 1);
+        records[i].tid = thread.tid;
+        records[i].flags = 0;
+        memcpy(records[i].name, name.constData(), size_t(name.size()));
+        records[i].firstFrame = firstFrame;
+        records[i].frameCount = quint32(thread.frames.size());
+        firstFrame += records[i].frameCount;
+    }
+    return writeSection(CrashReportThreads, quint32(threads.size()), payload);
+}
+
+bool CrashReportWriter::writeRegisters(const QVector<RawThread> &threads)
+{
+    QByteArray payload(threads.size() * int(sizeof(CrashReportRegisterSet)), '\0');
+    CrashReportRegisterSet *records = reinterpret_cast<CrashReportRegisterSet *>(payload.data());
+    for (int i = 0; i < threads.size(); ++i) {
+        const RawRegisters &registers = threads.at(i).registers;
+        records[i].tid = threads.at(i).tid;
+        records[i].pc = registers.pc;
+        records[i].validMask = registers.validMask;
+        memcpy(records[i].values, registers.values, sizeof(records[i].values));
+    }
+    return writeSection(CrashReportRegisters, quint32(threads.size()), payload);
+}
+
+bool CrashReportWriter::writeFrames(const QVector<RawThread> &threads, const QVector<RawModule> &modules)
+{
+    QByteArray payload;
+    quint32 count = 0;
+    foreach (const RawThread &thread, threads) {
+        foreach (const RawFrame &frame, thread.frames) {
+            CrashReportFrame record;
+            record.pc = frame.pc;
+            record.sp = frame.sp;
+            record.flags = frame.isReturnAddress ? CrashReportFrameReturnAddress : 0;
+            const RawModule *module = findRawModule(modules, frame.isReturnAddress ? frame.pc - 1 : frame.pc);
+            record.module = module ? quint32(module - modules.constData()) : quint32(CrashReportNoModule);
+            payload.append(reinterpret_cast<const char *>(&record), sizeof(record));
+            ++count;
+        }
+    }
+    return writeSection(CrashReportFrames, count, payload);
+}
+
+bool CrashReportWriter::writeStackMemory(const QVector<RawThread> &threads)
+{
+    // 栈内存是报告里最大的部分，逐段直接写出，不先拼成一整块
+    quint64 size = 0;
+    quint32 count = 0;
+    foreach (const RawThread &thread, threads) {
+        if (thread.stack.isEmpty())
+            continue;
+        size += sizeof(CrashReportStackSnippet) + alignedSize(quint64(thread.stack.size()));
+        ++count;
+    }
+
+    CrashReportSectionHeader header;
+    header.type = CrashReportStackMemory;
+    header.count = count;
+    header.size = size;
+    if (!writeData(&header, sizeof(header)))
+        return false;
+
+    foreach (const RawThread &thread, threads) {
+        if (thread.stack.isEmpty())
+            continue;
+        CrashReportStackSnippet snippet;
+        snippet.tid = thread.tid;
+        snippet.size = quint32(thread.stack.size());
+        snippet.address = thread.stackAddress;
+        if (!writeData(&snippet, sizeof(snippet))
+                || !writeData(thread.stack.constData(), snippet.size)
+                || !writeData(padding, qint64(alignedSize(snippet.size) - snippet.size))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CrashReportWriter::writeModules(const QVector<RawModule> &modules)
+{
+    QByteArray strings(1, '\0'); // 偏移 0 是空串
+    QHash<QByteArray, quint32> stringOffsets;
+    auto addString = [&](const QByteArray &string) -> quint32 {
+        if (string.isEmpty())
+            return 0;
+        auto it = stringOffsets.constFind(string);
+        if (it != stringOffsets.constEnd())
+            return it.value();
+        const quint32 offset = quint32(strings.size());
+        strings.append(string);
+        strings.append('\0');
+        stringOffsets.insert(string, offset);
+        return offset;
+    };
+
+    QByteArray payload(modules.size() * int(sizeof(CrashReportModule)), '\0');
+    CrashReportModule *records = reinterpret_cast<CrashReportModule *>(payload.data());
+    for (int i = 0; i < modules.size(); ++i) {
+        const RawModule &module = modules.at(i);
+        records[i].start = module.start;
+        records[i].end = module.end;
+        records[i].base = module.base;
+        records[i].path = addString(module.path.toUtf8());
+        records[i].buildId = addString(module.buildId);
+    }
+    payload.append(strings);
+    return writeSection(CrashReportModules, quint32(modules.size()), payload);
+}
+
+bool CrashReportWriter::writeEnd()
+{
+    return writeSection(CrashReportEnd, 0, QByteArray());
+}
+
+CrashReportReader::CrashReportReader()
+{
+}
+
+CrashReportReader::~CrashReportReader()
+{
+}
+
+void CrashReportReader::fail(const QString &errorString)
+{
+    m_errorString = errorString;
+    m_data = nullptr;
+}
+
+bool CrashReportReader::open(const QString &fileName)
+{
+    m_file.reset(new QFile(fileName));
+    if (!m_file->open(QIODevice::ReadOnly)) {
+        fail(m_file->errorString());
+        return false;
+    }
+
+    const qint64 size = m_file->size();
+    const uchar *data = size > 0 ? m_file->map(0, size) : nullptr;
+    if (!data) {
+        fail(QString("Could not map %1.").arg(fileName));
+        return false;
+    }
+    return openData(data, quint64(size));
+}
+
+bool CrashReportReader::openData(const uchar *data, quint64 size)
+{
+    m_complete = false;
+    m_sections.clear();
+    m_threadCount = m_registerSetCount = m_frameCount = m_moduleCount = 0;
+    m_threads = nullptr;
+    m_registerSets = nullptr;
+    m_frames = nullptr;
+    m_stackSnippets.clear();
+    m_modules = nullptr;
+    m_moduleStrings = nullptr;
+    m_moduleStringsSize = 0;
+
+    m_data = data;
+    m_size = size;
+    return parse();
+}
+
+quint16 CrashReportReader::version() const
+{
+    return m_data ? reinterpret_cast<const CrashReportFileHeader *>(m_data)->version : 0;
+}
+
+quint16 CrashReportReader::machine() const
+{
+    return m_data ? reinterpret_cast<const CrashReportFileHeader *>(m_data)->machine : 0;
+}
+
+pid_t CrashReportReader::pid() const
+{
+    return m_data ? reinterpret_cast<const CrashReportFileHeader *>(m_data)->pid : 0;
+}
+
+bool CrashReportReader::parse()
+{
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    fail(QLatin1String("Crash reports can only be read on little-endian hosts."));
+    return false;
+#endif
+    if (m_size < sizeof(CrashReportFileHeader)) {
+        fail(QLatin1String("File is too small to be a crash report."));
+        return false;
+    }
+    const CrashReportFileHeader *header = reinterpret_cast<const CrashReportFileHeader *>(m_data);
+    if (memcmp(header->magic, reportMagic, sizeof(reportMagic)) != 0) {
+        fail(QLatin1String("Not a crash report."));
+        return false;
+    }
+    if (header->version != CrashReportVersion) {
+        fail(QString("Unsupported crash report version %1.").arg(header->version));
+        return false;
+    }
+
+    // 截断的报告只读到最后一个完整的节为止
+    quint64 position = sizeof(CrashReportFileHeader);
+    while (position + sizeof(CrashReportSectionHeader) <= m_size) {
+        Section section;
+        section.header = reinterpret_cast<const CrashReportSectionHeader *>(m_data + position);
+        section.payload = m_data + position + sizeof(CrashReportSectionHeader);
+        const quint64 available = m_size - position - sizeof(CrashReportSectionHeader);
+        if (section.header->size > available)
+            break;
+        if (section.header->type == CrashReportEnd) {
+            m_complete = true;
+            break;
+        }
+        m_sections.append(section);
+        position += sizeof(CrashReportSectionHeader) + qMin(alignedSize(section.header->size), available);
+    }
+
+    // 未知类型的节直接跳过，新版本可以追加节而不破坏旧的读取器
+    if (const Section *section = findSection(CrashReportThreads)) {
+        if (section->header->size >= quint64(section->header->count) * sizeof(CrashReportThread)) {
+            m_threadCount = int(section->header->count);
+            m_threads = reinterpret_cast<const CrashReportThread *>(section->payload);
+        }
+    }
+    if (const Section *section = findSection(CrashReportRegisters)) {
+        if (section->header->size >= quint64(section->header->count) * sizeof(CrashReportRegisterSet)) {
+            m_registerSetCount = int(section->header->count);
+            m_registerSets = reinterpret_cast<const CrashReportRegisterSet *>(section->payload);
+        }
+    }
+    if (const Section *section = findSection(CrashReportFrames)) {
+        if (section->header->size >= quint64(section->header->count) * sizeof(CrashReportFrame)) {
+            m_frameCount = int(section->header->count);
+            m_frames = reinterpret_cast<const CrashReportFrame *>(section->payload);
+        }
+    }
+    if (const Section *section = findSection(CrashReportStackMemory)) {
+        quint64 offset = 0;
+        for (quint32 i = 0; i < section->header->count; ++i) {
+            if (offset + sizeof(CrashReportStackSnippet) > section->header->size)
+                break;
+            const CrashReportStackSnippet *snippet =
+                    reinterpret_cast<const CrashReportStackSnippet *>(section->payload + offset);
+            offset += sizeof(CrashReportStackSnippet);
+            if (snippet->size > section->header->size - offset)
+                break;
+            m_stackSnippets.append(snippet);
+            offset += alignedSize(snippet->size);
+        }
+    }
+    if (const Section *section = findSection(CrashReportModules)) {
+        const quint64 recordsSize = quint64(section->header->count) * sizeof(CrashReportModule);
+        if (section->header->size > recordsSize
+                && section->payload[section->header->size - 1] == '\0') {
+            m_moduleCount = int(section->header->count);
+            m_modules = reinterpret_cast<const CrashReportModule *>(section->payload);
+            m_moduleStrings = reinterpret_cast<const char *>(section->payload + recordsSize);
+            m_moduleStringsSize = section->header->size - recordsSize;
+        }
+    }
+    return true;
+}
+
+const CrashReportReader::Section *CrashReportReader::findSection(CrashReportSectionType type) const
+{
+    for (int i = 0; i < m_sections.size(); ++i) {
+        if (m_sections.at(i).header->type == quint32(type))
+            return &m_sections.at(i);
+    }
+    return nullptr;
+}
+
+RawProperties CrashReportReader::properties(CrashReportSectionType type) const
+{
+    RawProperties properties;
+    const Section *section = findSection(type);
+    if (!section)
+        return properties;
+
+    const char *position = reinterpret_cast<const char *>(section->payload);
+    const char *end = position + section->header->size;
+    for (quint32 i = 0; i < section->header->count; ++i) {
+        const char *key = position;
+        const char *keyEnd = static_cast<const char *>(memchr(key, '\0', size_t(end - key)));
+        if (!keyEnd)
+            break;
+        const char *value = keyEnd + 1;
+        const char *valueEnd = static_cast<const char *>(memchr(value, '\0', size_t(end - value)));
+        if (!valueEnd)
+            break;
+        properties.append(qMakePair(QString::fromUtf8(key, int(keyEnd - key)),
+                                    QString::fromUtf8(value, int(valueEnd - value))));
+        position = valueEnd + 1;
+    }
+    return properties;
+}
+
+QString CrashReportReader::threadName(const CrashReportThread &thread) const
+{
+    return QString::fromUtf8(thread.name, int(strnlen(thread.name, sizeof(thread.name))));
+}
+
+const uchar *CrashReportReader::stackSnippetData(int index) const
+{
+    return reinterpret_cast<const uchar *>(m_stackSnippets.at(index) + 1);
+}
+
+const char *CrashReportReader::moduleString(quint32 offset) const
+{
+    if (offset >= m_moduleStringsSize)
+        return "";
+    return m_moduleStrings + offset;
+}
+
+RawCapture CrashReportReader::toRawCapture() const
+{
+    RawCapture capture;
+    if (!m_data)
+        return capture;
+
+    capture.machine = machine();
+    capture.pid = pid();
+    capture.metadata = metadata();
+    capture.systemInfo = systemInfo();
+
+    for (int i = 0; i < m_moduleCount; ++i) {
+        RawModule module;
+        module.start = m_modules[i].start;
+        module.end = m_modules[i].end;
+        module.base = m_modules[i].base;
+        module.path = QString::fromUtf8(moduleString(m_modules[i].path));
+        module.buildId = QByteArray(moduleString(m_modules[i].buildId));
+        capture.modules.append(module);
+    }
+
+    QHash<pid_t, int> snippetIndexes;
+    for (int i = 0; i < m_stackSnippets.size(); ++i)
+        snippetIndexes.insert(m_stackSnippets.at(i)->tid, i);
+
+    for (int i = 0; i < m_threadCount; ++i) {
+        const CrashReportThread &record = m_threads[i];
+        RawThread thread;
+        thread.tid = record.tid;
+        thread.name = threadName(record);
+
+        if (i < m_registerSetCount && m_registerSets[i].tid == record.tid) {
+            thread.registers.pc = m_registerSets[i].pc;
+            thread.registers.validMask = m_registerSets[i].validMask;
+            memcpy(thread.registers.values, m_registerSets[i].values, sizeof(thread.registers.values));
+        }
+
+        const quint64 frameEnd = qMin<quint64>(quint64(record.firstFrame) + record.frameCount,
+                                               quint64(m_frameCount));
+        for (quint64 j = record.firstFrame; j < frameEnd; ++j) {
+            RawFrame frame;
+            frame.pc = m_frames[j].pc;
+            frame.sp = m_frames[j].sp;
+            frame.isReturnAddress = m_frames[j].flags & CrashReportFrameReturnAddress;
+            thread.frames.append(frame);
+        }
+
+        const int snippet = snippetIndexes.value(record.tid, -1);
+        if (snippet >= 0) {
+            thread.stackAddress = m_stackSnippets.at(snippet)->address;
+            thread.stack = QByteArray(reinterpret_cast<const char *>(stackSnippetData(snippet)),
+                                      int(m_stackSnippets.at(snippet)->size));
+        }
+        capture.threads.append(thread);
+    }
+    return capture;
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include "rawcapture.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QScopedPointer>
+#include <QString>
+#include <QVector>
+
+class QIODevice;
+
+// 二进制崩溃报告。
+//
+// 文件由一个文件头和若干个节组成，每个节以 CrashReportSectionHeader 开头，
+// 负载按 8 字节对齐，最后是一个 CrashReportEnd 节。写入时只顺序追加，不需要回头修改，
+// 没有 CrashReportEnd 的报告是写了一半的，读取时仍然可以读出已经完整写入的节。
+// 所有字段都是小端字节序，记录都是定长的，读取时直接 mmap 文件并返回指向记录的指针。
+
+enum {
+    CrashReportVersion = 1
+};
+
+enum CrashReportSectionType {
+    CrashReportEnd = 0,
+    CrashReportMetadata = 1,   // 键值对：key\0value\0...
+    CrashReportSystemInfo = 2, // 同上
+    CrashReportThreads = 3,    // CrashReportThread[count]
+    CrashReportRegisters = 4,  // CrashReportRegisterSet[count]，与线程一一对应
+    CrashReportFrames = 5,     // CrashReportFrame[count]，所有线程的帧依次排列
+    CrashReportStackMemory = 6, // count 个 (CrashReportStackSnippet + 数据，按 8 字节对齐)
+    CrashReportModules = 7     // CrashReportModule[count] + 字符串表
+};
+
+struct CrashReportFileHeader
+{
+    char magic[8]; // "CHREPORT"
+    quint16 version;
+    quint16 machine; // ELF e_machine
+    qint32 pid;
+};
+
+struct CrashReportSectionHeader
+{
+    quint32 type;
+    quint32 count; // 负载中的记录数
+    quint64 size;  // 负载字节数，不含对齐填充
+};
+
+struct CrashReportThread
+{
+    qint32 tid;
+    quint32 flags; // 保留
+    char name[16]; // /proc/<pid>/task/<tid>/comm，最长 15 个字节
+    quint32 firstFrame;
+    quint32 frameCount;
+};
+
+struct CrashReportRegisterSet
+{
+    qint32 tid;
+    quint32 reserved;
+    quint64 pc;
+    quint64 validMask;
+    quint64 values[RawRegisters::MaxRegisters];
+};
+
+enum {
+    CrashReportFrameReturnAddress = 0x1,
+    CrashReportNoModule = 0xffffffff
+};
+
+struct CrashReportFrame
+{
+    quint64 pc;
+    quint64 sp;
+    quint32 module; // CrashReportModule 的下标，CrashReportNoModule 表示不在任何模块中
+    quint32 flags;
+};
+
+struct CrashReportStackSnippet
+{
+    qint32 tid;
+    quint32 size;
+    quint64 address;
+};
+
+struct CrashReportModule
+{
+    quint64 start;
+    quint64 end;
+    quint64 base;
+    quint32 path;    // 字符串表偏移
+    quint32 buildId; // 字符串表偏移
+};
+
+// 把报告顺序写到 device，device 可以是文件、管道或 socket
+class CrashReportWriter
+{
+public:
+    explicit CrashReportWriter(QIODevice *device);
+
+    bool write(const RawCapture &capture);
+
+    bool writeHeader(quint16 machine, pid_t pid);
+    bool writeProperties(CrashReportSectionType type, const RawProperties &properties);
+    bool writeThreads(const QVector<RawThread> &threads);
+    bool writeRegisters(const QVector<RawThread> &threads);
+    bool writeFrames(const QVector<RawThread> &threads, const QVector<RawModule> &modules);
+    bool writeStackMemory(const QVector<RawThread> &threads);
+    bool writeModules(const QVector<RawModule> &modules);
+    bool writeEnd();
+
+private:
+    bool writeSection(CrashReportSectionType type, quint32 count, const QByteArray &payload);
+    bool writeData(const void *data, qint64 size);
+
+    QIODevice *m_device;
+};
+
+// 通过 mmap 读取报告，不复制记录
+class CrashReportReader
+{
+public:
+    CrashReportReader();
+    ~CrashReportReader();
+
+    bool open(const QString &fileName);
+    // data 在读取器的生命周期内必须保持有效
+    bool openData(const uchar *data, quint64 size);
+
+    QString errorString() const { return m_errorString; }
+    // 是否读到了 CrashReportEnd 节，否则报告是被截断的
+    bool isComplete() const { return m_complete; }
+
+    quint16 version() const;
+    quint16 machine() const;
+    pid_t pid() const;
+
+    RawProperties metadata() const { return properties(CrashReportMetadata); }
+    RawProperties systemInfo() const { return properties(CrashReportSystemInfo); }
+
+    int threadCount() const { return m_threadCount; }
+    const CrashReportThread *threads() const { return m_threads; }
+    QString threadName(const CrashReportThread &thread) const;
+
+    int registerSetCount() const { return m_registerSetCount; }
+    const CrashReportRegisterSet *registerSets() const { return m_registerSets; }
+
+    int frameCount() const { return m_frameCount; }
+    const CrashReportFrame *frames() const { return m_frames; }
+
+    int stackSnippetCount() const { return m_stackSnippets.size(); }
+    const CrashReportStackSnippet *stackSnippet(int index) const { return m_stackSnippets.at(index); }
+    const uchar *stackSnippetData(int index) const;
+
+    int moduleCount() const { return m_moduleCount; }
+    const CrashReportModule *modules() const { return m_modules; }
+    const char *moduleString(quint32 offset) const;
+
+    // 把报告转换回内存中的结构，供符号化使用
+    RawCapture toRawCapture() const;
+
+private:
+    struct Section
+    {
+        const CrashReportSectionHeader *header;
+        const uchar *payload;
+    };
+
+    bool parse();
+    const Section *findSection(CrashReportSectionType type) const;
+    RawProperties properties(CrashReportSectionType type) const;
+    void fail(const QString &errorString);
+
+    QScopedPointer<QFile> m_file;
+    const uchar *m_data = nullptr;
+    quint64 m_size = 0;
+    QString m_errorString;
+    bool m_complete = false;
+    QVector<Section> m_sections;
+
+    int m_threadCount = 0;
+    const CrashReportThread *m_threads = nullptr;
+    int m_registerSetCount = 0;
+    const CrashReportRegisterSet *m_registerSets = nullptr;
+    int m_frameCount = 0;
+    const CrashReportFrame *m_frames = nullptr;
+    QVector<const CrashReportStackSnippet *> m_stackSnippets;
+    int m_moduleCount = 0;
+    const CrashReportModule *m_modules = nullptr;
+    const char *m_moduleStrings = nullptr;
+    quint64 m_moduleStringsSize = 0;
+};
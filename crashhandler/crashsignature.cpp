@@ -0,0 +1,127 @@
+#include "crashsignature.h"
+#include "elffile.h"
+#include "processmaps.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLockFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace {
+const int defaultRecollectInterval = 10;
+const int lockTimeout = 2000; // ms
+const char entrySuffix[] = ".json";
+const char occurrencesFileName[] = "occurrences.log";
+const char lockFileName[] = "signatures.lock";
+const qint64 maximumLogSize = 4 * 1024 * 1024; // 超过后轮换为 occurrences.log.1
+}
+
+QByteArray CrashSignature::compute(int signalNumber, const QVector<quint64> &frames,
+                                   const ProcessMaps &maps, int frameCount)
+{
+    QHash<QString, QByteArray> moduleIds;
+    QByteArray normalized = QByteArray::number(signalNumber);
+
+    for (int i = 0; i < frames.size() && i < frameCount; ++i) {
+        // 除了第 0 帧以外都是返回地址，减一后才落在调用指令内
+        const quint64 pc = i == 0 ? frames.at(i) : frames.at(i) - 1;
+        normalized += '|';
+
+        const MemoryMapping *mapping = maps.findMapping(pc);
+        if (!mapping || !mapping->isFileBacked()) {
+            normalized += '?'; // JIT 代码之类的匿名映射，地址没有意义
+            continue;
+        }
+
+        auto it = moduleIds.constFind(mapping->path);
+        if (it == moduleIds.constEnd()) {
+            // 没有 build-id 时退回文件名，这样至少不依赖安装路径
+            ElfFile elf;
+            QByteArray moduleId;
+            if (elf.load(mapping->path))
+                moduleId = elf.buildId();
+            if (moduleId.isEmpty())
+                moduleId = QFileInfo(mapping->path).fileName().toUtf8();
+            it = moduleIds.insert(mapping->path, moduleId);
+        }
+        normalized += it.value() + '+' + QByteArray::number(pc - mapping->loadBase, 16);
+    }
+
+    return QCryptographicHash::hash(normalized, QCryptographicHash::Sha1).toHex();
+}
+
+CrashSignatureStore::CrashSignatureStore(const QString &directory)
+    : m_directory(directory.isEmpty() ? defaultDirectory() : directory)
+    , m_recollectInterval(defaultRecollectInterval)
+{
+}
+
+QString CrashSignatureStore::defaultDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
+            + QLatin1String("/crashhandler/signatures");
+}
+
+CrashSignatureStore::Occurrence CrashSignatureStore::record(const QByteArray &signature,
+                                                            const QString &appName, pid_t pid)
+{
+    Occurrence occurrence;
+    if (signature.isEmpty() || !QDir().mkpath(m_directory))
+        return occurrence;
+
+    // 拿不到锁时宁可多收集一次
+    QLockFile lock(m_directory + QLatin1Char('/') + QLatin1String(lockFileName));
+    if (!lock.tryLock(lockTimeout))
+        return occurrence;
+
+    // 指纹是十六进制的 SHA-1，可以直接用作文件名
+    const QString key = QString::fromLatin1(signature);
+    const QString entryPath = m_directory + QLatin1Char('/') + key + QLatin1String(entrySuffix);
+    QJsonObject entry;
+    QFile entryFile(entryPath);
+    if (entryFile.open(QIODevice::ReadOnly))
+        entry = QJsonDocument::fromJson(entryFile.readAll()).object();
+    entryFile.close();
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch() / 1000;
+    occurrence.hitCount = entry.value("hits").toInt() + 1;
+    occurrence.fullCollection = (occurrence.hitCount - 1) % m_recollectInterval == 0;
+
+    if (occurrence.hitCount == 1)
+        entry.insert("firstSeen", double(now));
+    entry.insert("lastSeen", double(now));
+    entry.insert("hits", occurrence.hitCount);
+    entry.insert("app", appName);
+    if (occurrence.fullCollection)
+        entry.insert("lastCollected", double(now));
+
+    QSaveFile saveFile(entryPath);
+    if (saveFile.open(QIODevice::WriteOnly)) {
+        saveFile.write(QJsonDocument(entry).toJson(QJsonDocument::Compact));
+        saveFile.commit();
+    }
+
+    // 每次发生只追加一行，便于事后统计崩溃风暴
+    const QString logPath = m_directory + QLatin1Char('/') + QLatin1String(occurrencesFileName);
+    if (QFileInfo(logPath).size() >= maximumLogSize) {
+        const QString previousPath = logPath + QLatin1String(".1");
+        QFile::remove(previousPath);
+        QFile::rename(logPath, previousPath);
+    }
+    QFile log(logPath);
+    if (log.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        log.write(QString("%1 %2 %3 %4 %5\n")
+                  .arg(QDateTime::currentDateTimeUtc().toString(Qt::ISODate), key)
+                  .arg(pid)
+                  .arg(occurrence.fullCollection ? "collected" : "skipped", appName)
+                  .toUtf8());
+    }
+    return occurrence;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include <sys/types.h>
+
+class ProcessMaps;
+
+// 崩溃指纹：信号编号加上崩溃线程栈顶几帧规范化后的位置（模块 build-id 与模块内偏移），取 SHA-1。
+// 模块内偏移与 ASLR 无关，build-id 相同的二进制在不同机器上得到相同的指纹。
+// 不用 strsignal() 的文本，它随语言环境变化，守护进程和单独启动的 helper 会得到不同的指纹。
+namespace CrashSignature {
+
+enum { DefaultFrameCount = 8 };
+
+// frames 为信号处理程序在进程内回溯到的原始 PC，frames[0] 为出错的指令
+QByteArray compute(int signalNumber, const QVector<quint64> &frames,
+                   const ProcessMaps &maps, int frameCount = DefaultFrameCount);
+
+} // namespace CrashSignature
+
+// 本机见过的崩溃指纹。已知的崩溃只追加一条发生记录，不再做完整的回溯收集，
+// 每 recollectInterval 次重新收集一次，以免错过同一指纹下的新信息。
+// 每个指纹一个小文件，一次崩溃只重写它自己的那一个；发生记录超过上限时轮换，只保留上一份。
+class CrashSignatureStore
+{
+public:
+    struct Occurrence
+    {
+        int hitCount = 0;         // 包括这一次
+        bool fullCollection = true; // 是否需要完整收集
+    };
+
+    explicit CrashSignatureStore(const QString &directory = QString());
+
+    static QString defaultDirectory();
+
+    QString directory() const { return m_directory; }
+    void setRecollectInterval(int interval) { m_recollectInterval = qMax(1, interval); }
+    int recollectInterval() const { return m_recollectInterval; }
+
+    // 记录一次发生并返回是否需要完整收集，多个 crashhandler 可以同时调用
+    Occurrence record(const QByteArray &signature, const QString &appName, pid_t pid);
+
+private:
+    QString m_directory;
+    int m_recollectInterval;
+};
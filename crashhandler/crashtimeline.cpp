@@ -0,0 +1,88 @@
+#include "crashtimeline.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <time.h>
+
+namespace {
+const char *const phaseNames[CrashTimeline::PhaseCount] = {
+    "signal",
+    "handover",
+    "helperStart",
+    "collectionStart",
+    "firstOutput",
+    "debuggerFinished",
+    "backtraceFinished",
+    "finalState",
+    "restart"
+};
+}
+
+static double milliseconds(quint64 nanoseconds, quint64 base)
+{
+    return nanoseconds >= base ? double(nanoseconds - base) / 1000000.0
+                               : -double(base - nanoseconds) / 1000000.0;
+}
+
+quint64 CrashTimeline::now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return quint64(now.tv_sec) * 1000000000 + quint64(now.tv_nsec);
+}
+
+QString CrashTimeline::phaseName(Phase phase)
+{
+    return QLatin1String(phaseNames[phase]);
+}
+
+void CrashTimeline::mark(Phase phase, quint64 nanoseconds)
+{
+    if (m_times[phase] == 0)
+        m_times[phase] = nanoseconds;
+}
+
+quint64 CrashTimeline::baseTime() const
+{
+    if (isMarked(SignalPhase))
+        return m_times[SignalPhase];
+    quint64 base = 0;
+    for (int i = 0; i < PhaseCount; ++i) {
+        if (m_times[i] != 0 && (base == 0 || m_times[i] < base))
+            base = m_times[i];
+    }
+    return base;
+}
+
+RawProperties CrashTimeline::toMetadata() const
+{
+    RawProperties metadata;
+    const quint64 base = baseTime();
+    for (int i = 0; i < PhaseCount; ++i) {
+        if (m_times[i] == 0)
+            continue;
+        metadata.append(qMakePair(QLatin1String("phase.") + phaseName(Phase(i)),
+                                  QString::number(milliseconds(m_times[i], base), 'f', 3)));
+    }
+    return metadata;
+}
+
+QByteArray CrashTimeline::toJson(const RawProperties &context) const
+{
+    QJsonObject stats;
+    for (int i = 0; i < context.size(); ++i)
+        stats.insert(context.at(i).first, context.at(i).second);
+
+    QJsonObject phases;
+    const quint64 base = baseTime();
+    for (int i = 0; i < PhaseCount; ++i) {
+        if (m_times[i] != 0)
+            phases.insert(phaseName(Phase(i)), milliseconds(m_times[i], base));
+    }
+    stats.insert(QLatin1String("phases"), phases);
+    stats.insert(QLatin1String("relativeToSignal"), isMarked(SignalPhase));
+    // 与其他进程测得的 CLOCK_MONOTONIC 时间对照，比如崩溃的进程什么时候退出
+    stats.insert(QLatin1String("baseNanoseconds"), QString::number(base));
+    return QJsonDocument(stats).toJson(QJsonDocument::Compact);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "rawcapture.h"
+
+#include <QString>
+#include <QtGlobal>
+
+// 一次崩溃处理中各阶段的时间点，CLOCK_MONOTONIC 的纳秒，在崩溃的进程和 crashhandler 之间可以直接比较。
+// 写进报告的元数据（phase.<名称>，相对信号处理程序入口的毫秒数），也可以作为一行 JSON 追加到统计文件，
+// 用来跟踪各个版本和各台机器上的崩溃处理延迟。
+class CrashTimeline
+{
+public:
+    // SignalPhase - 进入 signalHandler()
+    // HandoverPhase - 把崩溃记录交给 helper（fork/exec 或者写入已经建立的 socket）之前
+    // HelperStartPhase - crashhandler 的 main() 开始，守护进程中为收到崩溃记录
+    // CollectionStartPhase - BacktraceCollector::run()，原生回溯或者 gdb 开始
+    // FirstOutputPhase - 第一帧：gdb 输出的第一个帧，或者原生回溯完成
+    // DebuggerFinishedPhase - gdb 退出
+    // BacktraceFinishedPhase - 回溯收集结束（核心转储之前）
+    // FinalStatePhase - 对话框进入最终状态，或者无界面模式下写完结果
+    // RestartPhase - 重启应用程序
+    enum Phase {
+        SignalPhase,
+        HandoverPhase,
+        HelperStartPhase,
+        CollectionStartPhase,
+        FirstOutputPhase,
+        DebuggerFinishedPhase,
+        BacktraceFinishedPhase,
+        FinalStatePhase,
+        RestartPhase,
+        PhaseCount
+    };
+
+    static quint64 now();
+    static QString phaseName(Phase phase);
+
+    // 每个阶段只记录第一次，0 表示没有
+    void mark(Phase phase, quint64 nanoseconds = now());
+    bool isMarked(Phase phase) const { return m_times[phase] != 0; }
+    quint64 time(Phase phase) const { return m_times[phase]; }
+
+    // 已经记录的阶段，相对信号处理程序入口，没有时相对最早的阶段
+    RawProperties toMetadata() const;
+    // 一行紧凑的 JSON，context 中的项放在前面
+    QByteArray toJson(const RawProperties &context) const;
+
+private:
+    quint64 baseTime() const;
+
+    quint64 m_times[PhaseCount] = {};
+};
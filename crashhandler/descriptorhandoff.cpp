@@ -0,0 +1,102 @@
+#include "descriptorhandoff.h"
+#include "crashrecord.h"
+
+#include <QStringList>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/syscall.h>
+
+// 旧的内核头文件里没有这两个系统调用号，它们在所有架构上相同
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_pidfd_getfd
+#define SYS_pidfd_getfd 438
+#endif
+
+DescriptorHandoff::~DescriptorHandoff()
+{
+    for (int i = 0; i < m_descriptors.size(); ++i)
+        close(m_descriptors.at(i).second);
+}
+
+bool DescriptorHandoff::take(pid_t pid, const CrashRecord &record)
+{
+    const uint32_t count = qMin(record.keptDescriptorCount, uint32_t(CrashRecordMaxKeptDescriptors));
+    if (count == 0)
+        return true;
+
+    // fork() 方式下描述符已经以相同的编号继承下来，直接使用，不再用 pidfd 复制一份。
+    // 否则用 pidfd_getfd() 从崩溃的进程里复制，只在第一次需要时打开 pidfd
+    int pidfd = -1;
+    int error = 0;
+    QStringList failed;
+    for (uint32_t i = 0; i < count; ++i) {
+        const int remote = record.keptDescriptors[i];
+        const QString name = QString::fromUtf8(record.keptDescriptorNames[i],
+                                               int(strnlen(record.keptDescriptorNames[i],
+                                                           CrashRecordKeptNameSize)));
+        int fd = -1;
+        if (record.keptDescriptorsInherited && fcntl(remote, F_GETFD) != -1) {
+            // 继承来的描述符没有 FD_CLOEXEC，不能漏给 gdb、核心转储和重启的实例
+            fd = remote;
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        } else {
+            if (pidfd == -1) {
+                pidfd = int(syscall(SYS_pidfd_open, pid, 0));
+                if (pidfd == -1)
+                    error = errno;
+            }
+            // 返回的描述符已经设置了 FD_CLOEXEC
+            if (pidfd != -1) {
+                fd = int(syscall(SYS_pidfd_getfd, pidfd, remote, 0));
+                if (fd == -1)
+                    error = errno;
+            }
+        }
+        if (fd == -1) {
+            failed.append(QString("%1 (%2)").arg(name).arg(remote));
+            continue;
+        }
+        m_descriptors.append(qMakePair(name, fd));
+    }
+    if (pidfd != -1)
+        close(pidfd);
+
+    if (failed.isEmpty())
+        return true;
+    m_errorString = QString("Could not take descriptors %1 from process %2: %3")
+            .arg(failed.join(QLatin1String(", "))).arg(pid)
+            .arg(QString::fromLocal8Bit(strerror(error)));
+    return false;
+}
+
+QVector<int> DescriptorHandoff::descriptors() const
+{
+    QVector<int> fds;
+    for (int i = 0; i < m_descriptors.size(); ++i)
+        fds.append(m_descriptors.at(i).second);
+    return fds;
+}
+
+QStringList DescriptorHandoff::environment(const QStringList &environment) const
+{
+    const QString prefix = QLatin1String(CrashRecordKeptDescriptorsVariable) + QLatin1Char('=');
+    QStringList result;
+    foreach (const QString &item, environment) {
+        if (!item.startsWith(prefix))
+            result.append(item);
+    }
+    if (m_descriptors.isEmpty())
+        return result;
+
+    QStringList entries;
+    for (int i = 0; i < m_descriptors.size(); ++i)
+        entries.append(QString("%1=%2").arg(m_descriptors.at(i).first).arg(m_descriptors.at(i).second));
+    result.append(prefix + entries.join(QLatin1Char(',')));
+    return result;
+}
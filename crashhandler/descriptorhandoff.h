@@ -0,0 +1,35 @@
+#pragma once
+
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+#include <sys/types.h>
+
+struct CrashRecord;
+
+// 热重启：从崩溃的进程里取出 CrashHandlerSetup::keepDescriptor() 登记的描述符，在重启时交给新实例。
+// 优先用 pidfd_getfd()（Linux 5.6，需要 ptrace 权限，崩溃的进程已经授权给 helper）；
+// 没有时只有 fork() 启动的 helper 能拿到，它以相同的编号继承了这些描述符。
+// 描述符在本进程里设置了 FD_CLOEXEC，只传给重启的实例，不传给 gdb。
+class DescriptorHandoff
+{
+public:
+    DescriptorHandoff() = default;
+    ~DescriptorHandoff();
+
+    // 要在崩溃的进程退出之前调用。部分描述符取不到时返回 false，已经取到的照样可以交接
+    bool take(pid_t pid, const CrashRecord &record);
+
+    bool isEmpty() const { return m_descriptors.isEmpty(); }
+    int count() const { return m_descriptors.size(); }
+    // 本进程里的编号，exec() 之后不变
+    QVector<int> descriptors() const;
+    // 把交接的描述符写进重启的环境，替换崩溃的进程自己继承的那一项
+    QStringList environment(const QStringList &environment) const;
+    QString errorString() const { return m_errorString; }
+
+private:
+    QVector<QPair<QString, int> > m_descriptors;
+    QString m_errorString;
+};
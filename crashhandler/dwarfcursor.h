@@ -0,0 +1,174 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include <string.h>
+
+// 指针编码，见 LSB 规范 "DWARF Extensions"
+enum {
+    DW_EH_PE_absptr = 0x00,
+    DW_EH_PE_uleb128 = 0x01,
+    DW_EH_PE_udata2 = 0x02,
+    DW_EH_PE_udata4 = 0x03,
+    DW_EH_PE_udata8 = 0x04,
+    DW_EH_PE_sleb128 = 0x09,
+    DW_EH_PE_sdata2 = 0x0a,
+    DW_EH_PE_sdata4 = 0x0b,
+    DW_EH_PE_sdata8 = 0x0c,
+    DW_EH_PE_pcrel = 0x10,
+    DW_EH_PE_datarel = 0x30,
+    DW_EH_PE_indirect = 0x80,
+    DW_EH_PE_omit = 0xff
+};
+
+// 顺序读取 DWARF 数据，越界时置错误标志而不是越界访问
+class DwarfCursor
+{
+public:
+    DwarfCursor(const uchar *begin, const uchar *end, quint64 address)
+        : m_begin(begin), m_pos(begin), m_end(end), m_address(address) {}
+
+    bool atEnd() const { return m_pos >= m_end; }
+    bool ok() const { return m_ok; }
+    const uchar *position() const { return m_pos; }
+    const uchar *end() const { return m_end; }
+    quint64 address() const { return m_address + quint64(m_pos - m_begin); }
+    quint64 remaining() const { return quint64(m_end - m_pos); }
+
+    template <typename T> T read()
+    {
+        T value = 0;
+        if (remaining() < sizeof(T)) {
+            fail();
+            return value;
+        }
+        memcpy(&value, m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        return value;
+    }
+
+    quint64 readUleb128()
+    {
+        quint64 result = 0;
+        int shift = 0;
+        while (!atEnd()) {
+            const uchar byte = *m_pos++;
+            if (shift < 64)
+                result |= quint64(byte & 0x7f) << shift;
+            shift += 7;
+            if (!(byte & 0x80))
+                return result;
+        }
+        fail();
+        return 0;
+    }
+
+    qint64 readSleb128()
+    {
+        quint64 result = 0;
+        int shift = 0;
+        while (!atEnd()) {
+            const uchar byte = *m_pos++;
+            if (shift < 64)
+                result |= quint64(byte & 0x7f) << shift;
+            shift += 7;
+            if (!(byte & 0x80)) {
+                if (shift < 64 && (byte & 0x40))
+                    result |= ~quint64(0) << shift;
+                return qint64(result);
+            }
+        }
+        fail();
+        return 0;
+    }
+
+    const char *readString()
+    {
+        const char *string = reinterpret_cast<const char *>(m_pos);
+        while (!atEnd()) {
+            if (*m_pos++ == 0)
+                return string;
+        }
+        fail();
+        return "";
+    }
+
+    // dataRelativeBase 只对 .eh_frame_hdr 有意义
+    quint64 readEncoded(uchar encoding, quint64 dataRelativeBase = 0)
+    {
+        if (encoding == DW_EH_PE_omit)
+            return 0;
+
+        const quint64 fieldAddress = address();
+        quint64 value = 0;
+        switch (encoding & 0x0f) {
+        case DW_EH_PE_absptr:
+            value = sizeof(void *) == 8 ? read<quint64>() : read<quint32>();
+            break;
+        case DW_EH_PE_uleb128:
+            value = readUleb128();
+            break;
+        case DW_EH_PE_udata2:
+            value = read<quint16>();
+            break;
+        case DW_EH_PE_udata4:
+            value = read<quint32>();
+            break;
+        case DW_EH_PE_udata8:
+            value = read<quint64>();
+            break;
+        case DW_EH_PE_sleb128:
+            value = quint64(readSleb128());
+            break;
+        case DW_EH_PE_sdata2:
+            value = quint64(qint64(read<qint16>()));
+            break;
+        case DW_EH_PE_sdata4:
+            value = quint64(qint64(read<qint32>()));
+            break;
+        case DW_EH_PE_sdata8:
+            value = quint64(read<qint64>());
+            break;
+        default:
+            fail();
+            return 0;
+        }
+
+        switch (encoding & 0x70) {
+        case 0:
+            break;
+        case DW_EH_PE_pcrel:
+            value += fieldAddress;
+            break;
+        case DW_EH_PE_datarel:
+            value += dataRelativeBase;
+            break;
+        default: // textrel 与 funcrel 在 .eh_frame 中不会出现
+            fail();
+            return 0;
+        }
+        return value;
+    }
+
+    void skip(quint64 count)
+    {
+        if (remaining() < count) {
+            fail();
+            return;
+        }
+        m_pos += count;
+    }
+
+private:
+    void fail()
+    {
+        m_ok = false;
+        m_pos = m_end;
+    }
+
+    const uchar *m_begin;
+    const uchar *m_pos;
+    const uchar *m_end;
+    quint64 m_address;
+    bool m_ok = true;
+};
@@ -0,0 +1,374 @@
+#include "dwarflinetable.h"
+#include "dwarfcursor.h"
+#include "elffile.h"
+
+#include <QHash>
+
+#include <algorithm>
+
+#include <string.h>
+
+namespace {
+
+enum {
+    DW_LNCT_path = 0x1,
+    DW_LNCT_directory_index = 0x2
+};
+
+enum {
+    DW_FORM_data2 = 0x05,
+    DW_FORM_data4 = 0x06,
+    DW_FORM_data8 = 0x07,
+    DW_FORM_string = 0x08,
+    DW_FORM_block = 0x09,
+    DW_FORM_block1 = 0x0a,
+    DW_FORM_data1 = 0x0b,
+    DW_FORM_sdata = 0x0d,
+    DW_FORM_strp = 0x0e,
+    DW_FORM_udata = 0x0f,
+    DW_FORM_data16 = 0x1e,
+    DW_FORM_line_strp = 0x1f
+};
+
+struct EntryFormat
+{
+    quint64 contentType;
+    quint64 form;
+};
+
+// 一个编译单元的行号程序
+class LineProgram
+{
+public:
+    LineProgram(const ElfFile::Section &debugStr, const ElfFile::Section &debugLineStr,
+                DwarfLineTable *table, QHash<QString, int> *fileIndexes)
+        : m_debugStr(debugStr), m_debugLineStr(debugLineStr)
+        , m_table(table), m_fileIndexes(fileIndexes) {}
+
+    void setOffsetSize(int size) { m_offsetSize = size; }
+    bool run(DwarfCursor &unit);
+
+private:
+    bool readHeader(DwarfCursor &cursor);
+    bool readEntryFormats(DwarfCursor &cursor, QVector<EntryFormat> *formats);
+    bool readFormValue(DwarfCursor &cursor, quint64 form, QString *string, quint64 *number);
+    static QString sectionString(const ElfFile::Section &section, quint64 offset);
+    void addFile(const QString &name, quint64 directory);
+    void emitRow(quint64 address, quint64 file, quint32 line);
+
+    const ElfFile::Section &m_debugStr;
+    const ElfFile::Section &m_debugLineStr;
+    DwarfLineTable *m_table;
+    QHash<QString, int> *m_fileIndexes;
+
+    int m_version = 0;
+    int m_offsetSize = 4;
+    quint8 m_minimumInstructionLength = 1;
+    bool m_defaultIsStmt = true;
+    qint8 m_lineBase = 0;
+    quint8 m_lineRange = 1;
+    quint8 m_opcodeBase = 1;
+    QVector<quint8> m_standardOpcodeLengths;
+    QStringList m_directories;
+    QVector<int> m_files; // 编译单元内的文件编号到全局下标
+    bool m_discardSequence = false;
+    bool m_sequenceStarted = false;
+};
+
+QString LineProgram::sectionString(const ElfFile::Section &section, quint64 offset)
+{
+    if (!section.isValid() || offset >= section.size)
+        return QString();
+    const char *string = reinterpret_cast<const char *>(section.data + offset);
+    return QString::fromUtf8(string, int(strnlen(string, size_t(section.size - offset))));
+}
+
+bool LineProgram::readFormValue(DwarfCursor &cursor, quint64 form, QString *string, quint64 *number)
+{
+    switch (form) {
+    case DW_FORM_string:
+        *string = QString::fromUtf8(cursor.readString());
+        return true;
+    case DW_FORM_strp:
+    case DW_FORM_line_strp: {
+        const quint64 offset = m_offsetSize == 8 ? cursor.read<quint64>() : cursor.read<quint32>();
+        *string = sectionString(form == DW_FORM_strp ? m_debugStr : m_debugLineStr, offset);
+        return true;
+    }
+    case DW_FORM_udata:
+        *number = cursor.readUleb128();
+        return true;
+    case DW_FORM_sdata:
+        *number = quint64(cursor.readSleb128());
+        return true;
+    case DW_FORM_data1:
+        *number = cursor.read<quint8>();
+        return true;
+    case DW_FORM_data2:
+        *number = cursor.read<quint16>();
+        return true;
+    case DW_FORM_data4:
+        *number = cursor.read<quint32>();
+        return true;
+    case DW_FORM_data8:
+        *number = cursor.read<quint64>();
+        return true;
+    case DW_FORM_data16:
+        cursor.skip(16);
+        return true;
+    case DW_FORM_block:
+        cursor.skip(cursor.readUleb128());
+        return true;
+    case DW_FORM_block1:
+        cursor.skip(cursor.read<quint8>());
+        return true;
+    default: // DW_FORM_strx 等需要 .debug_str_offsets，行号表里很少见
+        return false;
+    }
+}
+
+bool LineProgram::readEntryFormats(DwarfCursor &cursor, QVector<EntryFormat> *formats)
+{
+    const quint8 count = cursor.read<quint8>();
+    for (int i = 0; i < count && cursor.ok(); ++i) {
+        EntryFormat format;
+        format.contentType = cursor.readUleb128();
+        format.form = cursor.readUleb128();
+        formats->append(format);
+    }
+    return cursor.ok();
+}
+
+void LineProgram::addFile(const QString &name, quint64 directory)
+{
+    QString path = name;
+    if (!name.startsWith(QLatin1Char('/')) && directory < quint64(m_directories.size())
+            && !m_directories.at(int(directory)).isEmpty()) {
+        path = m_directories.at(int(directory)) + QLatin1Char('/') + name;
+    }
+
+    auto it = m_fileIndexes->constFind(path);
+    if (it == m_fileIndexes->constEnd()) {
+        it = m_fileIndexes->insert(path, m_table->files.size());
+        m_table->files.append(path);
+    }
+    m_files.append(it.value());
+}
+
+bool LineProgram::readHeader(DwarfCursor &cursor)
+{
+    m_version = cursor.read<quint16>();
+    if (m_version < 2 || m_version > 5)
+        return false;
+    if (m_version >= 5) {
+        cursor.read<quint8>(); // address_size
+        cursor.read<quint8>(); // segment_selector_size
+    }
+    const quint64 headerLength = m_offsetSize == 8 ? cursor.read<quint64>() : cursor.read<quint32>();
+    if (!cursor.ok() || headerLength > cursor.remaining())
+        return false;
+    DwarfCursor header(cursor.position(), cursor.position() + headerLength, 0);
+    cursor.skip(headerLength);
+
+    m_minimumInstructionLength = header.read<quint8>();
+    if (m_version >= 4)
+        header.read<quint8>(); // maximum_operations_per_instruction，只有 VLIW 才用得上
+    m_defaultIsStmt = header.read<quint8>() != 0;
+    m_lineBase = header.read<qint8>();
+    m_lineRange = header.read<quint8>();
+    m_opcodeBase = header.read<quint8>();
+    if (m_lineRange == 0 || m_opcodeBase == 0)
+        return false;
+    for (int i = 1; i < m_opcodeBase; ++i)
+        m_standardOpcodeLengths.append(header.read<quint8>());
+
+    if (m_version < 5) {
+        // 目录 0 是编译目录，它记录在 .debug_info 中，这里不解析
+        m_directories.append(QString());
+        while (header.ok()) {
+            const char *directory = header.readString();
+            if (!*directory)
+                break;
+            m_directories.append(QString::fromUtf8(directory));
+        }
+        // 文件编号从 1 开始
+        m_files.append(-1);
+        while (header.ok()) {
+            const char *name = header.readString();
+            if (!*name)
+                break;
+            const quint64 directory = header.readUleb128();
+            header.readUleb128(); // 修改时间
+            header.readUleb128(); // 文件长度
+            addFile(QString::fromUtf8(name), directory);
+        }
+        return header.ok();
+    }
+
+    QVector<EntryFormat> directoryFormats;
+    if (!readEntryFormats(header, &directoryFormats))
+        return false;
+    const quint64 directoryCount = header.readUleb128();
+    for (quint64 i = 0; i < directoryCount && header.ok(); ++i) {
+        QString path;
+        foreach (const EntryFormat &format, directoryFormats) {
+            QString string;
+            quint64 number = 0;
+            if (!readFormValue(header, format.form, &string, &number))
+                return false;
+            if (format.contentType == DW_LNCT_path)
+                path = string;
+        }
+        m_directories.append(path);
+    }
+
+    QVector<EntryFormat> fileFormats;
+    if (!readEntryFormats(header, &fileFormats))
+        return false;
+    const quint64 fileCount = header.readUleb128();
+    for (quint64 i = 0; i < fileCount && header.ok(); ++i) {
+        QString path;
+        quint64 directory = 0;
+        foreach (const EntryFormat &format, fileFormats) {
+            QString string;
+            quint64 number = 0;
+            if (!readFormValue(header, format.form, &string, &number))
+                return false;
+            if (format.contentType == DW_LNCT_path)
+                path = string;
+            else if (format.contentType == DW_LNCT_directory_index)
+                directory = number;
+        }
+        addFile(path, directory);
+    }
+    return header.ok();
+}
+
+void LineProgram::emitRow(quint64 address, quint64 file, quint32 line)
+{
+    // 被链接器丢弃的函数的行号序列从地址 0 开始，整个序列都不要
+    if (!m_sequenceStarted) {
+        m_sequenceStarted = true;
+        m_discardSequence = address == 0;
+    }
+    if (m_discardSequence)
+        return;
+
+    DwarfLineRow row;
+    row.address = address;
+    row.file = file < quint64(m_files.size()) ? m_files.at(int(file)) : -1;
+    row.line = line;
+    m_table->rows.append(row);
+}
+
+bool LineProgram::run(DwarfCursor &unit)
+{
+    if (!readHeader(unit))
+        return false;
+
+    quint64 address = 0;
+    quint64 file = 1;
+    qint64 line = 1;
+
+    while (!unit.atEnd()) {
+        const quint8 opcode = unit.read<quint8>();
+
+        if (opcode >= m_opcodeBase) { // 特殊操作码
+            const int adjusted = opcode - m_opcodeBase;
+            address += quint64(adjusted / m_lineRange) * m_minimumInstructionLength;
+            line += m_lineBase + adjusted % m_lineRange;
+            emitRow(address, file, quint32(line));
+            continue;
+        }
+
+        switch (opcode) {
+        case 0: { // 扩展操作码
+            const quint64 length = unit.readUleb128();
+            if (length == 0 || length > unit.remaining())
+                return false;
+            DwarfCursor extended(unit.position(), unit.position() + length, 0);
+            unit.skip(length);
+            switch (extended.read<quint8>()) {
+            case 1: // DW_LNE_end_sequence
+                emitRow(address, file, 0);
+                address = 0;
+                file = 1;
+                line = 1;
+                m_sequenceStarted = false;
+                break;
+            case 2: // DW_LNE_set_address
+                address = length - 1 == 8 ? extended.read<quint64>() : extended.read<quint32>();
+                break;
+            case 3: { // DW_LNE_define_file
+                const QString name = QString::fromUtf8(extended.readString());
+                addFile(name, extended.readUleb128());
+                break;
+            }
+            default: // DW_LNE_set_discriminator 等
+                break;
+            }
+            break;
+        }
+        case 1: // DW_LNS_copy
+            emitRow(address, file, quint32(line));
+            break;
+        case 2: // DW_LNS_advance_pc
+            address += unit.readUleb128() * m_minimumInstructionLength;
+            break;
+        case 3: // DW_LNS_advance_line
+            line += unit.readSleb128();
+            break;
+        case 4: // DW_LNS_set_file
+            file = unit.readUleb128();
+            break;
+        case 8: // DW_LNS_const_add_pc
+            address += quint64((255 - m_opcodeBase) / m_lineRange) * m_minimumInstructionLength;
+            break;
+        case 9: // DW_LNS_fixed_advance_pc
+            address += unit.read<quint16>();
+            break;
+        default: // 其它标准操作码只影响我们不关心的状态，按声明的参数个数跳过
+            for (int i = 0; i < m_standardOpcodeLengths.value(opcode - 1); ++i)
+                unit.readUleb128();
+            break;
+        }
+    }
+    return unit.ok();
+}
+
+} // namespace
+
+bool DwarfLineTable::read(const ElfFile &elf)
+{
+    const ElfFile::Section debugLine = elf.section(".debug_line");
+    if (!debugLine.isValid())
+        return false;
+    const ElfFile::Section debugStr = elf.section(".debug_str");
+    const ElfFile::Section debugLineStr = elf.section(".debug_line_str");
+
+    QHash<QString, int> fileIndexes;
+    DwarfCursor cursor(debugLine.data, debugLine.data + debugLine.size, 0);
+    while (!cursor.atEnd()) {
+        int offsetSize = 4;
+        quint64 length = cursor.read<quint32>();
+        if (length == 0xffffffff) {
+            length = cursor.read<quint64>();
+            offsetSize = 8;
+        }
+        if (!cursor.ok() || length > cursor.remaining())
+            break;
+
+        DwarfCursor unit(cursor.position(), cursor.position() + length, 0);
+        cursor.skip(length);
+
+        // 一个编译单元解析失败不影响其它编译单元
+        LineProgram program(debugStr, debugLineStr, this, &fileIndexes);
+        program.setOffsetSize(offsetSize);
+        program.run(unit);
+    }
+
+    std::stable_sort(rows.begin(), rows.end(), [](const DwarfLineRow &a, const DwarfLineRow &b) {
+        return a.address < b.address;
+    });
+    return !rows.isEmpty();
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class ElfFile;
+
+struct DwarfLineRow
+{
+    quint64 address = 0;
+    int file = -1;  // DwarfLineTable::files 的下标
+    quint32 line = 0; // 0 表示序列结束，之后的地址没有行号信息
+};
+
+// 从 .debug_line 解出的地址到源文件行号的映射，支持 DWARF 2 到 5
+struct DwarfLineTable
+{
+    QStringList files;
+    QVector<DwarfLineRow> rows; // 按地址排序
+
+    bool read(const ElfFile &elf);
+};
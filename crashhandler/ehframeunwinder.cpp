@@ -0,0 +1,673 @@
+#include "ehframeunwinder.h"
+#include "dwarfcursor.h"
+#include "elffile.h"
+#include "processmemory.h"
+
+#include <string.h>
+
+namespace {
+
+const int MaxRememberedStates = 16;
+const int MaxExpressionStack = 64;
+
+struct CommonInformationEntry
+{
+    quint64 codeAlignment = 1;
+    qint64 dataAlignment = 1;
+    quint64 returnAddressRegister = DwarfReturnAddress;
+    uchar fdeEncoding = DW_EH_PE_absptr;
+    bool hasAugmentationData = false;
+    bool isSignalFrame = false;
+    const uchar *instructions = nullptr;
+    const uchar *instructionsEnd = nullptr;
+    quint64 instructionsAddress = 0;
+};
+
+struct FrameDescriptionEntry
+{
+    CommonInformationEntry cie;
+    quint64 pcBegin = 0;
+    quint64 pcEnd = 0;
+    const uchar *instructions = nullptr;
+    const uchar *instructionsEnd = nullptr;
+    quint64 instructionsAddress = 0;
+};
+
+struct RegisterRule
+{
+    enum Type { Unspecified, Undefined, SameValue, Offset, ValOffset, Register,
+                Expression, ValExpression };
+
+    Type type = Unspecified;
+    qint64 offset = 0;
+    quint64 reg = 0;
+    const uchar *expression = nullptr;
+    quint64 expressionLength = 0;
+};
+
+struct FrameState
+{
+    bool cfaIsExpression = false;
+    quint64 cfaRegister = 0;
+    qint64 cfaOffset = 0;
+    const uchar *cfaExpression = nullptr;
+    quint64 cfaExpressionLength = 0;
+    RegisterRule rules[DwarfRegisterCount];
+};
+
+// 一个 CIE/FDE 条目的位置
+struct EntryHeader
+{
+    const uchar *contents = nullptr; // 长度字段之后
+    const uchar *end = nullptr;
+    quint64 contentsAddress = 0;
+    quint64 id = 0;
+    bool isCie = false;
+};
+
+static bool readEntryHeader(const ElfFile::Section &ehFrame, quint64 offset, EntryHeader *header)
+{
+    if (offset >= ehFrame.size)
+        return false;
+
+    DwarfCursor cursor(ehFrame.data + offset, ehFrame.data + ehFrame.size, ehFrame.address + offset);
+    quint64 length = cursor.read<quint32>();
+    if (length == 0 || !cursor.ok())
+        return false;
+    if (length == 0xffffffff)
+        length = cursor.read<quint64>();
+    if (!cursor.ok() || length > cursor.remaining())
+        return false;
+
+    header->contents = cursor.position();
+    header->end = cursor.position() + length;
+    header->contentsAddress = cursor.address();
+    header->id = cursor.read<quint32>();
+    header->isCie = header->id == 0;
+    return cursor.ok();
+}
+
+static bool parseCie(const ElfFile::Section &ehFrame, quint64 offset, CommonInformationEntry *cie)
+{
+    EntryHeader header;
+    if (!readEntryHeader(ehFrame, offset, &header) || !header.isCie)
+        return false;
+
+    DwarfCursor cursor(header.contents, header.end, header.contentsAddress);
+    cursor.skip(4); // CIE id
+    const uchar version = cursor.read<uchar>();
+    const char *augmentation = cursor.readString();
+    if (strstr(augmentation, "eh"))
+        cursor.skip(sizeof(void *));
+    cie->codeAlignment = cursor.readUleb128();
+    cie->dataAlignment = cursor.readSleb128();
+    cie->returnAddressRegister = version == 1 ? cursor.read<uchar>() : cursor.readUleb128();
+
+    if (augmentation[0] == 'z') {
+        cie->hasAugmentationData = true;
+        const quint64 length = cursor.readUleb128();
+        const uchar *augmentationEnd = cursor.position() + qMin(length, cursor.remaining());
+        for (const char *c = augmentation + 1; *c && cursor.ok(); ++c) {
+            switch (*c) {
+            case 'R':
+                cie->fdeEncoding = cursor.read<uchar>();
+                break;
+            case 'P': {
+                const uchar encoding = cursor.read<uchar>();
+                cursor.readEncoded(encoding & ~DW_EH_PE_indirect);
+                break;
+            }
+            case 'L':
+                cursor.read<uchar>();
+                break;
+            case 'S':
+                cie->isSignalFrame = true;
+                break;
+            default:
+                break;
+            }
+        }
+        cursor.skip(quint64(augmentationEnd - cursor.position()));
+    }
+
+    cie->instructions = cursor.position();
+    cie->instructionsEnd = header.end;
+    cie->instructionsAddress = cursor.address();
+    return cursor.ok();
+}
+
+static bool parseFde(const ElfFile::Section &ehFrame, quint64 offset, FrameDescriptionEntry *fde)
+{
+    EntryHeader header;
+    if (!readEntryHeader(ehFrame, offset, &header) || header.isCie)
+        return false;
+
+    // CIE 指针是相对于该字段自身的偏移
+    const quint64 idOffset = quint64(header.contents - ehFrame.data);
+    if (header.id > idOffset || !parseCie(ehFrame, idOffset - header.id, &fde->cie))
+        return false;
+
+    DwarfCursor cursor(header.contents, header.end, header.contentsAddress);
+    cursor.skip(4);
+    fde->pcBegin = cursor.readEncoded(fde->cie.fdeEncoding);
+    fde->pcEnd = fde->pcBegin + cursor.readEncoded(fde->cie.fdeEncoding & 0x0f);
+    if (fde->cie.hasAugmentationData)
+        cursor.skip(cursor.readUleb128());
+
+    fde->instructions = cursor.position();
+    fde->instructionsEnd = header.end;
+    fde->instructionsAddress = cursor.address();
+    return cursor.ok();
+}
+
+// 通过 .eh_frame_hdr 中排好序的查找表二分查找 FDE
+static bool findFdeWithHeader(const ElfFile::Section &ehFrameHdr, const ElfFile::Section &ehFrame,
+                              quint64 pc, FrameDescriptionEntry *fde, bool *tableUsable)
+{
+    *tableUsable = false;
+    DwarfCursor cursor(ehFrameHdr.data, ehFrameHdr.data + ehFrameHdr.size, ehFrameHdr.address);
+    const uchar version = cursor.read<uchar>();
+    const uchar ehFramePtrEncoding = cursor.read<uchar>();
+    const uchar fdeCountEncoding = cursor.read<uchar>();
+    const uchar tableEncoding = cursor.read<uchar>();
+    if (version != 1 || !cursor.ok())
+        return false;
+    cursor.readEncoded(ehFramePtrEncoding, ehFrameHdr.address);
+    const quint64 fdeCount = cursor.readEncoded(fdeCountEncoding, ehFrameHdr.address);
+    if (!cursor.ok() || tableEncoding != (DW_EH_PE_datarel | DW_EH_PE_sdata4)
+            || fdeCount * 8 > cursor.remaining()) {
+        return false;
+    }
+    *tableUsable = true;
+
+    const uchar *table = cursor.position();
+    auto entryValue = [&](quint64 index, int field) {
+        qint32 value;
+        memcpy(&value, table + index * 8 + field * 4, sizeof(value));
+        return ehFrameHdr.address + quint64(qint64(value));
+    };
+
+    // 找最后一个起始地址不大于 pc 的条目
+    quint64 low = 0;
+    quint64 high = fdeCount;
+    while (low < high) {
+        const quint64 middle = low + (high - low) / 2;
+        if (entryValue(middle, 0) <= pc)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low == 0)
+        return false;
+
+    const quint64 fdeAddress = entryValue(low - 1, 1);
+    if (!ehFrame.contains(fdeAddress) || !parseFde(ehFrame, fdeAddress - ehFrame.address, fde))
+        return false;
+    return pc >= fde->pcBegin && pc < fde->pcEnd;
+}
+
+// 没有 .eh_frame_hdr 时顺序扫描整个 .eh_frame
+static bool findFdeLinear(const ElfFile::Section &ehFrame, quint64 pc, FrameDescriptionEntry *fde)
+{
+    quint64 offset = 0;
+    EntryHeader header;
+    while (readEntryHeader(ehFrame, offset, &header)) {
+        if (!header.isCie && parseFde(ehFrame, offset, fde) && pc >= fde->pcBegin && pc < fde->pcEnd)
+            return true;
+        offset = quint64(header.end - ehFrame.data);
+    }
+    return false;
+}
+
+static void setRule(FrameState *state, quint64 reg, const RegisterRule &rule)
+{
+    // 超出范围的寄存器（比如向量寄存器）对回溯没有用，忽略即可
+    if (reg < quint64(DwarfRegisterCount))
+        state->rules[reg] = rule;
+}
+
+// 执行 CFA 程序，直到位置超过 pc
+static bool executeCfaProgram(const uchar *begin, const uchar *end, quint64 address,
+                              const CommonInformationEntry &cie, const FrameState &initialState,
+                              quint64 startLocation, quint64 pc, FrameState *state)
+{
+    DwarfCursor cursor(begin, end, address);
+    quint64 location = startLocation;
+    FrameState remembered[MaxRememberedStates];
+    int rememberedCount = 0;
+
+    while (!cursor.atEnd() && location <= pc) {
+        const uchar opcode = cursor.read<uchar>();
+        const uchar high = opcode & 0xc0;
+        const uchar low = opcode & 0x3f;
+        RegisterRule rule;
+
+        if (high == 0x40) { // DW_CFA_advance_loc
+            location += low * cie.codeAlignment;
+            continue;
+        }
+        if (high == 0x80) { // DW_CFA_offset
+            rule.type = RegisterRule::Offset;
+            rule.offset = qint64(cursor.readUleb128()) * cie.dataAlignment;
+            setRule(state, low, rule);
+            continue;
+        }
+        if (high == 0xc0) { // DW_CFA_restore
+            if (low < DwarfRegisterCount)
+                state->rules[low] = initialState.rules[low];
+            continue;
+        }
+
+        switch (opcode) {
+        case 0x00: // DW_CFA_nop
+            break;
+        case 0x01: // DW_CFA_set_loc
+            location = cursor.readEncoded(cie.fdeEncoding);
+            break;
+        case 0x02: // DW_CFA_advance_loc1
+            location += cursor.read<quint8>() * cie.codeAlignment;
+            break;
+        case 0x03: // DW_CFA_advance_loc2
+            location += cursor.read<quint16>() * cie.codeAlignment;
+            break;
+        case 0x04: // DW_CFA_advance_loc4
+            location += cursor.read<quint32>() * cie.codeAlignment;
+            break;
+        case 0x05: { // DW_CFA_offset_extended
+            const quint64 reg = cursor.readUleb128();
+            rule.type = RegisterRule::Offset;
+            rule.offset = qint64(cursor.readUleb128()) * cie.dataAlignment;
+            setRule(state, reg, rule);
+            break;
+        }
+        case 0x06: { // DW_CFA_restore_extended
+            const quint64 reg = cursor.readUleb128();
+            if (reg < quint64(DwarfRegisterCount))
+                state->rules[reg] = initialState.rules[reg];
+            break;
+        }
+        case 0x07: // DW_CFA_undefined
+            rule.type = RegisterRule::Undefined;
+            setRule(state, cursor.readUleb128(), rule);
+            break;
+        case 0x08: // DW_CFA_same_value
+            rule.type = RegisterRule::SameValue;
+            setRule(state, cursor.readUleb128(), rule);
+            break;
+        case 0x09: { // DW_CFA_register
+            const quint64 reg = cursor.readUleb128();
+            rule.type = RegisterRule::Register;
+            rule.reg = cursor.readUleb128();
+            setRule(state, reg, rule);
+            break;
+        }
+        case 0x0a: // DW_CFA_remember_state
+            if (rememberedCount == MaxRememberedStates)
+                return false;
+            remembered[rememberedCount++] = *state;
+            break;
+        case 0x0b: // DW_CFA_restore_state
+            if (rememberedCount == 0)
+                return false;
+            *state = remembered[--rememberedCount];
+            break;
+        case 0x0c: // DW_CFA_def_cfa
+            state->cfaIsExpression = false;
+            state->cfaRegister = cursor.readUleb128();
+            state->cfaOffset = qint64(cursor.readUleb128());
+            break;
+        case 0x0d: // DW_CFA_def_cfa_register
+            state->cfaIsExpression = false;
+            state->cfaRegister = cursor.readUleb128();
+            break;
+        case 0x0e: // DW_CFA_def_cfa_offset
+            state->cfaOffset = qint64(cursor.readUleb128());
+            break;
+        case 0x0f: // DW_CFA_def_cfa_expression
+            state->cfaIsExpression = true;
+            state->cfaExpressionLength = cursor.readUleb128();
+            state->cfaExpression = cursor.position();
+            cursor.skip(state->cfaExpressionLength);
+            break;
+        case 0x10: // DW_CFA_expression
+        case 0x16: { // DW_CFA_val_expression
+            const quint64 reg = cursor.readUleb128();
+            rule.type = opcode == 0x10 ? RegisterRule::Expression : RegisterRule::ValExpression;
+            rule.expressionLength = cursor.readUleb128();
+            rule.expression = cursor.position();
+            cursor.skip(rule.expressionLength);
+            setRule(state, reg, rule);
+            break;
+        }
+        case 0x11: { // DW_CFA_offset_extended_sf
+            const quint64 reg = cursor.readUleb128();
+            rule.type = RegisterRule::Offset;
+            rule.offset = cursor.readSleb128() * cie.dataAlignment;
+            setRule(state, reg, rule);
+            break;
+        }
+        case 0x12: // DW_CFA_def_cfa_sf
+            state->cfaIsExpression = false;
+            state->cfaRegister = cursor.readUleb128();
+            state->cfaOffset = cursor.readSleb128() * cie.dataAlignment;
+            break;
+        case 0x13: // DW_CFA_def_cfa_offset_sf
+            state->cfaOffset = cursor.readSleb128() * cie.dataAlignment;
+            break;
+        case 0x14: // DW_CFA_val_offset
+        case 0x15: { // DW_CFA_val_offset_sf
+            const quint64 reg = cursor.readUleb128();
+            rule.type = RegisterRule::ValOffset;
+            rule.offset = (opcode == 0x14 ? qint64(cursor.readUleb128()) : cursor.readSleb128())
+                    * cie.dataAlignment;
+            setRule(state, reg, rule);
+            break;
+        }
+        case 0x2d: // DW_CFA_AARCH64_negate_ra_state / DW_CFA_GNU_window_save
+            break;
+        case 0x2e: // DW_CFA_GNU_args_size
+            cursor.readUleb128();
+            break;
+        case 0x2f: { // DW_CFA_GNU_negative_offset_extended
+            const quint64 reg = cursor.readUleb128();
+            rule.type = RegisterRule::Offset;
+            rule.offset = -qint64(cursor.readUleb128()) * cie.dataAlignment;
+            setRule(state, reg, rule);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return cursor.ok();
+}
+
+// 计算 CFI 中用到的 DWARF 表达式，只支持 CFI 中实际出现的那部分操作
+static bool evaluateExpression(const uchar *expression, quint64 length,
+                               const UnwindRegisters &registers, ProcessMemoryReader &memory,
+                               bool pushCfa, quint64 cfa, quint64 *result)
+{
+    quint64 stack[MaxExpressionStack];
+    int depth = 0;
+    if (pushCfa)
+        stack[depth++] = cfa;
+
+    DwarfCursor cursor(expression, expression + length, 0);
+    while (!cursor.atEnd()) {
+        const uchar opcode = cursor.read<uchar>();
+        if (depth >= MaxExpressionStack - 1)
+            return false;
+
+        if (opcode >= 0x30 && opcode <= 0x4f) { // DW_OP_lit0..31
+            stack[depth++] = opcode - 0x30;
+            continue;
+        }
+        if (opcode >= 0x50 && opcode <= 0x6f) { // DW_OP_reg0..31
+            if (!registers.isValid(opcode - 0x50))
+                return false;
+            stack[depth++] = registers.value(opcode - 0x50);
+            continue;
+        }
+        if (opcode >= 0x70 && opcode <= 0x8f) { // DW_OP_breg0..31
+            const qint64 offset = cursor.readSleb128();
+            if (!registers.isValid(opcode - 0x70))
+                return false;
+            stack[depth++] = registers.value(opcode - 0x70) + quint64(offset);
+            continue;
+        }
+
+        switch (opcode) {
+        case 0x03: // DW_OP_addr
+            stack[depth++] = cursor.readEncoded(DW_EH_PE_absptr);
+            break;
+        case 0x06: { // DW_OP_deref
+            if (depth < 1)
+                return false;
+            quint64 value;
+            if (!memory.readWord(stack[depth - 1], &value))
+                return false;
+            stack[depth - 1] = value;
+            break;
+        }
+        case 0x08: stack[depth++] = cursor.read<quint8>(); break;                    // DW_OP_const1u
+        case 0x09: stack[depth++] = quint64(qint64(cursor.read<qint8>())); break;    // DW_OP_const1s
+        case 0x0a: stack[depth++] = cursor.read<quint16>(); break;                   // DW_OP_const2u
+        case 0x0b: stack[depth++] = quint64(qint64(cursor.read<qint16>())); break;   // DW_OP_const2s
+        case 0x0c: stack[depth++] = cursor.read<quint32>(); break;                   // DW_OP_const4u
+        case 0x0d: stack[depth++] = quint64(qint64(cursor.read<qint32>())); break;   // DW_OP_const4s
+        case 0x0e: stack[depth++] = cursor.read<quint64>(); break;                   // DW_OP_const8u
+        case 0x0f: stack[depth++] = quint64(cursor.read<qint64>()); break;           // DW_OP_const8s
+        case 0x10: stack[depth++] = cursor.readUleb128(); break;                     // DW_OP_constu
+        case 0x11: stack[depth++] = quint64(cursor.readSleb128()); break;            // DW_OP_consts
+        case 0x12: // DW_OP_dup
+            if (depth < 1)
+                return false;
+            stack[depth] = stack[depth - 1];
+            ++depth;
+            break;
+        case 0x13: // DW_OP_drop
+            if (depth < 1)
+                return false;
+            --depth;
+            break;
+        case 0x14: // DW_OP_over
+            if (depth < 2)
+                return false;
+            stack[depth] = stack[depth - 2];
+            ++depth;
+            break;
+        case 0x16: // DW_OP_swap
+            if (depth < 2)
+                return false;
+            qSwap(stack[depth - 1], stack[depth - 2]);
+            break;
+        case 0x1a: case 0x1c: case 0x1e: case 0x21: case 0x22: case 0x24: case 0x25: case 0x27: {
+            if (depth < 2)
+                return false;
+            const quint64 b = stack[--depth];
+            quint64 &a = stack[depth - 1];
+            switch (opcode) {
+            case 0x1a: a &= b; break;         // DW_OP_and
+            case 0x1c: a -= b; break;         // DW_OP_minus
+            case 0x1e: a *= b; break;         // DW_OP_mul
+            case 0x21: a |= b; break;         // DW_OP_or
+            case 0x22: a += b; break;         // DW_OP_plus
+            case 0x24: a <<= (b & 63); break; // DW_OP_shl
+            case 0x25: a >>= (b & 63); break; // DW_OP_shr
+            case 0x27: a ^= b; break;         // DW_OP_xor
+            }
+            break;
+        }
+        case 0x23: // DW_OP_plus_uconst
+            if (depth < 1)
+                return false;
+            stack[depth - 1] += cursor.readUleb128();
+            break;
+        case 0x92: { // DW_OP_bregx
+            const quint64 reg = cursor.readUleb128();
+            const qint64 offset = cursor.readSleb128();
+            if (!registers.isValid(int(reg)))
+                return false;
+            stack[depth++] = registers.value(int(reg)) + quint64(offset);
+            break;
+        }
+        case 0x96: // DW_OP_nop
+            break;
+        default:
+            return false;
+        }
+    }
+
+    if (!cursor.ok() || depth < 1)
+        return false;
+    *result = stack[depth - 1];
+    return true;
+}
+
+static quint64 stripPointerAuthentication(quint64 pc)
+{
+#if defined(__aarch64__)
+    // 开启指针认证时返回地址的高位带有签名
+    return pc & 0x0000ffffffffffffULL;
+#else
+    return pc;
+#endif
+}
+
+} // namespace
+
+EhFrameUnwinder::StepResult EhFrameUnwinder::step(const ElfFile &elf, quint64 bias,
+                                                  ProcessMemoryReader &memory, bool adjustPc,
+                                                  UnwindRegisters *registers, bool *signalFrame)
+{
+#ifdef EHFRAME_UNWINDER_SUPPORTED
+    const ElfFile::Section ehFrame = elf.section(".eh_frame");
+    if (!ehFrame.isValid())
+        return StepNoFrameInfo;
+
+    const quint64 pc = registers->pc - bias - (adjustPc ? 1 : 0);
+    FrameDescriptionEntry fde;
+    bool tableUsable = false;
+    const ElfFile::Section ehFrameHdr = elf.section(".eh_frame_hdr");
+    bool found = false;
+    if (ehFrameHdr.isValid())
+        found = findFdeWithHeader(ehFrameHdr, ehFrame, pc, &fde, &tableUsable);
+    if (!found && !tableUsable)
+        found = findFdeLinear(ehFrame, pc, &fde);
+    if (!found)
+        return StepNoFrameInfo;
+
+    // 先执行 CIE 的初始指令，再执行 FDE 的指令直到 pc
+    FrameState initialState;
+    if (!executeCfaProgram(fde.cie.instructions, fde.cie.instructionsEnd, fde.cie.instructionsAddress,
+                           fde.cie, initialState, fde.pcBegin, ~quint64(0), &initialState)) {
+        return StepFailed;
+    }
+    FrameState state = initialState;
+    if (!executeCfaProgram(fde.instructions, fde.instructionsEnd, fde.instructionsAddress,
+                           fde.cie, initialState, fde.pcBegin, pc, &state)) {
+        return StepFailed;
+    }
+
+    quint64 cfa = 0;
+    if (state.cfaIsExpression) {
+        if (!evaluateExpression(state.cfaExpression, state.cfaExpressionLength, *registers, memory,
+                                false, 0, &cfa)) {
+            return StepFailed;
+        }
+    } else {
+        if (!registers->isValid(int(state.cfaRegister)))
+            return StepFailed;
+        cfa = registers->value(int(state.cfaRegister)) + quint64(state.cfaOffset);
+    }
+
+    // 未指定规则的寄存器保持原值，这与 libgcc 的行为一致
+    UnwindRegisters caller = *registers;
+    for (int reg = 0; reg < DwarfRegisterCount; ++reg) {
+        const RegisterRule &rule = state.rules[reg];
+        quint64 value = 0;
+        switch (rule.type) {
+        case RegisterRule::Unspecified:
+        case RegisterRule::SameValue:
+            continue;
+        case RegisterRule::Undefined:
+            caller.validMask &= ~(quint64(1) << reg);
+            continue;
+        case RegisterRule::Offset:
+            if (!memory.readWord(cfa + quint64(rule.offset), &value))
+                return StepFailed;
+            break;
+        case RegisterRule::ValOffset:
+            value = cfa + quint64(rule.offset);
+            break;
+        case RegisterRule::Register:
+            if (!registers->isValid(int(rule.reg)))
+                return StepFailed;
+            value = registers->value(int(rule.reg));
+            break;
+        case RegisterRule::Expression:
+            if (!evaluateExpression(rule.expression, rule.expressionLength, *registers, memory,
+                                    true, cfa, &value)
+                    || !memory.readWord(value, &value)) {
+                return StepFailed;
+            }
+            break;
+        case RegisterRule::ValExpression:
+            if (!evaluateExpression(rule.expression, rule.expressionLength, *registers, memory,
+                                    true, cfa, &value)) {
+                return StepFailed;
+            }
+            break;
+        }
+        caller.setValue(reg, value);
+    }
+
+    // 调用者的栈指针就是 CFA，除非 CFI 明确给出了规则（比如信号帧）
+    if (state.rules[DwarfStackPointer].type == RegisterRule::Unspecified)
+        caller.setValue(DwarfStackPointer, cfa);
+
+    const int returnAddressRegister = int(fde.cie.returnAddressRegister);
+    if (returnAddressRegister >= DwarfRegisterCount || !caller.isValid(returnAddressRegister)
+            || state.rules[returnAddressRegister].type == RegisterRule::Undefined) {
+        return StepEndOfStack;
+    }
+    caller.pc = stripPointerAuthentication(caller.value(returnAddressRegister));
+    if (caller.pc == 0)
+        return StepEndOfStack;
+
+    *registers = caller;
+    *signalFrame = fde.cie.isSignalFrame;
+    return StepOk;
+#else
+    Q_UNUSED(elf);
+    Q_UNUSED(bias);
+    Q_UNUSED(memory);
+    Q_UNUSED(adjustPc);
+    Q_UNUSED(registers);
+    Q_UNUSED(signalFrame);
+    return StepNoFrameInfo;
+#endif
+}
+
+bool EhFrameUnwinder::stepWithFramePointer(ProcessMemoryReader &memory, bool firstFrame,
+                                           UnwindRegisters *registers)
+{
+#ifdef EHFRAME_UNWINDER_SUPPORTED
+    UnwindRegisters caller = *registers;
+    quint64 returnAddress = 0;
+
+#if defined(__x86_64__)
+    // 第一帧没有帧信息多半是跳到了无效地址（比如调用空函数指针），返回地址还在栈顶
+    if (firstFrame && registers->isValid(DwarfStackPointer)
+            && memory.readWord(registers->sp(), &returnAddress) && returnAddress != 0) {
+        caller.setValue(DwarfStackPointer, registers->sp() + 8);
+        caller.pc = returnAddress;
+        *registers = caller;
+        return true;
+    }
+#else
+    Q_UNUSED(firstFrame);
+#endif
+
+    const quint64 fp = registers->value(DwarfFramePointer);
+    if (!registers->isValid(DwarfFramePointer) || fp == 0 || fp % sizeof(void *) != 0)
+        return false;
+
+    quint64 callerFp = 0;
+    if (!memory.readWord(fp, &callerFp) || !memory.readWord(fp + sizeof(void *), &returnAddress))
+        return false;
+    if (returnAddress == 0 || callerFp <= fp)
+        return false;
+
+    caller.setValue(DwarfFramePointer, callerFp);
+    caller.setValue(DwarfStackPointer, fp + 2 * sizeof(void *));
+    caller.pc = stripPointerAuthentication(returnAddress);
+    *registers = caller;
+    return true;
+#else
+    Q_UNUSED(memory);
+    Q_UNUSED(firstFrame);
+    Q_UNUSED(registers);
+    return false;
+#endif
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <QtGlobal>
+
+class ElfFile;
+class ProcessMemoryReader;
+
+// DWARF 寄存器编号
+#if defined(__x86_64__)
+#define EHFRAME_UNWINDER_SUPPORTED
+enum {
+    DwarfRegisterCount = 17,
+    DwarfFramePointer = 6,
+    DwarfStackPointer = 7,
+    DwarfReturnAddress = 16
+};
+#elif defined(__aarch64__)
+#define EHFRAME_UNWINDER_SUPPORTED
+enum {
+    DwarfRegisterCount = 32,
+    DwarfFramePointer = 29,
+    DwarfStackPointer = 31,
+    DwarfReturnAddress = 30
+};
+#else
+enum {
+    DwarfRegisterCount = 1,
+    DwarfFramePointer = 0,
+    DwarfStackPointer = 0,
+    DwarfReturnAddress = 0
+};
+#endif
+
+struct UnwindRegisters
+{
+    quint64 pc = 0;
+    quint64 values[DwarfRegisterCount] = {};
+    quint64 validMask = 0;
+
+    bool isValid(int reg) const { return reg < DwarfRegisterCount && (validMask & (quint64(1) << reg)); }
+    quint64 value(int reg) const { return isValid(reg) ? values[reg] : 0; }
+    void setValue(int reg, quint64 value)
+    {
+        if (reg >= DwarfRegisterCount)
+            return;
+        values[reg] = value;
+        validMask |= quint64(1) << reg;
+    }
+    quint64 sp() const { return value(DwarfStackPointer); }
+};
+
+// 根据 .eh_frame 中的调用帧信息 (CFI) 从一帧回溯到上一帧
+class EhFrameUnwinder
+{
+public:
+    enum StepResult { StepOk, StepNoFrameInfo, StepEndOfStack, StepFailed };
+
+    // elf 为 registers->pc 所在的模块，bias 为运行时地址与文件内地址之差。
+    // adjustPc 为 true 时 pc 是返回地址，查找帧信息时要减一落回调用指令内。
+    // 成功时 *signalFrame 表示刚处理的这一帧是否为信号处理程序的返回帧。
+    static StepResult step(const ElfFile &elf, quint64 bias, ProcessMemoryReader &memory,
+                           bool adjustPc, UnwindRegisters *registers, bool *signalFrame);
+
+    // 没有帧信息时退回沿帧指针回溯
+    static bool stepWithFramePointer(ProcessMemoryReader &memory, bool firstFrame,
+                                     UnwindRegisters *registers);
+};
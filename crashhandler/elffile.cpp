@@ -0,0 +1,266 @@
+#include "elffile.h"
+
+#include <QMutexLocker>
+#include <QtEndian>
+
+#include <algorithm>
+
+#include <cxxabi.h>
+#include <elf.h>
+#include <link.h>
+#include <stdlib.h>
+#include <string.h>
+
+QString demangledSymbolName(const char *name)
+{
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (status != 0 || !demangled)
+        return QString::fromLatin1(name);
+
+    const QString result = QString::fromLatin1(demangled);
+    free(demangled);
+    return result;
+}
+
+ElfFile::ElfFile()
+{
+}
+
+ElfFile::~ElfFile()
+{
+}
+
+bool ElfFile::load(const QString &path)
+{
+    m_path = path;
+    m_file.reset(new QFile(path));
+    if (!m_file->open(QIODevice::ReadOnly))
+        return false;
+
+    m_size = quint64(m_file->size());
+    m_data = m_file->map(0, m_file->size());
+    if (!m_data)
+        return false;
+
+    if (!parse()) {
+        m_data = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool ElfFile::loadFromImage(const QByteArray &image)
+{
+    m_image = image;
+    m_data = reinterpret_cast<const uchar *>(m_image.constData());
+    m_size = quint64(m_image.size());
+
+    if (!parse()) {
+        m_data = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool ElfFile::parse()
+{
+    if (m_size < sizeof(ElfW(Ehdr)))
+        return false;
+
+    const ElfW(Ehdr) *header = reinterpret_cast<const ElfW(Ehdr) *>(m_data);
+    if (memcmp(header->e_ident, ELFMAG, SELFMAG) != 0)
+        return false;
+    // 只支持与 crashhandler 自己相同的字长
+#if __SIZEOF_POINTER__ == 8
+    if (header->e_ident[EI_CLASS] != ELFCLASS64)
+        return false;
+#else
+    if (header->e_ident[EI_CLASS] != ELFCLASS32)
+        return false;
+#endif
+
+    if (header->e_phoff + quint64(header->e_phnum) * sizeof(ElfW(Phdr)) > m_size)
+        return false;
+
+    const ElfW(Phdr) *programHeaders = reinterpret_cast<const ElfW(Phdr) *>(m_data + header->e_phoff);
+    bool loadAddressFound = false;
+    for (int i = 0; i < header->e_phnum; ++i) {
+        const ElfW(Phdr) &phdr = programHeaders[i];
+        if (phdr.p_type == PT_LOAD && !loadAddressFound) {
+            m_loadAddress = phdr.p_vaddr - (phdr.p_vaddr % (phdr.p_align ? phdr.p_align : 1));
+            loadAddressFound = true;
+        }
+
+        // NT_GNU_BUILD_ID 记录在 PT_NOTE 段中
+        if (phdr.p_type != PT_NOTE || phdr.p_offset + phdr.p_filesz > m_size)
+            continue;
+        quint64 pos = phdr.p_offset;
+        const quint64 end = phdr.p_offset + phdr.p_filesz;
+        while (pos + sizeof(ElfW(Nhdr)) <= end) {
+            const ElfW(Nhdr) *note = reinterpret_cast<const ElfW(Nhdr) *>(m_data + pos);
+            const quint64 nameOffset = pos + sizeof(ElfW(Nhdr));
+            const quint64 descOffset = nameOffset + ((note->n_namesz + 3) & ~3u);
+            const quint64 next = descOffset + ((note->n_descsz + 3) & ~3u);
+            if (next > end)
+                break;
+            if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4
+                    && memcmp(m_data + nameOffset, "GNU", 4) == 0) {
+                m_buildId = QByteArray(reinterpret_cast<const char *>(m_data + descOffset),
+                                       int(note->n_descsz)).toHex();
+            }
+            pos = next;
+        }
+    }
+
+    return loadAddressFound;
+}
+
+ElfFile::Section ElfFile::section(const char *name) const
+{
+    Section result;
+    if (!m_data)
+        return result;
+
+    const ElfW(Ehdr) *header = reinterpret_cast<const ElfW(Ehdr) *>(m_data);
+    if (header->e_shoff == 0 || header->e_shstrndx == SHN_UNDEF
+            || header->e_shoff + quint64(header->e_shnum) * sizeof(ElfW(Shdr)) > m_size) {
+        return result;
+    }
+
+    const ElfW(Shdr) *sections = reinterpret_cast<const ElfW(Shdr) *>(m_data + header->e_shoff);
+    const ElfW(Shdr) &names = sections[header->e_shstrndx];
+    if (names.sh_offset + names.sh_size > m_size)
+        return result;
+
+    for (int i = 0; i < header->e_shnum; ++i) {
+        const ElfW(Shdr) &shdr = sections[i];
+        if (shdr.sh_name >= names.sh_size)
+            continue;
+        const char *sectionName = reinterpret_cast<const char *>(m_data + names.sh_offset + shdr.sh_name);
+        if (strncmp(sectionName, name, names.sh_size - shdr.sh_name) != 0)
+            continue;
+        if (shdr.sh_type == SHT_NOBITS || shdr.sh_offset + shdr.sh_size > m_size)
+            return result;
+        result.address = shdr.sh_addr;
+        if (shdr.sh_flags & SHF_COMPRESSED) {
+            const QByteArray &contents = decompressedSection(name, m_data + shdr.sh_offset, shdr.sh_size);
+            if (contents.isEmpty())
+                return result;
+            result.data = reinterpret_cast<const uchar *>(contents.constData());
+            result.size = quint64(contents.size());
+            return result;
+        }
+        result.data = m_data + shdr.sh_offset;
+        result.size = shdr.sh_size;
+        return result;
+    }
+    return result;
+}
+
+const QByteArray &ElfFile::decompressedSection(const char *name, const uchar *data, quint64 size) const
+{
+    const QByteArray key(name);
+    // QHash 的节点不会因为插入而移动，返回的引用在锁外仍然有效
+    QMutexLocker locker(&m_sectionsMutex);
+    auto it = m_decompressedSections.constFind(key);
+    if (it != m_decompressedSections.constEnd())
+        return it.value();
+
+    // 压缩的节区以 ElfW(Chdr) 开头，后面是 zlib 数据流。qUncompress() 需要一个
+    // 4 字节大端序的解压后长度作为前缀。
+    QByteArray contents;
+    if (size >= sizeof(ElfW(Chdr))) {
+        const ElfW(Chdr) *header = reinterpret_cast<const ElfW(Chdr) *>(data);
+        if (header->ch_type == ELFCOMPRESS_ZLIB && header->ch_size < 0x7fffffff) {
+            QByteArray compressed(4, Qt::Uninitialized);
+            qToBigEndian(quint32(header->ch_size), compressed.data());
+            compressed.append(reinterpret_cast<const char *>(data + sizeof(ElfW(Chdr))),
+                              int(size - sizeof(ElfW(Chdr))));
+            contents = qUncompress(compressed);
+        }
+    }
+    return m_decompressedSections.insert(key, contents).value();
+}
+
+void ElfFile::appendSymbols(const char *tableName) const
+{
+    const Section table = section(tableName);
+    if (!table.isValid())
+        return;
+
+    // 符号表的 sh_link 指向对应的字符串表，这里直接按约定的名字查找
+    const Section strings = section(strcmp(tableName, ".symtab") == 0 ? ".strtab" : ".dynstr");
+    if (!strings.isValid())
+        return;
+
+    const ElfW(Sym) *symbols = reinterpret_cast<const ElfW(Sym) *>(table.data);
+    const quint64 count = table.size / sizeof(ElfW(Sym));
+    for (quint64 i = 0; i < count; ++i) {
+        const ElfW(Sym) &symbol = symbols[i];
+        if (ELF64_ST_TYPE(symbol.st_info) != STT_FUNC || symbol.st_value == 0
+                || symbol.st_name >= strings.size) {
+            continue;
+        }
+        Symbol entry;
+        entry.address = symbol.st_value;
+        entry.size = symbol.st_size;
+        entry.name = reinterpret_cast<const char *>(strings.data + symbol.st_name);
+        m_symbols.append(entry);
+    }
+}
+
+void ElfFile::ensureSymbolsLoaded() const
+{
+    if (m_symbolsLoaded.loadAcquire())
+        return;
+
+    QMutexLocker locker(&m_symbolsMutex);
+    if (!m_symbolsLoaded.loadAcquire()) {
+        loadSymbols();
+        m_symbolsLoaded.storeRelease(1);
+    }
+}
+
+void ElfFile::loadSymbols() const
+{
+    // .symtab 通常是 .dynsym 的超集，被 strip 掉时才退回 .dynsym
+    appendSymbols(".symtab");
+    if (m_symbols.isEmpty())
+        appendSymbols(".dynsym");
+
+    std::sort(m_symbols.begin(), m_symbols.end(), [](const Symbol &a, const Symbol &b) {
+        return a.address < b.address;
+    });
+}
+
+const QVector<ElfFile::Symbol> &ElfFile::symbols() const
+{
+    if (m_data)
+        ensureSymbolsLoaded();
+    return m_symbols;
+}
+
+bool ElfFile::symbolize(quint64 address, QString *name, quint64 *offset) const
+{
+    if (!m_data)
+        return false;
+    ensureSymbolsLoaded();
+
+    // 找到最后一个起始地址不大于 address 的符号
+    auto it = std::upper_bound(m_symbols.constBegin(), m_symbols.constEnd(), address,
+                               [](quint64 value, const Symbol &symbol) {
+        return value < symbol.address;
+    });
+    if (it == m_symbols.constBegin())
+        return false;
+    --it;
+
+    // 大小为 0 的符号（手写汇编）没法判断范围，只要在下一个符号之前就接受
+    if (it->size != 0 && address >= it->address + it->size)
+        return false;
+
+    *name = demangledSymbolName(it->name);
+    *offset = address - it->address;
+    return true;
+}
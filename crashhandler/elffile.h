@@ -0,0 +1,82 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+#include <QScopedPointer>
+#include <QString>
+#include <QVector>
+
+// 只读的 ELF 文件，按需解析节区、build-id 与符号表。
+// 文件通过 mmap 映射进来，返回的数据指针在 ElfFile 的生命周期内一直有效。
+// 加载之后所有 const 函数都可以在多个线程里同时调用，延迟解析的部分由内部的锁保护。
+class ElfFile
+{
+public:
+    struct Section
+    {
+        const uchar *data = nullptr;
+        quint64 size = 0;
+        quint64 address = 0; // 链接时的虚拟地址
+
+        bool isValid() const { return data != nullptr; }
+        bool contains(quint64 vaddr) const { return vaddr >= address && vaddr < address + size; }
+    };
+
+    ElfFile();
+    ~ElfFile();
+
+    bool load(const QString &path);
+    // 从内存中的镜像加载，比如从目标进程读出来的 [vdso]
+    bool loadFromImage(const QByteArray &image);
+
+    bool isValid() const { return m_data != nullptr; }
+    QString path() const { return m_path; }
+
+    // 十六进制表示的 GNU build-id，没有时为空
+    QByteArray buildId() const { return m_buildId; }
+
+    // 第一个 PT_LOAD 段页对齐后的虚拟地址，运行时地址减去 (装载基址 - loadAddress()) 即为文件内地址
+    quint64 loadAddress() const { return m_loadAddress; }
+
+    // 带 SHF_COMPRESSED 标志的节区（常见于单独的调试信息文件）会被解压后缓存
+    Section section(const char *name) const;
+
+    struct Symbol
+    {
+        quint64 address;
+        quint64 size;
+        const char *name; // 指向映射的字符串表，未 demangle
+    };
+
+    // 按地址排好序的函数符号
+    const QVector<Symbol> &symbols() const;
+
+    // 查找包含文件内地址 address 的函数，返回符号名（已经 demangle）和函数内偏移
+    bool symbolize(quint64 address, QString *name, quint64 *offset) const;
+
+private:
+    bool parse();
+    const QByteArray &decompressedSection(const char *name, const uchar *data, quint64 size) const;
+    void ensureSymbolsLoaded() const;
+    void loadSymbols() const;
+    void appendSymbols(const char *tableName) const;
+
+    QString m_path;
+    QScopedPointer<QFile> m_file;
+    QByteArray m_image;
+    const uchar *m_data = nullptr;
+    quint64 m_size = 0;
+    QByteArray m_buildId;
+    quint64 m_loadAddress = 0;
+
+    mutable QMutex m_symbolsMutex;
+    mutable QAtomicInt m_symbolsLoaded;
+    mutable QVector<Symbol> m_symbols;
+    mutable QMutex m_sectionsMutex; // 符号表加载时也会用到节区，所以与 m_symbolsMutex 分开
+    mutable QHash<QByteArray, QByteArray> m_decompressedSections;
+};
+
+QString demangledSymbolName(const char *name);
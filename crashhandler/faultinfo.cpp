@@ -0,0 +1,150 @@
+#include "faultinfo.h"
+#include "crashrecord.h"
+#include "processmaps.h"
+
+#include <signal.h>
+
+namespace {
+// Linux 默认的 vm.mmap_min_addr，这以下的地址不会被映射
+const quint64 nullPageLimit = 64 * 1024;
+// 栈溢出时出错地址离栈指针不远：一次压栈，或者一个大的局部数组
+const quint64 stackOverflowDistance = 256 * 1024;
+}
+
+static bool isStackOverflow(quint64 faultAddress, quint64 stackPointer, const ProcessMaps &maps)
+{
+    if (stackPointer == 0)
+        return false;
+    const quint64 distance = faultAddress > stackPointer ? faultAddress - stackPointer
+                                                         : stackPointer - faultAddress;
+    if (distance > stackOverflowDistance)
+        return false;
+    // 线程栈下面是没有权限的保护页，主线程的栈下面没有映射
+    const MemoryMapping *mapping = maps.findMapping(faultAddress);
+    return !mapping || mapping->permissions.startsWith("---");
+}
+
+FaultInfo FaultInfo::fromRecord(const CrashRecord &record, const ProcessMaps &maps)
+{
+    FaultInfo info;
+    info.thread = record.faultingThread;
+    info.signalNumber = record.signalNumber;
+    info.signalCode = record.signalCode;
+    info.faultAddress = record.faultAddress;
+    info.stackPointer = record.stackPointer;
+
+    if (record.signalNumber == SIGABRT) {
+        info.kind = Abort;
+    } else if (record.signalCode <= 0) {
+        // SI_USER、SI_TKILL 等，由进程自己或者别的进程发送
+        info.kind = ExternalSignal;
+    } else if (record.signalNumber == SIGSEGV || record.signalNumber == SIGBUS) {
+        if (isStackOverflow(record.faultAddress, record.stackPointer, maps))
+            info.kind = StackOverflow;
+        else if (record.faultAddress < nullPageLimit)
+            info.kind = NullPointerDereference;
+        else if (record.signalNumber == SIGBUS)
+            info.kind = BusError;
+        else if (record.signalCode == SEGV_ACCERR)
+            info.kind = PermissionFault;
+        else
+            info.kind = InvalidAddress;
+    } else if (record.signalNumber == SIGFPE) {
+        info.kind = record.signalCode == FPE_INTDIV ? DivideByZero : ArithmeticError;
+    } else if (record.signalNumber == SIGILL) {
+        info.kind = IllegalInstruction;
+    }
+    return info;
+}
+
+QString FaultInfo::kindName(Kind kind)
+{
+    switch (kind) {
+    case NullPointerDereference:
+        return QLatin1String("null-dereference");
+    case StackOverflow:
+        return QLatin1String("stack-overflow");
+    case InvalidAddress:
+        return QLatin1String("invalid-address");
+    case PermissionFault:
+        return QLatin1String("permission");
+    case BusError:
+        return QLatin1String("bus-error");
+    case DivideByZero:
+        return QLatin1String("divide-by-zero");
+    case ArithmeticError:
+        return QLatin1String("arithmetic");
+    case IllegalInstruction:
+        return QLatin1String("illegal-instruction");
+    case Abort:
+        return QLatin1String("abort");
+    case ExternalSignal:
+        return QLatin1String("external-signal");
+    default:
+        return QLatin1String("unknown");
+    }
+}
+
+QString FaultInfo::signalCodeName() const
+{
+    if (signalCode == SI_USER)
+        return QLatin1String("SI_USER");
+    if (signalCode == SI_TKILL)
+        return QLatin1String("SI_TKILL");
+    switch (signalNumber) {
+    case SIGSEGV:
+        if (signalCode == SEGV_MAPERR)
+            return QLatin1String("SEGV_MAPERR");
+        if (signalCode == SEGV_ACCERR)
+            return QLatin1String("SEGV_ACCERR");
+        break;
+    case SIGBUS:
+        if (signalCode == BUS_ADRALN)
+            return QLatin1String("BUS_ADRALN");
+        if (signalCode == BUS_ADRERR)
+            return QLatin1String("BUS_ADRERR");
+        if (signalCode == BUS_OBJERR)
+            return QLatin1String("BUS_OBJERR");
+        break;
+    case SIGFPE:
+        if (signalCode == FPE_INTDIV)
+            return QLatin1String("FPE_INTDIV");
+        if (signalCode == FPE_FLTDIV)
+            return QLatin1String("FPE_FLTDIV");
+        break;
+    case SIGILL:
+        if (signalCode == ILL_ILLOPC)
+            return QLatin1String("ILL_ILLOPC");
+        if (signalCode == ILL_PRVOPC)
+            return QLatin1String("ILL_PRVOPC");
+        break;
+    default:
+        break;
+    }
+    return QString::number(signalCode);
+}
+
+QString FaultInfo::toString() const
+{
+    static const char *const descriptions[] = {
+        "Unknown fault",
+        "NULL pointer dereference",
+        "Stack overflow",
+        "Access to an unmapped address",
+        "Access without the required permission",
+        "Bus error",
+        "Integer division by zero",
+        "Arithmetic error",
+        "Illegal instruction",
+        "Aborted",
+        "Signal sent by another thread or process"
+    };
+
+    QString text = QString("Fault: %1 in thread %2 (si_code %3")
+            .arg(QLatin1String(descriptions[kind])).arg(thread).arg(signalCodeName());
+    if (signalNumber == SIGSEGV || signalNumber == SIGBUS || signalNumber == SIGILL || signalNumber == SIGFPE)
+        text += QString(", address 0x%1").arg(faultAddress, 0, 16);
+    if (stackPointer != 0)
+        text += QString(", stack pointer 0x%1").arg(stackPointer, 0, 16);
+    return text + QLatin1String(")\n");
+}
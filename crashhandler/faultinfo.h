@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QString>
+
+#include <sys/types.h>
+
+class ProcessMaps;
+struct CrashRecord;
+
+// 信号处理程序记录的出错上下文（si_code、si_addr 和寄存器），加上出错类型的判断。
+// 不需要等回溯，拿到崩溃记录就能区分空指针和栈溢出
+struct FaultInfo
+{
+    enum Kind {
+        UnknownFault,
+        NullPointerDereference, // 地址落在最低的 64 KiB 里
+        StackOverflow,          // 地址在栈指针附近，落在保护页或者没有映射的地方
+        InvalidAddress,         // 没有映射的地址
+        PermissionFault,        // 有映射，但没有相应的权限，比如写只读数据
+        BusError,
+        DivideByZero,
+        ArithmeticError,
+        IllegalInstruction,
+        Abort,                  // abort()，通常是断言失败
+        ExternalSignal          // 由 kill() 或 raise() 发送，不是出错
+    };
+
+    pid_t thread = 0;
+    int signalNumber = 0;
+    int signalCode = 0;
+    quint64 faultAddress = 0;
+    quint64 stackPointer = 0;
+    Kind kind = UnknownFault;
+
+    static FaultInfo fromRecord(const CrashRecord &record, const ProcessMaps &maps);
+    static QString kindName(Kind kind); // 写进报告元数据的名称
+
+    bool isValid() const { return thread != 0; }
+    QString signalCodeName() const;
+    QString toString() const;
+};
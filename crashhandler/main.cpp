@@ -1,15 +1,31 @@
+#include "crashdaemon.h"
+#include "crashdaemonprotocol.h"
 #include "crashhandler.h"
+#include "crashrecord.h"
+#include "crashsignature.h"
+#include "crashtimeline.h"
+#include "reportstore.h"
+#include "reportuploader.h"
+#include "restartpolicy.h"
+#include "symbolcache.h"
+#include "uploadqueue.h"
 #include "utils.h"
 
 #include <QApplication>
 #include <QCommandLineParser>
 #include <QFile>
 #include <QProcess>
+#include <QScopedPointer>
 #include <QString>
 #include <QStyle>
 #include <QTextStream>
+#include <QUrl>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -34,12 +50,45 @@ static bool isParentProcessValid(Q_PID pid)
     return executable.contains(parentProcessName);
 }
 
-// 由崩溃的应用程序的信号处理程序调用
+// 没有显示服务器时无法创建 QApplication，只能使用无界面模式
+static bool isDisplayAvailable()
+{
+    const QByteArray platform = qgetenv("QT_QPA_PLATFORM");
+    if (!platform.isEmpty())
+        return platform != "offscreen" && platform != "minimal";
+    return !qEnvironmentVariableIsEmpty("DISPLAY") || !qEnvironmentVariableIsEmpty("WAYLAND_DISPLAY");
+}
+
+// 读取信号处理程序传过来的崩溃记录
+static bool readCrashRecord(int fd, CrashRecord *record)
+{
+    char *data = reinterpret_cast<char *>(record);
+    size_t remaining = sizeof(*record);
+    while (remaining > 0) {
+        const ssize_t count = read(fd, data, remaining);
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            break;
+        data += count;
+        remaining -= size_t(count);
+    }
+
+    return remaining == 0
+            && record->magic == CrashRecordMagic
+            && record->version == CrashRecordVersion
+            && record->frameCount <= CrashRecordMaxFrames;
+}
+
+// 由崩溃的应用程序的信号处理程序调用，或者由 CrashHandlerSetup 预先启动
 int main(int argc, char *argv[])
 {
-    QApplication app(argc, argv);
-    app.setApplicationName(applicationName);
-    app.setWindowIcon(QApplication::style()->standardIcon(QStyle::SP_MessageBoxCritical));
+    const quint64 startTime = CrashTimeline::now();
+
+    // 参数在创建 QApplication 之前解析，这样预先启动的 crashhandler 在等待期间不会初始化 GUI
+    QStringList arguments;
+    for (int i = 0; i < argc; ++i)
+        arguments.append(QString::fromLocal8Bit(argv[i]));
 
     // 解析参数
     QCommandLineParser parser;
@@ -47,27 +96,296 @@ int main(int argc, char *argv[])
     parser.addPositionalArgument("app-name", QString());
     const QCommandLineOption disableRestartOption("disable-restart");
     parser.addOption(disableRestartOption);
-    parser.process(app);
+    const QCommandLineOption recordFdOption("record-fd", QString(), "fd");
+    parser.addOption(recordFdOption);
+    const QCommandLineOption waitFdOption("wait-fd", QString(), "fd");
+    parser.addOption(waitFdOption);
+    const QCommandLineOption engineOption("engine", QString(), "native|gdb", "native");
+    parser.addOption(engineOption);
+    const QCommandLineOption symbolCacheOption("symbol-cache", QString(), "dir");
+    parser.addOption(symbolCacheOption);
+    const QCommandLineOption symbolCacheSizeOption("symbol-cache-max-mb", QString(), "size");
+    parser.addOption(symbolCacheSizeOption);
+    const QCommandLineOption rawCaptureOption("raw-capture", QString(), "file");
+    parser.addOption(rawCaptureOption);
+    const QCommandLineOption reportOption("report", QString(), "file");
+    parser.addOption(reportOption);
+    const QCommandLineOption skipKnownCrashesOption("skip-known-crashes");
+    parser.addOption(skipKnownCrashesOption);
+    const QCommandLineOption signatureStoreOption("signature-store", QString(), "dir");
+    parser.addOption(signatureStoreOption);
+    const QCommandLineOption recollectEveryOption("recollect-every", QString(), "n");
+    parser.addOption(recollectEveryOption);
+    const QCommandLineOption crashLoopThresholdOption("crash-loop-threshold", QString(), "n");
+    parser.addOption(crashLoopThresholdOption);
+    const QCommandLineOption crashLoopWindowOption("crash-loop-window", QString(), "seconds");
+    parser.addOption(crashLoopWindowOption);
+    const QCommandLineOption restartBackoffOption("restart-backoff", QString(), "initial,max");
+    parser.addOption(restartBackoffOption);
+    const QCommandLineOption restartStateOption("restart-state", QString(), "dir");
+    parser.addOption(restartStateOption);
+    const QCommandLineOption headlessOption("headless");
+    parser.addOption(headlessOption);
+    const QCommandLineOption spoolDirOption("spool-dir", QString(), "dir");
+    parser.addOption(spoolDirOption);
+    const QCommandLineOption spoolMaxReportsOption("spool-max-reports", QString(), "n");
+    parser.addOption(spoolMaxReportsOption);
+    const QCommandLineOption spoolMaxSizeOption("spool-max-mb", QString(), "size");
+    parser.addOption(spoolMaxSizeOption);
+    const QCommandLineOption maxTierOption("max-tier", QString(), "1|2|3");
+    parser.addOption(maxTierOption);
+    const QCommandLineOption timeBudgetOption("time-budget", QString(), "seconds");
+    parser.addOption(timeBudgetOption);
+    const QCommandLineOption phaseTimeoutOption("phase-timeout", QString(), "seconds");
+    parser.addOption(phaseTimeoutOption);
+    const QCommandLineOption coreDumpOption("core-dump");
+    parser.addOption(coreDumpOption);
+    const QCommandLineOption coreFileOption("core-file", QString(), "file");
+    parser.addOption(coreFileOption);
+    const QCommandLineOption coreFilterOption("core-filter", QString(), "stacks,heap,data,files");
+    parser.addOption(coreFilterOption);
+    const QCommandLineOption coreHeapLimitOption("core-heap-limit-mb", QString(), "size");
+    parser.addOption(coreHeapLimitOption);
+    const QCommandLineOption coreCompressionOption("core-compression", QString(), "0-9");
+    parser.addOption(coreCompressionOption);
+    const QCommandLineOption statsFileOption("stats-file", QString(), "file");
+    parser.addOption(statsFileOption);
+    const QCommandLineOption daemonOption("daemon");
+    parser.addOption(daemonOption);
+    const QCommandLineOption socketOption("socket", QString(), "path");
+    parser.addOption(socketOption);
+    const QCommandLineOption workersOption("workers", QString(), "n");
+    parser.addOption(workersOption);
+    const QCommandLineOption uploadUrlOption("upload-url", QString(), "url");
+    parser.addOption(uploadUrlOption);
+    const QCommandLineOption uploadQueueOption("upload-queue", QString(), "dir");
+    parser.addOption(uploadQueueOption);
+    const QCommandLineOption uploadQueueSizeOption("upload-queue-max-mb", QString(), "size");
+    parser.addOption(uploadQueueSizeOption);
+    const QCommandLineOption uploadBatchOption("upload-batch", QString(), "files");
+    parser.addOption(uploadBatchOption);
+    const QCommandLineOption uploadIntervalOption("upload-interval", QString(), "seconds");
+    parser.addOption(uploadIntervalOption);
+    const QCommandLineOption uploadOption("upload");
+    parser.addOption(uploadOption);
+    const QCommandLineOption indexReportsOption("index-reports");
+    parser.addOption(indexReportsOption);
+    if (!parser.parse(arguments))
+        printErrorAndExit();
+    const bool daemonMode = parser.isSet(daemonOption);
+    const bool uploadMode = parser.isSet(uploadOption);
 
     // 检查使用情况
     const QStringList positionalArguments = parser.positionalArguments();
-    if (positionalArguments.size() != 2)
-        printErrorAndExit();
-
-    // 返回父进程标识
+    CrashRecord record;
+    memset(&record, 0, sizeof(record));
+    bool hasRecord = false;
     Q_PID parentPid = getppid();
+    QString signalName;
+    QString appName;
+    quint64 recordTime = 0;
+
+    if (daemonMode || uploadMode) {
+        // 守护进程：崩溃的进程通过 socket 注册，见 crashdaemon.h
+        // 上传：把队列里的报告发送完就退出，可以由定时任务运行
+        if (!positionalArguments.isEmpty() || (uploadMode && !parser.isSet(uploadUrlOption)))
+            printErrorAndExit();
+    } else if (parser.isSet(waitFdOption)) {
+        // 预先启动：阻塞直到应用程序崩溃。应用程序正常退出时 socket 被关闭，直接退出即可。
+        // socket 要一直保持打开，应用程序在 helper 退出之前会一直阻塞在信号处理程序里。
+        if (positionalArguments.size() != 1)
+            printErrorAndExit();
+        const int waitFd = parser.value(waitFdOption).toInt();
+        fcntl(waitFd, F_SETFD, FD_CLOEXEC);
+        if (!readCrashRecord(waitFd, &record))
+            return EXIT_SUCCESS;
+        recordTime = CrashTimeline::now();
+        hasRecord = true;
+        parentPid = record.pid;
+        signalName = QString::fromLocal8Bit(strsignal(record.signalNumber));
+        appName = positionalArguments.at(0);
+    } else {
+        if (positionalArguments.size() != 2)
+            printErrorAndExit();
+        if (parser.isSet(recordFdOption)) {
+            const int recordFd = parser.value(recordFdOption).toInt();
+            hasRecord = readCrashRecord(recordFd, &record);
+            close(recordFd);
+        }
+        signalName = positionalArguments.at(0);
+        appName = positionalArguments.at(1);
+    }
+
 //    if (!isParentProcessValid(parentPid))
 //        printErrorAndExit();
 
+    // 无界面模式只创建 QCoreApplication，不加载平台插件，也不创建对话框
+    const CrashHandler::UiMode uiMode = daemonMode || uploadMode || parser.isSet(headlessOption)
+            || !isDisplayAvailable()
+            ? CrashHandler::Headless : CrashHandler::DialogUi;
+    QScopedPointer<QCoreApplication> app;
+    if (uiMode == CrashHandler::Headless) {
+        app.reset(new QCoreApplication(argc, argv));
+    } else {
+        app.reset(new QApplication(argc, argv));
+        QApplication::setWindowIcon(QApplication::style()->standardIcon(QStyle::SP_MessageBoxCritical));
+    }
+    app->setApplicationName(applicationName);
+
     // 运行
-    const QString signalName = positionalArguments.at(0);
-    const QString appName = positionalArguments.at(1);
     CrashHandler::RestartCapability restartCap = CrashHandler::EnableRestart;
     if (parser.isSet(disableRestartOption))
         restartCap = CrashHandler::DisableRestart;
 
-    CrashHandler crashHandler(parentPid, signalName, appName, restartCap);
+    SymbolCache symbolCache(parser.value(symbolCacheOption));
+    if (parser.isSet(symbolCacheSizeOption))
+        symbolCache.setMaximumSize(parser.value(symbolCacheSizeOption).toLongLong() * 1024 * 1024);
+
+    CrashSignatureStore signatureStore(parser.value(signatureStoreOption));
+    if (parser.isSet(recollectEveryOption))
+        signatureStore.setRecollectInterval(parser.value(recollectEveryOption).toInt());
+
+    RestartPolicy restartPolicy(appName, parser.value(restartStateOption));
+    if (parser.isSet(crashLoopThresholdOption))
+        restartPolicy.setThreshold(parser.value(crashLoopThresholdOption).toInt());
+    if (parser.isSet(crashLoopWindowOption))
+        restartPolicy.setWindow(parser.value(crashLoopWindowOption).toInt());
+    if (parser.isSet(restartBackoffOption)) {
+        const QStringList backoff = parser.value(restartBackoffOption).split(QLatin1Char(','));
+        restartPolicy.setBackoff(backoff.at(0).toInt(), backoff.value(1, backoff.at(0)).toInt());
+    }
+
+    const BacktraceCollector::Engine engine = parser.value(engineOption) == QLatin1String("gdb")
+            ? BacktraceCollector::GdbEngine : BacktraceCollector::NativeEngine;
+    const BacktraceCollector::Tier maximumTier = parser.isSet(maxTierOption)
+            ? BacktraceCollector::Tier(parser.value(maxTierOption).toInt()) : BacktraceCollector::FullTier;
+    const int timeBudget = parser.isSet(timeBudgetOption)
+            ? parser.value(timeBudgetOption).toInt() * 1000 : BacktraceCollector::defaultTimeBudget();
+    const int phaseTimeout = parser.isSet(phaseTimeoutOption)
+            ? parser.value(phaseTimeoutOption).toInt() * 1000 : BacktraceCollector::defaultPhaseTimeout();
+
+    const bool coreDumpEnabled = parser.isSet(coreDumpOption) || parser.isSet(coreFileOption);
+    CoreDumpOptions coreDumpOptions;
+    if (parser.isSet(coreFilterOption)) {
+        bool ok = false;
+        coreDumpOptions.filter = CoreDumpOptions::parseFilter(parser.value(coreFilterOption), &ok);
+        if (!ok)
+            printErrorAndExit();
+    }
+    if (parser.isSet(coreHeapLimitOption))
+        coreDumpOptions.heapLimit = parser.value(coreHeapLimitOption).toULongLong() * 1024 * 1024;
+    if (parser.isSet(coreCompressionOption))
+        coreDumpOptions.compressionLevel = parser.value(coreCompressionOption).toInt();
+
+    // 设置了任何一个上传选项都把结果放进队列
+    QScopedPointer<UploadQueue> uploadQueue;
+    QScopedPointer<ReportUploader> uploader;
+    if (parser.isSet(uploadUrlOption) || parser.isSet(uploadQueueOption)) {
+        uploadQueue.reset(new UploadQueue(parser.value(uploadQueueOption)));
+        if (parser.isSet(uploadQueueSizeOption))
+            uploadQueue->setLimits(INT_MAX, parser.value(uploadQueueSizeOption).toLongLong() * 1024 * 1024);
+    }
+    // 单次的 helper 只放进队列，由守护进程或者 crashhandler --upload 发送
+    if (parser.isSet(uploadUrlOption) && (daemonMode || uploadMode)) {
+        uploader.reset(new ReportUploader(uploadQueue.data()));
+        uploader->setEndpoint(QUrl(parser.value(uploadUrlOption)));
+        if (parser.isSet(uploadBatchOption))
+            uploader->setBatchLimits(parser.value(uploadBatchOption).toInt(), qint64(8) * 1024 * 1024);
+    }
+
+    // spool 目录有自己的上限，与上传队列无关。只设置其中一个时另一个不限
+    const int spoolMaximumReports = parser.value(spoolMaxReportsOption).toInt();
+    const qint64 spoolMaximumBytes = parser.value(spoolMaxSizeOption).toLongLong() * 1024 * 1024;
+
+    // 报告索引和结果放在同一个目录里，由 crashquery 查询
+    ReportStore reportStore(parser.value(spoolDirOption));
+    ReportStore *indexStore = parser.isSet(indexReportsOption) ? &reportStore : nullptr;
+
+    if (uploadMode) {
+        int exitCode = EXIT_SUCCESS;
+        QObject::connect(uploader.data(), &ReportUploader::finished, app.data(), [&](bool success) {
+            QTextStream err(stderr);
+            err << "Uploaded " << uploader->uploadedFiles() << " file(s).\n";
+            if (!success) {
+                err << uploader->errorString() << "\n";
+                exitCode = EXIT_FAILURE;
+            }
+            app->quit();
+        }, Qt::QueuedConnection);
+        uploader->drain();
+        app->exec();
+        return exitCode;
+    }
+
+    if (daemonMode) {
+        CrashDaemon daemon;
+        daemon.setBacktraceEngine(engine);
+        daemon.setMaximumTier(maximumTier);
+        daemon.setTimeBudget(timeBudget);
+        daemon.setPhaseTimeout(phaseTimeout);
+        if (coreDumpEnabled)
+            daemon.setCoreDump(coreDumpOptions);
+        daemon.setSymbolCache(&symbolCache);
+        if (parser.isSet(skipKnownCrashesOption))
+            daemon.setSignatureStore(&signatureStore);
+        daemon.setSpoolDirectory(parser.value(spoolDirOption));
+        if (parser.isSet(spoolMaxReportsOption) || parser.isSet(spoolMaxSizeOption))
+            daemon.setSpoolLimits(spoolMaximumReports, spoolMaximumBytes);
+        daemon.setStatsFile(parser.value(statsFileOption));
+        daemon.setRestartPolicy(restartPolicy);
+        if (parser.isSet(workersOption))
+            daemon.setWorkerCount(parser.value(workersOption).toInt());
+        daemon.setUploadQueue(uploadQueue.data());
+        daemon.setReportStore(indexStore);
+        // 守护进程里定期分批发送，各次崩溃的报告自然攒成一批
+        if (uploader) {
+            const int interval = parser.isSet(uploadIntervalOption)
+                    ? parser.value(uploadIntervalOption).toInt() * 1000 : 60 * 1000;
+            uploader->start(qMax(1000, interval));
+        }
+
+        QString errorString;
+        const QString socketPath = parser.isSet(socketOption) ? parser.value(socketOption)
+                                                              : defaultCrashDaemonSocketPath();
+        if (!daemon.listen(socketPath, &errorString)) {
+            QTextStream(stderr) << errorString << "\n";
+            return EXIT_FAILURE;
+        }
+        return app->exec();
+    }
+
+    CrashHandler crashHandler(parentPid, signalName, appName, restartCap, uiMode);
+    crashHandler.setSymbolCache(&symbolCache);
+    if (parser.isSet(spoolDirOption))
+        crashHandler.setSpoolDirectory(parser.value(spoolDirOption));
+    if (parser.isSet(spoolMaxReportsOption) || parser.isSet(spoolMaxSizeOption))
+        crashHandler.setSpoolLimits(spoolMaximumReports, spoolMaximumBytes);
+    if (parser.isSet(rawCaptureOption))
+        crashHandler.setRawCaptureFile(parser.value(rawCaptureOption));
+    if (parser.isSet(reportOption))
+        crashHandler.setReportFile(parser.value(reportOption));
+    if (parser.isSet(skipKnownCrashesOption))
+        crashHandler.setSignatureStore(&signatureStore);
+    if (restartCap == CrashHandler::EnableRestart)
+        crashHandler.setRestartPolicy(&restartPolicy);
+    if (hasRecord)
+        crashHandler.setCrashRecord(record);
+    // 预先启动的 helper 早就在运行了，从收到崩溃记录开始算
+    crashHandler.setHelperStartTime(parser.isSet(waitFdOption) ? recordTime : startTime);
+    if (parser.isSet(statsFileOption))
+        crashHandler.setStatsFile(parser.value(statsFileOption));
+    crashHandler.setBacktraceEngine(engine);
+    crashHandler.setMaximumTier(maximumTier);
+    crashHandler.setTimeBudget(timeBudget);
+    crashHandler.setPhaseTimeout(phaseTimeout);
+    if (coreDumpEnabled)
+        crashHandler.setCoreDump(coreDumpOptions, parser.value(coreFileOption));
+    crashHandler.setUploadQueue(uploadQueue.data());
+    crashHandler.setReportStore(indexStore);
+    // 可能在事件循环开始之前就结束了，quit() 要排队执行
+    QObject::connect(&crashHandler, &CrashHandler::finished,
+                     app.data(), &QCoreApplication::quit, Qt::QueuedConnection);
     crashHandler.run();
 
-    return app.exec();
+    return app->exec();
 }
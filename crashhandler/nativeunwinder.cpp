@@ -0,0 +1,366 @@
+#include "nativeunwinder.h"
+#include "elffile.h"
+#include "utils.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QThread>
+#include <QtConcurrent>
+
+#include <algorithm>
+
+#include <elf.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+
+namespace {
+const int maxFramesPerThread = 256;
+const quint64 stackSnippetSize = 4096;
+}
+
+// 模块的运行时装载基址。[vdso] 这样的匿名映射没有文件偏移信息，直接取映射起始地址。
+static quint64 moduleBase(const MemoryMapping &mapping)
+{
+    return mapping.isFileBacked() ? mapping.loadBase : mapping.start;
+}
+
+NativeUnwinder::NativeUnwinder(pid_t pid)
+    : m_pid(pid)
+{
+}
+
+NativeUnwinder::~NativeUnwinder()
+{
+    detach();
+    qDeleteAll(m_elfFiles);
+}
+
+bool NativeUnwinder::collect(QString *backtrace)
+{
+    if (!unwind())
+        return false;
+
+    *backtrace = formatBacktrace();
+    return true;
+}
+
+bool NativeUnwinder::collectRaw(RawCapture *capture)
+{
+    if (!unwind())
+        return false;
+
+    *capture = rawCapture();
+    return true;
+}
+
+bool NativeUnwinder::unwind()
+{
+    if (!attach()) {
+        detach();
+        return false;
+    }
+    unwindAll();
+    detach();
+    return true;
+}
+
+bool NativeUnwinder::attach()
+{
+    // 附加期间可能有新线程被创建，反复扫描 task 目录直到没有新线程出现。
+    // 每一轮先向所有新线程发出附加请求再统一等待，线程很多时它们可以同时停下来，不必逐个等待调度。
+    const QDir taskDir(QString("/proc/%1/task").arg(m_pid));
+    QElapsedTimer timer;
+    timer.start();
+    bool foundNewThread = true;
+    bool failed = false;
+    while (foundNewThread && !failed) {
+        foundNewThread = false;
+        QVector<pid_t> attaching;
+        foreach (const QString &entry, taskDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+            const pid_t tid = entry.toInt();
+            if (tid <= 0 || m_attachedThreads.contains(tid) || attaching.contains(tid))
+                continue;
+            foundNewThread = true;
+
+            if (ptrace(PTRACE_ATTACH, tid, nullptr, nullptr) == -1) {
+                if (errno == ESRCH) // 线程已经退出
+                    continue;
+                m_errorString = QString("ptrace(PTRACE_ATTACH, %1) failed: %2")
+                        .arg(tid).arg(QString::fromLocal8Bit(strerror(errno)));
+                failed = true;
+                break;
+            }
+            attaching.append(tid);
+        }
+
+        // 失败时也要等已经附加的线程停下，之后才能分离。
+        // 处在不可中断睡眠里的线程可能迟迟不停，轮询等待，取消或超时后放弃
+        if (!waitForStop(attaching, &timer) && !failed) {
+            m_errorString = m_canceled.loadAcquire()
+                    ? QString("Attaching to process %1 was canceled.").arg(m_pid)
+                    : QString("Threads of process %1 did not stop within %2 ms.").arg(m_pid).arg(m_attachTimeout);
+            failed = true;
+        }
+    }
+    if (failed)
+        return false;
+
+    if (m_attachedThreads.isEmpty()) {
+        m_errorString = QString("No threads found for process %1.").arg(m_pid);
+        return false;
+    }
+
+    // 所有线程都停下来以后内存映射不会再变化
+    if (!m_maps.load(m_pid)) {
+        m_errorString = QString("Could not read memory maps of process %1.").arg(m_pid);
+        return false;
+    }
+
+    std::sort(m_attachedThreads.begin(), m_attachedThreads.end());
+    foreach (pid_t tid, m_attachedThreads) {
+        NativeThread thread;
+        thread.tid = tid;
+        thread.name = QString::fromLocal8Bit(
+                    fileContents(QString("/proc/%1/task/%2/comm").arg(m_pid).arg(tid))).trimmed();
+        if (readRegisters(&thread))
+            m_threads.append(thread);
+    }
+
+    if (m_threads.isEmpty()) {
+        m_errorString = QString("Could not read registers of process %1.").arg(m_pid);
+        return false;
+    }
+    return true;
+}
+
+bool NativeUnwinder::waitForStop(const QVector<pid_t> &threads, const QElapsedTimer *timer)
+{
+    m_pendingThreads += threads;
+    int interval = 1; // ms
+    while (!m_pendingThreads.isEmpty()) {
+        for (int i = m_pendingThreads.size() - 1; i >= 0; --i) {
+            const pid_t tid = m_pendingThreads.at(i);
+            int status = 0;
+            const pid_t result = waitpid(tid, &status, __WALL | WNOHANG);
+            if (result == 0 || (result == -1 && errno == EINTR))
+                continue;
+            m_pendingThreads.remove(i);
+            if (result == tid)
+                m_attachedThreads.append(tid);
+        }
+        if (m_pendingThreads.isEmpty())
+            break;
+        if (m_canceled.loadAcquire() || (m_attachTimeout > 0 && timer->hasExpired(m_attachTimeout)))
+            return false;
+        QThread::msleep(interval);
+        interval = qMin(interval * 2, 20);
+    }
+    return true;
+}
+
+void NativeUnwinder::detach()
+{
+    foreach (pid_t tid, m_attachedThreads)
+        ptrace(PTRACE_DETACH, tid, nullptr, nullptr);
+    m_attachedThreads.clear();
+
+    // 还没停下的线程没法分离，最后再看一次，仍然没停的在调用线程所在进程退出时由内核分离
+    foreach (pid_t tid, m_pendingThreads) {
+        int status = 0;
+        if (waitpid(tid, &status, __WALL | WNOHANG) == tid)
+            ptrace(PTRACE_DETACH, tid, nullptr, nullptr);
+    }
+    m_pendingThreads.clear();
+}
+
+bool NativeUnwinder::readRegisters(NativeThread *thread)
+{
+#ifdef EHFRAME_UNWINDER_SUPPORTED
+    struct user_regs_struct regs;
+    struct iovec iov = { &regs, sizeof(regs) };
+    if (ptrace(PTRACE_GETREGSET, thread->tid, reinterpret_cast<void *>(NT_PRSTATUS), &iov) == -1)
+        return false;
+
+    UnwindRegisters &registers = thread->registers;
+#if defined(__x86_64__)
+    const quint64 values[] = { regs.rax, regs.rdx, regs.rcx, regs.rbx, regs.rsi, regs.rdi,
+                               regs.rbp, regs.rsp, regs.r8, regs.r9, regs.r10, regs.r11,
+                               regs.r12, regs.r13, regs.r14, regs.r15, regs.rip };
+    for (int reg = 0; reg < DwarfRegisterCount; ++reg)
+        registers.setValue(reg, values[reg]);
+    registers.pc = regs.rip;
+#elif defined(__aarch64__)
+    for (int reg = 0; reg < 31; ++reg)
+        registers.setValue(reg, regs.regs[reg]);
+    registers.setValue(DwarfStackPointer, regs.sp);
+    registers.pc = regs.pc;
+#endif
+    return true;
+#else
+    Q_UNUSED(thread);
+    return false;
+#endif
+}
+
+void NativeUnwinder::unwindAll()
+{
+    // 线程之间没有依赖，耗时却相差很大，QtConcurrent 按块动态分配，空闲的工作线程会接着取下一块。
+    // 读内存不要求是 ptrace 的附加线程；每个任务用自己的 ProcessMemoryReader，页缓存就不必加锁。
+    // m_threads 已经按线程号排好序，原地回溯后顺序不变。
+    QtConcurrent::blockingMap(m_threads, [this](NativeThread &thread) {
+        ProcessMemoryReader memory(m_pid);
+        captureStack(&thread, memory);
+        unwindThread(&thread, memory);
+    });
+}
+
+void NativeUnwinder::captureStack(NativeThread *thread, ProcessMemoryReader &memory)
+{
+    const quint64 sp = thread->registers.sp();
+    const MemoryMapping *mapping = m_maps.findMapping(sp);
+    if (!mapping)
+        return;
+    thread->stackAddress = sp;
+    thread->stack = memory.readRange(sp, qMin(stackSnippetSize, mapping->end - sp));
+}
+
+void NativeUnwinder::unwindThread(NativeThread *thread, ProcessMemoryReader &memory)
+{
+    UnwindRegisters registers = thread->registers;
+    bool isReturnAddress = false;
+
+    for (int i = 0; i < maxFramesPerThread && registers.pc != 0; ++i) {
+        NativeFrame frame;
+        frame.pc = registers.pc;
+        frame.sp = registers.sp();
+        frame.isReturnAddress = isReturnAddress;
+        thread->frames.append(frame);
+
+        const quint64 lookupPc = isReturnAddress ? registers.pc - 1 : registers.pc;
+        const MemoryMapping *mapping = m_maps.findMapping(lookupPc);
+        const ElfFile *elf = mapping ? elfFileForMapping(*mapping) : nullptr;
+        const quint64 previousSp = registers.sp();
+
+        bool signalFrame = false;
+        EhFrameUnwinder::StepResult result = EhFrameUnwinder::StepNoFrameInfo;
+        if (elf) {
+            const quint64 bias = moduleBase(*mapping) - elf->loadAddress();
+            result = EhFrameUnwinder::step(*elf, bias, memory, isReturnAddress, &registers,
+                                           &signalFrame);
+        }
+        if (result == EhFrameUnwinder::StepEndOfStack)
+            break;
+        if (result != EhFrameUnwinder::StepOk
+                && !EhFrameUnwinder::stepWithFramePointer(memory, i == 0, &registers)) {
+            break;
+        }
+
+        // 栈向低地址增长。信号帧之后可能从替代栈跳回线程栈，所以这时不做检查。
+        if (!signalFrame && registers.sp() <= previousSp)
+            break;
+        isReturnAddress = !signalFrame;
+    }
+}
+
+const ElfFile *NativeUnwinder::elfFileForMapping(const MemoryMapping &mapping)
+{
+    const QString key = mapping.isFileBacked() ? mapping.path
+                                               : QString("%1@%2").arg(mapping.path).arg(mapping.start);
+    // 并行回溯和符号化时从多个线程调用
+    QMutexLocker locker(&m_elfFilesMutex);
+    auto it = m_elfFiles.constFind(key);
+    if (it != m_elfFiles.constEnd())
+        return it.value();
+
+    // 加载失败的模块也记下来，避免重复尝试
+    ElfFile *elf = new ElfFile;
+    bool loaded = false;
+    if (mapping.isFileBacked())
+        loaded = elf->load(mapping.path);
+    else if (mapping.path == QLatin1String("[vdso]"))
+        loaded = elf->loadFromImage(ProcessMemoryReader(m_pid).readRange(mapping.start, mapping.end - mapping.start));
+    if (!loaded) {
+        delete elf;
+        elf = nullptr;
+    }
+    m_elfFiles.insert(key, elf);
+    return elf;
+}
+
+RawCapture NativeUnwinder::rawCapture()
+{
+    RawCapture capture;
+    capture.pid = m_pid;
+#if defined(__x86_64__)
+    capture.machine = EM_X86_64;
+#elif defined(__aarch64__)
+    capture.machine = EM_AARCH64;
+#endif
+
+    foreach (const MemoryMapping &mapping, m_maps.mappings()) {
+        if (!mapping.isExecutable())
+            continue;
+        RawModule module;
+        module.start = mapping.start;
+        module.end = mapping.end;
+        module.base = moduleBase(mapping);
+        module.path = mapping.path;
+        if (const ElfFile *elf = elfFileForMapping(mapping))
+            module.buildId = elf->buildId();
+        capture.modules.append(module);
+    }
+
+    foreach (const NativeThread &nativeThread, m_threads) {
+        RawThread thread;
+        thread.tid = nativeThread.tid;
+        thread.name = nativeThread.name;
+        thread.registers.pc = nativeThread.registers.pc;
+        for (int reg = 0; reg < DwarfRegisterCount && reg < RawRegisters::MaxRegisters; ++reg) {
+            if (nativeThread.registers.isValid(reg)) {
+                thread.registers.values[reg] = nativeThread.registers.values[reg];
+                thread.registers.validMask |= quint64(1) << reg;
+            }
+        }
+        thread.stackAddress = nativeThread.stackAddress;
+        thread.stack = nativeThread.stack;
+        foreach (const NativeFrame &nativeFrame, nativeThread.frames) {
+            RawFrame frame;
+            frame.pc = nativeFrame.pc;
+            frame.sp = nativeFrame.sp;
+            frame.isReturnAddress = nativeFrame.isReturnAddress;
+            thread.frames.append(frame);
+        }
+        capture.threads.append(thread);
+    }
+    return capture;
+}
+
+Symbolizer NativeUnwinder::symbolizer()
+{
+    Symbolizer symbolizer([this](const RawModule &module) -> const ElfFile * {
+        const MemoryMapping *mapping = m_maps.findMapping(module.start);
+        return mapping ? elfFileForMapping(*mapping) : nullptr;
+    });
+    symbolizer.setSymbolCache(m_symbolCache);
+    return symbolizer;
+}
+
+QString NativeUnwinder::formatBacktrace()
+{
+    return formatBacktrace(rawCapture());
+}
+
+QString NativeUnwinder::formatBacktrace(const RawCapture &capture)
+{
+    return symbolizer().symbolize(capture);
+}
+
+QString NativeUnwinder::formatThread(const RawCapture &capture, int threadIndex)
+{
+    return symbolizer().symbolizeThread(capture, threadIndex);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "ehframeunwinder.h"
+#include "processmaps.h"
+#include "processmemory.h"
+#include "rawcapture.h"
+#include "symbolizer.h"
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+#include <sys/types.h>
+
+class ElfFile;
+class QElapsedTimer;
+class SymbolCache;
+
+struct NativeFrame
+{
+    quint64 pc = 0;
+    quint64 sp = 0;
+    bool isReturnAddress = false; // 除了第一帧和信号帧之后的那一帧，pc 都是返回地址
+};
+
+struct NativeThread
+{
+    pid_t tid = 0;
+    QString name;
+    UnwindRegisters registers;
+    QVector<NativeFrame> frames;
+    quint64 stackAddress = 0;
+    QByteArray stack; // 线程停下时从栈顶开始的一段栈内存
+};
+
+// 不借助 gdb，直接用 ptrace 附加到目标进程，读取寄存器和栈内存，根据 .eh_frame 回溯所有线程。
+// ptrace 的附加属于调用线程，所以一个 NativeUnwinder 的公共函数必须在同一个线程里调用。
+// 寄存器在附加时就读好了，之后各线程的回溯与符号化只需要读内存，分给全局线程池并行完成。
+// 等待线程停下的过程可以被 cancel() 从其他线程打断，也可以用 setAttachTimeout() 限定时间。
+class NativeUnwinder
+{
+public:
+    explicit NativeUnwinder(pid_t pid);
+    ~NativeUnwinder();
+
+    // 符号化时优先使用磁盘上的符号索引，不设置时直接查 ELF 符号表
+    void setSymbolCache(SymbolCache *cache) { m_symbolCache = cache; }
+    // 等所有线程停下的最长时间，0 表示不限
+    void setAttachTimeout(int msecs) { m_attachTimeout = msecs; }
+    // 可以在任何线程里调用，正在进行的 attach() 尽快失败返回
+    void cancel() { m_canceled.storeRelease(1); }
+
+    // 附加、回溯、分离并生成文本，失败时可以通过 errorString() 获取原因
+    bool collect(QString *backtrace);
+    // 同上，但只记录原始帧地址和模块表，不做符号化
+    bool collectRaw(RawCapture *capture);
+
+    bool attach();
+    void detach();
+    void unwindAll();
+    RawCapture rawCapture();
+    QString formatBacktrace();
+    // 以下两个只用到模块表，分离之后在任何线程里都可以调用，capture 必须来自 rawCapture()
+    QString formatBacktrace(const RawCapture &capture);
+    QString formatThread(const RawCapture &capture, int threadIndex);
+
+    const QVector<NativeThread> &threads() const { return m_threads; }
+    const ProcessMaps &maps() const { return m_maps; }
+    QString errorString() const { return m_errorString; }
+
+private:
+    bool unwind();
+    bool waitForStop(const QVector<pid_t> &threads, const QElapsedTimer *timer);
+    bool readRegisters(NativeThread *thread);
+    void captureStack(NativeThread *thread, ProcessMemoryReader &memory);
+    void unwindThread(NativeThread *thread, ProcessMemoryReader &memory);
+    const ElfFile *elfFileForMapping(const MemoryMapping &mapping);
+    Symbolizer symbolizer();
+
+    const pid_t m_pid;
+    ProcessMaps m_maps;
+    QMutex m_elfFilesMutex;
+    QHash<QString, ElfFile *> m_elfFiles; // 只加载出现在栈上的模块
+    SymbolCache *m_symbolCache = nullptr;
+    QVector<pid_t> m_attachedThreads;
+    QVector<pid_t> m_pendingThreads; // 已经发出附加请求、还没停下的线程
+    int m_attachTimeout = 0;
+    QAtomicInt m_canceled;
+    QVector<NativeThread> m_threads;
+    QString m_errorString;
+};
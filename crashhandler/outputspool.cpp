@@ -0,0 +1,93 @@
+#include "outputspool.h"
+
+#include <QDir>
+#include <QFile>
+#include <QTemporaryFile>
+
+OutputSpool::OutputSpool(int bufferSize)
+    : m_bufferSize(qMax(1, bufferSize))
+{
+}
+
+OutputSpool::~OutputSpool()
+{
+    flush();
+}
+
+bool OutputSpool::open(const QString &fileName)
+{
+    bool opened = false;
+    if (fileName.isEmpty()) {
+        QTemporaryFile *file = new QTemporaryFile(QDir::tempPath() + QLatin1String("/crashhandler-XXXXXX.txt"));
+        m_file.reset(file);
+        opened = file->open();
+    } else {
+        m_file.reset(new QFile(fileName));
+        opened = m_file->open(QIODevice::WriteOnly | QIODevice::Truncate);
+    }
+    if (!opened) {
+        // 没有地方可写，打开前留下的内容也丢掉，之后的 append() 由 flush() 限制
+        m_written += m_buffer.size();
+        m_buffer.clear();
+        return false;
+    }
+    m_written = 0;
+    return flush();
+}
+
+bool OutputSpool::isOpen() const
+{
+    return m_file && m_file->isOpen();
+}
+
+QString OutputSpool::fileName() const
+{
+    return m_file ? m_file->fileName() : QString();
+}
+
+QString OutputSpool::errorString() const
+{
+    return m_file ? m_file->errorString() : QString();
+}
+
+void OutputSpool::append(const QString &text)
+{
+    if (text.isEmpty())
+        return;
+    m_buffer.append(text.toUtf8());
+    if (m_buffer.size() >= m_bufferSize)
+        flush();
+}
+
+void OutputSpool::appendParagraph(const QString &text)
+{
+    if (size() > 0)
+        m_buffer.append('\n');
+    append(text);
+}
+
+bool OutputSpool::flush()
+{
+    if (!isOpen()) {
+        // 还没有打开或者打不开：缓冲区满了也只能丢掉，内存占用同样不超过上限
+        if (m_buffer.size() >= m_bufferSize) {
+            m_written += m_buffer.size();
+            m_buffer.clear();
+        }
+        return false;
+    }
+    if (m_buffer.isEmpty())
+        return true;
+
+    // 写失败（比如磁盘满）时丢掉缓冲区，内存占用不能因此无限增长
+    const qint64 written = m_file->write(m_buffer);
+    const bool ok = written == m_buffer.size() && m_file->flush();
+    m_written += qMax(written, qint64(0));
+    m_buffer.clear();
+    return ok;
+}
+
+qint64 OutputSpool::size() const
+{
+    return m_written + m_buffer.size();
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QByteArray>
+#include <QScopedPointer>
+#include <QString>
+
+QT_BEGIN_NAMESPACE
+class QFile;
+QT_END_NAMESPACE
+
+// 把调试输出以 UTF-8 追加写到文件里，内存中只保留一个有上限的缓冲区。
+// 回溯（特别是带局部变量的）可能有几个 GB，界面和解析都从文件读回，不在内存中保留完整的文本。
+class OutputSpool
+{
+public:
+    enum { DefaultBufferSize = 64 * 1024 };
+
+    explicit OutputSpool(int bufferSize = DefaultBufferSize);
+    ~OutputSpool();
+
+    // fileName 为空时在临时目录里创建，对象析构时删除。打开前追加的内容先留在缓冲区里
+    bool open(const QString &fileName = QString());
+    bool isOpen() const;
+    QString fileName() const;
+    QString errorString() const;
+
+    // 原样追加
+    void append(const QString &text);
+    // 与 QTextEdit::append() 一样，在新的一行开始追加
+    void appendParagraph(const QString &text);
+    // 把缓冲区写到文件，读文件之前调用
+    bool flush();
+
+    // 包括还在缓冲区里的内容，字节
+    qint64 size() const;
+
+private:
+    Q_DISABLE_COPY(OutputSpool)
+
+    QScopedPointer<QFile> m_file;
+    QByteArray m_buffer;
+    int m_bufferSize;
+    qint64 m_written = 0;
+};
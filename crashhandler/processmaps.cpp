@@ -0,0 +1,93 @@
+#include "processmaps.h"
+#include "utils.h"
+
+#include <QHash>
+#include <QList>
+
+// 解析 /proc/<pid>/maps 的一行，格式为：
+// 起始-结束 权限 偏移 设备 inode 路径
+// 路径中可能包含空格，所以取第五个字段之后的全部内容。
+static bool parseMapsLine(const QByteArray &line, MemoryMapping *mapping)
+{
+    int pos = 0;
+    QList<QByteArray> fields;
+    while (fields.size() < 5) {
+        while (pos < line.size() && line.at(pos) == ' ')
+            ++pos;
+        const int begin = pos;
+        while (pos < line.size() && line.at(pos) != ' ')
+            ++pos;
+        if (begin == pos)
+            return false;
+        fields.append(line.mid(begin, pos - begin));
+    }
+    while (pos < line.size() && line.at(pos) == ' ')
+        ++pos;
+
+    const int dash = fields.at(0).indexOf('-');
+    if (dash == -1)
+        return false;
+
+    bool ok1, ok2, ok3, ok4;
+    mapping->start = fields.at(0).left(dash).toULongLong(&ok1, 16);
+    mapping->end = fields.at(0).mid(dash + 1).toULongLong(&ok2, 16);
+    mapping->permissions = fields.at(1);
+    mapping->offset = fields.at(2).toULongLong(&ok3, 16);
+    mapping->inode = fields.at(4).toULongLong(&ok4, 10);
+    mapping->path = QString::fromLocal8Bit(line.mid(pos));
+
+    return ok1 && ok2 && ok3 && ok4;
+}
+
+bool ProcessMaps::load(pid_t pid)
+{
+    m_mappings.clear();
+
+    const QByteArray contents = fileContents(QString("/proc/%1/maps").arg(pid));
+    if (contents.isEmpty())
+        return false;
+
+    QHash<QString, quint64> loadBases;
+    foreach (const QByteArray &line, contents.split('\n')) {
+        MemoryMapping mapping;
+        if (!parseMapsLine(line, &mapping))
+            continue;
+
+        // 模块的装载基址是偏移为 0 的第一个映射
+        if (mapping.isFileBacked()) {
+            if (!loadBases.contains(mapping.path) && mapping.offset == 0)
+                loadBases.insert(mapping.path, mapping.start);
+            mapping.loadBase = loadBases.value(mapping.path, mapping.start - mapping.offset);
+        }
+        m_mappings.append(mapping);
+    }
+
+    return !m_mappings.isEmpty();
+}
+
+const MemoryMapping *ProcessMaps::findMapping(quint64 address) const
+{
+    // maps 文件按地址升序排列，所以可以二分查找
+    int low = 0;
+    int high = m_mappings.size() - 1;
+    while (low <= high) {
+        const int middle = (low + high) / 2;
+        const MemoryMapping &mapping = m_mappings.at(middle);
+        if (address < mapping.start)
+            high = middle - 1;
+        else if (address >= mapping.end)
+            low = middle + 1;
+        else
+            return &mapping;
+    }
+    return nullptr;
+}
+
+QString ProcessMaps::describeAddress(quint64 address) const
+{
+    const MemoryMapping *mapping = findMapping(address);
+    if (!mapping || !mapping->isFileBacked())
+        return QString();
+
+    return QString("%1+0x%2").arg(mapping->path).arg(address - mapping->loadBase, 0, 16);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+
+#include <sys/types.h>
+
+// /proc/<pid>/maps 中的一个映射
+struct MemoryMapping
+{
+    quint64 start = 0;
+    quint64 end = 0;
+    quint64 offset = 0;
+    quint64 inode = 0;
+    quint64 loadBase = 0; // 同一文件第一个映射的起始地址，用于计算模块内偏移
+    QByteArray permissions;
+    QString path;
+
+    bool contains(quint64 address) const { return address >= start && address < end; }
+    bool isExecutable() const { return permissions.contains('x'); }
+    bool isFileBacked() const { return inode != 0 && path.startsWith(QLatin1Char('/')); }
+};
+
+class ProcessMaps
+{
+public:
+    bool load(pid_t pid);
+
+    const QVector<MemoryMapping> &mappings() const { return m_mappings; }
+    const MemoryMapping *findMapping(quint64 address) const;
+
+    // 形如 "/usr/lib/libfoo.so+0x1234" 的描述，地址不属于任何文件映射时返回空字符串
+    QString describeAddress(quint64 address) const;
+
+private:
+    QVector<MemoryMapping> m_mappings;
+};
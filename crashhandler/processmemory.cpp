@@ -0,0 +1,65 @@
+#include "processmemory.h"
+
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static bool readProcessMemory(pid_t pid, quint64 address, void *buffer, quint64 size)
+{
+    struct iovec local = { buffer, size_t(size) };
+    struct iovec remote = { reinterpret_cast<void *>(address), size_t(size) };
+    return process_vm_readv(pid, &local, 1, &remote, 1, 0) == ssize_t(size);
+}
+
+ProcessMemoryReader::ProcessMemoryReader(pid_t pid)
+    : m_pid(pid)
+    , m_pageSize(quint64(sysconf(_SC_PAGESIZE)))
+{
+}
+
+const QByteArray *ProcessMemoryReader::page(quint64 pageAddress)
+{
+    auto it = m_pages.constFind(pageAddress);
+    if (it != m_pages.constEnd())
+        return it->isEmpty() ? nullptr : &it.value();
+
+    // 读不到的页也记下来，避免重复的系统调用
+    QByteArray contents(int(m_pageSize), Qt::Uninitialized);
+    if (!readProcessMemory(m_pid, pageAddress, contents.data(), m_pageSize))
+        contents.clear();
+    it = m_pages.insert(pageAddress, contents);
+    return it->isEmpty() ? nullptr : &it.value();
+}
+
+bool ProcessMemoryReader::read(quint64 address, void *buffer, quint64 size)
+{
+    char *out = static_cast<char *>(buffer);
+    while (size > 0) {
+        const quint64 pageAddress = address & ~(m_pageSize - 1);
+        const quint64 pageOffset = address - pageAddress;
+        const quint64 count = qMin(size, m_pageSize - pageOffset);
+        const QByteArray *contents = page(pageAddress);
+        if (!contents)
+            return false;
+        memcpy(out, contents->constData() + pageOffset, size_t(count));
+        out += count;
+        address += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool ProcessMemoryReader::readWord(quint64 address, quint64 *value)
+{
+    *value = 0;
+    return read(address, value, sizeof(void *));
+}
+
+QByteArray ProcessMemoryReader::readRange(quint64 address, quint64 size)
+{
+    // 大块读取不经过页缓存
+    QByteArray contents(int(size), Qt::Uninitialized);
+    if (!readProcessMemory(m_pid, address, contents.data(), size))
+        return QByteArray();
+    return contents;
+}
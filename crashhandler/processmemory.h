@@ -0,0 +1,25 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+
+#include <sys/types.h>
+
+// 通过 process_vm_readv() 读取另一个进程的内存。回溯时反复读取同一段栈，
+// 所以按页缓存读到的内容。
+class ProcessMemoryReader
+{
+public:
+    explicit ProcessMemoryReader(pid_t pid);
+
+    bool read(quint64 address, void *buffer, quint64 size);
+    bool readWord(quint64 address, quint64 *value);
+    QByteArray readRange(quint64 address, quint64 size);
+
+private:
+    const QByteArray *page(quint64 pageAddress);
+
+    const pid_t m_pid;
+    const quint64 m_pageSize;
+    QHash<quint64, QByteArray> m_pages;
+};
@@ -0,0 +1,264 @@
+#include "processsnapshot.h"
+
+#include <QByteArray>
+#include <QList>
+
+#include <algorithm>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace {
+// 从 /proc/<pid>/status 中保留的字段
+const char *const statusKeys[] = {
+    "State", "Threads", "VmPeak", "VmSize", "VmHWM", "VmRSS", "RssAnon", "RssFile", "RssShmem", "VmSwap",
+    "voluntary_ctxt_switches", "nonvoluntary_ctxt_switches", nullptr
+};
+const char *const smapsRollupKeys[] = {
+    "Pss", "Private_Clean", "Private_Dirty", "Swap", nullptr
+};
+const char *const limitNames[] = {
+    "Max stack size", "Max core file size", "Max address space", "Max open files", "Max processes", nullptr
+};
+// 只有内核开启了 CONFIG_SCHED_DEBUG 才有 sched
+const char *const schedKeys[] = {
+    "se.sum_exec_runtime", "nr_switches", "nr_voluntary_switches", "nr_involuntary_switches", nullptr
+};
+const int readBlockSize = 16 * 1024;
+}
+
+// 相对于目录描述符读出整个文件，/proc 的文件大小总是 0，只能读到结束
+static QByteArray readFileAt(int dirFd, const char *name)
+{
+    const int fd = openat(dirFd, name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return QByteArray();
+
+    QByteArray contents;
+    for (;;) {
+        const int oldSize = contents.size();
+        contents.resize(oldSize + readBlockSize);
+        const ssize_t count = read(fd, contents.data() + oldSize, readBlockSize);
+        if (count == -1 && errno == EINTR) {
+            contents.resize(oldSize);
+            continue;
+        }
+        contents.resize(oldSize + int(qMax(ssize_t(0), count)));
+        if (count <= 0)
+            break;
+    }
+    close(fd);
+    return contents;
+}
+
+static bool isListed(const QByteArray &key, const char *const *keys)
+{
+    for (int i = 0; keys[i]; ++i) {
+        if (key == keys[i])
+            return true;
+    }
+    return false;
+}
+
+// "Key:  value" 或 "key : value" 形式的行
+static void appendKeyValues(RawProperties *entries, const QByteArray &contents, const char *const *keys)
+{
+    foreach (const QByteArray &line, contents.split('\n')) {
+        const int separator = line.indexOf(':');
+        if (separator <= 0)
+            continue;
+        const QByteArray key = line.left(separator).trimmed();
+        if (isListed(key, keys)) {
+            entries->append(qMakePair(QString::fromLatin1(key),
+                                      QString::fromLatin1(line.mid(separator + 1).simplified())));
+        }
+    }
+}
+
+QString ProcessSnapshot::stateName(char state)
+{
+    switch (state) {
+    case 'R': return QLatin1String("running");
+    case 'S': return QLatin1String("sleeping");
+    case 'D': return QLatin1String("uninterruptible");
+    case 'T': return QLatin1String("stopped");
+    case 't': return QLatin1String("traced");
+    case 'Z': return QLatin1String("zombie");
+    case 'X': return QLatin1String("dead");
+    case 'I': return QLatin1String("idle");
+    default: return QLatin1String("unknown");
+    }
+}
+
+bool ProcessSnapshot::readThreads(pid_t pid)
+{
+    m_threads.clear();
+    const QByteArray taskPath = QByteArray("/proc/") + QByteArray::number(pid) + "/task";
+    const int taskFd = open(taskPath.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (taskFd == -1)
+        return false;
+    DIR *dir = fdopendir(taskFd);
+    if (!dir) {
+        close(taskFd);
+        return false;
+    }
+
+    const quint64 ticksPerSecond = quint64(qMax(1L, sysconf(_SC_CLK_TCK)));
+    while (dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+            continue;
+        const QByteArray stat = readFileAt(dirfd(dir), (QByteArray(entry->d_name) + "/stat").constData());
+        // "tid (comm) S ppid ..."，comm 里可能有空格和括号，以最后一个 ')' 为准
+        const int nameStart = stat.indexOf('(');
+        const int nameEnd = stat.lastIndexOf(')');
+        if (nameStart == -1 || nameEnd < nameStart)
+            continue;
+        const QList<QByteArray> fields = stat.mid(nameEnd + 2).split(' ');
+        if (fields.size() < 13)
+            continue;
+
+        Thread thread;
+        thread.tid = pid_t(stat.left(nameStart).trimmed().toInt());
+        thread.name = QString::fromUtf8(stat.mid(nameStart + 1, nameEnd - nameStart - 1));
+        thread.state = fields.at(0).isEmpty() ? '?' : fields.at(0).at(0);
+        // 第 14、15 个字段是 utime 和 stime，第 39 个字段是 processor
+        thread.userMsecs = fields.at(11).toULongLong() * 1000 / ticksPerSecond;
+        thread.systemMsecs = fields.at(12).toULongLong() * 1000 / ticksPerSecond;
+        if (fields.size() > 36)
+            thread.processor = fields.at(36).toInt();
+        m_threads.append(thread);
+    }
+    closedir(dir);
+
+    std::sort(m_threads.begin(), m_threads.end(), [](const Thread &a, const Thread &b) {
+        const quint64 timeA = a.userMsecs + a.systemMsecs;
+        const quint64 timeB = b.userMsecs + b.systemMsecs;
+        return timeA != timeB ? timeA > timeB : a.tid < b.tid;
+    });
+    return !m_threads.isEmpty();
+}
+
+void ProcessSnapshot::readProcess(pid_t pid)
+{
+    const QByteArray procPath = QByteArray("/proc/") + QByteArray::number(pid);
+    const int procFd = open(procPath.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (procFd == -1)
+        return;
+
+    appendKeyValues(&m_entries, readFileAt(procFd, "status"), statusKeys);
+    appendKeyValues(&m_entries, readFileAt(procFd, "smaps_rollup"), smapsRollupKeys);
+    appendKeyValues(&m_entries, readFileAt(procFd, "sched"), schedKeys);
+
+    // "Max open files            1024                 4096                 files"
+    foreach (const QByteArray &line, readFileAt(procFd, "limits").split('\n')) {
+        for (int i = 0; limitNames[i]; ++i) {
+            if (line.startsWith(limitNames[i])) {
+                m_entries.append(qMakePair(QString::fromLatin1(limitNames[i]),
+                                           QString::fromLatin1(line.mid(int(strlen(limitNames[i]))).simplified())));
+            }
+        }
+    }
+
+    // 只数映射，具体的映射在回溯的模块表和核心转储里
+    foreach (const QByteArray &line, readFileAt(procFd, "maps").split('\n')) {
+        const int dash = line.indexOf('-');
+        const int space = line.indexOf(' ');
+        if (dash <= 0 || space < dash)
+            continue;
+        const quint64 start = line.left(dash).toULongLong(nullptr, 16);
+        const quint64 end = line.mid(dash + 1, space - dash - 1).toULongLong(nullptr, 16);
+        ++m_mappingCount;
+        m_mappedBytes += end > start ? end - start : 0;
+    }
+
+    // 按链接目标的类型统计打开的描述符，比如 "socket:[1234]"、"anon_inode:[eventfd]" 和文件路径
+    const int fdDirFd = openat(procFd, "fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *dir = fdDirFd != -1 ? fdopendir(fdDirFd) : nullptr;
+    if (dir) {
+        m_descriptorCount = 0;
+        char target[256];
+        while (dirent *entry = readdir(dir)) {
+            if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+                continue;
+            ++m_descriptorCount;
+            const ssize_t length = readlinkat(dirfd(dir), entry->d_name, target, sizeof(target) - 1);
+            QString type = QLatin1String("unknown");
+            if (length > 0) {
+                const QByteArray link(target, int(length));
+                const int colon = link.indexOf(':');
+                if (link.startsWith('/'))
+                    type = QLatin1String("file");
+                else if (link.startsWith("anon_inode:"))
+                    type = QString::fromLatin1(link.mid(colon + 1)).remove(QLatin1Char('[')).remove(QLatin1Char(']'));
+                else if (colon > 0)
+                    type = QString::fromLatin1(link.left(colon));
+            }
+            ++m_descriptorTypes[type];
+        }
+        closedir(dir);
+    } else if (fdDirFd != -1) {
+        close(fdDirFd);
+    }
+    close(procFd);
+}
+
+QString ProcessSnapshot::formatThreads() const
+{
+    QString text;
+    foreach (const Thread &thread, m_threads) {
+        text += QString("  tid %1  %2  user %3 ms  system %4 ms  cpu %5  %6\n")
+                .arg(thread.tid, -7).arg(stateName(thread.state), -15)
+                .arg(thread.userMsecs, 7).arg(thread.systemMsecs, 7)
+                .arg(thread.processor, 3).arg(thread.name);
+    }
+    return text;
+}
+
+QString ProcessSnapshot::formatProcess() const
+{
+    QString text;
+    if (m_mappingCount > 0) {
+        text += QString("  Mappings: %1 (%2 MiB mapped)\n")
+                .arg(m_mappingCount).arg(m_mappedBytes / (1024 * 1024));
+    }
+    if (m_descriptorCount >= 0) {
+        QStringList types;
+        for (auto it = m_descriptorTypes.constBegin(); it != m_descriptorTypes.constEnd(); ++it)
+            types.append(QString("%1 %2").arg(it.key()).arg(it.value()));
+        text += QString("  Open descriptors: %1 (%2)\n")
+                .arg(m_descriptorCount).arg(types.join(QLatin1String(", ")));
+    }
+    for (int i = 0; i < m_entries.size(); ++i)
+        text += QString("  %1: %2\n").arg(m_entries.at(i).first, m_entries.at(i).second);
+    return text;
+}
+
+QString ProcessSnapshot::format() const
+{
+    if (isEmpty())
+        return QString();
+
+    QString text = QLatin1String("\nProcess state at the time of the crash:\n");
+    text += formatProcess();
+    if (!m_threads.isEmpty()) {
+        text += QString("Threads by CPU time (%1):\n").arg(m_threads.size());
+        text += formatThreads();
+    }
+    return text;
+}
+
+RawProperties ProcessSnapshot::toMetadata() const
+{
+    RawProperties metadata;
+    if (isEmpty())
+        return metadata;
+    metadata.append(qMakePair(QString("processState"), formatProcess()));
+    metadata.append(qMakePair(QString("threadStates"), formatThreads()));
+    metadata.append(qMakePair(QString("threadCount"), QString::number(m_threads.size())));
+    if (m_descriptorCount >= 0)
+        metadata.append(qMakePair(QString("openDescriptors"), QString::number(m_descriptorCount)));
+    return metadata;
+}
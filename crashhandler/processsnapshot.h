@@ -0,0 +1,51 @@
+#pragma once
+
+#include "rawcapture.h"
+
+#include <QMap>
+#include <QString>
+#include <QVector>
+
+#include <sys/types.h>
+
+// 崩溃时目标进程状态的快照：内存、资源限制、打开的描述符，以及各线程的状态和 CPU 时间，
+// 用来判断进程死的时候哪些线程在空转、哪些在阻塞。
+// 文件都通过 /proc/<pid> 的目录描述符用 openat() 打开，不必每次解析完整路径，进程号被重用时也不会读错进程。
+// /proc 的文件在读的时候才生成，O_NONBLOCK 对它们没有意义，所以放在工作线程里一次读完，与回溯收集同时进行。
+class ProcessSnapshot
+{
+public:
+    struct Thread
+    {
+        pid_t tid = 0;
+        QString name;
+        char state = '?'; // /proc/<pid>/task/<tid>/stat 的第 3 个字段
+        quint64 userMsecs = 0;
+        quint64 systemMsecs = 0;
+        int processor = -1; // 最后运行在哪个 CPU 上
+    };
+
+    // 线程状态要在附加之前读，附加以后所有线程都是 t（被跟踪而停止）。很快，可以在主线程里调用
+    bool readThreads(pid_t pid);
+    // 其余的文件，在工作线程里调用
+    void readProcess(pid_t pid);
+
+    bool isEmpty() const { return m_threads.isEmpty() && m_entries.isEmpty(); }
+    const QVector<Thread> &threads() const { return m_threads; }
+    static QString stateName(char state);
+
+    // 线程按 CPU 时间从多到少排列
+    QString format() const;
+    RawProperties toMetadata() const;
+
+private:
+    QString formatThreads() const;
+    QString formatProcess() const;
+
+    QVector<Thread> m_threads;
+    RawProperties m_entries; // 从 status、smaps_rollup、limits 和 sched 中选出的行
+    int m_mappingCount = 0;
+    quint64 m_mappedBytes = 0;
+    int m_descriptorCount = -1; // -1 表示读不到
+    QMap<QString, int> m_descriptorTypes; // socket、pipe、file 等
+};
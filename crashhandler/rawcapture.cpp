@@ -0,0 +1,46 @@
+#include "rawcapture.h"
+#include "crashreport.h"
+
+#include <QSaveFile>
+
+#include <algorithm>
+
+const RawModule *findRawModule(const QVector<RawModule> &modules, quint64 address)
+{
+    auto it = std::upper_bound(modules.constBegin(), modules.constEnd(), address,
+                               [](quint64 value, const RawModule &module) {
+        return value < module.start;
+    });
+    if (it == modules.constBegin())
+        return nullptr;
+    --it;
+    return it->contains(address) ? &*it : nullptr;
+}
+
+const RawModule *RawCapture::findModule(quint64 address) const
+{
+    return findRawModule(modules, address);
+}
+
+bool RawCapture::save(const QString &fileName) const
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    if (!CrashReportWriter(&file).write(*this)) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+bool RawCapture::load(const QString &fileName, QString *errorString)
+{
+    CrashReportReader reader;
+    if (!reader.open(fileName)) {
+        *errorString = reader.errorString();
+        return false;
+    }
+    *this = reader.toRawCapture();
+    return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+#include <sys/types.h>
+
+struct RawFrame
+{
+    quint64 pc = 0;
+    quint64 sp = 0;
+    bool isReturnAddress = false;
+};
+
+// 线程停下时的寄存器，按 DWARF 编号保存
+struct RawRegisters
+{
+    enum { MaxRegisters = 32 };
+
+    quint64 pc = 0;
+    quint64 validMask = 0; // 第 n 位表示寄存器 n 有效
+    quint64 values[MaxRegisters] = {};
+};
+
+struct RawThread
+{
+    pid_t tid = 0;
+    QString name;
+    RawRegisters registers;
+    QVector<RawFrame> frames;
+    quint64 stackAddress = 0; // stack 是从这个地址（线程停下时的栈顶）开始的一段栈内存
+    QByteArray stack;
+};
+
+// 目标进程的一个可执行映射
+struct RawModule
+{
+    quint64 start = 0;
+    quint64 end = 0;
+    quint64 base = 0; // 模块的运行时装载基址，文件内地址 = pc - (base - ElfFile::loadAddress())
+    QString path;
+    QByteArray buildId; // 十六进制，匿名映射或没有 build-id 时为空
+
+    bool contains(quint64 address) const { return address >= start && address < end; }
+};
+
+// modules 必须按起始地址排序
+const RawModule *findRawModule(const QVector<RawModule> &modules, quint64 address);
+
+typedef QList<QPair<QString, QString> > RawProperties;
+
+// 未符号化的回溯：每个线程的原始帧地址、寄存器和栈顶内存，加上模块表。
+// 在生产机上只做这些，符号化交给装有调试信息的机器上的 crashsymbolize 离线完成。
+// 保存为 crashreport.h 中定义的二进制报告格式。
+struct RawCapture
+{
+    quint16 machine = 0; // ELF e_machine，决定寄存器编号的含义
+    pid_t pid = 0;
+    RawProperties metadata;   // 信号、应用程序名等
+    RawProperties systemInfo; // 内核版本、发行版信息
+    QVector<RawThread> threads;
+    QVector<RawModule> modules; // 按起始地址排序
+
+    const RawModule *findModule(quint64 address) const;
+
+    bool save(const QString &fileName) const;
+    bool load(const QString &fileName, QString *errorString);
+};
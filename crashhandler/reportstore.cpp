@@ -0,0 +1,675 @@
+#include "reportstore.h"
+#include "crashreport.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QLockFile>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <functional>
+
+#include <signal.h>
+#include <string.h>
+
+namespace {
+
+const char indexMagic[8] = { 'C', 'H', 'R', 'P', 'T', 'I', 'D', 'X' };
+const char stringsMagic[8] = { 'C', 'H', 'R', 'P', 'T', 'S', 'T', 'R' };
+const quint32 indexVersion = 2;
+const char indexFileName[] = "reports.chindex";
+const char stringsFileName[] = "reports.chstrings";
+const int lockTimeout = 5000; // ms
+const int scanChunkSize = 16384; // 记录数，一块 896 KB
+
+const struct { int number; const char *name; } signalNames[] = {
+    { SIGHUP, "SIGHUP" }, { SIGINT, "SIGINT" }, { SIGQUIT, "SIGQUIT" }, { SIGILL, "SIGILL" },
+    { SIGTRAP, "SIGTRAP" }, { SIGABRT, "SIGABRT" }, { SIGBUS, "SIGBUS" }, { SIGFPE, "SIGFPE" },
+    { SIGKILL, "SIGKILL" }, { SIGUSR1, "SIGUSR1" }, { SIGSEGV, "SIGSEGV" }, { SIGUSR2, "SIGUSR2" },
+    { SIGPIPE, "SIGPIPE" }, { SIGALRM, "SIGALRM" }, { SIGTERM, "SIGTERM" }, { SIGCHLD, "SIGCHLD" },
+    { SIGCONT, "SIGCONT" }, { SIGSTOP, "SIGSTOP" }, { SIGTSTP, "SIGTSTP" }, { SIGTTIN, "SIGTTIN" },
+    { SIGTTOU, "SIGTTOU" }, { SIGURG, "SIGURG" }, { SIGXCPU, "SIGXCPU" }, { SIGXFSZ, "SIGXFSZ" },
+    { SIGVTALRM, "SIGVTALRM" }, { SIGPROF, "SIGPROF" }, { SIGWINCH, "SIGWINCH" }, { SIGIO, "SIGIO" },
+    { SIGSYS, "SIGSYS" }
+};
+
+enum {
+    RecordRemoved = 0x1 // 报告已经删除，或者被同名的新记录取代
+};
+
+// 索引只在本机上读写，所有字段都用本机字节序
+struct IndexHeader
+{
+    char magic[8];
+    quint32 version;
+    quint32 recordSize;
+    quint64 generation;  // 与字符串表的相同，重建时两个文件各自原子地替换，不匹配说明读到了一半
+    quint64 recordCount; // 已经提交的记录数
+    quint64 stringsSize; // 已经提交的字符串表长度
+};
+
+struct StringsHeader
+{
+    char magic[8];
+    quint64 generation;
+    // 后面是字符串表，偏移 0 是空串
+};
+
+struct IndexRecord
+{
+    qint64 timestamp; // 崩溃时间，毫秒
+    qint64 modified;  // 报告文件的修改时间，和 size 一起判断报告是否改变
+    quint64 size;
+    quint32 file;     // 以下都是字符串表偏移，file 是相对于目录的文件名，目录外的报告是绝对路径
+    quint32 application;
+    quint32 signal;
+    quint32 signature;
+    quint32 faultKind;
+    quint32 buildIds; // 排好序的 build-id，以空格分隔，同一组模块得到同一个字符串
+    quint32 flags;
+    quint32 signo;    // 信号的缩写，与语言无关
+};
+
+Q_STATIC_ASSERT(sizeof(IndexHeader) == 40);
+Q_STATIC_ASSERT(sizeof(StringsHeader) == 16);
+Q_STATIC_ASSERT(sizeof(IndexRecord) == 56);
+
+// 与 SymbolIndex 的字符串表相同，但可以从已经提交的部分继续追加。
+// base 不为 0 时只管理从 base 开始新追加的部分，不与已经提交的字符串去重
+class StringTable
+{
+public:
+    explicit StringTable(const QByteArray &data = QByteArray(1, '\0'), quint32 base = 0)
+        : m_data(data)
+        , m_base(base)
+    {
+        for (int i = 1; i < m_data.size(); ) {
+            const int end = m_data.indexOf('\0', i);
+            m_offsets.insert(m_data.mid(i, end - i), quint32(i));
+            i = end + 1;
+        }
+    }
+
+    quint32 add(const QByteArray &string)
+    {
+        if (string.isEmpty())
+            return 0;
+        auto it = m_offsets.constFind(string);
+        if (it != m_offsets.constEnd())
+            return it.value();
+        const quint32 offset = m_base + quint32(m_data.size());
+        m_data.append(string);
+        m_data.append('\0');
+        m_offsets.insert(string, offset);
+        return offset;
+    }
+
+    QByteArray string(quint32 offset) const { return QByteArray(m_data.constData() + offset - m_base); }
+    const QByteArray &data() const { return m_data; }
+
+private:
+    QByteArray m_data;
+    quint32 m_base;
+    QHash<QByteArray, quint32> m_offsets;
+};
+
+struct ScanFilter
+{
+    bool active = false;
+    QVector<quint32> offsets; // 符合条件的字符串，升序
+
+    bool accepts(quint32 offset) const
+    {
+        return !active || std::binary_search(offsets.constBegin(), offsets.constEnd(), offset);
+    }
+};
+
+struct ScanChunk
+{
+    int first = 0;
+    int last = 0;
+    QVector<int> matches;
+};
+
+} // namespace
+
+// 从报告里取出要索引的字段，只读元数据节和模块表，不转换成 RawCapture
+static bool indexReport(const QString &path, const QFileInfo &info, StringTable *strings, IndexRecord *record)
+{
+    CrashReportReader reader;
+    if (!reader.open(path) || !reader.isComplete())
+        return false;
+
+    memset(record, 0, sizeof(*record));
+    record->modified = info.lastModified().toMSecsSinceEpoch();
+    record->size = quint64(info.size());
+    record->timestamp = record->modified; // 旧报告没有 time
+    const RawProperties metadata = reader.metadata();
+    for (int i = 0; i < metadata.size(); ++i) {
+        const QString &key = metadata.at(i).first;
+        const QString &value = metadata.at(i).second;
+        if (key == QLatin1String("time"))
+            record->timestamp = value.toLongLong();
+        else if (key == QLatin1String("application"))
+            record->application = strings->add(value.toUtf8());
+        else if (key == QLatin1String("signal"))
+            record->signal = strings->add(value.toUtf8());
+        else if (key == QLatin1String("signo"))
+            record->signo = strings->add(value.toLatin1());
+        else if (key == QLatin1String("signature"))
+            record->signature = strings->add(value.toLatin1());
+        else if (key == QLatin1String("faultKind"))
+            record->faultKind = strings->add(value.toUtf8());
+    }
+
+    QList<QByteArray> buildIds;
+    for (int i = 0; i < reader.moduleCount(); ++i) {
+        const QByteArray buildId(reader.moduleString(reader.modules()[i].buildId));
+        if (!buildId.isEmpty() && !buildIds.contains(buildId))
+            buildIds.append(buildId);
+    }
+    std::sort(buildIds.begin(), buildIds.end());
+    record->buildIds = strings->add(buildIds.join(' '));
+    return true;
+}
+
+// 读两个文件的头部并检查它们是否匹配，文件必须已经以读写方式打开
+static bool readHeaders(QFile *indexFile, QFile *stringsFile, IndexHeader *header, StringsHeader *stringsHeader)
+{
+    return indexFile->read(reinterpret_cast<char *>(header), sizeof(*header)) == qint64(sizeof(*header))
+            && stringsFile->read(reinterpret_cast<char *>(stringsHeader), sizeof(*stringsHeader))
+               == qint64(sizeof(*stringsHeader))
+            && memcmp(header->magic, indexMagic, sizeof(indexMagic)) == 0
+            && header->version == indexVersion && header->recordSize == sizeof(IndexRecord)
+            && memcmp(stringsHeader->magic, stringsMagic, sizeof(stringsMagic)) == 0
+            && stringsHeader->generation == header->generation
+            && header->stringsSize >= 1
+            && sizeof(*header) + header->recordCount * sizeof(IndexRecord) <= quint64(indexFile->size())
+            && sizeof(*stringsHeader) + header->stringsSize <= quint64(stringsFile->size());
+}
+
+ReportStore::ReportStore(const QString &directory)
+    : m_directory(directory.isEmpty() ? defaultDirectory() : directory)
+{
+}
+
+ReportStore::~ReportStore()
+{
+}
+
+QString ReportStore::defaultDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
+            + QLatin1String("/crashhandler/spool");
+}
+
+QString ReportStore::signalAbbreviation(int signalNumber)
+{
+    for (const auto &entry : signalNames) {
+        if (entry.number == signalNumber)
+            return QLatin1String(entry.name);
+    }
+    return QString::number(signalNumber);
+}
+
+// signalAbbreviation() 的反向，不认识时返回 0
+static int signalNumber(const QByteArray &abbreviation)
+{
+    for (const auto &entry : signalNames) {
+        if (abbreviation == entry.name)
+            return entry.number;
+    }
+    return 0;
+}
+
+QString ReportStore::indexPath() const
+{
+    return m_directory + QLatin1Char('/') + QLatin1String(indexFileName);
+}
+
+QString ReportStore::stringsPath() const
+{
+    return m_directory + QLatin1Char('/') + QLatin1String(stringsFileName);
+}
+
+bool ReportStore::add(const QString &fileName, QString *errorString)
+{
+    QString error;
+    {
+        QLockFile lock(indexPath() + QLatin1String(".lock"));
+        if (!QDir().mkpath(m_directory) || !lock.tryLock(lockTimeout)) {
+            if (errorString)
+                *errorString = QString("Could not lock the report index in %1").arg(m_directory);
+            return false;
+        }
+
+        QFile indexFile(indexPath());
+        QFile stringsFile(stringsPath());
+        IndexHeader header;
+        StringsHeader stringsHeader;
+        if (indexFile.open(QIODevice::ReadWrite) && stringsFile.open(QIODevice::ReadWrite)
+                && readHeaders(&indexFile, &stringsFile, &header, &stringsHeader)) {
+            const QFileInfo info(fileName);
+            const QString name = info.absolutePath() == QDir(m_directory).absolutePath() ? info.fileName()
+                                                                                         : info.absoluteFilePath();
+            // 新字符串接在已经提交的字符串表后面，与 write() 的追加相同，最后写头部
+            StringTable strings(QByteArray(), quint32(header.stringsSize));
+            IndexRecord record;
+            if (!indexReport(info.absoluteFilePath(), info, &strings, &record)) {
+                error = QString("Could not index %1").arg(fileName);
+            } else {
+                record.file = strings.add(name.toUtf8());
+                const QByteArray &stringsData = strings.data();
+                const bool ok = stringsFile.seek(qint64(sizeof(stringsHeader) + header.stringsSize))
+                        && stringsFile.write(stringsData) == stringsData.size() && stringsFile.flush()
+                        && indexFile.seek(qint64(sizeof(header) + header.recordCount * sizeof(IndexRecord)))
+                        && indexFile.write(reinterpret_cast<const char *>(&record), sizeof(record))
+                           == qint64(sizeof(record))
+                        && indexFile.flush();
+                header.recordCount += 1;
+                header.stringsSize += quint64(stringsData.size());
+                if (!ok || !indexFile.seek(0)
+                        || indexFile.write(reinterpret_cast<const char *>(&header), sizeof(header))
+                           != qint64(sizeof(header))
+                        || !indexFile.flush()) {
+                    error = QString("Could not write the report index in %1").arg(m_directory);
+                }
+            }
+            if (errorString && !error.isEmpty())
+                *errorString = error;
+            return error.isEmpty();
+        }
+    }
+    // 还没有索引或者索引无效：整个重建一次
+    return write(QStringList(fileName), false, false, errorString) >= 0;
+}
+
+int ReportStore::update(QString *errorString)
+{
+    return write(QStringList(), true, false, errorString);
+}
+
+int ReportStore::rebuild(QString *errorString)
+{
+    return write(QStringList(), true, true, errorString);
+}
+
+int ReportStore::write(const QStringList &files, bool scanDirectory, bool reset, QString *errorString)
+{
+    QString error;
+    QLockFile lock(indexPath() + QLatin1String(".lock"));
+    if (!QDir().mkpath(m_directory) || !lock.tryLock(lockTimeout)) {
+        if (errorString)
+            *errorString = QString("Could not lock the report index in %1").arg(m_directory);
+        return -1;
+    }
+
+    // 读入已经提交的部分，头部不对或者两个文件不匹配时整个重建
+    QFile indexFile(indexPath());
+    QFile stringsFile(stringsPath());
+    IndexHeader header;
+    StringsHeader stringsHeader;
+    bool valid = !reset && indexFile.open(QIODevice::ReadWrite) && stringsFile.open(QIODevice::ReadWrite)
+            && readHeaders(&indexFile, &stringsFile, &header, &stringsHeader);
+
+    QVector<IndexRecord> records;
+    QByteArray committedStrings(1, '\0');
+    if (valid) {
+        records.resize(int(header.recordCount));
+        const qint64 recordBytes = qint64(records.size()) * qint64(sizeof(IndexRecord));
+        committedStrings = stringsFile.read(qint64(header.stringsSize));
+        valid = indexFile.read(reinterpret_cast<char *>(records.data()), recordBytes) == recordBytes
+                && committedStrings.size() == int(header.stringsSize) && committedStrings.endsWith('\0');
+    }
+    if (!valid) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, indexMagic, sizeof(indexMagic));
+        header.version = indexVersion;
+        header.recordSize = sizeof(IndexRecord);
+        header.generation = quint64(QDateTime::currentMSecsSinceEpoch());
+        memcpy(stringsHeader.magic, stringsMagic, sizeof(stringsMagic));
+        stringsHeader.generation = header.generation;
+        records.clear();
+        committedStrings = QByteArray(1, '\0');
+    }
+    StringTable strings(committedStrings);
+    const int committedRecords = records.size();
+
+    // 每个文件名只有最新的一条记录有效，add() 追加的同名记录在这里作废旧的
+    QHash<QString, int> live;
+    QVector<int> removed;
+    for (int i = 0; i < records.size(); ++i) {
+        if (records.at(i).flags & RecordRemoved)
+            continue;
+        const QString name = QString::fromUtf8(strings.string(records.at(i).file));
+        const int previous = live.value(name, -1);
+        if (previous != -1) {
+            records[previous].flags |= RecordRemoved;
+            removed.append(previous);
+        }
+        live.insert(name, i);
+    }
+
+    const QDir directory(m_directory);
+    QStringList candidates;
+    foreach (const QString &file, files)
+        candidates.append(QFileInfo(file).absoluteFilePath());
+    if (scanDirectory) {
+        const QStringList entries = directory.entryList(QStringList("*.chreport"), QDir::Files, QDir::Name);
+        QSet<QString> present;
+        foreach (const QString &entry, entries) {
+            present.insert(entry);
+            candidates.append(directory.filePath(entry));
+        }
+        for (auto it = live.begin(); it != live.end(); ) {
+            const bool exists = it.key().startsWith(QLatin1Char('/')) ? QFileInfo::exists(it.key())
+                                                                      : present.contains(it.key());
+            if (exists) {
+                ++it;
+            } else {
+                records[it.value()].flags |= RecordRemoved;
+                removed.append(it.value());
+                it = live.erase(it);
+            }
+        }
+    }
+
+    int added = 0;
+    foreach (const QString &path, candidates) {
+        const QFileInfo info(path);
+        // 目录里的报告用相对路径，整个目录搬走以后索引仍然有效
+        const QString name = info.absolutePath() == directory.absolutePath() ? info.fileName()
+                                                                             : info.absoluteFilePath();
+        const int existing = live.value(name, -1);
+        if (existing != -1 && records.at(existing).size == quint64(info.size())
+                && records.at(existing).modified == info.lastModified().toMSecsSinceEpoch()) {
+            continue;
+        }
+
+        IndexRecord record;
+        if (!indexReport(path, info, &strings, &record)) {
+            if (!scanDirectory)
+                error = QString("Could not index %1").arg(path);
+            continue;
+        }
+        record.file = strings.add(name.toUtf8());
+        if (existing != -1) {
+            records[existing].flags |= RecordRemoved;
+            removed.append(existing);
+        }
+        live.insert(name, records.size());
+        records.append(record);
+        ++added;
+    }
+
+    if (valid && removed.isEmpty() && records.size() == committedRecords) {
+        if (errorString && !error.isEmpty())
+            *errorString = error;
+        return error.isEmpty() ? added : -1;
+    }
+
+    const QByteArray stringsData = strings.data();
+    bool ok = true;
+    if (valid) {
+        // 追加：先写字符串表和记录，最后写头部，中断时读的一方和下一次写入都只看头部里提交的部分
+        ok = stringsFile.seek(qint64(sizeof(stringsHeader) + header.stringsSize))
+                && stringsFile.write(stringsData.mid(int(header.stringsSize)))
+                   == qint64(stringsData.size()) - qint64(header.stringsSize);
+        foreach (int index, removed) {
+            if (index >= committedRecords)
+                continue;
+            ok = ok && indexFile.seek(qint64(sizeof(header) + quint64(index) * sizeof(IndexRecord)))
+                    && indexFile.write(reinterpret_cast<const char *>(&records.at(index)), sizeof(IndexRecord))
+                       == qint64(sizeof(IndexRecord));
+        }
+        const qint64 newBytes = qint64(records.size() - committedRecords) * qint64(sizeof(IndexRecord));
+        ok = ok && stringsFile.flush()
+                && indexFile.seek(qint64(sizeof(header) + quint64(committedRecords) * sizeof(IndexRecord)))
+                && indexFile.write(reinterpret_cast<const char *>(records.constData() + committedRecords), newBytes)
+                   == newBytes;
+        header.recordCount = quint64(records.size());
+        header.stringsSize = quint64(stringsData.size());
+        ok = ok && indexFile.flush() && indexFile.seek(0)
+                && indexFile.write(reinterpret_cast<const char *>(&header), sizeof(header)) == qint64(sizeof(header))
+                && indexFile.flush();
+        if (!ok)
+            error = QString("Could not write the report index in %1").arg(m_directory);
+    } else {
+        // 重建：两个文件都原子地替换，已经映射了旧文件的查询不受影响
+        indexFile.close();
+        stringsFile.close();
+        header.recordCount = quint64(records.size());
+        header.stringsSize = quint64(stringsData.size());
+        QSaveFile newStrings(stringsPath());
+        QSaveFile newIndex(indexPath());
+        ok = newStrings.open(QIODevice::WriteOnly)
+                && newStrings.write(reinterpret_cast<const char *>(&stringsHeader), sizeof(stringsHeader))
+                   == qint64(sizeof(stringsHeader))
+                && newStrings.write(stringsData) == stringsData.size()
+                && newStrings.commit()
+                && newIndex.open(QIODevice::WriteOnly)
+                && newIndex.write(reinterpret_cast<const char *>(&header), sizeof(header)) == qint64(sizeof(header))
+                && newIndex.write(reinterpret_cast<const char *>(records.constData()),
+                                  qint64(records.size()) * qint64(sizeof(IndexRecord)))
+                   == qint64(records.size()) * qint64(sizeof(IndexRecord))
+                && newIndex.commit();
+        if (!ok)
+            error = QString("Could not write %1: %2").arg(indexPath(), newStrings.errorString() + newIndex.errorString());
+    }
+
+    if (errorString && !error.isEmpty())
+        *errorString = error;
+    // 扫描目录时跳过不完整的报告，它们可能还在写，下一次再试
+    return ok && (scanDirectory || error.isEmpty()) ? added : -1;
+}
+
+bool ReportStore::open(QString *errorString)
+{
+    m_records = nullptr;
+    m_recordCount = 0;
+    m_strings = nullptr;
+    m_stringsSize = 0;
+    m_indexFile.reset(new QFile(indexPath()));
+    m_stringsFile.reset(new QFile(stringsPath()));
+
+    QString error;
+    const uchar *index = nullptr;
+    const uchar *strings = nullptr;
+    const qint64 indexSize = m_indexFile->size();
+    const qint64 stringsSize = m_stringsFile->size();
+    if (!m_indexFile->open(QIODevice::ReadOnly) || !m_stringsFile->open(QIODevice::ReadOnly)) {
+        error = QString("Could not open the report index in %1").arg(m_directory);
+    } else if (indexSize < qint64(sizeof(IndexHeader)) || stringsSize < qint64(sizeof(StringsHeader))
+               || !(index = m_indexFile->map(0, indexSize)) || !(strings = m_stringsFile->map(0, stringsSize))) {
+        error = QString("Could not map the report index in %1").arg(m_directory);
+    } else {
+        // 头部只读一次，之后追加的记录不可见
+        const IndexHeader *header = reinterpret_cast<const IndexHeader *>(index);
+        const StringsHeader *stringsHeader = reinterpret_cast<const StringsHeader *>(strings);
+        const char *table = reinterpret_cast<const char *>(strings + sizeof(StringsHeader));
+        if (memcmp(header->magic, indexMagic, sizeof(indexMagic)) != 0 || header->version != indexVersion
+                || header->recordSize != sizeof(IndexRecord)
+                || memcmp(stringsHeader->magic, stringsMagic, sizeof(stringsMagic)) != 0
+                || stringsHeader->generation != header->generation
+                || header->recordCount > quint64((indexSize - qint64(sizeof(IndexHeader))) / qint64(sizeof(IndexRecord)))
+                || header->stringsSize < 1 || header->stringsSize > quint64(stringsSize) - sizeof(StringsHeader)
+                || table[header->stringsSize - 1] != 0) {
+            error = QString("The report index in %1 is invalid, rebuild it").arg(m_directory);
+        } else {
+            m_records = index + sizeof(IndexHeader);
+            m_recordCount = int(header->recordCount);
+            m_strings = table;
+            m_stringsSize = header->stringsSize;
+        }
+    }
+
+    if (!error.isEmpty() && errorString)
+        *errorString = error;
+    return error.isEmpty();
+}
+
+const char *ReportStore::string(quint32 offset) const
+{
+    if (offset >= m_stringsSize)
+        return "";
+    return m_strings + offset;
+}
+
+QVector<int> ReportStore::scan(const Query &query) const
+{
+    // 先在字符串表里找出符合条件的字符串，不同的字符串远少于记录
+    auto resolve = [this](ScanFilter *filter, const std::function<bool(const QByteArray &)> &matches) {
+        filter->active = true;
+        for (quint64 offset = 1; offset < m_stringsSize; ) {
+            const char *text = m_strings + offset;
+            const int length = int(strlen(text));
+            if (matches(QByteArray::fromRawData(text, length)))
+                filter->offsets.append(quint32(offset));
+            offset += quint64(length) + 1;
+        }
+        return !filter->offsets.isEmpty();
+    };
+
+    ScanFilter application;
+    ScanFilter signo;
+    ScanFilter legacySignal; // 没有 signo 的旧报告
+    ScanFilter signature;
+    ScanFilter buildIds;
+    const QByteArray applicationName = query.application.toUtf8();
+    // "11"、"segv" 和 "SIGSEGV" 都换算成 "SIGSEGV"
+    QString signalName = query.signal.trimmed().toUpper();
+    bool isNumber = false;
+    const int number = signalName.toInt(&isNumber);
+    if (isNumber)
+        signalName = signalAbbreviation(number);
+    else if (!signalName.startsWith(QLatin1String("SIG")))
+        signalName.prepend(QLatin1String("SIG"));
+    const QByteArray signoName = signalName.toLatin1();
+    if (!query.signal.isEmpty()) {
+        resolve(&signo, [&](const QByteArray &text) { return text == signoName; });
+        // 旧报告只记录了本地化的 strsignal() 文本，与当前语言下的文本相同时也算。
+        // 生成报告时的语言不同的旧报告仍然找不到
+        legacySignal.active = true;
+        const int legacyNumber = isNumber ? number : signalNumber(signoName);
+        if (legacyNumber > 0) {
+            const QByteArray localizedName = QString::fromLocal8Bit(strsignal(legacyNumber)).toUtf8();
+            resolve(&legacySignal, [&](const QByteArray &text) { return text == localizedName; });
+        }
+        if (signo.offsets.isEmpty() && legacySignal.offsets.isEmpty())
+            return QVector<int>();
+    }
+    const QByteArray buildIdToken = ' ' + query.buildId;
+    if ((!query.application.isEmpty() && !resolve(&application, [&](const QByteArray &text) {
+            return text == applicationName;
+        }))
+            || (!query.signature.isEmpty() && !resolve(&signature, [&](const QByteArray &text) {
+            return text.startsWith(query.signature);
+        }))
+            || (!query.buildId.isEmpty() && !resolve(&buildIds, [&](const QByteArray &text) {
+            return text.startsWith(query.buildId) || text.contains(buildIdToken);
+        }))) {
+        return QVector<int>();
+    }
+
+    // 每块扫描连续的记录，块内的结果已经按下标排序，按顺序拼起来即可
+    QVector<ScanChunk> chunks;
+    for (int first = 0; first < m_recordCount; first += scanChunkSize) {
+        ScanChunk chunk;
+        chunk.first = first;
+        chunk.last = qMin(first + scanChunkSize, m_recordCount);
+        chunks.append(chunk);
+    }
+    const IndexRecord *records = reinterpret_cast<const IndexRecord *>(m_records);
+    QtConcurrent::blockingMap(chunks, [&](ScanChunk &chunk) {
+        for (int i = chunk.first; i < chunk.last; ++i) {
+            const IndexRecord &record = records[i];
+            if ((record.flags & RecordRemoved)
+                    || (query.since && record.timestamp < query.since)
+                    || (query.until && record.timestamp >= query.until)
+                    || !application.accepts(record.application)
+                    || !(record.signo ? signo.accepts(record.signo) : legacySignal.accepts(record.signal))
+                    || !signature.accepts(record.signature)
+                    || !buildIds.accepts(record.buildIds)) {
+                continue;
+            }
+            chunk.matches.append(i);
+        }
+    });
+
+    QVector<int> matches;
+    foreach (const ScanChunk &chunk, chunks)
+        matches += chunk.matches;
+    return matches;
+}
+
+QVector<int> ReportStore::find(const Query &query) const
+{
+    QVector<int> matches = scan(query);
+    const IndexRecord *records = reinterpret_cast<const IndexRecord *>(m_records);
+    std::stable_sort(matches.begin(), matches.end(), [records](int a, int b) {
+        return records[a].timestamp > records[b].timestamp;
+    });
+    return matches;
+}
+
+QVector<QPair<QString, int> > ReportStore::count(const Query &query, Field field) const
+{
+    const IndexRecord *records = reinterpret_cast<const IndexRecord *>(m_records);
+    QHash<quint32, int> counts;
+    foreach (int index, scan(query)) {
+        const IndexRecord &record = records[index];
+        switch (field) {
+        case Application:
+            ++counts[record.application];
+            break;
+        case Signal:
+            // 旧报告没有 signo，退回本地化的文本
+            ++counts[record.signo ? record.signo : record.signal];
+            break;
+        case Signature:
+            ++counts[record.signature];
+            break;
+        case FaultKind:
+            ++counts[record.faultKind];
+            break;
+        }
+    }
+
+    // add() 追加的字符串不去重，同一个文本可能有多个偏移，按文本合并
+    QHash<QString, int> merged;
+    for (auto it = counts.constBegin(); it != counts.constEnd(); ++it)
+        merged[QString::fromUtf8(string(it.key()))] += it.value();
+    QVector<QPair<QString, int> > groups;
+    for (auto it = merged.constBegin(); it != merged.constEnd(); ++it)
+        groups.append(qMakePair(it.key(), it.value()));
+    std::sort(groups.begin(), groups.end(), [](const QPair<QString, int> &a, const QPair<QString, int> &b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    return groups;
+}
+
+ReportStore::Report ReportStore::report(int index) const
+{
+    Report report;
+    if (index < 0 || index >= m_recordCount)
+        return report;
+
+    const IndexRecord &record = reinterpret_cast<const IndexRecord *>(m_records)[index];
+    const QString file = QString::fromUtf8(string(record.file));
+    report.fileName = file.startsWith(QLatin1Char('/')) ? file : m_directory + QLatin1Char('/') + file;
+    report.timestamp = record.timestamp;
+    report.application = QString::fromUtf8(string(record.application));
+    report.signal = QString::fromUtf8(string(record.signal));
+    report.signo = QString::fromLatin1(string(record.signo));
+    report.signature = QByteArray(string(record.signature));
+    report.faultKind = QString::fromUtf8(string(record.faultKind));
+    const QByteArray buildIds(string(record.buildIds));
+    if (!buildIds.isEmpty())
+        report.buildIds = buildIds.split(' ');
+    return report;
+}
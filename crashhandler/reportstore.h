@@ -0,0 +1,93 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QPair>
+#include <QScopedPointer>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// 报告索引：spool 目录里的 .chreport 按应用程序名、信号、指纹、模块 build-id 和崩溃时间建立索引，
+// 查询不必再打开每一份报告。索引是目录里的两个文件：定长记录数组和字符串表，都只追加，
+// 头部的记录数和字符串表长度最后写入，写到一半中断时多出来的部分在下一次写入时被覆盖。
+// 每次崩溃的 add() 只读两个头部，追加一条记录和它自己的字符串，与已有的报告数无关；
+// update() 和 rebuild() 读入整个索引，去掉重复的字符串并作废同名的旧记录。
+// 写入由锁文件串行化；查询不加锁，直接映射打开时已经提交的部分，先把条件换算成字符串表里的偏移，
+// 再在全局线程池里分块并行扫描记录，每条记录只比较整数。
+class ReportStore
+{
+public:
+    enum Field {
+        Application,
+        Signal,
+        Signature,
+        FaultKind
+    };
+
+    struct Query
+    {
+        QString application;  // 完全相同，为空表示不限
+        QString signal;       // 信号的缩写或编号，不区分大小写，可以省略 SIG，比如 "SIGSEGV"、"segv" 或 "11"。
+                              // 没有 signo 的旧报告按当前语言下的 strsignal() 文本匹配
+        QByteArray signature; // 前缀
+        QByteArray buildId;   // 前缀，任何一个模块的 build-id 匹配即可
+        qint64 since = 0;     // 毫秒，自 1970 年起，0 表示不限
+        qint64 until = 0;
+    };
+
+    struct Report
+    {
+        QString fileName; // 绝对路径
+        qint64 timestamp = 0;
+        QString application;
+        QString signal; // 崩溃时 strsignal() 的文本，与语言有关
+        QString signo;  // 与语言无关的缩写，比如 SIGSEGV，旧报告没有
+        QByteArray signature;
+        QString faultKind;
+        QList<QByteArray> buildIds;
+    };
+
+    explicit ReportStore(const QString &directory = QString());
+    ~ReportStore();
+
+    // 与 CrashHandler::defaultSpoolDirectory() 相同，索引和报告放在一起
+    static QString defaultDirectory();
+    // 报告元数据 signo 的值，比如 11 是 "SIGSEGV"，不认识的信号是编号本身
+    static QString signalAbbreviation(int signalNumber);
+    QString directory() const { return m_directory; }
+
+    // 把一份刚写完的报告追加到索引，不读入已有的记录。同一份报告再次加入时，旧记录在下一次 update() 时作废。
+    // 目录外的报告按绝对路径记录。
+    bool add(const QString &fileName, QString *errorString = nullptr);
+    // 增量更新：索引目录里新出现和改变了的报告，作废已经删除的，返回新加入的报告数，失败时返回 -1
+    int update(QString *errorString = nullptr);
+    // 丢掉索引，从目录重新生成
+    int rebuild(QString *errorString = nullptr);
+
+    // 映射索引的当前版本，之后的写入要重新 open() 才能看到
+    bool open(QString *errorString = nullptr);
+    int recordCount() const { return m_recordCount; }
+
+    // 符合条件的记录，按崩溃时间从新到旧
+    QVector<int> find(const Query &query) const;
+    // 按 field 分组计数，数量多的在前
+    QVector<QPair<QString, int> > count(const Query &query, Field field) const;
+    Report report(int index) const;
+
+private:
+    QString indexPath() const;
+    QString stringsPath() const;
+    int write(const QStringList &files, bool scanDirectory, bool reset, QString *errorString);
+    QVector<int> scan(const Query &query) const;
+    const char *string(quint32 offset) const;
+
+    QString m_directory;
+    QScopedPointer<QFile> m_indexFile;
+    QScopedPointer<QFile> m_stringsFile;
+    const uchar *m_records = nullptr;
+    int m_recordCount = 0;
+    const char *m_strings = nullptr;
+    quint64 m_stringsSize = 0;
+};
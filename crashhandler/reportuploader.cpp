@@ -0,0 +1,150 @@
+#include "reportuploader.h"
+#include "uploadbatch.h"
+#include "uploadqueue.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QVector>
+
+namespace {
+const int defaultBatchFiles = 20;
+const qint64 defaultBatchBytes = qint64(8) * 1024 * 1024;
+const int defaultRequestTimeout = 60 * 1000; // ms
+}
+
+ReportUploader::ReportUploader(UploadQueue *queue, QObject *parent)
+    : QObject(parent)
+    , m_queue(queue)
+    , m_maximumFiles(defaultBatchFiles)
+    , m_batchFiles(defaultBatchFiles)
+    , m_maximumBytes(defaultBatchBytes)
+{
+    connect(&m_intervalTimer, &QTimer::timeout, this, &ReportUploader::uploadNextBatch);
+    m_requestTimer.setSingleShot(true);
+    m_requestTimer.setInterval(defaultRequestTimeout);
+    connect(&m_requestTimer, &QTimer::timeout, this, &ReportUploader::onRequestTimeout);
+}
+
+void ReportUploader::setBatchLimits(int maximumFiles, qint64 maximumBytes)
+{
+    m_maximumFiles = qMax(1, maximumFiles);
+    m_batchFiles = m_maximumFiles;
+    m_maximumBytes = qMax(qint64(1), maximumBytes);
+}
+
+void ReportUploader::start(int intervalMsecs)
+{
+    m_intervalTimer.start(intervalMsecs);
+    uploadNextBatch();
+}
+
+void ReportUploader::drain()
+{
+    m_draining = true;
+    uploadNextBatch();
+}
+
+void ReportUploader::finishDrain(bool success)
+{
+    if (!m_draining)
+        return;
+    m_draining = false;
+    emit finished(success);
+}
+
+void ReportUploader::uploadNextBatch()
+{
+    if (m_reply)
+        return;
+
+    const UploadQueue::State state = m_queue->state();
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (state.nextAttempt > now) {
+        m_errorString = QString("Backing off for %1 more seconds after %2 failed upload(s).")
+                .arg((state.nextAttempt - now + 999) / 1000).arg(state.failures);
+        finishDrain(false);
+        return;
+    }
+
+    // 最旧的先发，一个文件超过字节上限时单独发送
+    const QStringList pending = m_queue->pendingFiles();
+    QVector<UploadItem> items;
+    qint64 batchBytes = 0;
+    m_sending.clear();
+    foreach (const QString &fileName, pending) {
+        if (items.size() >= m_batchFiles)
+            break;
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            continue; // 可能刚被另一个进程发送并删除
+        if (!items.isEmpty() && batchBytes + file.size() > m_maximumBytes)
+            break;
+        UploadItem item;
+        item.name = QFileInfo(fileName).fileName();
+        item.data = file.readAll();
+        batchBytes += item.data.size();
+        items.append(item);
+        m_sending.append(fileName);
+    }
+    if (items.isEmpty()) {
+        finishDrain(true);
+        return;
+    }
+
+    QNetworkRequest request(m_endpoint);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, QByteArray(UploadBatchContentType));
+    request.setRawHeader("X-Crashhandler-Dropped", QByteArray::number(state.dropped));
+    m_reply = m_network.post(request, encodeUploadBatch(items));
+    connect(m_reply, &QNetworkReply::finished, this, &ReportUploader::onReplyFinished);
+    m_requestTimer.start();
+}
+
+void ReportUploader::onRequestTimeout()
+{
+    // abort() 会以 OperationCanceledError 发出 finished()
+    if (m_reply)
+        m_reply->abort();
+}
+
+void ReportUploader::onReplyFinished()
+{
+    m_requestTimer.stop();
+    QNetworkReply *reply = m_reply;
+    m_reply = nullptr;
+    reply->deleteLater();
+
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (reply->error() == QNetworkReply::NoError && status / 100 == 2) {
+        m_queue->remove(m_sending);
+        m_queue->recordSuccess();
+        m_uploadedFiles += m_sending.size();
+        m_sending.clear();
+        // 队列里可能还有，接着发
+        QTimer::singleShot(0, this, &ReportUploader::uploadNextBatch);
+        return;
+    }
+
+    if (status == 413) {
+        if (m_sending.size() > 1) {
+            m_batchFiles = qMax(1, m_sending.size() / 2);
+            QTimer::singleShot(0, this, &ReportUploader::uploadNextBatch);
+            return;
+        }
+        // 收集端永远不会接受这个文件，不要让它挡住后面的报告
+        m_queue->discard(m_sending);
+        m_sending.clear();
+        QTimer::singleShot(0, this, &ReportUploader::uploadNextBatch);
+        return;
+    }
+
+    const int retryAfter = status == 429 || status == 503 ? reply->rawHeader("Retry-After").toInt() : 0;
+    const UploadQueue::State state = m_queue->recordFailure(retryAfter);
+    m_errorString = QString("Upload to %1 failed (%2), retrying in %3 seconds.")
+            .arg(m_endpoint.toString(), status != 0 ? QString("HTTP %1").arg(status) : reply->errorString())
+            .arg((state.nextAttempt - QDateTime::currentMSecsSinceEpoch() + 999) / 1000);
+    m_sending.clear();
+    finishDrain(false);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QNetworkAccessManager>
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+#include <QUrl>
+
+QT_BEGIN_NAMESPACE
+class QNetworkReply;
+QT_END_NAMESPACE
+
+class UploadQueue;
+
+// 把上传队列里的报告分批 POST 到收集端，同时只有一个请求，请求体的格式见 uploadbatch.h。
+// 2xx 以后删除已经发送的文件；429 和 503 按 Retry-After 等待；413 时把批量减半再试，
+// 单个文件也被拒绝时丢掉它；其他错误按指数退避。退避状态保存在 UploadQueue 里，所有进程共享，
+// 收集端过载时整个机群都会慢下来，而不是一起重试。
+class ReportUploader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ReportUploader(UploadQueue *queue, QObject *parent = Q_NULLPTR);
+
+    void setEndpoint(const QUrl &url) { m_endpoint = url; }
+    void setBatchLimits(int maximumFiles, qint64 maximumBytes);
+    void setRequestTimeout(int msecs) { m_requestTimer.setInterval(msecs); }
+
+    // 守护进程：每隔 intervalMsecs 发送一批，一批成功后接着发下一批，直到队列为空
+    void start(int intervalMsecs);
+    // crashhandler --upload：一直发送到队列为空或者需要退避，然后发出 finished()
+    void drain();
+
+    int uploadedFiles() const { return m_uploadedFiles; }
+    QString errorString() const { return m_errorString; }
+
+signals:
+    // 只在 drain() 之后发出
+    void finished(bool success);
+
+private slots:
+    void uploadNextBatch();
+    void onReplyFinished();
+    void onRequestTimeout();
+
+private:
+    void finishDrain(bool success);
+
+    UploadQueue *m_queue;
+    QNetworkAccessManager m_network;
+    QUrl m_endpoint;
+    int m_maximumFiles;
+    int m_batchFiles; // 收到 413 后减小，只在这个进程里有效
+    qint64 m_maximumBytes;
+    QTimer m_intervalTimer;
+    QTimer m_requestTimer;
+    QNetworkReply *m_reply = nullptr;
+    QStringList m_sending;
+    bool m_draining = false;
+    int m_uploadedFiles = 0;
+    QString m_errorString;
+};
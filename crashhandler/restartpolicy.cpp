@@ -0,0 +1,120 @@
+#include "restartpolicy.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLockFile>
+#include <QRegExp>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace {
+const int defaultThreshold = 3;
+const int defaultWindowSeconds = 60;
+const int defaultInitialBackoff = 5;
+const int defaultMaximumBackoff = 300;
+const int lockTimeout = 2000; // ms
+}
+
+QString RestartPolicy::Decision::toString() const
+{
+    switch (state) {
+    case Normal:
+        return QString("No crash loop (%1 quick crash(es) in a row).").arg(recentCrashes);
+    case Backoff:
+        return QString("Crash loop detected (%1 quick crashes in a row, level %2). "
+                       "Restart is delayed by %3 seconds.").arg(recentCrashes).arg(loopLevel).arg(restartDelay);
+    case CircuitOpen:
+        return QString("Crash loop detected (%1 quick crashes in a row, level %2). "
+                       "Automatic restart and full backtrace collection are disabled.")
+                .arg(recentCrashes).arg(loopLevel);
+    }
+    return QString();
+}
+
+RestartPolicy::RestartPolicy(const QString &appName, const QString &directory)
+    : m_appName(appName)
+    , m_directory(directory.isEmpty() ? defaultDirectory() : directory)
+    , m_threshold(defaultThreshold)
+    , m_windowSeconds(defaultWindowSeconds)
+    , m_initialBackoff(defaultInitialBackoff)
+    , m_maximumBackoff(defaultMaximumBackoff)
+{
+}
+
+QString RestartPolicy::defaultDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
+            + QLatin1String("/crashhandler/restart");
+}
+
+void RestartPolicy::setBackoff(int initialSeconds, int maximumSeconds)
+{
+    m_initialBackoff = qMax(1, initialSeconds);
+    m_maximumBackoff = qMax(m_initialBackoff, maximumSeconds);
+}
+
+QString RestartPolicy::statePath() const
+{
+    // 应用程序名用作文件名，去掉路径分隔符之类的字符
+    QString name = m_appName;
+    name.replace(QRegExp("[^A-Za-z0-9._-]"), QString("_"));
+    if (name.isEmpty())
+        name = QLatin1String("unnamed");
+    return m_directory + QLatin1Char('/') + name + QLatin1String(".json");
+}
+
+RestartPolicy::Decision RestartPolicy::recordCrash()
+{
+    Decision decision;
+    decision.recentCrashes = 1;
+
+    // 状态文件不可用时按没有崩溃循环处理
+    if (!QDir().mkpath(m_directory))
+        return decision;
+    QLockFile lock(statePath() + QLatin1String(".lock"));
+    if (!lock.tryLock(lockTimeout))
+        return decision;
+
+    QJsonObject state;
+    QFile stateFile(statePath());
+    if (stateFile.open(QIODevice::ReadOnly))
+        state = QJsonDocument::fromJson(stateFile.readAll()).object();
+    stateFile.close();
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch() / 1000;
+    const qint64 lastCrash = qint64(state.value("lastCrash").toDouble());
+    const qint64 startedAt = lastCrash + state.value("lastDelay").toInt();
+    const bool quickCrash = lastCrash > 0 && now - startedAt <= m_windowSeconds;
+
+    decision.recentCrashes = quickCrash ? state.value("quickCrashes").toInt() + 1 : 1;
+    decision.loopLevel = quickCrash ? state.value("loopLevel").toInt() : 0;
+
+    if (decision.recentCrashes >= m_threshold) {
+        ++decision.loopLevel;
+        const qint64 delay = qint64(m_initialBackoff) << qMin(decision.loopLevel - 1, 30);
+        if (delay > m_maximumBackoff) {
+            decision.state = CircuitOpen;
+            decision.fullCollection = false;
+        } else {
+            decision.state = Backoff;
+            decision.restartDelay = int(delay);
+            // 循环刚开始时收集一次就够了，之后的崩溃多半是同一个原因
+            decision.fullCollection = decision.loopLevel == 1;
+        }
+    }
+
+    state.insert("lastCrash", double(now));
+    state.insert("lastDelay", decision.restartDelay);
+    state.insert("quickCrashes", decision.recentCrashes);
+    state.insert("loopLevel", decision.loopLevel);
+
+    QSaveFile saveFile(statePath());
+    if (saveFile.open(QIODevice::WriteOnly)) {
+        saveFile.write(QJsonDocument(state).toJson(QJsonDocument::Compact));
+        saveFile.commit();
+    }
+    return decision;
+}
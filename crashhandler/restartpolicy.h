@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QString>
+#include <QtGlobal>
+
+// 崩溃循环检测。每个应用程序的崩溃历史保存在一个小的状态文件里。
+// 连续若干次崩溃都发生在（重新）启动后的一个窗口期内即认为进入崩溃循环：重启按指数退避延迟，
+// 延迟超过上限后熔断，不再自动重启，也不再做完整的回溯收集，直到应用程序稳定运行超过一个窗口期。
+// 退避的等待时间不计入运行时间，否则延迟一长循环就检测不到了。
+class RestartPolicy
+{
+public:
+    enum State { Normal, Backoff, CircuitOpen };
+
+    struct Decision
+    {
+        State state = Normal;
+        int recentCrashes = 0;   // 连续的启动后窗口期内的崩溃次数，包括这一次
+        int loopLevel = 0;       // 连续检测到崩溃循环的次数
+        int restartDelay = 0;    // 秒
+        bool fullCollection = true;
+
+        bool restartAllowed() const { return state != CircuitOpen; }
+        QString toString() const;
+    };
+
+    explicit RestartPolicy(const QString &appName, const QString &directory = QString());
+
+    static QString defaultDirectory();
+
+    QString appName() const { return m_appName; }
+    void setAppName(const QString &appName) { m_appName = appName; }
+
+    void setThreshold(int crashes) { m_threshold = qMax(1, crashes); }
+    void setWindow(int seconds) { m_windowSeconds = qMax(1, seconds); }
+    void setBackoff(int initialSeconds, int maximumSeconds);
+
+    // 记录一次崩溃并给出这次的处理方式，每次崩溃只调用一次
+    Decision recordCrash();
+
+private:
+    QString statePath() const;
+
+    QString m_appName;
+    QString m_directory;
+    int m_threshold;
+    int m_windowSeconds;
+    int m_initialBackoff;
+    int m_maximumBackoff;
+};
@@ -0,0 +1,107 @@
+#include "symbolcache.h"
+#include "elffile.h"
+#include "symbolindex.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QStandardPaths>
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace {
+const qint64 defaultCacheSize = 256 * 1024 * 1024;
+const char indexSuffix[] = ".idx";
+}
+
+SymbolCache::SymbolCache(const QString &directory)
+    : m_directory(directory.isEmpty() ? defaultDirectory() : directory)
+    , m_maximumSize(defaultCacheSize)
+{
+}
+
+SymbolCache::~SymbolCache()
+{
+    qDeleteAll(m_indexes);
+}
+
+QString SymbolCache::defaultDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+            + QLatin1String("/crashhandler/symbols");
+}
+
+qint64 SymbolCache::defaultMaximumSize()
+{
+    return defaultCacheSize;
+}
+
+QString SymbolCache::indexPath(const QByteArray &buildId) const
+{
+    return m_directory + QLatin1Char('/') + QString::fromLatin1(buildId) + QLatin1String(indexSuffix);
+}
+
+const SymbolIndex *SymbolCache::index(const ElfFile &elf)
+{
+    const QByteArray buildId = elf.buildId();
+    if (buildId.isEmpty())
+        return nullptr;
+
+    // 生成索引也在锁内完成，同一个模块不会被两个线程同时解析
+    QMutexLocker locker(&m_mutex);
+    auto it = m_indexes.constFind(buildId);
+    if (it != m_indexes.constEnd())
+        return it.value();
+
+    SymbolIndex *index = new SymbolIndex;
+    const QString path = indexPath(buildId);
+    if (index->open(path)) {
+        // 刷新修改时间，淘汰时按最近使用排序
+        utimensat(AT_FDCWD, QFile::encodeName(path).constData(), nullptr, 0);
+    } else {
+        ElfFile debugElf;
+        const bool hasDebugElf = debugElf.load(SymbolIndex::separateDebugFilePath(buildId))
+                && debugElf.buildId() == buildId;
+        if (QDir().mkpath(m_directory)
+                && SymbolIndex::build(elf, hasDebugElf ? &debugElf : nullptr, path)
+                && index->open(path)) {
+            evict(path);
+        } else {
+            delete index;
+            index = nullptr;
+        }
+    }
+
+    m_indexes.insert(buildId, index);
+    return index;
+}
+
+void SymbolCache::evict(const QString &keepPath)
+{
+    QFileInfoList entries = QDir(m_directory).entryInfoList(
+                QStringList(QString("*%1").arg(indexSuffix)), QDir::Files);
+
+    qint64 totalSize = 0;
+    foreach (const QFileInfo &entry, entries)
+        totalSize += entry.size();
+    if (totalSize <= m_maximumSize)
+        return;
+
+    std::sort(entries.begin(), entries.end(), [](const QFileInfo &a, const QFileInfo &b) {
+        return a.lastModified() < b.lastModified();
+    });
+
+    // 已经映射的索引即使被删除也仍然可以读取
+    foreach (const QFileInfo &entry, entries) {
+        if (totalSize <= m_maximumSize)
+            break;
+        if (entry.absoluteFilePath() == QFileInfo(keepPath).absoluteFilePath())
+            continue;
+        if (QFile::remove(entry.absoluteFilePath()))
+            totalSize -= entry.size();
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+class ElfFile;
+class SymbolIndex;
+
+// 以 build-id 为键的磁盘符号索引缓存，同一个模块只在第一次崩溃时解析符号表和行号表。
+// 每次命中会刷新索引文件的修改时间，写入新索引后按修改时间从旧到新淘汰，使总大小不超过上限。
+// index() 是线程安全的，守护进程里并发的回溯共用一个缓存，已经打开的索引在进程的生命周期内一直保持映射。
+class SymbolCache
+{
+public:
+    explicit SymbolCache(const QString &directory = QString());
+    ~SymbolCache();
+
+    static QString defaultDirectory();
+    static qint64 defaultMaximumSize();
+
+    QString directory() const { return m_directory; }
+    void setMaximumSize(qint64 bytes) { m_maximumSize = bytes; }
+    qint64 maximumSize() const { return m_maximumSize; }
+
+    // 返回模块的索引，没有 build-id 或无法生成索引时返回 nullptr，调用者应退回 ElfFile::symbolize()。
+    // 返回的指针在 SymbolCache 的生命周期内有效。
+    const SymbolIndex *index(const ElfFile &elf);
+
+private:
+    QString indexPath(const QByteArray &buildId) const;
+    void evict(const QString &keepPath);
+
+    QString m_directory;
+    qint64 m_maximumSize;
+    QMutex m_mutex; // 保护 m_indexes 与磁盘上的索引文件
+    QHash<QByteArray, SymbolIndex *> m_indexes; // 失败的也记下来，避免重复尝试
+};
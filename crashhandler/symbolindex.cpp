@@ -0,0 +1,233 @@
+#include "symbolindex.h"
+#include "dwarflinetable.h"
+#include "elffile.h"
+
+#include <QHash>
+#include <QSaveFile>
+#include <QVector>
+
+#include <algorithm>
+
+#include <string.h>
+
+namespace {
+
+const char indexMagic[8] = { 'C', 'H', 'S', 'Y', 'M', 'I', 'D', 'X' };
+const quint32 indexVersion = 1;
+const quint32 noFile = 0xffffffff;
+
+// 索引只在本机上读写，所有字段都用本机字节序
+struct IndexHeader
+{
+    char magic[8];
+    quint32 version;
+    quint32 symbolCount;
+    quint32 lineCount;
+    quint32 fileCount;
+    quint32 stringTableSize;
+    quint32 reserved;
+};
+
+struct IndexSymbol
+{
+    quint64 address;
+    quint32 size;
+    quint32 name; // 字符串表偏移
+};
+
+struct IndexLine
+{
+    quint64 address;
+    quint32 file; // 文件表下标，noFile 表示未知
+    quint32 line; // 0 表示序列结束
+};
+
+// 文件布局：头部、符号数组、行号数组、文件表（字符串表偏移数组）、字符串表
+quint64 symbolsOffset() { return sizeof(IndexHeader); }
+quint64 linesOffset(const IndexHeader &h) { return symbolsOffset() + quint64(h.symbolCount) * sizeof(IndexSymbol); }
+quint64 filesOffset(const IndexHeader &h) { return linesOffset(h) + quint64(h.lineCount) * sizeof(IndexLine); }
+quint64 stringsOffset(const IndexHeader &h) { return filesOffset(h) + quint64(h.fileCount) * sizeof(quint32); }
+
+Q_STATIC_ASSERT(sizeof(IndexHeader) == 32);
+Q_STATIC_ASSERT(sizeof(IndexSymbol) == 16);
+Q_STATIC_ASSERT(sizeof(IndexLine) == 16);
+
+class StringTable
+{
+public:
+    StringTable() { m_data.append('\0'); } // 偏移 0 是空串
+
+    quint32 add(const QByteArray &string)
+    {
+        auto it = m_offsets.constFind(string);
+        if (it != m_offsets.constEnd())
+            return it.value();
+        const quint32 offset = quint32(m_data.size());
+        m_data.append(string);
+        m_data.append('\0');
+        m_offsets.insert(string, offset);
+        return offset;
+    }
+
+    const QByteArray &data() const { return m_data; }
+
+private:
+    QByteArray m_data;
+    QHash<QByteArray, quint32> m_offsets;
+};
+
+} // namespace
+
+SymbolIndex::SymbolIndex()
+{
+}
+
+SymbolIndex::~SymbolIndex()
+{
+}
+
+bool SymbolIndex::open(const QString &path)
+{
+    m_file.reset(new QFile(path));
+    m_data = nullptr;
+    if (!m_file->open(QIODevice::ReadOnly))
+        return false;
+
+    const quint64 size = quint64(m_file->size());
+    if (size < sizeof(IndexHeader))
+        return false;
+    const uchar *data = m_file->map(0, qint64(size));
+    if (!data)
+        return false;
+
+    const IndexHeader *header = reinterpret_cast<const IndexHeader *>(data);
+    if (memcmp(header->magic, indexMagic, sizeof(indexMagic)) != 0 || header->version != indexVersion)
+        return false;
+    if (stringsOffset(*header) + header->stringTableSize != size || header->stringTableSize == 0
+            || data[size - 1] != 0) {
+        return false;
+    }
+
+    m_data = data;
+    m_size = size;
+    return true;
+}
+
+const char *SymbolIndex::string(quint32 offset) const
+{
+    const IndexHeader *header = reinterpret_cast<const IndexHeader *>(m_data);
+    if (offset >= header->stringTableSize)
+        return "";
+    return reinterpret_cast<const char *>(m_data + stringsOffset(*header) + offset);
+}
+
+bool SymbolIndex::lookup(quint64 address, Location *location) const
+{
+    if (!m_data)
+        return false;
+    const IndexHeader *header = reinterpret_cast<const IndexHeader *>(m_data);
+
+    const IndexSymbol *symbolsBegin = reinterpret_cast<const IndexSymbol *>(m_data + symbolsOffset());
+    const IndexSymbol *symbolsEnd = symbolsBegin + header->symbolCount;
+    const IndexSymbol *symbol = std::upper_bound(symbolsBegin, symbolsEnd, address,
+                                                 [](quint64 value, const IndexSymbol &s) {
+        return value < s.address;
+    });
+    if (symbol == symbolsBegin)
+        return false;
+    --symbol;
+    // 与 ElfFile::symbolize() 一样，大小为 0 的符号只要在下一个符号之前就接受
+    if (symbol->size != 0 && address >= symbol->address + symbol->size)
+        return false;
+
+    location->function = QString::fromUtf8(string(symbol->name));
+    location->offset = address - symbol->address;
+    location->file.clear();
+    location->line = 0;
+
+    const IndexLine *linesBegin = reinterpret_cast<const IndexLine *>(m_data + linesOffset(*header));
+    const IndexLine *linesEnd = linesBegin + header->lineCount;
+    const IndexLine *line = std::upper_bound(linesBegin, linesEnd, address,
+                                             [](quint64 value, const IndexLine &l) {
+        return value < l.address;
+    });
+    if (line != linesBegin) {
+        --line;
+        // 行号行不能落在函数起始地址之前，否则说明这个函数没有行号信息
+        if (line->line != 0 && line->address >= symbol->address) {
+            location->line = line->line;
+            if (line->file < header->fileCount) {
+                const quint32 *files = reinterpret_cast<const quint32 *>(m_data + filesOffset(*header));
+                location->file = QString::fromUtf8(string(files[line->file]));
+            }
+        }
+    }
+    return true;
+}
+
+bool SymbolIndex::build(const ElfFile &elf, const ElfFile *debugElf, const QString &path)
+{
+    StringTable strings;
+
+    const QVector<ElfFile::Symbol> &elfSymbols = debugElf && !debugElf->symbols().isEmpty()
+            ? debugElf->symbols() : elf.symbols();
+    QVector<IndexSymbol> symbols;
+    symbols.reserve(elfSymbols.size());
+    foreach (const ElfFile::Symbol &elfSymbol, elfSymbols) {
+        IndexSymbol symbol;
+        symbol.address = elfSymbol.address;
+        symbol.size = quint32(qMin<quint64>(elfSymbol.size, 0xffffffff));
+        symbol.name = strings.add(demangledSymbolName(elfSymbol.name).toUtf8());
+        symbols.append(symbol);
+    }
+
+    DwarfLineTable lineTable;
+    if (!debugElf || !lineTable.read(*debugElf))
+        lineTable.read(elf);
+
+    QVector<quint32> files;
+    files.reserve(lineTable.files.size());
+    foreach (const QString &file, lineTable.files)
+        files.append(strings.add(file.toUtf8()));
+
+    QVector<IndexLine> lines;
+    lines.reserve(lineTable.rows.size());
+    foreach (const DwarfLineRow &row, lineTable.rows) {
+        IndexLine line;
+        line.address = row.address;
+        line.file = row.file >= 0 ? quint32(row.file) : noFile;
+        line.line = row.line;
+        // 同一位置连续的行（比如 is_stmt 切换）只保留一条
+        if (!lines.isEmpty() && lines.last().file == line.file && lines.last().line == line.line)
+            continue;
+        lines.append(line);
+    }
+
+    IndexHeader header;
+    memcpy(header.magic, indexMagic, sizeof(indexMagic));
+    header.version = indexVersion;
+    header.symbolCount = quint32(symbols.size());
+    header.lineCount = quint32(lines.size());
+    header.fileCount = quint32(files.size());
+    header.stringTableSize = quint32(strings.data().size());
+    header.reserved = 0;
+
+    // 先写临时文件再改名，并发的 crashhandler 不会读到写了一半的索引
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(symbols.constData()), qint64(symbols.size()) * qint64(sizeof(IndexSymbol)));
+    file.write(reinterpret_cast<const char *>(lines.constData()), qint64(lines.size()) * qint64(sizeof(IndexLine)));
+    file.write(reinterpret_cast<const char *>(files.constData()), qint64(files.size()) * qint64(sizeof(quint32)));
+    file.write(strings.data());
+    return file.commit();
+}
+
+QString SymbolIndex::separateDebugFilePath(const QByteArray &buildId)
+{
+    if (buildId.size() < 3)
+        return QString();
+    return QString("/usr/lib/debug/.build-id/%1/%2.debug")
+            .arg(QString::fromLatin1(buildId.left(2)), QString::fromLatin1(buildId.mid(2)));
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QScopedPointer>
+#include <QString>
+
+class ElfFile;
+
+// 一个模块的符号与行号索引，按 build-id 缓存在磁盘上。
+// 文件格式是定长记录加字符串表，打开时直接 mmap，查找只做二分，不需要解析 ELF 和 DWARF。
+class SymbolIndex
+{
+public:
+    struct Location
+    {
+        QString function; // 已经 demangle
+        quint64 offset = 0; // 函数内偏移
+        QString file;
+        quint32 line = 0; // 0 表示没有行号信息
+    };
+
+    SymbolIndex();
+    ~SymbolIndex();
+
+    bool open(const QString &path);
+    bool isValid() const { return m_data != nullptr; }
+
+    // address 是模块的文件内地址，与 ElfFile::symbolize() 一致
+    bool lookup(quint64 address, Location *location) const;
+
+    // 从 elf 的符号表和 .debug_line 生成索引并原子地写到 path。
+    // debugElf 是可选的单独调试信息文件，存在时优先使用其中的完整符号表与行号表。
+    static bool build(const ElfFile &elf, const ElfFile *debugElf, const QString &path);
+
+    // 发行版调试信息包按 build-id 安装的单独调试信息文件
+    static QString separateDebugFilePath(const QByteArray &buildId);
+
+private:
+    const char *string(quint32 offset) const;
+
+    QScopedPointer<QFile> m_file;
+    const uchar *m_data = nullptr;
+    quint64 m_size = 0;
+};
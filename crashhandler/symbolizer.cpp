@@ -0,0 +1,81 @@
+#include "symbolizer.h"
+#include "elffile.h"
+#include "symbolcache.h"
+#include "symbolindex.h"
+
+#include <QtConcurrent>
+
+#include <numeric>
+
+Symbolizer::Symbolizer(const ModuleLoader &loader)
+    : m_loader(loader)
+{
+}
+
+QString Symbolizer::describeFrame(const RawCapture &capture, const RawFrame &frame) const
+{
+    const quint64 lookupPc = frame.isReturnAddress ? frame.pc - 1 : frame.pc;
+    const RawModule *module = capture.findModule(lookupPc);
+    if (!module)
+        return QLatin1String("?? ()");
+
+    const ElfFile *elf = m_loader(*module);
+    if (!elf)
+        return QString("?? () from %1").arg(module->path);
+
+    const quint64 bias = module->base - elf->loadAddress();
+    const quint64 address = lookupPc - bias;
+    const quint64 returnAdjust = frame.pc - lookupPc;
+
+    if (const SymbolIndex *index = m_symbolCache ? m_symbolCache->index(*elf) : nullptr) {
+        SymbolIndex::Location location;
+        if (index->lookup(address, &location)) {
+            const QString function = QString("%1+0x%2").arg(location.function)
+                    .arg(location.offset + returnAdjust, 0, 16);
+            if (location.line != 0 && !location.file.isEmpty())
+                return QString("%1 () at %2:%3").arg(function, location.file).arg(location.line);
+            return QString("%1 () from %2").arg(function, module->path);
+        }
+    }
+
+    QString function = QLatin1String("??");
+    QString name;
+    quint64 offset = 0;
+    if (elf->symbolize(address, &name, &offset))
+        function = QString("%1+0x%2").arg(name).arg(offset + returnAdjust, 0, 16);
+    return QString("%1 () from %2").arg(function, module->path);
+}
+
+QString Symbolizer::symbolize(const RawCapture &capture) const
+{
+    QString text = QString("Native backtrace of process %1 (%2 threads):\n")
+            .arg(capture.pid).arg(capture.threads.size());
+
+    // 每个线程的文本写到自己的位置上，拼接时保持原来的线程顺序
+    QVector<QString> threadTexts(capture.threads.size());
+    QString *results = threadTexts.data();
+    QVector<int> threadIndexes(capture.threads.size());
+    std::iota(threadIndexes.begin(), threadIndexes.end(), 0);
+    QtConcurrent::blockingMap(threadIndexes, [this, &capture, results](const int &i) {
+        results[i] = symbolizeThread(capture, i);
+    });
+
+    foreach (const QString &threadText, threadTexts)
+        text += threadText;
+    return text;
+}
+
+QString Symbolizer::symbolizeThread(const RawCapture &capture, int threadIndex) const
+{
+    const RawThread &thread = capture.threads.at(threadIndex);
+    QString text = QString("\nThread %1 (LWP %2 \"%3\"):\n")
+            .arg(threadIndex + 1).arg(thread.tid).arg(thread.name);
+    for (int j = 0; j < thread.frames.size(); ++j) {
+        const RawFrame &frame = thread.frames.at(j);
+        text += QString("#%1 0x%2 in %3\n")
+                .arg(j, -2)
+                .arg(frame.pc, 16, 16, QLatin1Char('0'))
+                .arg(describeFrame(capture, frame));
+    }
+    return text;
+}
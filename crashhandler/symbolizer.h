@@ -0,0 +1,33 @@
+#pragma once
+
+#include "rawcapture.h"
+
+#include <QString>
+
+#include <functional>
+
+class ElfFile;
+class SymbolCache;
+
+// 把 RawCapture 转换为对话框里显示的文本。
+// 模块文件从哪里来由调用者决定：在线时就是目标进程映射的文件，离线时按 build-id 在调试信息目录中查找。
+// 各线程在全局线程池里并行符号化，所以 ModuleLoader 必须是线程安全的。
+class Symbolizer
+{
+public:
+    // 返回 nullptr 表示找不到模块，对应的帧只输出模块路径
+    typedef std::function<const ElfFile *(const RawModule &module)> ModuleLoader;
+
+    explicit Symbolizer(const ModuleLoader &loader);
+
+    // 不设置时直接查 ELF 符号表
+    void setSymbolCache(SymbolCache *cache) { m_symbolCache = cache; }
+
+    QString symbolize(const RawCapture &capture) const;
+    QString symbolizeThread(const RawCapture &capture, int threadIndex) const;
+    QString describeFrame(const RawCapture &capture, const RawFrame &frame) const;
+
+private:
+    ModuleLoader m_loader;
+    SymbolCache *m_symbolCache = nullptr;
+};
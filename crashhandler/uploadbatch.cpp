@@ -0,0 +1,97 @@
+#include "uploadbatch.h"
+
+#include <QtEndian>
+
+#include <string.h>
+
+static bool isValidName(const QString &name)
+{
+    return !name.isEmpty() && name.size() <= UploadBatchMaxNameSize
+            && !name.startsWith(QLatin1Char('.')) && !name.contains(QLatin1Char('/'))
+            && !name.contains(QLatin1Char('\0'));
+}
+
+QByteArray encodeUploadBatch(const QVector<UploadItem> &items)
+{
+    qint64 size = sizeof(UploadBatchHeader);
+    for (int i = 0; i < items.size(); ++i)
+        size += sizeof(UploadBatchEntry) + items.at(i).name.toUtf8().size() + items.at(i).data.size();
+
+    QByteArray batch;
+    batch.reserve(int(size));
+
+    UploadBatchHeader header;
+    memcpy(header.magic, UploadBatchMagic, sizeof(header.magic));
+    header.version = qToLittleEndian(uint32_t(UploadBatchVersion));
+    header.count = qToLittleEndian(uint32_t(items.size()));
+    header.reserved = 0;
+    batch.append(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    for (int i = 0; i < items.size(); ++i) {
+        const QByteArray name = items.at(i).name.toUtf8();
+        UploadBatchEntry entry;
+        entry.nameSize = qToLittleEndian(uint32_t(name.size()));
+        entry.reserved = 0;
+        entry.dataSize = qToLittleEndian(uint64_t(items.at(i).data.size()));
+        batch.append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+        batch.append(name);
+        batch.append(items.at(i).data);
+    }
+    return batch;
+}
+
+bool decodeUploadBatch(const QByteArray &data, QVector<UploadItem> *items, QString *errorString)
+{
+    items->clear();
+    const char *p = data.constData();
+    quint64 remaining = quint64(data.size());
+
+    UploadBatchHeader header;
+    if (remaining < sizeof(header)) {
+        *errorString = QLatin1String("Truncated batch header");
+        return false;
+    }
+    memcpy(&header, p, sizeof(header));
+    p += sizeof(header);
+    remaining -= sizeof(header);
+    if (memcmp(header.magic, UploadBatchMagic, sizeof(header.magic)) != 0
+            || qFromLittleEndian(header.version) != UploadBatchVersion) {
+        *errorString = QLatin1String("Not a crash report batch");
+        return false;
+    }
+
+    const uint32_t count = qFromLittleEndian(header.count);
+    for (uint32_t i = 0; i < count; ++i) {
+        UploadBatchEntry entry;
+        if (remaining < sizeof(entry)) {
+            *errorString = QString("Truncated entry %1").arg(i);
+            return false;
+        }
+        memcpy(&entry, p, sizeof(entry));
+        p += sizeof(entry);
+        remaining -= sizeof(entry);
+
+        const quint64 nameSize = qFromLittleEndian(entry.nameSize);
+        const quint64 dataSize = qFromLittleEndian(entry.dataSize);
+        if (nameSize > UploadBatchMaxNameSize || nameSize > remaining || dataSize > remaining - nameSize) {
+            *errorString = QString("Truncated entry %1").arg(i);
+            return false;
+        }
+
+        UploadItem item;
+        item.name = QString::fromUtf8(p, int(nameSize));
+        item.data = QByteArray(p + nameSize, int(dataSize));
+        p += nameSize + dataSize;
+        remaining -= nameSize + dataSize;
+        if (!isValidName(item.name)) {
+            *errorString = QString("Invalid file name in entry %1").arg(i);
+            return false;
+        }
+        items->append(item);
+    }
+    if (remaining != 0) {
+        *errorString = QLatin1String("Trailing data after the last entry");
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include <stdint.h>
+
+// 上传的一批报告，是 crashhandler 与收集端之间 HTTP 请求体的格式。
+// 一个 UploadBatchHeader，后面是 count 个条目，每个条目是一个 UploadBatchEntry、文件名和文件内容。
+// 文件内容已经是 gzip 压缩过的，这里不再压缩。所有字段都是小端字节序。
+
+enum {
+    UploadBatchVersion = 1,
+    UploadBatchMaxNameSize = 255
+};
+
+const char UploadBatchMagic[4] = { 'C', 'H', 'U', 'B' };
+const char UploadBatchContentType[] = "application/x-crashhandler-batch";
+
+struct UploadBatchHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+struct UploadBatchEntry
+{
+    uint32_t nameSize;
+    uint32_t reserved;
+    uint64_t dataSize;
+};
+
+struct UploadItem
+{
+    QString name; // 不含路径
+    QByteArray data;
+};
+
+QByteArray encodeUploadBatch(const QVector<UploadItem> &items);
+// 文件名中的路径分隔符等字符视为错误，收集端可以直接用它作为文件名
+bool decodeUploadBatch(const QByteArray &data, QVector<UploadItem> *items, QString *errorString);
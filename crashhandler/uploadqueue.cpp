@@ -0,0 +1,253 @@
+#include "uploadqueue.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLockFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <string.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+namespace {
+const int defaultMaximumFiles = 200;
+const qint64 defaultMaximumBytes = qint64(64) * 1024 * 1024;
+const int defaultInitialBackoff = 30;      // 秒
+const int defaultMaximumBackoff = 60 * 60; // 秒
+const int compressionLevel = 6;
+const int blockSize = 256 * 1024;
+const int lockTimeout = 2000; // ms
+const char stateFileName[] = "upload-state.json";
+}
+
+// 按块压缩成 gzip，不把整个文件读进内存
+static bool gzipFile(QFile *input, QSaveFile *output, QString *errorString)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // windowBits 加 16 表示写 gzip 头和尾
+    if (deflateInit2(&stream, compressionLevel, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        *errorString = QLatin1String("Could not initialize zlib");
+        return false;
+    }
+
+    QByteArray in(blockSize, Qt::Uninitialized);
+    QByteArray out(blockSize, Qt::Uninitialized);
+    bool ok = true;
+    int flush = Z_NO_FLUSH;
+    while (ok && flush != Z_FINISH) {
+        const qint64 count = input->read(in.data(), blockSize);
+        if (count < 0) {
+            *errorString = input->errorString();
+            ok = false;
+            break;
+        }
+        flush = count == 0 || input->atEnd() ? Z_FINISH : Z_NO_FLUSH;
+        stream.next_in = reinterpret_cast<Bytef *>(in.data());
+        stream.avail_in = uInt(count);
+        do {
+            stream.next_out = reinterpret_cast<Bytef *>(out.data());
+            stream.avail_out = uInt(blockSize);
+            deflate(&stream, flush);
+            const qint64 produced = blockSize - qint64(stream.avail_out);
+            if (output->write(out.constData(), produced) != produced) {
+                *errorString = output->errorString();
+                ok = false;
+                break;
+            }
+        } while (stream.avail_out == 0);
+    }
+    deflateEnd(&stream);
+    return ok;
+}
+
+UploadQueue::UploadQueue(const QString &directory)
+    : m_directory(directory.isEmpty() ? defaultDirectory() : directory)
+    , m_maximumFiles(defaultMaximumFiles)
+    , m_maximumBytes(defaultMaximumBytes)
+    , m_initialBackoff(defaultInitialBackoff)
+    , m_maximumBackoff(defaultMaximumBackoff)
+{
+}
+
+QString UploadQueue::defaultDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
+            + QLatin1String("/crashhandler/outbox");
+}
+
+void UploadQueue::setLimits(int maximumFiles, qint64 maximumBytes)
+{
+    m_maximumFiles = qMax(1, maximumFiles);
+    m_maximumBytes = qMax(qint64(1), maximumBytes);
+}
+
+void UploadQueue::setBackoff(int initialSeconds, int maximumSeconds)
+{
+    m_initialBackoff = qMax(1, initialSeconds);
+    m_maximumBackoff = qMax(m_initialBackoff, maximumSeconds);
+}
+
+bool UploadQueue::enqueue(const QString &fileName, const QString &name, QString *errorString)
+{
+    QString error;
+    QFile input(fileName);
+    const QString queuedName = m_directory + QLatin1Char('/') + name + QLatin1String(".gz");
+    // QSaveFile 提交之前发送方看不到写了一半的文件
+    QSaveFile output(queuedName);
+    if (!QDir().mkpath(m_directory)) {
+        error = QString("Could not create %1").arg(m_directory);
+    } else if (!input.open(QIODevice::ReadOnly)) {
+        error = QString("Could not read %1: %2").arg(fileName, input.errorString());
+    } else if (!output.open(QIODevice::WriteOnly)) {
+        error = QString("Could not write %1: %2").arg(queuedName, output.errorString());
+    } else if (gzipFile(&input, &output, &error) && !output.commit()) {
+        error = QString("Could not write %1: %2").arg(queuedName, output.errorString());
+    }
+    if (!error.isEmpty()) {
+        if (errorString)
+            *errorString = error;
+        return false;
+    }
+
+    trim(queuedName);
+    return true;
+}
+
+QStringList UploadQueue::pendingFiles() const
+{
+    QStringList files;
+    const QFileInfoList entries = QDir(m_directory).entryInfoList(QStringList("*.gz"), QDir::Files,
+                                                                   QDir::Time | QDir::Reversed);
+    foreach (const QFileInfo &entry, entries)
+        files.append(entry.filePath());
+    return files;
+}
+
+// 从最旧的开始删除 directory 里符合 nameFilters 的文件，直到不超过上限，路径以 keep 开头的不删。返回删掉的文件数
+static int removeOldest(const QString &directory, const QStringList &nameFilters, int maximumFiles,
+                        qint64 maximumBytes, const QString &keep)
+{
+    const QFileInfoList entries = QDir(directory).entryInfoList(nameFilters, QDir::Files, QDir::Time | QDir::Reversed);
+    qint64 totalBytes = 0;
+    foreach (const QFileInfo &entry, entries)
+        totalBytes += entry.size();
+
+    int count = entries.size();
+    int removed = 0;
+    for (int i = 0; i < entries.size() && (count > maximumFiles || totalBytes > maximumBytes); ++i) {
+        if (!keep.isEmpty() && entries.at(i).filePath().startsWith(keep))
+            continue;
+        if (QFile::remove(entries.at(i).filePath())) {
+            --count;
+            totalBytes -= entries.at(i).size();
+            ++removed;
+        }
+    }
+    return removed;
+}
+
+void UploadQueue::trim(const QString &keep)
+{
+    const int dropped = removeOldest(m_directory, QStringList("*.gz"), m_maximumFiles, m_maximumBytes, keep);
+    if (dropped > 0)
+        addDropped(dropped);
+}
+
+void UploadQueue::remove(const QStringList &files)
+{
+    foreach (const QString &file, files)
+        QFile::remove(file);
+}
+
+void UploadQueue::discard(const QStringList &files)
+{
+    remove(files);
+    addDropped(files.size());
+}
+
+QString UploadQueue::statePath() const
+{
+    return m_directory + QLatin1Char('/') + QLatin1String(stateFileName);
+}
+
+UploadQueue::State UploadQueue::readState() const
+{
+    State state;
+    QFile stateFile(statePath());
+    if (!stateFile.open(QIODevice::ReadOnly))
+        return state;
+    const QJsonObject object = QJsonDocument::fromJson(stateFile.readAll()).object();
+    state.nextAttempt = qint64(object.value("nextAttempt").toDouble());
+    state.failures = object.value("failures").toInt();
+    state.dropped = qint64(object.value("dropped").toDouble());
+    return state;
+}
+
+void UploadQueue::writeState(const State &state)
+{
+    QJsonObject object;
+    object.insert("nextAttempt", double(state.nextAttempt));
+    object.insert("failures", state.failures);
+    object.insert("dropped", double(state.dropped));
+
+    QSaveFile saveFile(statePath());
+    if (saveFile.open(QIODevice::WriteOnly)) {
+        saveFile.write(QJsonDocument(object).toJson(QJsonDocument::Compact));
+        saveFile.commit();
+    }
+}
+
+UploadQueue::State UploadQueue::state() const
+{
+    return readState();
+}
+
+void UploadQueue::addDropped(int count)
+{
+    // 状态文件不可用时只是少记几个
+    QLockFile lock(statePath() + QLatin1String(".lock"));
+    if (!QDir().mkpath(m_directory) || !lock.tryLock(lockTimeout))
+        return;
+    State state = readState();
+    state.dropped += count;
+    writeState(state);
+}
+
+void UploadQueue::recordSuccess()
+{
+    QLockFile lock(statePath() + QLatin1String(".lock"));
+    if (!lock.tryLock(lockTimeout))
+        return;
+    writeState(State());
+}
+
+UploadQueue::State UploadQueue::recordFailure(int retryAfter)
+{
+    QLockFile lock(statePath() + QLatin1String(".lock"));
+    const bool locked = lock.tryLock(lockTimeout);
+    State state = readState();
+    ++state.failures;
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    qint64 delay = 0;
+    if (retryAfter > 0) {
+        // 收集端知道自己什么时候能恢复，按它说的等
+        delay = qint64(qMin(retryAfter, m_maximumBackoff)) * 1000;
+    } else {
+        delay = qMin(qint64(m_initialBackoff) << qMin(state.failures - 1, 20), qint64(m_maximumBackoff)) * 1000;
+        // 加上最多 25% 的抖动，同时失败的机器不会在同一时刻一起重试
+        const quint64 seed = quint64(now) * 6364136223846793005ULL + quint64(getpid());
+        delay += qint64((seed >> 33) % quint64(delay / 4 + 1));
+    }
+    state.nextAttempt = now + delay;
+    if (locked)
+        writeState(state);
+    return state;
+}
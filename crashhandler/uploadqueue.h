@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QtGlobal>
+
+// 上传队列：完成的报告用 gzip 压缩后放在一个目录里，由 ReportUploader 分批发送。
+// 文件数和总大小都有上限，超过时丢掉最旧的，整个机群一起崩溃时也不会占满本地磁盘。
+// 退避状态（下一次可以发送的时间、连续失败次数和丢掉的文件数）保存在目录里的一个小文件中，
+// 守护进程和 crashhandler --upload 等多个进程共享，收集端要求的等待时间对所有进程都有效。
+class UploadQueue
+{
+public:
+    struct State
+    {
+        qint64 nextAttempt = 0; // 毫秒，自 1970 年起，0 表示可以马上发送
+        int failures = 0;       // 连续失败的次数
+        qint64 dropped = 0;     // 上次成功发送以后因为超过上限或者收集端拒绝而丢掉的文件数
+    };
+
+    explicit UploadQueue(const QString &directory = QString());
+
+    static QString defaultDirectory();
+    QString directory() const { return m_directory; }
+
+    void setLimits(int maximumFiles, qint64 maximumBytes);
+    void setBackoff(int initialSeconds, int maximumSeconds);
+
+    // 把 fileName 压缩后以 name + ".gz" 放进队列，然后按上限丢掉最旧的文件
+    bool enqueue(const QString &fileName, const QString &name, QString *errorString = nullptr);
+    // 队列中的文件，最旧的在前
+    QStringList pendingFiles() const;
+    // 已经发送的文件
+    void remove(const QStringList &files);
+    // 收集端永远不会接受的文件，计入 dropped
+    void discard(const QStringList &files);
+
+    State state() const;
+    // 发送成功，清除退避和 dropped（已经在请求里告诉收集端了）
+    void recordSuccess();
+    // 发送失败。retryAfter 是收集端要求的等待时间（秒），0 表示按指数退避，返回新的状态
+    State recordFailure(int retryAfter);
+
+private:
+    QString statePath() const;
+    State readState() const;
+    void writeState(const State &state);
+    void addDropped(int count);
+    void trim(const QString &keep);
+
+    QString m_directory;
+    int m_maximumFiles;
+    qint64 m_maximumBytes;
+    int m_initialBackoff;
+    int m_maximumBackoff;
+};
@@ -0,0 +1,21 @@
+QT = core concurrent
+
+TARGET = crashquery
+TEMPLATE = app
+DESTDIR = $$OUT_PWD/../bin/
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD/../crashhandler
+
+HEADERS += \
+    $$PWD/../crashhandler/crashreport.h \
+    $$PWD/../crashhandler/rawcapture.h \
+    $$PWD/../crashhandler/reportstore.h
+
+SOURCES += \
+    main.cpp \
+    $$PWD/../crashhandler/crashreport.cpp \
+    $$PWD/../crashhandler/rawcapture.cpp \
+    $$PWD/../crashhandler/reportstore.cpp
@@ -0,0 +1,159 @@
+#include "reportstore.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+
+#include <stdlib.h>
+
+// "24h"、"7d"、"30m"、"90s" 表示从现在往前多久，否则是 ISO 8601 的日期或时间（本地时间）
+static qint64 parseTime(const QString &text, bool *ok)
+{
+    static const struct { char suffix; qint64 milliseconds; } units[] = {
+        { 's', 1000 }, { 'm', 60 * 1000 }, { 'h', 3600 * 1000 }, { 'd', 24 * 3600 * 1000 }
+    };
+
+    *ok = false;
+    if (text.isEmpty())
+        return 0;
+    for (const auto &unit : units) {
+        if (text.endsWith(QLatin1Char(unit.suffix))) {
+            const qint64 count = text.left(text.size() - 1).toLongLong(ok);
+            return *ok ? QDateTime::currentMSecsSinceEpoch() - count * unit.milliseconds : 0;
+        }
+    }
+    const QDateTime time = QDateTime::fromString(text, Qt::ISODate);
+    *ok = time.isValid();
+    return *ok ? time.toMSecsSinceEpoch() : 0;
+}
+
+// 从 spool 目录里的报告索引回答查询，不打开报告本身
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("crashquery");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Queries the crash report index written by crashhandler --index-reports.");
+    parser.addHelpOption();
+    const QCommandLineOption directoryOption(QStringList({"d", "directory"}),
+                                             "Directory with the reports and their index.", "dir");
+    parser.addOption(directoryOption);
+    const QCommandLineOption appOption("app", "Only reports of this application.", "name");
+    parser.addOption(appOption);
+    const QCommandLineOption signalOption("signal", "Only reports of this signal, e.g. SIGSEGV, segv or 11.", "name");
+    parser.addOption(signalOption);
+    const QCommandLineOption signatureOption("signature", "Only reports whose signature starts with this.", "hex");
+    parser.addOption(signatureOption);
+    const QCommandLineOption buildIdOption("build-id", "Only reports with a module whose build-id starts with this.",
+                                           "hex");
+    parser.addOption(buildIdOption);
+    const QCommandLineOption sinceOption("since", "Only reports since this time, e.g. 24h, 7d or 2024-05-01.", "time");
+    parser.addOption(sinceOption);
+    const QCommandLineOption untilOption("until", "Only reports before this time.", "time");
+    parser.addOption(untilOption);
+    const QCommandLineOption groupByOption("group-by", "Count the matches by app, signal, signature or fault.",
+                                           "field");
+    parser.addOption(groupByOption);
+    const QCommandLineOption countOption("count", "Only print the number of matches.");
+    parser.addOption(countOption);
+    const QCommandLineOption limitOption(QStringList({"n", "limit"}), "Print at most this many reports, 0 for all.",
+                                         "n", "20");
+    parser.addOption(limitOption);
+    const QCommandLineOption noUpdateOption("no-update",
+                                            "Query the index as it is, without indexing new and removed reports first.");
+    parser.addOption(noUpdateOption);
+    const QCommandLineOption rebuildOption("rebuild", "Rebuild the index from the reports first.");
+    parser.addOption(rebuildOption);
+    const QCommandLineOption timingOption("timing", "Print how long the query took to stderr.");
+    parser.addOption(timingOption);
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    ReportStore::Query query;
+    query.application = parser.value(appOption);
+    query.signal = parser.value(signalOption);
+    query.signature = parser.value(signatureOption).toLatin1().toLower();
+    query.buildId = parser.value(buildIdOption).toLatin1().toLower();
+    bool ok = true;
+    if (parser.isSet(sinceOption))
+        query.since = parseTime(parser.value(sinceOption), &ok);
+    if (ok && parser.isSet(untilOption))
+        query.until = parseTime(parser.value(untilOption), &ok);
+    if (!ok) {
+        err << "Invalid time.\n";
+        return EXIT_FAILURE;
+    }
+
+    ReportStore::Field field = ReportStore::Application;
+    const QString groupBy = parser.value(groupByOption);
+    if (groupBy == QLatin1String("signal"))
+        field = ReportStore::Signal;
+    else if (groupBy == QLatin1String("signature"))
+        field = ReportStore::Signature;
+    else if (groupBy == QLatin1String("fault"))
+        field = ReportStore::FaultKind;
+    else if (!groupBy.isEmpty() && groupBy != QLatin1String("app"))
+        parser.showHelp(EXIT_FAILURE);
+
+    // 默认先增量更新：作废已经被删掉的报告（比如 spool 目录超过上限时），补上 add() 之外写入的报告。
+    // 第一次使用时还没有索引，同样从目录生成
+    ReportStore store(parser.value(directoryOption));
+    QString errorString;
+    QElapsedTimer timer;
+    timer.start();
+    const bool noIndex = !QFile::exists(store.directory() + QLatin1String("/reports.chindex"));
+    if (parser.isSet(rebuildOption) || !parser.isSet(noUpdateOption) || noIndex) {
+        const int added = parser.isSet(rebuildOption) ? store.rebuild(&errorString) : store.update(&errorString);
+        if (added < 0) {
+            err << errorString << "\n";
+            return EXIT_FAILURE;
+        }
+        if (parser.isSet(timingOption))
+            err << "Indexed " << added << " report(s) in " << timer.restart() << " ms.\n";
+    }
+    if (!store.open(&errorString)) {
+        err << errorString << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if (parser.isSet(groupByOption)) {
+        const QVector<QPair<QString, int> > groups = store.count(query, field);
+        const qint64 elapsed = timer.elapsed();
+        for (int i = 0; i < groups.size(); ++i)
+            out << groups.at(i).second << "\t" << (groups.at(i).first.isEmpty() ? QString("-") : groups.at(i).first)
+                << "\n";
+        if (parser.isSet(timingOption))
+            err << groups.size() << " group(s) of " << store.recordCount() << " indexed report(s) in " << elapsed
+                << " ms.\n";
+        return EXIT_SUCCESS;
+    }
+
+    const QVector<int> matches = store.find(query);
+    const qint64 elapsed = timer.elapsed();
+    if (parser.isSet(countOption)) {
+        out << matches.size() << "\n";
+    } else {
+        // 最新的在前，以制表符分隔，便于交给其他工具
+        const int limit = parser.value(limitOption).toInt();
+        const int shown = limit > 0 ? qMin(limit, matches.size()) : matches.size();
+        for (int i = 0; i < shown; ++i) {
+            const ReportStore::Report report = store.report(matches.at(i));
+            out << QDateTime::fromMSecsSinceEpoch(report.timestamp).toString(Qt::ISODate) << "\t"
+                << report.application << "\t" << (report.signo.isEmpty() ? report.signal : report.signo) << "\t"
+                << (report.signature.isEmpty() ? QByteArray("-") : report.signature.left(16)) << "\t"
+                << report.fileName << "\n";
+        }
+        if (shown < matches.size())
+            err << (matches.size() - shown) << " more report(s), use --limit 0 to show all.\n";
+    }
+    if (parser.isSet(timingOption))
+        err << matches.size() << " match(es) of " << store.recordCount() << " indexed report(s) in " << elapsed
+            << " ms.\n";
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,20 @@
+QT += core gui widgets
+
+TARGET = crashstress
+TEMPLATE = app
+DESTDIR = $$OUT_PWD/../bin/
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD/../crashhandler
+
+HEADERS += \
+    $$PWD/../crashhandler/breadcrumbs.h \
+    $$PWD/../crashhandler/crashdaemonprotocol.h \
+    $$PWD/../crashhandler/crashhandlersetup.h \
+    $$PWD/../crashhandler/crashrecord.h
+
+SOURCES += \
+    main.cpp \
+    $$PWD/../crashhandler/crashhandlersetup.cpp
@@ -0,0 +1,128 @@
+#include "crashhandlersetup.h"
+
+#include <QAtomicInt>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace {
+const int victimStackSize = 256 * 1024; // 小一点，栈溢出来得快
+}
+
+static QAtomicInt threadsReady;
+
+static Q_NOINLINE int overflowStack(int depth)
+{
+    volatile char frame[1024];
+    frame[0] = char(depth);
+    return overflowStack(depth + 1) + frame[0];
+}
+
+// 所有线程都注册替代信号栈，等齐以后同时出错：一半空指针，一半栈溢出
+static void crashThreads(int threadCount)
+{
+    for (int i = 0; i < threadCount; ++i) {
+        QThread *thread = QThread::create([i, threadCount]() {
+            CrashHandlerSetup::registerThread();
+            threadsReady.fetchAndAddOrdered(1);
+            while (threadsReady.loadAcquire() < threadCount) {
+            }
+            if (i % 2) {
+                volatile int *address = nullptr;
+                *address = 1;
+            } else {
+                overflowStack(0);
+            }
+        });
+        thread->setStackSize(victimStackSize);
+        thread->start();
+    }
+    for (;;)
+        pause();
+}
+
+static int countLines(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+    return file.readAll().count('\n');
+}
+
+// 多个线程同时崩溃的压力测试。每次崩溃都应该只有一个线程进入 crashhandler，
+// 进程在收集完以后从信号处理程序里退出（退出码 EXIT_FAILURE），而不是被第二个信号杀死
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("crashstress");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Crashes many threads at the same time and checks that every crash is handled once.");
+    parser.addHelpOption();
+    const QCommandLineOption threadsOption("threads", "Threads that fault at the same time.", "n", "32");
+    parser.addOption(threadsOption);
+    const QCommandLineOption iterationsOption("iterations", "Number of crashes.", "n", "20");
+    parser.addOption(iterationsOption);
+    const QCommandLineOption timeoutOption("timeout", "Seconds to wait for each crash.", "seconds", "60");
+    parser.addOption(timeoutOption);
+    QCommandLineOption victimOption("victim");
+    victimOption.setFlags(QCommandLineOption::HiddenFromHelp);
+    parser.addOption(victimOption);
+    QCommandLineOption helperArgOption("helper-arg", QString(), "argument");
+    helperArgOption.setFlags(QCommandLineOption::HiddenFromHelp);
+    parser.addOption(helperArgOption);
+    parser.process(app);
+
+    const int threadCount = qMax(1, parser.value(threadsOption).toInt());
+    if (parser.isSet(victimOption)) {
+        CrashHandlerSetup::setHelperArguments(parser.values(helperArgOption));
+        new CrashHandlerSetup(QLatin1String("crashstress"), CrashHandlerSetup::DisableRestart);
+        crashThreads(threadCount);
+        return EXIT_SUCCESS;
+    }
+
+    QTextStream out(stdout);
+    QTemporaryDir directory;
+    const QString statsFile = directory.filePath(QLatin1String("stats.jsonl"));
+    QStringList victimArguments({ "--victim", "--threads", QString::number(threadCount) });
+    foreach (const QString &argument, QStringList({ "--headless", "--max-tier", "1", "--stats-file", statsFile,
+                                                    "--spool-dir", directory.path() }))
+        victimArguments += QStringList({ "--helper-arg", argument });
+
+    const int iterations = parser.value(iterationsOption).toInt();
+    int failures = 0;
+    for (int i = 0; i < iterations; ++i) {
+        const int statsBefore = countLines(statsFile);
+        QProcess victim;
+        victim.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        victim.start(QCoreApplication::applicationFilePath(), victimArguments);
+
+        QString failure;
+        if (!victim.waitForFinished(parser.value(timeoutOption).toInt() * 1000)) {
+            victim.kill();
+            victim.waitForFinished();
+            failure = QLatin1String("the victim did not exit in time");
+        } else if (victim.exitStatus() != QProcess::NormalExit) {
+            failure = QLatin1String("the victim was killed by a signal during collection");
+        } else if (victim.exitCode() != EXIT_FAILURE) {
+            failure = QString("unexpected exit code %1").arg(victim.exitCode());
+        } else if (countLines(statsFile) != statsBefore + 1) {
+            failure = QString("%1 crashes handled instead of 1").arg(countLines(statsFile) - statsBefore);
+        }
+        if (!failure.isEmpty()) {
+            ++failures;
+            out << "Crash " << i << ": " << failure << "\n";
+        }
+    }
+
+    out << iterations - failures << " of " << iterations << " crashes with " << threadCount
+        << " faulting threads handled correctly.\n";
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,30 @@
+QT = core concurrent
+
+TARGET = crashsymbolize
+TEMPLATE = app
+DESTDIR = $$OUT_PWD/../bin/
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD/../crashhandler
+
+HEADERS += \
+    $$PWD/../crashhandler/crashreport.h \
+    $$PWD/../crashhandler/dwarfcursor.h \
+    $$PWD/../crashhandler/dwarflinetable.h \
+    $$PWD/../crashhandler/elffile.h \
+    $$PWD/../crashhandler/rawcapture.h \
+    $$PWD/../crashhandler/symbolcache.h \
+    $$PWD/../crashhandler/symbolindex.h \
+    $$PWD/../crashhandler/symbolizer.h
+
+SOURCES += \
+    main.cpp \
+    $$PWD/../crashhandler/crashreport.cpp \
+    $$PWD/../crashhandler/dwarflinetable.cpp \
+    $$PWD/../crashhandler/elffile.cpp \
+    $$PWD/../crashhandler/rawcapture.cpp \
+    $$PWD/../crashhandler/symbolcache.cpp \
+    $$PWD/../crashhandler/symbolindex.cpp \
+    $$PWD/../crashhandler/symbolizer.cpp
@@ -0,0 +1,157 @@
+#include "elffile.h"
+#include "rawcapture.h"
+#include "symbolcache.h"
+#include "symbolizer.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+
+#include <stdlib.h>
+
+// 按 build-id 在本机和调试信息目录里查找崩溃时映射的模块，Symbolizer 会在多个线程里同时调用 load()
+class ModuleLocator
+{
+public:
+    explicit ModuleLocator(const QStringList &debugDirectories)
+        : m_debugDirectories(debugDirectories) {}
+    ~ModuleLocator() { qDeleteAll(m_elfFiles); }
+
+    const ElfFile *load(const RawModule &module);
+
+private:
+    QStringList candidatePaths(const RawModule &module) const;
+
+    QStringList m_debugDirectories;
+    QMutex m_mutex;
+    QHash<QString, ElfFile *> m_elfFiles; // 找不到的模块也记下来
+};
+
+QStringList ModuleLocator::candidatePaths(const RawModule &module) const
+{
+    QStringList paths;
+    foreach (const QString &directory, m_debugDirectories) {
+        if (module.buildId.size() > 2) {
+            paths.append(QString("%1/.build-id/%2/%3.debug").arg(directory,
+                         QString::fromLatin1(module.buildId.left(2)),
+                         QString::fromLatin1(module.buildId.mid(2))));
+        }
+        paths.append(directory + module.path); // 作为 sysroot
+        paths.append(directory + QLatin1Char('/') + QFileInfo(module.path).fileName());
+    }
+    if (module.buildId.size() > 2) {
+        paths.append(QString("/usr/lib/debug/.build-id/%1/%2.debug").arg(
+                     QString::fromLatin1(module.buildId.left(2)),
+                     QString::fromLatin1(module.buildId.mid(2))));
+    }
+    paths.append(module.path);
+    return paths;
+}
+
+const ElfFile *ModuleLocator::load(const RawModule &module)
+{
+    const QString key = module.buildId.isEmpty() ? module.path : QString::fromLatin1(module.buildId);
+    QMutexLocker locker(&m_mutex);
+    auto it = m_elfFiles.constFind(key);
+    if (it != m_elfFiles.constEnd())
+        return it.value();
+
+    ElfFile *found = nullptr;
+    if (module.path.startsWith(QLatin1Char('/'))) {
+        foreach (const QString &path, candidatePaths(module)) {
+            if (!QFileInfo(path).isFile())
+                continue;
+            ElfFile *elf = new ElfFile;
+            // 没有 build-id 时只能相信路径
+            if (elf->load(path) && (module.buildId.isEmpty() || elf->buildId() == module.buildId)) {
+                found = elf;
+                break;
+            }
+            delete elf;
+        }
+    }
+
+    m_elfFiles.insert(key, found);
+    return found;
+}
+
+// 把 crashhandler --raw-capture 或 --report 写出的报告转换为与对话框中相同的文本
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("crashsymbolize");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Symbolizes a crash report written by crashhandler --raw-capture or --report.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("report", "Crash report file.");
+    const QCommandLineOption debugDirOption(QStringList({"d", "debug-dir"}),
+                                            "Directory with debug files or a sysroot. Can be repeated.",
+                                            "dir");
+    parser.addOption(debugDirOption);
+    const QCommandLineOption symbolCacheOption("symbol-cache", "Symbol index cache directory.", "dir");
+    parser.addOption(symbolCacheOption);
+    const QCommandLineOption outputOption(QStringList({"o", "output"}),
+                                          "Write the backtrace to this file instead of stdout.", "file");
+    parser.addOption(outputOption);
+    parser.process(app);
+
+    QTextStream err(stderr);
+    if (parser.positionalArguments().size() != 1)
+        parser.showHelp(EXIT_FAILURE);
+
+    RawCapture capture;
+    QString errorString;
+    if (!capture.load(parser.positionalArguments().at(0), &errorString)) {
+        err << "Could not read crash report: " << errorString << "\n";
+        return EXIT_FAILURE;
+    }
+
+    ModuleLocator locator(parser.values(debugDirOption));
+    SymbolCache symbolCache(parser.value(symbolCacheOption));
+    Symbolizer symbolizer([&locator](const RawModule &module) { return locator.load(module); });
+    symbolizer.setSymbolCache(&symbolCache);
+
+    // 与对话框一样，先是系统信息，然后是回溯
+    QString backtrace;
+    for (int i = 0; i < capture.systemInfo.size(); ++i)
+        backtrace += capture.systemInfo.at(i).second;
+    backtrace += symbolizer.symbolize(capture);
+    // gdb 收集的层（比如带局部变量的第三层）和进程状态的快照以文本形式保存在元数据里
+    QString processState;
+    QString threadStates;
+    for (int i = 0; i < capture.metadata.size(); ++i) {
+        const QString &key = capture.metadata.at(i).first;
+        if (key == QLatin1String("gdbBacktrace")) {
+            backtrace += QLatin1Char('\n');
+            backtrace += capture.metadata.at(i).second;
+        } else if (key == QLatin1String("processState")) {
+            processState = capture.metadata.at(i).second;
+        } else if (key == QLatin1String("threadStates")) {
+            threadStates = capture.metadata.at(i).second;
+        }
+    }
+    if (!processState.isEmpty())
+        backtrace += QLatin1String("\nProcess state at the time of the crash:\n") + processState;
+    if (!threadStates.isEmpty())
+        backtrace += QLatin1String("Threads by CPU time:\n") + threadStates;
+
+    QFile output;
+    if (parser.isSet(outputOption)) {
+        output.setFileName(parser.value(outputOption));
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            err << "Could not open " << output.fileName() << ": " << output.errorString() << "\n";
+            return EXIT_FAILURE;
+        }
+    } else {
+        output.open(stdout, QIODevice::WriteOnly | QIODevice::Text);
+    }
+    output.write(backtrace.toUtf8());
+
+    return EXIT_SUCCESS;
+}
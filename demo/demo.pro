@@ -10,9 +10,15 @@ CONFIG += c++11
 
 #CONFIG += force_debug_info
 
+# 信号处理程序沿帧指针链回溯崩溃线程
+QMAKE_CXXFLAGS += -fno-omit-frame-pointer
+
 HEADERS += \
         widget.h \
-        $$PWD/../crashhandler/crashhandlersetup.h
+        $$PWD/../crashhandler/breadcrumbs.h \
+        $$PWD/../crashhandler/crashdaemonprotocol.h \
+        $$PWD/../crashhandler/crashhandlersetup.h \
+        $$PWD/../crashhandler/crashrecord.h
 
 SOURCES += \
         main.cpp \
@@ -21,6 +21,8 @@ int main(int argc, char *argv[])
     CrashHandlerSetup crashHandler(appName,
                                    CrashHandlerSetup::EnableRestart,
                                    executableDirPath);
+    CrashHandlerSetup::enableBreadcrumbs();
+    CrashHandlerSetup::breadcrumb("demo started");
 
     Widget w;
     w.resize(600, 400);
@@ -1,4 +1,5 @@
 #include "widget.h"
+#include "../crashhandler/crashhandlersetup.h"
 #include <QPushButton>
 
 Widget::Widget(QWidget *parent)
@@ -16,6 +17,7 @@ Widget::~Widget()
 
 void Widget::crash()
 {
+    CrashHandlerSetup::breadcrumb("crash button clicked");
     int* a = nullptr;
     *a = 1;
 }
@@ -0,0 +1,49 @@
+#include "reportreceiver.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QHostAddress>
+#include <QTextStream>
+
+#include <stdlib.h>
+
+// 本地的收集端替身：crashhandler --upload-url http://127.0.0.1:<port>/reports 把报告发到这里
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("reportreceiver");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Receives crash report batches uploaded by crashhandler.");
+    parser.addHelpOption();
+    const QCommandLineOption addressOption("listen", "Address to listen on.", "address", "127.0.0.1");
+    parser.addOption(addressOption);
+    const QCommandLineOption portOption(QStringList({"p", "port"}), "Port to listen on.", "port", "8750");
+    parser.addOption(portOption);
+    const QCommandLineOption directoryOption(QStringList({"d", "directory"}),
+                                             "Directory for the received reports.", "dir", "received");
+    parser.addOption(directoryOption);
+    const QCommandLineOption rateLimitOption("rate-limit",
+                                             "Accept at most this many batches per minute, answer 429 beyond.",
+                                             "n", "0");
+    parser.addOption(rateLimitOption);
+    const QCommandLineOption maxBatchOption("max-batch-mb", "Answer 413 to larger batches.", "size", "32");
+    parser.addOption(maxBatchOption);
+    const QCommandLineOption failEveryOption("fail-every", "Answer 503 to every n-th request.", "n", "0");
+    parser.addOption(failEveryOption);
+    parser.process(app);
+
+    ReportReceiver receiver(parser.value(directoryOption));
+    receiver.setRateLimit(parser.value(rateLimitOption).toInt());
+    receiver.setMaximumBatchSize(parser.value(maxBatchOption).toLongLong() * 1024 * 1024);
+    receiver.setFailureInterval(parser.value(failEveryOption).toInt());
+
+    QString errorString;
+    if (!receiver.listen(QHostAddress(parser.value(addressOption)), quint16(parser.value(portOption).toUInt()),
+                         &errorString)) {
+        QTextStream(stderr) << "Could not listen: " << errorString << "\n";
+        return EXIT_FAILURE;
+    }
+    QTextStream(stdout) << "Listening on " << parser.value(addressOption) << ":" << receiver.port() << "\n";
+    return app.exec();
+}
@@ -0,0 +1,168 @@
+#include "reportreceiver.h"
+#include "uploadbatch.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QSaveFile>
+#include <QTcpSocket>
+#include <QTextStream>
+#include <QVector>
+
+namespace {
+const int maximumHeaderSize = 16 * 1024;
+const qint64 rateWindow = 60 * 1000; // ms
+}
+
+ReportReceiver::ReportReceiver(const QString &directory, QObject *parent)
+    : QObject(parent)
+    , m_directory(directory)
+{
+    connect(&m_server, &QTcpServer::newConnection, this, &ReportReceiver::acceptConnections);
+}
+
+ReportReceiver::~ReportReceiver()
+{
+    qDeleteAll(m_connections);
+}
+
+bool ReportReceiver::listen(const QHostAddress &address, quint16 port, QString *errorString)
+{
+    if (!QDir().mkpath(m_directory)) {
+        *errorString = QString("Could not create %1").arg(m_directory);
+        return false;
+    }
+    if (!m_server.listen(address, port)) {
+        *errorString = m_server.errorString();
+        return false;
+    }
+    return true;
+}
+
+void ReportReceiver::acceptConnections()
+{
+    while (QTcpSocket *socket = m_server.nextPendingConnection()) {
+        m_connections.insert(socket, new Connection);
+        connect(socket, &QIODevice::readyRead, this, [this, socket]() { readConnection(socket); });
+        connect(socket, &QAbstractSocket::disconnected, this, [this, socket]() {
+            delete m_connections.take(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void ReportReceiver::readConnection(QTcpSocket *socket)
+{
+    Connection *connection = m_connections.value(socket);
+    if (!connection)
+        return;
+    connection->buffer.append(socket->readAll());
+
+    if (connection->headerSize == -1) {
+        const int end = connection->buffer.indexOf("\r\n\r\n");
+        if (end == -1) {
+            if (connection->buffer.size() > maximumHeaderSize)
+                respond(socket, 431, "Request Header Fields Too Large", QByteArray());
+            return;
+        }
+        connection->headerSize = end + 4;
+        const QList<QByteArray> lines = connection->buffer.left(end).split('\n');
+        connection->method = lines.value(0).split(' ').value(0);
+        for (int i = 1; i < lines.size(); ++i) {
+            const int colon = lines.at(i).indexOf(':');
+            if (colon > 0 && lines.at(i).left(colon).trimmed().toLower() == "content-length")
+                connection->contentLength = lines.at(i).mid(colon + 1).trimmed().toLongLong();
+        }
+        if (connection->method != "POST") {
+            respond(socket, 405, "Method Not Allowed", QByteArray());
+            return;
+        }
+        if (connection->contentLength < 0) {
+            respond(socket, 411, "Length Required", QByteArray());
+            return;
+        }
+        // 不必等请求体收完就能拒绝
+        if (m_maximumBatchSize > 0 && connection->contentLength > m_maximumBatchSize) {
+            respond(socket, 413, "Payload Too Large", QByteArray());
+            return;
+        }
+    }
+
+    if (connection->buffer.size() - connection->headerSize >= connection->contentLength)
+        handleRequest(socket, connection);
+}
+
+int ReportReceiver::retryAfter()
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    while (!m_recentBatches.isEmpty() && now - m_recentBatches.head() >= rateWindow)
+        m_recentBatches.dequeue();
+    if (m_rateLimit == 0 || m_recentBatches.size() < m_rateLimit)
+        return 0;
+    return int((m_recentBatches.head() + rateWindow - now + 999) / 1000);
+}
+
+void ReportReceiver::handleRequest(QTcpSocket *socket, Connection *connection)
+{
+    ++m_requestCount;
+    QTextStream out(stdout);
+    const QString peer = socket->peerAddress().toString();
+
+    if (m_failureInterval > 0 && m_requestCount % m_failureInterval == 0) {
+        out << "Simulated failure for the request from " << peer << "\n";
+        respond(socket, 503, "Service Unavailable", QByteArray(), "Retry-After: 5\r\n");
+        return;
+    }
+    const int wait = retryAfter();
+    if (wait > 0) {
+        out << "Rate limit reached, asking " << peer << " to retry in " << wait << " seconds\n";
+        respond(socket, 429, "Too Many Requests", QByteArray(),
+                QByteArray("Retry-After: ") + QByteArray::number(wait) + "\r\n");
+        return;
+    }
+
+    QVector<UploadItem> items;
+    QString errorString;
+    const QByteArray body = connection->buffer.mid(connection->headerSize, int(connection->contentLength));
+    if (!decodeUploadBatch(body, &items, &errorString)) {
+        out << "Rejected a batch from " << peer << ": " << errorString << "\n";
+        respond(socket, 400, "Bad Request", errorString.toUtf8() + "\n");
+        return;
+    }
+
+    foreach (const UploadItem &item, items) {
+        QSaveFile file(m_directory + QLatin1Char('/') + item.name);
+        if (!file.open(QIODevice::WriteOnly) || file.write(item.data) != item.data.size() || !file.commit()) {
+            out << "Could not write " << file.fileName() << ": " << file.errorString() << "\n";
+            respond(socket, 500, "Internal Server Error", QByteArray());
+            return;
+        }
+    }
+    m_recentBatches.enqueue(QDateTime::currentMSecsSinceEpoch());
+    out << "Accepted " << items.size() << " file(s), " << body.size() << " bytes from " << peer << "\n";
+    respond(socket, 200, "OK", QByteArray("accepted ") + QByteArray::number(items.size()) + "\n");
+}
+
+void ReportReceiver::respond(QTcpSocket *socket, int status, const QByteArray &reason, const QByteArray &body,
+                             const QByteArray &extraHeaders)
+{
+    QByteArray response = "HTTP/1.1 " + QByteArray::number(status) + ' ' + reason + "\r\n";
+    response += "Content-Type: text/plain\r\n";
+    response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    response += "Connection: close\r\n";
+    response += extraHeaders;
+    response += "\r\n";
+    response += body;
+    socket->write(response);
+    socket->disconnectFromHost();
+
+    // 不再读这个连接，断开以后才释放
+    if (Connection *connection = m_connections.value(socket)) {
+        connection->buffer.clear();
+        connection->headerSize = -1;
+    }
+    socket->disconnect(this);
+    connect(socket, &QAbstractSocket::disconnected, this, [this, socket]() {
+        delete m_connections.take(socket);
+        socket->deleteLater();
+    });
+}
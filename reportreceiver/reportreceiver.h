@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QHostAddress>
+#include <QObject>
+#include <QQueue>
+#include <QString>
+#include <QTcpServer>
+
+QT_BEGIN_NAMESPACE
+class QTcpSocket;
+QT_END_NAMESPACE
+
+// 本地的收集端替身，用来离线测试整个上传流程。只实现 ReportUploader 用到的那一点 HTTP/1.1：
+// POST 一批报告（见 uploadbatch.h），每个连接一个请求，应答后关闭连接。
+// 收到的文件原样（gzip）写到目录里。可以模拟收集端的背压：超过速率时返回 429 和 Retry-After，
+// 请求太大时返回 413，也可以每隔几个请求返回一次 503。
+class ReportReceiver : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ReportReceiver(const QString &directory, QObject *parent = Q_NULLPTR);
+    ~ReportReceiver();
+
+    // 每分钟最多接受这么多批，0 表示不限制
+    void setRateLimit(int batchesPerMinute) { m_rateLimit = qMax(0, batchesPerMinute); }
+    void setMaximumBatchSize(qint64 bytes) { m_maximumBatchSize = bytes; }
+    // 每 n 个请求返回一次 503，0 表示不模拟
+    void setFailureInterval(int requests) { m_failureInterval = qMax(0, requests); }
+
+    bool listen(const QHostAddress &address, quint16 port, QString *errorString);
+    quint16 port() const { return m_server.serverPort(); }
+
+private:
+    struct Connection
+    {
+        QByteArray buffer;
+        int headerSize = -1; // 包括空行，-1 表示还没有收全
+        qint64 contentLength = -1;
+        QByteArray method;
+    };
+
+    void acceptConnections();
+    void readConnection(QTcpSocket *socket);
+    void handleRequest(QTcpSocket *socket, Connection *connection);
+    void respond(QTcpSocket *socket, int status, const QByteArray &reason, const QByteArray &body,
+                 const QByteArray &extraHeaders = QByteArray());
+    int retryAfter();
+
+    QTcpServer m_server;
+    QString m_directory;
+    QHash<QTcpSocket *, Connection *> m_connections;
+    QQueue<qint64> m_recentBatches; // 最近一分钟内接受的批次的时间，毫秒
+    int m_rateLimit = 0;
+    qint64 m_maximumBatchSize = qint64(32) * 1024 * 1024;
+    int m_failureInterval = 0;
+    int m_requestCount = 0;
+};
@@ -0,0 +1,20 @@
+QT += core network
+QT -= gui
+
+TARGET = reportreceiver
+TEMPLATE = app
+DESTDIR = $$OUT_PWD/../bin/
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD/../crashhandler
+
+HEADERS += \
+    reportreceiver.h \
+    $$PWD/../crashhandler/uploadbatch.h
+
+SOURCES += \
+    main.cpp \
+    reportreceiver.cpp \
+    $$PWD/../crashhandler/uploadbatch.cpp